@@ -1,14 +1,15 @@
 #include "analyser.h"
 
 #include <climits>
+#include <algorithm>
 
 namespace cc0 {
-	std::pair<std::map<int32_t ,std::vector<Instruction>>, std::optional<CompilationError>> Analyser::Analyse() {
+	std::pair<Program, std::optional<CompilationError>> Analyser::Analyse() {
 		auto err = analyseC0Program();
 		if (err.has_value())
-			return std::make_pair(std::map<int32_t ,std::vector<Instruction>>(), err);
+			return std::make_pair(Program(), err);
 		else
-			return std::make_pair(_instructions, std::optional<CompilationError>());
+			return std::make_pair(std::move(_program), std::optional<CompilationError>());
 	}
 
     // <C0-program> ::= {<variable-declaration>}{<function-definition>}
@@ -22,6 +23,8 @@ namespace cc0 {
 	    auto err = analyseVariableDeclaration(-1);
 	    if(err.has_value())
             return err;
+        // 全局变量声明用到的临时内存不算在任何函数里
+        _scratch.release();
 
 	    err = analyseFunctionDefinition();
 	    if(err.has_value())
@@ -102,7 +105,7 @@ namespace cc0 {
                 if(!pre_next.has_value() || pre_next.value().GetType() != TokenType::IDENTIFIER)
                     return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrNeedIdentifier);
                 // 全局下 main 必须是函数，强制跳转到函数处理
-                if(funcIndex == -1 && pre_next.value().GetValueString() == "main") {
+                if(funcIndex == -1 && pre_next.value().GetStringValue() == "main") {
                     unreadToken();  // 回溯 int main
                     unreadToken();
                     return {};
@@ -167,10 +170,10 @@ namespace cc0 {
 	    // 查符号表看看是否已声明，再添加
         // 全局变量：需要查全局变量表，但不需要查函数表，因为函数还没开始定义
         // 局部变量：只需查找局部变量表
-        if(isDeclared(funcIndex, ident.value().GetValueString()))
+        if(isDeclared(funcIndex, ident.value().GetStringValue()))
             return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrDuplicateDeclaration);
 
-        addVar(funcIndex, ident.value().GetValueString(), isConst, type);
+        addVar(funcIndex, ident.value().GetStringValue(), isConst, type);
 
 	    // 预读 =
 	    // const 必须显式初始化，变量随意
@@ -186,21 +189,25 @@ namespace cc0 {
 
             // 没有初始化，局部变量在栈上先为它分配内存
 	        // 全局变量未初始化直接默认为 0
+            // double 占 2 个 slot，两个 0 拼起来正好是 0.0
             if(funcIndex != -1) {
-	            _instructions[funcIndex].emplace_back(Operation::SNEW, 1);
+	            getCode(funcIndex).emplace_back(Operation::SNEW, type == DOUBLE_TYPE ? 2 : 1);
 	        } else {
-                _instructions[funcIndex].emplace_back(Operation::IPUSH, 0);
-                initVar(funcIndex, ident.value().GetValueString());
+                getCode(funcIndex).emplace_back(Operation::IPUSH, 0);
+                if(type == DOUBLE_TYPE)
+                    getCode(funcIndex).emplace_back(Operation::IPUSH, 0);
+                initVar(funcIndex, ident.value().GetStringValue());
             }
 
             unreadToken();
             return {};
 	    }
 
-	    // std::cout << "declare var: name = " << ident.value().GetValueString() << "; type = " << type << std::endl;
+	    // std::cout << "declare var: name = " << ident.value().GetStringValue() << "; type = " << type << std::endl;
 
         // expression
         SymType secType;
+        auto begin = getCode(funcIndex).mark();
 	    auto err = analyseExpression(secType, funcIndex);
 	    if(err.has_value())
             return err;
@@ -210,21 +217,21 @@ namespace cc0 {
 	    switch(type) {
 	        case INT_TYPE: {
 	            if(secType == DOUBLE_TYPE)
-	                _instructions[funcIndex].emplace_back(Operation::D2I);
+	                getCode(funcIndex).emplace_back(Operation::D2I);
 	            break;
 	        }
 	        case CHAR_TYPE: {
 	            if(secType == DOUBLE_TYPE) {
-	                _instructions[funcIndex].emplace_back(Operation::D2I);
-	                _instructions[funcIndex].emplace_back(Operation::I2C);
+	                getCode(funcIndex).emplace_back(Operation::D2I);
+	                getCode(funcIndex).emplace_back(Operation::I2C);
 	            }
 	            else if(secType == INT_TYPE)
-	                _instructions[funcIndex].emplace_back(Operation::I2C);
+	                getCode(funcIndex).emplace_back(Operation::I2C);
 	            break;
 	        }
 	        case DOUBLE_TYPE: {
 	            if(secType != DOUBLE_TYPE)
-	                _instructions[funcIndex].emplace_back(Operation::I2D);
+	                getCode(funcIndex).emplace_back(Operation::I2D);
 	            break;
 	        }
             default:
@@ -232,7 +239,12 @@ namespace cc0 {
 	    }
 
 	    // 设为已初始化
-	    initVar(funcIndex, ident.value().GetValueString());
+	    initVar(funcIndex, ident.value().GetStringValue());
+
+	    // 记下 const 变量的初始化代码，初始化表达式是常量时优化可以把它直接传播到使用的地方
+	    if(isConst && (type == INT_TYPE || type == CHAR_TYPE))
+	        getConstSlots(funcIndex).push_back({ getVarIndex(funcIndex, ident.value().GetStringValue()),
+	                                             begin.index, getCode(funcIndex).size() });
 
 	    // 对于变量声明而言，表达式计算出来的值存放在栈顶就是变量的值了，以后加载就加载这个地方的值
 
@@ -243,6 +255,8 @@ namespace cc0 {
     // <parameter-clause> ::= '(' [<parameter-declaration-list>] ')'
     std::optional<CompilationError> Analyser::analyseFunctionDefinition() {
 	    while(true) {
+	        // 从这里到函数分析完的分配都算在这个函数上
+	        auto allocs_start = MemStats::counters();
 	        // <type-specifier>
             // 如果读完了，就直接退出。有的话必须是 type
             auto type = nextToken();
@@ -271,13 +285,13 @@ namespace cc0 {
             if(!ident.has_value() || ident.value().GetType() != TokenType::IDENTIFIER)
                 return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrNeedIdentifier);
             // 查符号表
-            // 查全局变量表是否重名，查常量表是否有函数重名
-            if(isDeclared(-1, ident.value().GetValueString()) || isDeclaredFunc(ident.value().GetValueString()))
+            // 查全局变量表是否重名，查函数表是否有函数重名
+            if(isDeclared(-1, ident.value().GetStringValue()) || isDeclaredFunc(ident.value().GetStringValue()))
                 return std::make_optional<CompilationError>(_current_pos, ErrorCode ::ErrDuplicateDeclaration);
             // 参数数量在确定参数后修改
             int32_t param_num = 0;
             // 添加符号表
-            int32_t funcIndex = addFunc(ident.value().GetValueString(), symType);
+            int32_t funcIndex = addFunc(ident.value().GetStringValue(), symType);
 
             // <parameter-clause> ::= '(' [<parameter-declaration-list>] ')'
             // '('
@@ -290,15 +304,17 @@ namespace cc0 {
             unreadToken();
             if(!next.has_value())
                 return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrInvalidFunctionDefinition);
-            if(next.value().GetType() == TokenType::CONST || next.value().GetType() == TokenType::INT) {
+            if(next.value().GetType() == TokenType::CONST || next.value().GetType() == TokenType::INT
+               || next.value().GetType() == TokenType::CHAR || next.value().GetType() == TokenType::DOUBLE) {
                 // <parameter-declaration-list>
                 auto err = analyseParameterDeclarationList(funcIndex, param_num);
                 if(err.has_value())
                     return err;
             }
 
-            // 修改参数数量
-            setFuncParamNum(ident.value().GetValueString(), param_num);
+            // 修改参数数量，函数表里记的是参数占的 slot 数
+            setFuncParamNum(ident.value().GetStringValue(), param_num);
+            _program.getFunctions()[getFuncOrder(ident.value().GetStringValue())].setParamsSize(_var_symbols[funcIndex].getSlotCount());
 
             // ')'
             next = nextToken();
@@ -309,6 +325,10 @@ namespace cc0 {
             auto err = analyseCompoundStatement(funcIndex);
             if(err.has_value())
                 return err;
+
+            // 这个函数的临时对象都已经不用了，整块归还
+            _scratch.release();
+            _function_allocs.emplace_back(ident.value().GetStringValue(), MemStats::since(allocs_start));
         }
 	}
 
@@ -376,9 +396,10 @@ namespace cc0 {
             return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrNeedIdentifier);
 
         // 添加参数到局部符号表
-        addVar(funcIndex, ident.value().GetValueString(), isConst, type);
+        addVar(funcIndex, ident.value().GetStringValue(), isConst, type);
+        _program.getFunctions()[funcIndex].addParam(type == DOUBLE_TYPE ? 2 : 1);
         // 参数必然可以看作已初始化的
-        initVar(funcIndex, ident.value().GetValueString());
+        initVar(funcIndex, ident.value().GetStringValue());
 
         return {};
 	}
@@ -393,16 +414,16 @@ namespace cc0 {
             return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrNeedIdentifier);
         // https://forum.lazymio.cn/t/287
         // 按照助教说法，函数内如果存在同名的变量，会屏蔽外层的函数定义，所以无法递归
-        if(isDeclared(funcIndex, ident.value().GetValueString()))
+        if(isDeclared(funcIndex, ident.value().GetStringValue()))
             return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrInvalidStatementSeq);
         // 获取参数数量，如果是-1则没有定义这个函数
-        int32_t param_num = getFuncParamNum(ident.value().GetValueString());
+        int32_t param_num = getFuncParamNum(ident.value().GetStringValue());
         if(param_num == -1)
             return std::make_optional<CompilationError>(_current_pos, ErrCallUndefined);
         // 设置类型为函数的返回值类型
-        type = getFuncType(ident.value().GetValueString());
+        type = getFuncType(ident.value().GetStringValue());
 //        // 判断函数返回值，如果是在表达式中参与运算的话返回值必须为int
-//        if(type == SymType::CONST_INT && getFuncType(ident.value().GetValueString()) != INT_TYPE)
+//        if(type == SymType::CONST_INT && getFuncType(ident.value().GetStringValue()) != INT_TYPE)
 //            return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrInvalidFunctionCall);
 
         // '('
@@ -414,7 +435,7 @@ namespace cc0 {
         // 这里需要把参数都压栈了
         // 还需查表找到参数类型
         if(param_num > 0) {
-            auto err = analyseExpressionList(funcIndex, getConstantIndex(ident.value().GetValueString()), param_num);
+            auto err = analyseExpressionList(funcIndex, getFuncOrder(ident.value().GetStringValue()), param_num);
             if(err.has_value())
                 return err;
         }
@@ -425,9 +446,9 @@ namespace cc0 {
             return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrInvalidFunctionCall);
 
         // 获取函数在函数表的位置
-        int32_t order = getFuncOrder(ident.value().GetValueString());
+        int32_t order = getFuncOrder(ident.value().GetStringValue());
         // 添加函数调用的指令
-        _instructions[funcIndex].emplace_back(Operation::CALL, order);
+        getCode(funcIndex).emplace_back(Operation::CALL, order);
 
         return {};
 	}
@@ -435,7 +456,7 @@ namespace cc0 {
     // <expression-list> ::= <expression>{','<expression>}
     // 函数调用的传参数量以及每一个参数的数据类型（不考虑const），都必须和函数声明中的完全一致
     // 第一个参数是指当前在哪个函数体内，第二个参数是指被调用的函数是哪个
-    std::optional<CompilationError> Analyser::analyseExpressionList(int32_t funcIndex, int32_t constIndex, int32_t param_num) {
+    std::optional<CompilationError> Analyser::analyseExpressionList(int32_t funcIndex, int32_t callee, int32_t param_num) {
 	    int paramNum = param_num;
 	    // <expression>
         // 这是第一个参数，查符号表找第一项的type
@@ -446,7 +467,7 @@ namespace cc0 {
 
         // std::cout << "-------------------param type = " << secType << std::endl;
 
-        SymType firstType = getFuncParamType(constIndex, param_num-paramNum);
+        SymType firstType = getFuncParamType(callee, param_num-paramNum);
 
         // std::cout << "??????????????????   funcIndex = " << funcIndex << "  freq = " << param_num-paramNum << std::endl;
 
@@ -458,22 +479,22 @@ namespace cc0 {
         if(firstType == SymType::INT_TYPE) {
             if(secType == SymType::DOUBLE_TYPE) {
                 // 把表达式的值转换为 int
-                _instructions[funcIndex].emplace_back(Operation::D2I);
+                getCode(funcIndex).emplace_back(Operation::D2I);
             }
         }
         else if(firstType == SymType::CHAR_TYPE) {
             if(secType == SymType::DOUBLE_TYPE) {
-                _instructions[funcIndex].emplace_back(Operation::D2I);
-                _instructions[funcIndex].emplace_back(Operation::I2C);
+                getCode(funcIndex).emplace_back(Operation::D2I);
+                getCode(funcIndex).emplace_back(Operation::I2C);
             }
             else if(secType == SymType::INT_TYPE) {
-                _instructions[funcIndex].emplace_back(Operation::I2C);
+                getCode(funcIndex).emplace_back(Operation::I2C);
             }
         }
         else if(firstType == SymType::DOUBLE_TYPE) {
             if(secType == SymType::INT_TYPE || secType == SymType::CHAR_TYPE)
                 // 把表达式的值转换为 double
-                _instructions[funcIndex].emplace_back(Operation::I2D);
+                getCode(funcIndex).emplace_back(Operation::I2D);
         }
 
         paramNum--;
@@ -489,28 +510,28 @@ namespace cc0 {
             if(err.has_value())
                 return err;
 
-            SymType firstType = getFuncParamType(constIndex, param_num-paramNum);
+            SymType firstType = getFuncParamType(callee, param_num-paramNum);
 
             // 将右侧表达式隐式转换为左侧标识符的类型
             if(firstType == SymType::INT_TYPE) {
                 if(secType == SymType::DOUBLE_TYPE) {
                     // 把表达式的值转换为 int
-                    _instructions[funcIndex].emplace_back(Operation::D2I);
+                    getCode(funcIndex).emplace_back(Operation::D2I);
                 }
             }
             else if(firstType == SymType::CHAR_TYPE) {
                 if(secType == SymType::DOUBLE_TYPE) {
-                    _instructions[funcIndex].emplace_back(Operation::D2I);
-                    _instructions[funcIndex].emplace_back(Operation::I2C);
+                    getCode(funcIndex).emplace_back(Operation::D2I);
+                    getCode(funcIndex).emplace_back(Operation::I2C);
                 }
                 else if(secType == SymType::INT_TYPE) {
-                    _instructions[funcIndex].emplace_back(Operation::I2C);
+                    getCode(funcIndex).emplace_back(Operation::I2C);
                 }
             }
             else if(firstType == SymType::DOUBLE_TYPE) {
                 if(secType == SymType::INT_TYPE || secType == SymType::CHAR_TYPE)
                     // 把表达式的值转换为 double
-                    _instructions[funcIndex].emplace_back(Operation::I2D);
+                    getCode(funcIndex).emplace_back(Operation::I2D);
             }
 
             paramNum--;
@@ -544,21 +565,21 @@ namespace cc0 {
 
 	    // 没写返回语句自动加返回指令
 	    if(!isReturn) {
-	        std::string name = getFuncName(funcIndex);
+	        const std::string& name = getFuncName(funcIndex);
 	        SymType type = getFuncType(name);
             switch(type) {
                 case CHAR_TYPE:
                 case INT_TYPE:
-                    _instructions[funcIndex].emplace_back(Operation::IPUSH, 0);
-                    _instructions[funcIndex].emplace_back(Operation::IRET);
+                    getCode(funcIndex).emplace_back(Operation::IPUSH, 0);
+                    getCode(funcIndex).emplace_back(Operation::IRET);
                     break;
                 case DOUBLE_TYPE:
-                    _instructions[funcIndex].emplace_back(Operation::IPUSH, 0);
-                    _instructions[funcIndex].emplace_back(Operation::IPUSH, 0);
-                    _instructions[funcIndex].emplace_back(Operation::DRET);
+                    getCode(funcIndex).emplace_back(Operation::IPUSH, 0);
+                    getCode(funcIndex).emplace_back(Operation::IPUSH, 0);
+                    getCode(funcIndex).emplace_back(Operation::DRET);
                     break;
                 default:
-                    _instructions[funcIndex].emplace_back(Operation::RET);
+                    getCode(funcIndex).emplace_back(Operation::RET);
                     break;
             }
         }
@@ -577,7 +598,12 @@ namespace cc0 {
                 case LEFT_BRACE:
                 case IF:
                 case WHILE:
+                case DO:
+                case FOR:
+                case SWITCH:
                 case RETURN:
+                case BREAK:
+                case CONTINUE:
                 case PRINT:
                 case SCAN:
                 case IDENTIFIER:
@@ -594,12 +620,16 @@ namespace cc0 {
         }
 	}
 
-    // <statement> ::= '{' <statement-seq> '}' | <condition-statement> | <loop-statement> | <jump-statement>
+    // <statement> ::= '{' <statement-seq> '}' | <condition-statement> | <loop-statement> | <switch-statement> | <jump-statement>
     //                  | <print-statement> | <scan-statement> | <assignment-expression>';' | <function-call>';' |';'
-    // <jump-statement> ::= <return-statement>
+    // <jump-statement> ::= 'break' ';' | 'continue' ';' | <return-statement>
     // <return-statement> ::= 'return' [<expression>] ';'
     // <condition-statement> ::= 'if' '(' <condition> ')' <statement> ['else' <statement>]
     // <loop-statement> ::= 'while' '(' <condition> ')' <statement>
+    //                    | 'do' <statement> 'while' '(' <condition> ')' ';'
+    //                    | 'for' '(' <for-init-statement> [<condition>] ';' [<for-update-expression>] ')' <statement>
+    // <switch-statement> ::= 'switch' '(' <expression> ')' '{' {<labeled-statement>} '}'
+    // <labeled-statement> ::= ('case' (<integer-literal>|<char-literal>) | 'default') ':' <statement-seq>
     // <scan-statement>  ::= 'scan' '(' <identifier> ')' ';'
     // <print-statement> ::= 'print' '(' [<printable-list>] ')' ';'
     // <printable-list>  ::= <printable> {',' <printable>}
@@ -630,18 +660,29 @@ namespace cc0 {
                 // std::cout << "condition: isReturn? " << isReturn << std::boolalpha << std::endl;
                 break;
             }
-            case WHILE: { // <loop-statement>
+            case WHILE:
+            case DO:
+            case FOR: { // <loop-statement>
                 auto err = analyseLoopStatement(funcIndex, isReturn);
                 if(err.has_value())
                     return err;
                 // std::cout << "loop: isReturn? " << isReturn << std::boolalpha << std::endl;
                 break;
             }
-            case RETURN: { // <jump-statement> ::= <return-statement>
+            case SWITCH: { // <switch-statement>
+                auto err = analyseSwitchStatement(funcIndex, isReturn);
+                if(err.has_value())
+                    return err;
+                break;
+            }
+            case RETURN:
+            case BREAK:
+            case CONTINUE: { // <jump-statement>
                 auto err = analyseJumpStatement(funcIndex);
                 if(err.has_value())
                     return err;
-                isReturn = true;
+                if(next.value().GetType() == RETURN)
+                    isReturn = true;
                 break;
             }
             case PRINT: { // <print-statement>
@@ -682,8 +723,7 @@ namespace cc0 {
                     if(err.has_value())
                         return err;
                     // 如果调用者不需要返回值，执行 pop 系列指令清除调用者栈帧得到的返回值
-                    if(getFuncType(next.value().GetValueString()) == SymType::INT_TYPE)
-                        _instructions[funcIndex].emplace_back(Operation::POP);
+                    discardResult(funcIndex, unlimited);
                 }
 
                 // ';'
@@ -707,7 +747,6 @@ namespace cc0 {
     // <condition-statement> ::= 'if' '(' <condition> ')' <statement> ['else' <statement>]
     // 必须要 if 和 else 都有 return 语句才是 isReturn = true
     std::optional<CompilationError>Analyser::analyseConditionStatement(int32_t funcIndex, bool& isReturn) {
-	    TokenType type = TokenType::NULL_TOKEN;
 	    // 'if'
         auto next = nextToken();
         if(!next.has_value() || next.value().GetType() != TokenType::IF)
@@ -720,39 +759,13 @@ namespace cc0 {
 
         // <condition>
         // 如果 <condition> ::= <expression> == 0，false，否则为 true
-        auto err = analyseCondition(type, funcIndex);
+        ConditionJumps cond;
+        auto err = analyseCondition(cond, funcIndex);
         if(err.has_value())
             return err;
 
-        // 不满足条件就跳转
-        Operation opt;
-        switch(type) {
-            case NULL_TOKEN:  // if(a)，栈顶 value == a
-                opt = Operation::JE; // je：value 是 0 就跳转
-                break;
-            case LESS_SIGN:  // if(a < b)，栈顶 value ==
-                opt = Operation::JGE;
-                break;
-            case LESS_EQUAL_SIGN:
-                opt = Operation::JG;
-                break;
-            case GREATER_SIGN:
-                opt = Operation::JLE;
-                break;
-            case GREATER_EQUAL_SIGN:
-                opt = Operation::JL;
-                break;
-            case EQUAL_SIGN:
-                opt = Operation::JNE;
-                break;
-            case NONEQUAL_SIGN:
-                opt = Operation::JE;
-                break;
-            default:
-                break;
-        }
-        int32_t tmp = _instructions[funcIndex].size();
-        _instructions[funcIndex].emplace_back(opt);
+        // 不满足条件就跳转，满足条件的跳转落到 <statement> 的开始
+        auto tmp = finishCondition(cond, false, funcIndex);
 
         // ')'
         next = nextToken();
@@ -773,17 +786,18 @@ namespace cc0 {
             unreadToken();
             // 没有 else
             // 设置跳转指令的位置为这里
-            _instructions[funcIndex][tmp].setX(_instructions[funcIndex].size());
+            for(auto jump : tmp)
+                getCode(funcIndex).patchX(jump, getCode(funcIndex).size());
             isReturn = false;
             return {};
         }
         // 有 else 的话
         // 执行完后需要跳过 else 的内容，即跳转到后面
-        auto jmp = _instructions[funcIndex].size();
-        _instructions[funcIndex].emplace_back(Operation::JMP);
+        auto jmp = getCode(funcIndex).emplace_back(Operation::JMP);
 
         // 设置跳转指令的位置为这里
-        _instructions[funcIndex][tmp].setX(_instructions[funcIndex].size());
+        for(auto jump : tmp)
+            getCode(funcIndex).patchX(jump, getCode(funcIndex).size());
 
         // <statement>
         bool elseReturn = false;
@@ -792,7 +806,7 @@ namespace cc0 {
             return err;
 
         // 设置跳转指令的位置为这里
-        _instructions[funcIndex][jmp].setX(_instructions[funcIndex].size());
+        getCode(funcIndex).patchX(jmp, getCode(funcIndex).size());
 
         isReturn = ifReturn && elseReturn;
 
@@ -800,17 +814,29 @@ namespace cc0 {
 	}
 
     // <loop-statement> ::= 'while' '(' <condition> ')' <statement>
-    // 运行过程：
+    //                    | 'do' <statement> 'while' '(' <condition> ')' ';'
+    //                    | 'for' '(' <for-init-statement> [<condition>] ';' [<for-update-expression>] ')' <statement>
+    // while 的运行过程：
     //           goto condition
     //      loop:
     //           statement
-    // condition:
+    // condition:                       continue 跳到这里
     //           if(condition)
     //                 goto loop
+    //                                  break 跳到这里
     // 所以这里要把 <condition> 生成的判断指令放在后面
     std::optional<CompilationError>Analyser::analyseLoopStatement(int32_t funcIndex, bool& isReturn) {
+        auto next = nextToken();
+        if(next.has_value() && next.value().GetType() == TokenType::DO) {
+            unreadToken();
+            return analyseDoWhileStatement(funcIndex, isReturn);
+        }
+        if(next.has_value() && next.value().GetType() == TokenType::FOR) {
+            unreadToken();
+            return analyseForStatement(funcIndex, isReturn);
+        }
+
 	    // 'while'
-	    auto next = nextToken();
 	    if(!next.has_value() || next.value().GetType() != TokenType::WHILE)
             return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrInvalidLoopStatement);
 
@@ -819,27 +845,19 @@ namespace cc0 {
         if(!next.has_value() || next.value().GetType() != TokenType::LEFT_BRACKET)
             return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrInvalidLoopStatement);
 
-        auto i = _instructions[funcIndex].size();
+        auto i = getCode(funcIndex).mark();
 
         // <condition>
-        TokenType type = TokenType::NULL_TOKEN;
-        auto err = analyseCondition(type, funcIndex);
+        ConditionJumps cond;
+        auto err = analyseCondition(cond, funcIndex);
         if(err.has_value())
             return err;
 
-        auto now = _instructions[funcIndex].size();
-        int times = now - i;
-        // 将 <condition> 生成的指令先挪出来
-        std::vector<Instruction> conditions; // 备份到这
-        for(;i!=now; i++) {
-            conditions.emplace_back(_instructions[funcIndex][i]);
-        }
-        while(times--)
-            _instructions[funcIndex].pop_back();
+        // 将 <condition> 生成的指令先剪下来，备份到函数的临时内存里
+        auto conditions = getCode(funcIndex).cut(i, _scratch.resource());
 
         // 生成一个跳转指令，循环开始之前先跳转到后面进行判断
-        auto tmp = _instructions[funcIndex].size();
-        _instructions[funcIndex].emplace_back(Operation::JMP);
+        auto tmp = getCode(funcIndex).emplace_back(Operation::JMP);
 
         // ')'
         next = nextToken();
@@ -847,64 +865,477 @@ namespace cc0 {
             return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrInvalidLoopStatement);
 
         // 标记循环体的开始位置
-        auto begin = _instructions[funcIndex].size();
+        auto begin = getCode(funcIndex).size();
 
         // <statement>
-        err = analyseStatement(funcIndex, isReturn);
+        _jump_targets.push_back(JumpTargets{ true, {}, {} });
+        bool bodyReturn = false;
+        err = analyseStatement(funcIndex, bodyReturn);
         if(err.has_value())
             return err;
 
         // 设置上述 jmp 指令的 offset
-        auto order = _instructions[funcIndex].size();
-        _instructions[funcIndex][tmp].setX(_instructions[funcIndex].size());
+        auto condition = getCode(funcIndex).size();
+        getCode(funcIndex).patchX(tmp, condition);
 
         // 把条件判断指令放在这里
-        for(auto& it : conditions) {
-            _instructions[funcIndex].emplace_back(std::move(it));
+        appendLoopCondition(funcIndex, conditions, cond, i, begin);
+
+        // 循环体可能一次都不执行，后面还要有返回指令
+        isReturn = false;
+        popJumpTargets(funcIndex, getCode(funcIndex).size(), condition);
+        return {};
+    }
+
+    // 'do' <statement> 'while' '(' <condition> ')' ';'
+    // 运行过程：
+    //      loop:
+    //           statement
+    // condition:                       continue 跳到这里
+    //           if(condition)
+    //                 goto loop
+    //                                  break 跳到这里
+    // 条件本来就在循环体后面，进入循环不用跳转
+    std::optional<CompilationError> Analyser::analyseDoWhileStatement(int32_t funcIndex, bool& isReturn) {
+        // 'do'
+        auto next = nextToken();
+        if(!next.has_value() || next.value().GetType() != TokenType::DO)
+            return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrInvalidLoopStatement);
+
+        auto begin = getCode(funcIndex).size();
+
+        // <statement>
+        _jump_targets.push_back(JumpTargets{ true, {}, {} });
+        bool bodyReturn = false;
+        auto err = analyseStatement(funcIndex, bodyReturn);
+        if(err.has_value())
+            return err;
+
+        // 'while' '('
+        next = nextToken();
+        if(!next.has_value() || next.value().GetType() != TokenType::WHILE)
+            return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrInvalidLoopStatement);
+        next = nextToken();
+        if(!next.has_value() || next.value().GetType() != TokenType::LEFT_BRACKET)
+            return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrInvalidLoopStatement);
+
+        // <condition>
+        auto condition = getCode(funcIndex).size();
+        ConditionJumps cond;
+        err = analyseCondition(cond, funcIndex);
+        if(err.has_value())
+            return err;
+        for(auto jump : finishCondition(cond, true, funcIndex))
+            getCode(funcIndex).patchX(jump, begin);
+
+        // ')' ';'
+        next = nextToken();
+        if(!next.has_value() || next.value().GetType() != TokenType::RIGHT_BRACKET)
+            return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrInvalidLoopStatement);
+        next = nextToken();
+        if(!next.has_value() || next.value().GetType() != TokenType::SEMICOLON)
+            return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrNoSemicolon);
+
+        // 循环体至少执行一次，没有 break、continue 时循环体里的 return 一定会执行
+        auto& targets = _jump_targets.back();
+        isReturn = bodyReturn && targets.breaks.empty() && targets.continues.empty();
+        popJumpTargets(funcIndex, getCode(funcIndex).size(), condition);
+        return {};
+    }
+
+    // 'for' '(' <for-init-statement> [<condition>] ';' [<for-update-expression>] ')' <statement>
+    // <for-init-statement> ::= [<assignment-expression>{','<assignment-expression>}] ';'
+    // <for-update-expression> ::= (<assignment-expression>|<function-call>){','(<assignment-expression>|<function-call>)}
+    // 运行过程和 while 一样把条件放在后面：
+    //           init
+    //           goto condition
+    //      loop:
+    //           statement
+    //           update                 continue 跳到这里
+    // condition:
+    //           if(condition)
+    //                 goto loop
+    //                                  break 跳到这里
+    // 没有条件时是死循环，不用开头的跳转，update 之后直接跳回 loop
+    std::optional<CompilationError> Analyser::analyseForStatement(int32_t funcIndex, bool& isReturn) {
+        // 'for' '('
+        auto next = nextToken();
+        if(!next.has_value() || next.value().GetType() != TokenType::FOR)
+            return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrInvalidLoopStatement);
+        next = nextToken();
+        if(!next.has_value() || next.value().GetType() != TokenType::LEFT_BRACKET)
+            return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrInvalidLoopStatement);
+
+        // <for-init-statement>
+        next = nextToken();
+        if(!next.has_value())
+            return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrInvalidLoopStatement);
+        if(next.value().GetType() != TokenType::SEMICOLON) {
+            unreadToken();
+            while(true) {
+                auto err = analyseAssignmentExpression(funcIndex);
+                if(err.has_value())
+                    return err;
+                next = nextToken();
+                if(!next.has_value())
+                    return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrNoSemicolon);
+                if(next.value().GetType() == TokenType::SEMICOLON)
+                    break;
+                if(next.value().GetType() != TokenType::COMMA_SIGN)
+                    return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrNoSemicolon);
+            }
         }
 
-        // 设置跳转指令，满足条件就跳转到循环体开始位置
-        Operation opt;
-        switch(type) {
-            case NULL_TOKEN:  // if(a)，栈顶 value == a
-                opt = Operation::JNE; // je：value 是 0 就跳转
-                break;
-            case LESS_SIGN:  // if(a < b)，栈顶 value ==
-                opt = Operation::JL;
-                break;
-            case LESS_EQUAL_SIGN:
-                opt = Operation::JLE;
-                break;
-            case GREATER_SIGN:
-                opt = Operation::JG;
-                break;
-            case GREATER_EQUAL_SIGN:
-                opt = Operation::JGE;
-                break;
-            case EQUAL_SIGN:
-                opt = Operation::JE;
-                break;
-            case NONEQUAL_SIGN:
-                opt = Operation::JNE;
-                break;
-            default:
+        // [<condition>] ';'，先剪下来放到后面
+        auto i = getCode(funcIndex).mark();
+        ConditionJumps cond;
+        bool hasCondition = false;
+        next = nextToken();
+        if(!next.has_value())
+            return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrInvalidLoopStatement);
+        if(next.value().GetType() != TokenType::SEMICOLON) {
+            unreadToken();
+            auto err = analyseCondition(cond, funcIndex);
+            if(err.has_value())
+                return err;
+            hasCondition = true;
+            next = nextToken();
+            if(!next.has_value() || next.value().GetType() != TokenType::SEMICOLON)
+                return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrNoSemicolon);
+        }
+        auto conditions = getCode(funcIndex).cut(i, _scratch.resource());
+
+        // [<for-update-expression>] ')'，同样剪下来放到循环体后面
+        next = nextToken();
+        if(!next.has_value())
+            return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrInvalidLoopStatement);
+        if(next.value().GetType() != TokenType::RIGHT_BRACKET) {
+            unreadToken();
+            while(true) {
+                // 和语句一样：'(' 开头的是函数调用
+                nextToken();
+                auto pre_next = nextToken();
+                unreadToken();
+                unreadToken();
+                if(pre_next.has_value() && pre_next.value().GetType() == TokenType::LEFT_BRACKET) {
+                    SymType type;
+                    auto err = analyseFunctionCall(type, funcIndex);
+                    if(err.has_value())
+                        return err;
+                    discardResult(funcIndex, type);
+                }
+                else {
+                    auto err = analyseAssignmentExpression(funcIndex);
+                    if(err.has_value())
+                        return err;
+                }
+                next = nextToken();
+                if(!next.has_value())
+                    return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrInvalidLoopStatement);
+                if(next.value().GetType() == TokenType::RIGHT_BRACKET)
+                    break;
+                if(next.value().GetType() != TokenType::COMMA_SIGN)
+                    return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrInvalidLoopStatement);
+            }
+        }
+        auto updates = getCode(funcIndex).cut(i, _scratch.resource());
+
+        // 有条件时先跳转到后面进行判断
+        std::optional<CodeBuffer::Mark> tmp;
+        if(hasCondition)
+            tmp = getCode(funcIndex).emplace_back(Operation::JMP);
+        auto begin = getCode(funcIndex).size();
+
+        // <statement>
+        _jump_targets.push_back(JumpTargets{ true, {}, {} });
+        bool bodyReturn = false;
+        auto err = analyseStatement(funcIndex, bodyReturn);
+        if(err.has_value())
+            return err;
+
+        // update
+        auto update = getCode(funcIndex).size();
+        getCode(funcIndex).append(updates);
+
+        // condition
+        if(hasCondition) {
+            getCode(funcIndex).patchX(*tmp, getCode(funcIndex).size());
+            appendLoopCondition(funcIndex, conditions, cond, i, begin);
+        }
+        else
+            getCode(funcIndex).emplace_back(Operation::JMP, begin);
+
+        // 有条件时循环体可能一次都不执行；没有条件时只有 break 能走到循环后面
+        isReturn = !hasCondition && _jump_targets.back().breaks.empty();
+        popJumpTargets(funcIndex, getCode(funcIndex).size(), update);
+        return {};
+    }
+
+    void Analyser::appendLoopCondition(int32_t funcIndex, const CodeBuffer::Fragment& condition, ConditionJumps& cond,
+                                       CodeBuffer::Mark from, int32_t begin) {
+        // 条件里还没有回填的跳转也跟着移过来
+        auto at = getCode(funcIndex).mark();
+        getCode(funcIndex).append(condition);
+        for(auto jumps : { &cond.trueJumps, &cond.falseJumps })
+            for(auto& jump : *jumps) {
+                jump.offset = jump.offset - from.offset + at.offset;
+                jump.index = jump.index - from.index + at.index;
+            }
+
+        // 设置跳转指令，满足条件就跳转到循环体开始位置，不满足的跳转落到循环后面
+        for(auto jump : finishCondition(cond, true, funcIndex))
+            getCode(funcIndex).patchX(jump, begin);
+    }
+
+    void Analyser::popJumpTargets(int32_t funcIndex, int32_t breakTarget, int32_t continueTarget) {
+        auto& targets = _jump_targets.back();
+        for(auto jump : targets.breaks)
+            getCode(funcIndex).patchX(jump, breakTarget);
+        for(auto jump : targets.continues)
+            getCode(funcIndex).patchX(jump, continueTarget);
+        _jump_targets.pop_back();
+    }
+
+    // <switch-statement> ::= 'switch' '(' <expression> ')' '{' {<labeled-statement>} '}'
+    // <labeled-statement> ::= ('case' ['+'|'-'](<integer-literal>|<char-literal>) | 'default') ':' <statement-seq>
+    // 和 C 一样，执行完一个 case 会接着执行下一个 case
+    // 运行过程：
+    //           value            switch 期间 value 一直留在栈顶，分派时 dup 一份来比较
+    //           goto dispatch
+    //   case_1: statement-seq
+    //   case_2: statement-seq
+    //           ...
+    //           goto end
+    // dispatch: 按 case 的值二分查找，跳到对应的 case 或 default
+    //      end: pop                    break 跳到这里
+    // case 的值要等整个 switch 分析完才知道，所以分派代码放在后面
+    std::optional<CompilationError>Analyser::analyseSwitchStatement(int32_t funcIndex, bool& isReturn) {
+        // 'switch'
+        auto next = nextToken();
+        if(!next.has_value() || next.value().GetType() != TokenType::SWITCH)
+            return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrInvalidSwitchStatement);
+
+        // '('
+        next = nextToken();
+        if(!next.has_value() || next.value().GetType() != TokenType::LEFT_BRACKET)
+            return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrInvalidSwitchStatement);
+
+        // <expression>，只能是 int 或 char
+        SymType type;
+        auto err = analyseExpression(type, funcIndex);
+        if(err.has_value())
+            return err;
+        if(type != SymType::INT_TYPE && type != SymType::CHAR_TYPE)
+            return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrInvalidSwitchStatement);
+
+        // ')'
+        next = nextToken();
+        if(!next.has_value() || next.value().GetType() != TokenType::RIGHT_BRACKET)
+            return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrInvalidSwitchStatement);
+
+        // '{'
+        next = nextToken();
+        if(!next.has_value() || next.value().GetType() != TokenType::LEFT_BRACE)
+            return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrInvalidSwitchStatement);
+
+        auto& code = getCode(funcIndex);
+        auto dispatch = code.emplace_back(Operation::JMP);
+        _jump_targets.push_back(JumpTargets{ false, {}, {} });
+
+        // {<labeled-statement>}
+        std::vector<std::pair<int32_t, int32_t>> cases;
+        int32_t defaultTarget = -1;
+        // 最后一个标号之后的语句里有没有 return：有 default 时每条路径最后都会执行到它们
+        bool tailReturn = false;
+        while(true) {
+            next = nextToken();
+            if(!next.has_value())
+                return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrInvalidSwitchStatement);
+            if(next.value().GetType() == TokenType::RIGHT_BRACE)
                 break;
+            if(next.value().GetType() == TokenType::DEFAULT) {
+                if(defaultTarget != -1)
+                    return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrDuplicateCase);
+                defaultTarget = code.size();
+            }
+            else if(next.value().GetType() == TokenType::CASE) {
+                // ['+'|'-']
+                int32_t sign = 1;
+                next = nextToken();
+                if(next.has_value() && (next.value().GetType() == TokenType::PLUS_SIGN || next.value().GetType() == TokenType::MINUS_SIGN)) {
+                    if(next.value().GetType() == TokenType::MINUS_SIGN)
+                        sign = -1;
+                    next = nextToken();
+                }
+                // <integer-literal>|<char-literal>
+                int32_t value;
+                if(!next.has_value())
+                    return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrInvalidSwitchStatement);
+                if(next.value().GetType() == TokenType::INTEGER) {
+                    try {
+                        value = std::any_cast<int32_t>(next.value().GetValue());
+                    } catch(const std::bad_any_cast&) {
+                        return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrIntegerOverflow);
+                    }
+                }
+                else if(next.value().GetType() == TokenType::CHAR_TOKEN)
+                    value = next.value().GetStringValue()[0];
+                else
+                    return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrInvalidSwitchStatement);
+                // -2147483648 写不出来，取负不会溢出
+                cases.emplace_back(sign * value, code.size());
+            }
+            else
+                return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrInvalidSwitchStatement);
+
+            // ':'
+            next = nextToken();
+            if(!next.has_value() || next.value().GetType() != TokenType::COLON)
+                return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrInvalidSwitchStatement);
+
+            // <statement-seq>
+            tailReturn = false;
+            err = analyseStatementSeq(funcIndex, tailReturn);
+            if(err.has_value())
+                return err;
         }
-        _instructions[funcIndex].emplace_back(opt, begin);
 
+        // 最后一个 case 执行完跳过分派代码
+        std::vector<CodeBuffer::Mark> toEnd;
+        toEnd.push_back(code.emplace_back(Operation::JMP));
+        code.patchX(dispatch, code.size());
+
+        std::sort(cases.begin(), cases.end());
+        for(std::size_t i=1; i<cases.size(); i++)
+            if(cases[i].first == cases[i - 1].first)
+                return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrDuplicateCase);
+
+        int64_t min = INT_MIN;
+        int64_t max = INT_MAX;
+        // case 的值比较密集（至少占值域的一半）时先检查上下界，界内二分到只剩一个值就直接跳转，不用再比较相等
+        // 虚拟机没有跳转表指令，这样分派的比较次数是 O(log n)
+        if(cases.size() >= 4 && static_cast<int64_t>(cases.back().first) - cases.front().first < 2 * static_cast<int64_t>(cases.size())) {
+            min = cases.front().first;
+            max = cases.back().first;
+            auto bound = [&](int32_t value, Operation out) {
+                code.emplace_back(Operation::DUP);
+                code.emplace_back(Operation::IPUSH, value);
+                code.emplace_back(Operation::ICMP);
+                auto jump = code.emplace_back(out, defaultTarget);
+                if(defaultTarget == -1)
+                    toEnd.push_back(jump);
+            };
+            bound(cases.front().first, Operation::JL);
+            bound(cases.back().first, Operation::JG);
+        }
+        emitSwitchDispatch(funcIndex, cases, 0, cases.size(), min, max, defaultTarget, toEnd);
+
+        // end: 'pop'，break 也跳到这里
+        for(auto jump : toEnd)
+            code.patchX(jump, code.size());
+        // 没有 default 时可能一个 case 都不执行，break 会跳过后面的 return
+        isReturn = defaultTarget != -1 && tailReturn && _jump_targets.back().breaks.empty();
+        popJumpTargets(funcIndex, code.size(), -1);
+        code.emplace_back(Operation::POP);
         return {};
     }
 
-    // <jump-statement> ::= <return-statement> ::= 'return' [<expression>] ';'
+    void Analyser::emitSwitchDispatch(int32_t funcIndex, const std::vector<std::pair<int32_t, int32_t>>& cases, std::size_t lo, std::size_t hi,
+                                      int64_t min, int64_t max, int32_t defaultTarget, std::vector<CodeBuffer::Mark>& toEnd) {
+        auto& code = getCode(funcIndex);
+        auto jump = [&](Operation op, int32_t target) {
+            auto at = code.emplace_back(op, target);
+            if(target == -1)
+                toEnd.push_back(at);
+        };
+        // 不用比较就知道去哪里：-2 表示还要比较
+        auto resolved = [&](std::size_t l, std::size_t h, int64_t mn, int64_t mx) -> int32_t {
+            if(l == h)
+                return defaultTarget;
+            if(mn == mx)
+                return cases[l].second;
+            return -2;
+        };
+        auto count = hi - lo;
+        auto target = resolved(lo, hi, min, max);
+        if(target != -2) {
+            jump(Operation::JMP, target);
+            return;
+        }
+        // 值稀疏的少数几个 case 逐个比较相等
+        if(count <= 3 && max - min + 1 > static_cast<int64_t>(count)) {
+            for(auto i=lo; i<hi; i++) {
+                code.emplace_back(Operation::DUP);
+                code.emplace_back(Operation::IPUSH, cases[i].first);
+                code.emplace_back(Operation::ICMP);
+                jump(Operation::JE, cases[i].second);
+            }
+            jump(Operation::JMP, defaultTarget);
+            return;
+        }
+        // 以中间的值为界分成两半：小于它的去左边
+        auto mid = lo + count / 2;
+        int64_t pivot = cases[mid].first;
+        code.emplace_back(Operation::DUP);
+        code.emplace_back(Operation::IPUSH, cases[mid].first);
+        code.emplace_back(Operation::ICMP);
+        auto left = resolved(lo, mid, min, pivot - 1);
+        auto right = resolved(mid, hi, pivot, max);
+        if(left != -2) {
+            jump(Operation::JL, left);
+            emitSwitchDispatch(funcIndex, cases, mid, hi, pivot, max, defaultTarget, toEnd);
+        }
+        else if(right != -2) {
+            jump(Operation::JGE, right);
+            emitSwitchDispatch(funcIndex, cases, lo, mid, min, pivot - 1, defaultTarget, toEnd);
+        }
+        else {
+            auto toLeft = code.emplace_back(Operation::JL);
+            emitSwitchDispatch(funcIndex, cases, mid, hi, pivot, max, defaultTarget, toEnd);
+            code.patchX(toLeft, code.size());
+            emitSwitchDispatch(funcIndex, cases, lo, mid, min, pivot - 1, defaultTarget, toEnd);
+        }
+    }
+
+    // <jump-statement> ::= 'break' ';' | 'continue' ';' | <return-statement>
+    // <return-statement> ::= 'return' [<expression>] ';'
     std::optional<CompilationError>Analyser::analyseJumpStatement(int32_t funcIndex) {
-	    // 'return'
         auto next = nextToken();
+        // 'break' ';' | 'continue' ';'
+        if(next.has_value() && (next.value().GetType() == TokenType::BREAK || next.value().GetType() == TokenType::CONTINUE)) {
+            bool isBreak = next.value().GetType() == TokenType::BREAK;
+            next = nextToken();
+            if(!next.has_value() || next.value().GetType() != TokenType::SEMICOLON)
+                return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrNoSemicolon);
+            if(isBreak) {
+                // 跳出最里层的循环或 switch
+                if(_jump_targets.empty())
+                    return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrBreakOutsideLoop);
+                _jump_targets.back().breaks.push_back(getCode(funcIndex).emplace_back(Operation::JMP));
+                return {};
+            }
+            // continue 跳到最里层的循环，中间每层 switch 留在栈顶的值都要先弹掉
+            auto loop = _jump_targets.rbegin();
+            while(loop != _jump_targets.rend() && !loop->isLoop)
+                ++loop;
+            if(loop == _jump_targets.rend())
+                return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrContinueOutsideLoop);
+            auto switches = static_cast<int32_t>(loop - _jump_targets.rbegin());
+            if(switches == 1)
+                getCode(funcIndex).emplace_back(Operation::POP);
+            else if(switches > 1)
+                getCode(funcIndex).emplace_back(Operation::POPN, switches);
+            loop->continues.push_back(getCode(funcIndex).emplace_back(Operation::JMP));
+            return {};
+        }
+
+	    // 'return'
         if(!next.has_value() || next.value().GetType() != TokenType::RETURN)
             return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrInvalidReturnStatement);
 
         // 查表看看有没有返回值
         bool ret_flag = false;
-        std::string funcName = getFuncName(funcIndex);
+        const std::string& funcName = getFuncName(funcIndex);
         SymType funcType = getFuncType(funcName);
         if(funcType != SymType::VOID_TYPE) {
             // [<expression>]
@@ -916,19 +1347,19 @@ namespace cc0 {
             // 如果函数return语句的表达式类型和函数声明的返回值类型不一致，应当对该表达式进行隐式类型转换后再返回
             if(funcType == SymType::INT_TYPE) {
                 if(secType == SymType::DOUBLE_TYPE)
-                    _instructions[funcIndex].emplace_back(Operation::D2I);
+                    getCode(funcIndex).emplace_back(Operation::D2I);
             }
             else if(funcType == SymType::CHAR_TYPE) {
                 if(secType == SymType::DOUBLE_TYPE) {
-                    _instructions[funcIndex].emplace_back(Operation::D2I);
-                    _instructions[funcIndex].emplace_back(Operation::I2C);
+                    getCode(funcIndex).emplace_back(Operation::D2I);
+                    getCode(funcIndex).emplace_back(Operation::I2C);
                 }
                 else if(secType == SymType::INT_TYPE)
-                    _instructions[funcIndex].emplace_back(Operation::I2C);
+                    getCode(funcIndex).emplace_back(Operation::I2C);
             }
             else if(funcType == SymType::DOUBLE_TYPE) {
                 if(secType == SymType::INT_TYPE || secType ==SymType::CHAR_TYPE)
-                    _instructions[funcIndex].emplace_back(Operation::I2D);
+                    getCode(funcIndex).emplace_back(Operation::I2D);
             }
         }
 
@@ -939,11 +1370,11 @@ namespace cc0 {
 
         // 添加 iret 指令
         if(funcType == INT_TYPE || funcType == CHAR_TYPE)
-            _instructions[funcIndex].emplace_back(Operation::IRET);
+            getCode(funcIndex).emplace_back(Operation::IRET);
         else if(funcType == VOID_TYPE)
-            _instructions[funcIndex].emplace_back(Operation::RET);
+            getCode(funcIndex).emplace_back(Operation::RET);
         else if(funcType == DOUBLE_TYPE)
-            _instructions[funcIndex].emplace_back(Operation::DRET);
+            getCode(funcIndex).emplace_back(Operation::DRET);
         return {};
 	}
 
@@ -987,7 +1418,7 @@ namespace cc0 {
             return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrNoSemicolon);
 
         // 生成指令：输出换行
-        _instructions[funcIndex].emplace_back(Operation::PRINTL);
+        getCode(funcIndex).emplace_back(Operation::PRINTL);
 
         return {};
 	}
@@ -1011,8 +1442,8 @@ namespace cc0 {
 
             // 生成指令：输出空格
             // 每个 <printable> 之间一个空格
-            _instructions[funcIndex].emplace_back(Operation::BIPUSH, 32);
-            _instructions[funcIndex].emplace_back(Operation::CPRINT);
+            getCode(funcIndex).emplace_back(Operation::BIPUSH, 32);
+            getCode(funcIndex).emplace_back(Operation::CPRINT);
 
             // <printable>
             err = analysePrintable(funcIndex);
@@ -1030,24 +1461,20 @@ namespace cc0 {
             return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrInvalidPrintStatement);
         if(next.value().GetType() == TokenType::CHAR_TOKEN) { // 字符字面量
             // 获取字符值，压栈
-            auto str = next.value().GetValueString();
-            const char *ch = str.c_str();
+            const char *ch = next.value().GetStringValue().c_str();
             // 将单字节值 byte 值提升至 int 值后入栈
-            _instructions[funcIndex].emplace_back(Operation::BIPUSH, ch[0]);
+            getCode(funcIndex).emplace_back(Operation::BIPUSH, ch[0]);
             // 输出栈顶的值 ASCII 字符
-            _instructions[funcIndex].emplace_back(Operation::CPRINT);
+            getCode(funcIndex).emplace_back(Operation::CPRINT);
         }
         else if(next.value().GetType() == TokenType::STRING) { // 字符串字面量
-            // 查表看看有没有一样的字面量
-            if(!isConstantExisted(SymType::STRING_TYPE, next.value().GetValueString()))
-                addConstant(next.value().GetValueString(), SymType::STRING_TYPE);
-            // 获取字面量在常量表的位置
-            auto index = getConstantIndex(next.value().GetValueString());
+            // 加入常量池，已有一样的字面量就直接拿到它的位置
+            auto index = _program.getConstants().addString(next.value().GetStringValue());
             // 生成指令
             // 加载常量表中字符串的地址值
-            _instructions[funcIndex].emplace_back(Operation::LOADC, index);
+            getCode(funcIndex).emplace_back(Operation::LOADC, index);
             // 弹出栈顶的字符串地址，对每个 slot 的值进行输出
-            _instructions[funcIndex].emplace_back(Operation::SPRINT);
+            getCode(funcIndex).emplace_back(Operation::SPRINT);
         }
         else { // <expression>
             unreadToken();
@@ -1060,11 +1487,11 @@ namespace cc0 {
 
             // 生成指令：输出结果
             if(type == SymType::INT_TYPE)
-                _instructions[funcIndex].emplace_back(Operation::IPRINT);
+                getCode(funcIndex).emplace_back(Operation::IPRINT);
             else if(type == SymType::CHAR_TYPE)
-                _instructions[funcIndex].emplace_back(Operation::CPRINT);
+                getCode(funcIndex).emplace_back(Operation::CPRINT);
             else if(type == SymType::DOUBLE_TYPE)
-                _instructions[funcIndex].emplace_back(Operation::DPRINT);
+                getCode(funcIndex).emplace_back(Operation::DPRINT);
         }
 
         return {};
@@ -1092,21 +1519,21 @@ namespace cc0 {
         // 是全局变量还是局部变量
         bool isGlobal = false;
         // 查符号表: 已声明、非const、局部符号表必然没有func，全局变量需要判断一下是不是函数
-        if(!isDeclared(funcIndex, ident.value().GetValueString())) { // 局部符号表
-            if(!isDeclared(-1, ident.value().GetValueString())) // 全局符号表
+        if(!isDeclared(funcIndex, ident.value().GetStringValue())) { // 局部符号表
+            if(!isDeclared(-1, ident.value().GetStringValue())) // 全局符号表
                 return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrNotDeclared);
             // 说明是全局变量
             isGlobal = true;
-            type = getVarType(-1, ident.value().GetValueString());
-            if(isConst(funcIndex, ident.value().GetValueString()))
+            type = getVarType(-1, ident.value().GetStringValue());
+            if(isConst(funcIndex, ident.value().GetStringValue()))
                 return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrAssignToConstant);
         } else {
             // 说明是局部变量
-            type = getVarType(funcIndex, ident.value().GetValueString());
-            if(isConst(funcIndex, ident.value().GetValueString()))
+            type = getVarType(funcIndex, ident.value().GetStringValue());
+            if(isConst(funcIndex, ident.value().GetStringValue()))
                 return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrAssignToConstant);
             // 如果没有初始化，这里就算初始化了
-            initVar(funcIndex, ident.value().GetValueString());
+            initVar(funcIndex, ident.value().GetStringValue());
         }
 
         // ')'
@@ -1123,28 +1550,28 @@ namespace cc0 {
         int16_t level_diff;
         int32_t offset;
         if(isGlobal) {
-            offset = getVarIndex(-1, ident.value().GetValueString());
+            offset = getVarIndex(-1, ident.value().GetStringValue());
             level_diff = 1;
         } else { // 这里是局部变量，那么只能是局部变量在函数体内被调用了
-            offset = getVarIndex(funcIndex, ident.value().GetValueString());
+            offset = getVarIndex(funcIndex, ident.value().GetStringValue());
             level_diff = 0;
         }
         // 加载变量的地址
-        _instructions[funcIndex].emplace_back(Operation::LOADA, level_diff, offset);
+        getCode(funcIndex).emplace_back(Operation::LOADA, level_diff, offset);
 
         if(type == SymType::DOUBLE_TYPE) {
-            _instructions[funcIndex].emplace_back(Operation::DSCAN);
-            _instructions[funcIndex].emplace_back(Operation::DSTORE);
+            getCode(funcIndex).emplace_back(Operation::DSCAN);
+            getCode(funcIndex).emplace_back(Operation::DSTORE);
         }
         else if(type == SymType::INT_TYPE) {
             // 从标准输入解析一个可有符号的十进制整数，将其转换为 int 得到 value，将 value 压入栈。
-            _instructions[funcIndex].emplace_back(Operation::ISCAN);
+            getCode(funcIndex).emplace_back(Operation::ISCAN);
             // 将获取的值存入该地址
-            _instructions[funcIndex].emplace_back(Operation::ISTORE);
+            getCode(funcIndex).emplace_back(Operation::ISTORE);
         }
         else if(type == SymType::CHAR_TYPE) {
-            _instructions[funcIndex].emplace_back(Operation::CSCAN);
-            _instructions[funcIndex].emplace_back(Operation::ISTORE);
+            getCode(funcIndex).emplace_back(Operation::CSCAN);
+            getCode(funcIndex).emplace_back(Operation::ISTORE);
         }
 
 
@@ -1169,17 +1596,17 @@ namespace cc0 {
         // 是全局变量还是局部变量
         bool isGlobal = false;
         // 查符号表: 已声明、非const、局部符号表必然没有func，全局变量需要判断一下是不是函数
-        if(!isDeclared(funcIndex, ident.value().GetValueString())) { // 不是局部变量
-            if(!isDeclared(-1, ident.value().GetValueString())) // 不是全局变量
+        if(!isDeclared(funcIndex, ident.value().GetStringValue())) { // 不是局部变量
+            if(!isDeclared(-1, ident.value().GetStringValue())) // 不是全局变量
                 return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrNotDeclared);
             // 说明是全局变量
             isGlobal = true;
-            firstType = getVarType(-1, ident.value().GetValueString());
-            if(isConst(-1, ident.value().GetValueString()))
+            firstType = getVarType(-1, ident.value().GetStringValue());
+            if(isConst(-1, ident.value().GetStringValue()))
                 return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrAssignToConstant);
         } else {
-            firstType = getVarType(funcIndex, ident.value().GetValueString());
-            if(isConst(funcIndex, ident.value().GetValueString()))
+            firstType = getVarType(funcIndex, ident.value().GetStringValue());
+            if(isConst(funcIndex, ident.value().GetStringValue()))
                return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrAssignToConstant);
         }
 
@@ -1187,22 +1614,22 @@ namespace cc0 {
         int16_t level_diff;
         int32_t offset;
         if(isGlobal) {
-            offset = getVarIndex(-1, ident.value().GetValueString());
+            offset = getVarIndex(-1, ident.value().GetStringValue());
             level_diff = 1;
         } else { // 这里是局部变量，那么只能是局部变量在函数体内被调用了
-            offset = getVarIndex(funcIndex, ident.value().GetValueString());
+            offset = getVarIndex(funcIndex, ident.value().GetStringValue());
             level_diff = 0;
         }
 
         // 生成指令
         // 加载变量的地址
-        _instructions[funcIndex].emplace_back(Operation::LOADA, level_diff, offset);
+        getCode(funcIndex).emplace_back(Operation::LOADA, level_diff, offset);
 
         // 如果没有初始化，这里就算初始化了
         if(isGlobal)
-            initVar(-1, ident.value().GetValueString());
+            initVar(-1, ident.value().GetStringValue());
         else
-            initVar(funcIndex, ident.value().GetValueString());
+            initVar(funcIndex, ident.value().GetStringValue());
 
         // <assignment-operator>
         auto next = nextToken();
@@ -1224,18 +1651,18 @@ namespace cc0 {
                 type = SymType::INT_TYPE;
             else if(secType == SymType::DOUBLE_TYPE) {
                 // 把表达式的值转换为 int
-                _instructions[funcIndex].emplace_back(Operation::D2I);
+                getCode(funcIndex).emplace_back(Operation::D2I);
                 type = SymType::INT_TYPE;
             }
         }
         else if(firstType == SymType::CHAR_TYPE) {
             if(secType == SymType::DOUBLE_TYPE) {
-                _instructions[funcIndex].emplace_back(Operation::D2I);
-                _instructions[funcIndex].emplace_back(Operation::I2C);
+                getCode(funcIndex).emplace_back(Operation::D2I);
+                getCode(funcIndex).emplace_back(Operation::I2C);
                 type = SymType::CHAR_TYPE;
             }
             else if(secType == SymType::INT_TYPE) {
-                _instructions[funcIndex].emplace_back(Operation::I2C);
+                getCode(funcIndex).emplace_back(Operation::I2C);
                 type = SymType::CHAR_TYPE;
             }
             else if(secType == SymType::CHAR_TYPE)
@@ -1244,26 +1671,161 @@ namespace cc0 {
         else if(firstType == SymType::DOUBLE_TYPE) {
             if(secType == SymType::INT_TYPE || secType == SymType::CHAR_TYPE)
                 // 把表达式的值转换为 double
-                _instructions[funcIndex].emplace_back(Operation::I2D);
+                getCode(funcIndex).emplace_back(Operation::I2D);
             type = SymType::DOUBLE_TYPE;
         }
 
         // 生成指令，将栈顶的值存入上述地址
         if(type == SymType::DOUBLE_TYPE)
-            _instructions[funcIndex].emplace_back(Operation::DSTORE);
+            getCode(funcIndex).emplace_back(Operation::DSTORE);
         else
-            _instructions[funcIndex].emplace_back(Operation::ISTORE);
+            getCode(funcIndex).emplace_back(Operation::ISTORE);
 
         return {};
     }
 
-    // <condition> ::= <expression>[<relational-operator><expression>]
+    namespace {
+        // 条件相反的跳转
+        Operation invertJump(Operation op) {
+            switch(op) {
+                case Operation::JE:  return Operation::JNE;
+                case Operation::JNE: return Operation::JE;
+                case Operation::JL:  return Operation::JGE;
+                case Operation::JGE: return Operation::JL;
+                case Operation::JG:  return Operation::JLE;
+                default:             return Operation::JG;
+            }
+        }
+    }
+
+    std::vector<CodeBuffer::Mark> Analyser::finishCondition(ConditionJumps& cond, bool jumpIf, int32_t funcIndex) {
+        auto& code = getCode(funcIndex);
+        auto& jumps = jumpIf ? cond.trueJumps : cond.falseJumps;
+        auto& other = jumpIf ? cond.falseJumps : cond.trueJumps;
+        jumps.push_back(code.emplace_back(jumpIf ? cond.pending : invertJump(cond.pending)));
+        for(auto jump : other)
+            code.patchX(jump, code.size());
+        other.clear();
+        return std::move(jumps);
+    }
+
+    // <condition> ::= <and-condition> {'||' <and-condition>}
+    // a || b：a 为真直接跳到真出口，为假时往下执行 b
+    std::optional<CompilationError> Analyser::analyseCondition(ConditionJumps& cond, int32_t funcIndex) {
+        // <and-condition>
+        auto err = analyseAndCondition(cond, funcIndex);
+        if(err.has_value())
+            return err;
+
+        // {'||' <and-condition>}
+        while(true) {
+            auto next = nextToken();
+            if(!next.has_value())
+                return {};
+            if(next.value().GetType() != TokenType::OR_SIGN) {
+                unreadToken();
+                return {};
+            }
+            auto trueJumps = finishCondition(cond, true, funcIndex);
+            ConditionJumps rhs;
+            err = analyseAndCondition(rhs, funcIndex);
+            if(err.has_value())
+                return err;
+            trueJumps.insert(trueJumps.end(), rhs.trueJumps.begin(), rhs.trueJumps.end());
+            cond.trueJumps = std::move(trueJumps);
+            cond.falseJumps = std::move(rhs.falseJumps);
+            cond.pending = rhs.pending;
+        }
+    }
+
+    // <and-condition> ::= <unary-condition> {'&&' <unary-condition>}
+    // a && b：a 为假直接跳到假出口，为真时往下执行 b
+    std::optional<CompilationError> Analyser::analyseAndCondition(ConditionJumps& cond, int32_t funcIndex) {
+        // <unary-condition>
+        auto err = analyseUnaryCondition(cond, funcIndex);
+        if(err.has_value())
+            return err;
+
+        // {'&&' <unary-condition>}
+        while(true) {
+            auto next = nextToken();
+            if(!next.has_value())
+                return {};
+            if(next.value().GetType() != TokenType::AND_SIGN) {
+                unreadToken();
+                return {};
+            }
+            auto falseJumps = finishCondition(cond, false, funcIndex);
+            ConditionJumps rhs;
+            err = analyseUnaryCondition(rhs, funcIndex);
+            if(err.has_value())
+                return err;
+            falseJumps.insert(falseJumps.end(), rhs.falseJumps.begin(), rhs.falseJumps.end());
+            cond.trueJumps = std::move(rhs.trueJumps);
+            cond.falseJumps = std::move(falseJumps);
+            cond.pending = rhs.pending;
+        }
+    }
+
+    // <unary-condition> ::= '!' <unary-condition> | '(' <condition> ')' | <relational-condition>
+    std::optional<CompilationError> Analyser::analyseUnaryCondition(ConditionJumps& cond, int32_t funcIndex) {
+        auto next = nextToken();
+        // '!' <unary-condition>：不生成指令，交换真假出口
+        if(next.has_value() && next.value().GetType() == TokenType::NOT_SIGN) {
+            auto err = analyseUnaryCondition(cond, funcIndex);
+            if(err.has_value())
+                return err;
+            std::swap(cond.trueJumps, cond.falseJumps);
+            cond.pending = invertJump(cond.pending);
+            return {};
+        }
+        // '(' <condition> ')'
+        // '(' 开头的也可能是表达式，比如 (a + b) < c：先按条件分析，
+        // 括号后面跟的不是 '&&'、'||'、')'、';' 时回退，重新按 <relational-condition> 分析
+        if(next.has_value() && next.value().GetType() == TokenType::LEFT_BRACKET) {
+            auto offset = _offset - 1;
+            auto& code = getCode(funcIndex);
+            auto start = code.mark();
+            ConditionJumps inner;
+            auto err = analyseCondition(inner, funcIndex);
+            if(!err.has_value()) {
+                next = nextToken();
+                if(next.has_value() && next.value().GetType() == TokenType::RIGHT_BRACKET) {
+                    auto follow = nextToken();
+                    if(!follow.has_value())
+                        return {};
+                    unreadToken();
+                    switch(follow.value().GetType()) {
+                        case AND_SIGN:
+                        case OR_SIGN:
+                        case RIGHT_BRACKET:
+                        case SEMICOLON:
+                            cond = std::move(inner);
+                            return {};
+                        default:
+                            break;
+                    }
+                }
+            }
+            while(_offset > offset)
+                unreadToken();
+            code.cut(start, _scratch.resource());
+        }
+        else if(next.has_value())
+            unreadToken();
+
+        // <relational-condition>
+        return analyseRelationalCondition(cond, funcIndex);
+    }
+
+    // <relational-condition> ::= <expression>[<relational-operator><expression>]
     //                   次栈顶 lhs                        栈顶 rhs
-    // <condition> 判断完后
+    // 判断完后
     // 如果 lhs == rhs，栈顶为 0
     // 如果 lhs > rhs，栈顶为 1
     // 如果 lhs < rhs，栈顶为 -1
-    std::optional<CompilationError> Analyser::analyseCondition(TokenType& type, int32_t funcIndex) {
+    // 没有 <relational-operator> 时栈顶就是 <expression> 的值，不为 0 时条件为真
+    std::optional<CompilationError> Analyser::analyseRelationalCondition(ConditionJumps& cond, int32_t funcIndex) {
         // <expression>
         SymType firstType;
         auto err = analyseExpression(firstType, funcIndex);
@@ -1285,12 +1847,33 @@ namespace cc0 {
             // 说明这里是 <condition> ::= <expression>
             // 如果<expression>是（或可以转换为）int类型，且转换得到的值为0，那么视为false；否则均视为true。
             if(firstType == DOUBLE_TYPE)
-                _instructions[funcIndex].emplace_back(Operation::D2I);
+                getCode(funcIndex).emplace_back(Operation::D2I);
+            cond.pending = Operation::JNE;
             return {};
         }
-        type = opt.value().GetType();
+        // 比较结果满足这个跳转时条件为真
+        switch(opt.value().GetType()) {
+            case LESS_SIGN:
+                cond.pending = Operation::JL;
+                break;
+            case LESS_EQUAL_SIGN:
+                cond.pending = Operation::JLE;
+                break;
+            case GREATER_SIGN:
+                cond.pending = Operation::JG;
+                break;
+            case GREATER_EQUAL_SIGN:
+                cond.pending = Operation::JGE;
+                break;
+            case EQUAL_SIGN:
+                cond.pending = Operation::JE;
+                break;
+            default:
+                cond.pending = Operation::JNE;
+                break;
+        }
 
-        auto iter = _instructions[funcIndex].end();
+        auto pos = getCode(funcIndex).mark();
 
         // <expression>
         SymType secType;
@@ -1306,22 +1889,22 @@ namespace cc0 {
                 conditionType = SymType::INT_TYPE;
             else if(secType == SymType::DOUBLE_TYPE) {
                 // 把第一个表达式的值转换为 double
-                _instructions[funcIndex].insert(iter, Operation::I2D);
+                getCode(funcIndex).insert(pos, Operation::I2D);
                 conditionType = SymType::DOUBLE_TYPE;
             }
         } else if(firstType == SymType::DOUBLE_TYPE) {
             if(secType == SymType::INT_TYPE || secType == SymType::CHAR_TYPE)
                 // 把第二个表达式的值转换为 double
-                _instructions[funcIndex].emplace_back(Operation::I2D);
+                getCode(funcIndex).emplace_back(Operation::I2D);
             conditionType = SymType::DOUBLE_TYPE;
         }
 
         // 添加指令
         // 将两个结果进行比较
         if(conditionType == SymType::DOUBLE_TYPE)
-            _instructions[funcIndex].emplace_back(Operation::DCMP);
+            getCode(funcIndex).emplace_back(Operation::DCMP);
         else
-            _instructions[funcIndex].emplace_back(Operation::ICMP);
+            getCode(funcIndex).emplace_back(Operation::ICMP);
 
         return {};
     }
@@ -1350,7 +1933,7 @@ namespace cc0 {
             }
 
             // 记录表达式左边的位置，有可能需要插入类型转换指令
-            auto iter = _instructions[funcIndex].end();
+            auto pos = getCode(funcIndex).mark();
 
             // <multiplicative-expression>
             SymType secType;
@@ -1367,13 +1950,13 @@ namespace cc0 {
                     type = SymType::INT_TYPE;
                 else if(secType == SymType::DOUBLE_TYPE) {
                     // 把第一个表达式的值转换为 double
-                    _instructions[funcIndex].insert(iter, Operation::I2D);
+                    getCode(funcIndex).insert(pos, Operation::I2D);
                     type = SymType::DOUBLE_TYPE;
                 }
             } else if(firstType == SymType::DOUBLE_TYPE) {
                 if(secType == SymType::INT_TYPE || secType == SymType::CHAR_TYPE)
                     // 把第二个表达式的值转换为 double
-                    _instructions[funcIndex].emplace_back(Operation::I2D);
+                    getCode(funcIndex).emplace_back(Operation::I2D);
                 type = SymType::DOUBLE_TYPE;
             }
 
@@ -1382,14 +1965,14 @@ namespace cc0 {
             // 加减指令压栈
             if(opt.value().GetType() == TokenType::PLUS_SIGN)
                 if(type == SymType::DOUBLE_TYPE)
-                    _instructions[funcIndex].emplace_back(Operation::DADD);
+                    getCode(funcIndex).emplace_back(Operation::DADD);
                 else
-                    _instructions[funcIndex].emplace_back(Operation::IADD);
+                    getCode(funcIndex).emplace_back(Operation::IADD);
             else
                 if(type == SymType::DOUBLE_TYPE)
-                    _instructions[funcIndex].emplace_back(Operation::DSUB);
+                    getCode(funcIndex).emplace_back(Operation::DSUB);
                 else
-                    _instructions[funcIndex].emplace_back(Operation::ISUB);
+                    getCode(funcIndex).emplace_back(Operation::ISUB);
         }
     }
 
@@ -1418,7 +2001,7 @@ namespace cc0 {
 	        }
 
 	        // 记录表达式左边的位置，有可能需要插入类型转换指令
-	        auto iter = _instructions[funcIndex].end();
+	        auto pos = getCode(funcIndex).mark();
 
             // <cast-expression>
             SymType secType;
@@ -1433,13 +2016,13 @@ namespace cc0 {
                     type = SymType::INT_TYPE;
                 else if(secType == SymType::DOUBLE_TYPE) {
                     // 把第一个表达式的值转换为 double
-                    _instructions[funcIndex].insert(iter, Operation::I2D);
+                    getCode(funcIndex).insert(pos, Operation::I2D);
                     type = SymType::DOUBLE_TYPE;
                 }
             } else if(firstType == SymType::DOUBLE_TYPE) {
                 if(secType == SymType::INT_TYPE || secType == SymType::CHAR_TYPE)
                     // 把第二个表达式的值转换为 double
-                    _instructions[funcIndex].emplace_back(Operation::I2D);
+                    getCode(funcIndex).emplace_back(Operation::I2D);
                 type = SymType::DOUBLE_TYPE;
             }
 
@@ -1448,14 +2031,14 @@ namespace cc0 {
             // 将乘/除指令压栈
             if(opt.value().GetType() == TokenType::DIVISION_SIGN)
                 if(type == SymType::DOUBLE_TYPE)
-                    _instructions[funcIndex].emplace_back(Operation::DDIV);
+                    getCode(funcIndex).emplace_back(Operation::DDIV);
                 else
-                    _instructions[funcIndex].emplace_back(Operation::IDIV);
+                    getCode(funcIndex).emplace_back(Operation::IDIV);
             else
                 if(type == SymType::DOUBLE_TYPE)
-                    _instructions[funcIndex].emplace_back(Operation::DMUL);
+                    getCode(funcIndex).emplace_back(Operation::DMUL);
                 else
-                    _instructions[funcIndex].emplace_back(Operation::IMUL);
+                    getCode(funcIndex).emplace_back(Operation::IMUL);
 	    }
 	}
 
@@ -1463,7 +2046,7 @@ namespace cc0 {
     std::optional<CompilationError> Analyser::analyseCastExpression(SymType& type, int32_t funcIndex) {
 	    // {'('<type-specifier>')'}
 	    // 需要预读两个
-	    std::vector<SymType> types;
+	    std::pmr::vector<SymType> types(_scratch.resource());
 	    while(true) {
 	        // '('
             auto next = nextToken();
@@ -1534,7 +2117,7 @@ namespace cc0 {
                     if(type == SymType::INT_TYPE || type == SymType::CHAR_TYPE)
                         ;
                     else if(type == SymType::DOUBLE_TYPE)
-                        _instructions[funcIndex].emplace_back(Operation::D2I); // 把 double 转换为 int
+                        getCode(funcIndex).emplace_back(Operation::D2I); // 把 double 转换为 int
                     else {}
                     // 设置表达式类型为 int
                     type = SymType::INT_TYPE;
@@ -1542,7 +2125,7 @@ namespace cc0 {
                 }
                 case DOUBLE_TYPE: {
                     if(type == SymType::INT_TYPE || type == SymType::CHAR_TYPE)
-                        _instructions[funcIndex].emplace_back(Operation::I2D);
+                        getCode(funcIndex).emplace_back(Operation::I2D);
                     else if(type == SymType::DOUBLE_TYPE)
                         ;
                     else
@@ -1552,10 +2135,10 @@ namespace cc0 {
                 }
                 case CHAR_TYPE: {
                     if(type == SymType::INT_TYPE)
-                        _instructions[funcIndex].emplace_back(Operation::I2C);
+                        getCode(funcIndex).emplace_back(Operation::I2C);
                     else if(type == SymType::DOUBLE_TYPE) {
-                        _instructions[funcIndex].emplace_back(Operation::D2I);
-                        _instructions[funcIndex].emplace_back(Operation::I2C);
+                        getCode(funcIndex).emplace_back(Operation::D2I);
+                        getCode(funcIndex).emplace_back(Operation::I2C);
                     }
                     else if(type == SymType::CHAR_TYPE)
                         ;
@@ -1602,7 +2185,7 @@ namespace cc0 {
                 tmp = Operation::INEG;
             else if(type == SymType::DOUBLE_TYPE)
                 tmp = Operation::DNEG;
-            _instructions[funcIndex].emplace_back(tmp);
+            getCode(funcIndex).emplace_back(tmp);
         }
 
         return {};
@@ -1643,20 +2226,16 @@ namespace cc0 {
                 type = SymType::INT_TYPE;
                 // 如果是大字节数据就添加到常量表，然后添加 loadc 指令
                 // 将数字压栈
-                _instructions[funcIndex].emplace_back(Operation::IPUSH, val);
+                getCode(funcIndex).emplace_back(Operation::IPUSH, val);
                 break;
             }
             case CHAR_TOKEN: {
-                char ch;
-                try {
-                    std::string str = std::any_cast<std::string>(next.value().GetValue());
-                    ch = *(str.c_str());
-                    // std::cout << "ch=" << ch <<std::endl;
-                } catch(const std::bad_any_cast&) {
+                auto str = std::any_cast<std::string>(&next.value().GetValue());
+                if(str == nullptr)
                     return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrCharInvalid);
-                }
+                char ch = *(str->c_str());
                 type = SymType::INT_TYPE;
-                _instructions[funcIndex].emplace_back(Operation::BIPUSH, ch);
+                getCode(funcIndex).emplace_back(Operation::BIPUSH, ch);
                 break;
             }
             case IDENTIFIER: {
@@ -1678,19 +2257,19 @@ namespace cc0 {
                     bool isGlobal = false;
                     // 查符号表: 已声明、局部符号表必然没有func，全局变量需要判断一下不能是函数
                     // int 还是 double
-                    if(!isDeclared(funcIndex, next.value().GetValueString())) {
-                        if(!isDeclared(-1, next.value().GetValueString()))
+                    if(!isDeclared(funcIndex, next.value().GetStringValue())) {
+                        if(!isDeclared(-1, next.value().GetStringValue()))
                             return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrNotDeclared);
                         // 说明是全局变量
                         isGlobal = true;
-                        if(!isInit(-1, next.value().GetValueString()))
+                        if(!isInit(-1, next.value().GetStringValue()))
                             return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrNotInitialized);
-                        type = getVarType(-1, next.value().GetValueString());
+                        type = getVarType(-1, next.value().GetStringValue());
                     } else {
                         // 说明是局部变量
-                        if(!isInit(funcIndex, next.value().GetValueString()))
+                        if(!isInit(funcIndex, next.value().GetStringValue()))
                             return std::make_optional<CompilationError>(_current_pos, ErrorCode::ErrNotInitialized);
-                        type = getVarType(funcIndex, next.value().GetValueString());
+                        type = getVarType(funcIndex, next.value().GetStringValue());
                     }
 
                     // std::cout << "Primary expression type = " << type << std::endl;
@@ -1699,23 +2278,23 @@ namespace cc0 {
                     int16_t level_diff;
                     int32_t offset;
                     if(isGlobal) {
-                        offset = getVarIndex(-1, next.value().GetValueString());
+                        offset = getVarIndex(-1, next.value().GetStringValue());
                         if(funcIndex == -1) // 说明这里是全局变量的初始化
                             level_diff = 0;
                         else
                             level_diff = 1; // 说明这里是函数体内调用全局变量
                     } else { // 这里是局部变量，那么只能是局部变量在函数体内被调用了
-                        offset = getVarIndex(funcIndex, next.value().GetValueString());
+                        offset = getVarIndex(funcIndex, next.value().GetStringValue());
                         level_diff = 0;
                     }
 
                     // 加载变量的地址
-                    _instructions[funcIndex].emplace_back(Operation::LOADA, level_diff, offset);
+                    getCode(funcIndex).emplace_back(Operation::LOADA, level_diff, offset);
                     // 从栈中弹出地址，从地址处加载数据压栈
                     if(type == SymType::DOUBLE_TYPE)
-                        _instructions[funcIndex].emplace_back(Operation::DLOAD);
+                        getCode(funcIndex).emplace_back(Operation::DLOAD);
                     else
-                        _instructions[funcIndex].emplace_back(Operation::ILOAD);
+                        getCode(funcIndex).emplace_back(Operation::ILOAD);
                 }
                 break;
             }
@@ -1727,7 +2306,7 @@ namespace cc0 {
 
 	}
 
-	std::optional<Token> Analyser::nextToken() {
+	TokenRef Analyser::nextToken() {
 		if (_offset == _tokens.size())
 			return {};
 		// 考虑到 _tokens[0..._offset-1] 已经被分析过了
@@ -1736,6 +2315,25 @@ namespace cc0 {
 		return _tokens[_offset++];
 	}
 
+	CodeBuffer& Analyser::getCode(int32_t funcIndex) {
+	    if(funcIndex == -1)
+	        return _program.getStartCode();
+	    return _program.getFunctions()[funcIndex].getInstructions();
+	}
+
+	void Analyser::discardResult(int32_t funcIndex, SymType type) {
+	    if(type == SymType::DOUBLE_TYPE)
+	        getCode(funcIndex).emplace_back(Operation::POP2);
+	    else if(type == SymType::INT_TYPE || type == SymType::CHAR_TYPE)
+	        getCode(funcIndex).emplace_back(Operation::POP);
+	}
+
+	std::vector<ConstSlot>& Analyser::getConstSlots(int32_t funcIndex) {
+	    if(funcIndex == -1)
+	        return _program.getGlobalConstSlots();
+	    return _program.getFunctions()[funcIndex].getConstSlots();
+	}
+
 	void Analyser::unreadToken() {
 		if (_offset == 0)
 			DieAndPrint("analyser unreads token from the begining.");
@@ -1743,90 +2341,82 @@ namespace cc0 {
 		_offset--;
 	}
 
-    void Analyser::addConstant(std::string name, SymType type) {
-	    _constant_symbols.addVar(name, true, type);
-	}
-
-	void Analyser::addVar(int32_t funcIndex, std::string name, bool isConst, cc0::SymType type) {
+	void Analyser::addVar(int32_t funcIndex, const std::string& name, bool isConst, cc0::SymType type) {
 	    if(_var_symbols.find(funcIndex) == _var_symbols.end()) // 函数刚创建
-            _var_symbols[funcIndex] = *new SymTable;
+            _var_symbols[funcIndex] = SymTable();
 	    _var_symbols[funcIndex].addVar(name, isConst, type);
 	}
 
-    int32_t Analyser::addFunc(std::string name, SymType type) {
-        return _constant_symbols.addFunc(name, type);
+    int32_t Analyser::addFunc(const std::string& name, SymType type) {
+	    int32_t nameIndex = _program.getConstants().addString(name);
+	    _program.getFunctions().emplace_back(nameIndex, 0, 1);
+        return _func_symbols.addFunc(name, type, nameIndex);
 	}
 
     bool Analyser::isMainExisted() {
-        return _constant_symbols.isMainExisted();
+        return _func_symbols.isMainExisted();
     }
 
-    bool Analyser::isDeclaredFunc(std::string name) {
-        return _constant_symbols.isFunction(name);
+    bool Analyser::isDeclaredFunc(const std::string& name) {
+        return _func_symbols.isFunction(name);
 	}
 
-    bool Analyser::isDeclared(int32_t funcIndex, std::string name) {
+    bool Analyser::isDeclared(int32_t funcIndex, const std::string& name) {
 	    // 如果是全局变量需要同时查全局变量表和函数表
 	    if(funcIndex == -1)
-            return _constant_symbols.isFunction(name) || _var_symbols[-1].isDeclared(name);
+            return _func_symbols.isFunction(name) || _var_symbols[-1].isDeclared(name);
         return _var_symbols[funcIndex].isDeclared(name);
 	}
 
-    bool Analyser::isConstantExisted(SymType type, std::string name) {
-        return _constant_symbols.isConstantExisted(type, name);
-	}
-
-    bool Analyser::isInit(int32_t funcIndex, std::string name) {
+    bool Analyser::isInit(int32_t funcIndex, const std::string& name) {
             return _var_symbols[funcIndex].isInit(name);
 	}
 
-	int32_t Analyser::getFuncParamNum(std::string name) {
-        return _constant_symbols.getFuncParamNum(name);
+	int32_t Analyser::getFuncParamNum(const std::string& name) {
+        return _func_symbols.getFuncParamNum(name);
 	}
 
-    void Analyser::setFuncParamNum(std::string name, int32_t param_num) {
-        _constant_symbols.setFuncParamNum(name, param_num);
+    void Analyser::setFuncParamNum(const std::string& name, int32_t param_num) {
+        _func_symbols.setFuncParamNum(name, param_num);
 	}
 
-	SymType Analyser::getFuncType(std::string name) {
-        return _constant_symbols.getFuncType(name);
+	SymType Analyser::getFuncType(const std::string& name) {
+        return _func_symbols.getFuncType(name);
 	}
 
 	SymType Analyser::getFuncParamType(int32_t funcIndex, int32_t paramIndex) {
         return _var_symbols[funcIndex].getFuncParamType(paramIndex);
 	}
 
-	int32_t Analyser::getConstantIndex(std::string name) {
-        return _constant_symbols.getIndex(name);
-	}
-
-	int32_t Analyser::getFuncOrder(std::string name) {
-        return _constant_symbols.getFuncOrder(name);
+	int32_t Analyser::getFuncOrder(const std::string& name) {
+        return _func_symbols.getFuncOrder(name);
 	}
 
-    std::string Analyser::getFuncName(int32_t funcIndex) {
-        return _constant_symbols.getNameByIndex(funcIndex);
+    const std::string& Analyser::getFuncName(int32_t funcIndex) {
+        return _func_symbols.getNameByIndex(funcIndex);
     }
 
-	int32_t Analyser::getVarIndex(int32_t funcIndex, std::string name) {
+	int32_t Analyser::getVarIndex(int32_t funcIndex, const std::string& name) {
         return _var_symbols[funcIndex].getVarIndex(name);
 	}
 
-	SymType Analyser::getVarType(int32_t funcIndex, std::string name) {
+	SymType Analyser::getVarType(int32_t funcIndex, const std::string& name) {
         return _var_symbols[funcIndex].getType(name);
 	}
 
-	bool Analyser::isConst(int32_t funcIndex, std::string name) {
+	bool Analyser::isConst(int32_t funcIndex, const std::string& name) {
 	    return _var_symbols[funcIndex].isConst(name);
 	}
 
-	void Analyser::initVar(int32_t funcIndex, std::string name) {
+	void Analyser::initVar(int32_t funcIndex, const std::string& name) {
 	        _var_symbols[funcIndex].initVar(name);
 	}
 
 	void Analyser::printSym() {
 	    std::cout << "constant: " << std::endl;
-	    _constant_symbols.print();
+	    _program.getConstants().print();
+	    std::cout << "function: " << std::endl;
+	    _func_symbols.print();
         std::cout << "var: " << std::endl;
         auto iter = _var_symbols.begin();
         for(; iter!=_var_symbols.end(); iter++) {
@@ -4,6 +4,10 @@
 #include "instruction/instruction.h"
 #include "tokenizer/token.h"
 #include "symTable.h"
+#include "constantPool.h"
+#include "program.h"
+#include "scratchArena.h"
+#include "memstats/memStats.h"
 
 #include <vector>
 #include <optional>
@@ -14,6 +18,19 @@
 
 namespace cc0 {
 
+	// 指向 _tokens 中某个 token 的只读引用，接口和 std::optional<Token> 一样
+	// nextToken() 每次都会调用，返回它就不用拷贝 Token（拷贝其中的 std::any 要申请内存）
+	class TokenRef final {
+	public:
+		TokenRef() : _token(nullptr) {}
+		TokenRef(const Token& token) : _token(&token) {}
+
+		bool has_value() const { return _token != nullptr; }
+		const Token& value() const { return *_token; }
+	private:
+		const Token* _token;
+	};
+
 	class Analyser final {
 	private:
 		using uint64_t = std::uint64_t;
@@ -21,20 +38,37 @@ namespace cc0 {
 		using uint32_t = std::uint32_t;
 		using int32_t = std::int32_t;
 		using int16_t = std::int16_t;
+
+		// 条件编译成的跳转链，条件的值不会存成 0/1
+		// 栈顶是最后一个比较的结果，满足 pending 时条件为真，这条跳转要等知道往哪边跳时才生成
+		// trueJumps、falseJumps 是前面的 &&、|| 已经生成的、条件为真/假时跳走的跳转，目标还没有回填
+		struct ConditionJumps {
+			std::vector<CodeBuffer::Mark> trueJumps;
+			std::vector<CodeBuffer::Mark> falseJumps;
+			Operation pending = Operation::JNE;
+		};
+
+		// 循环或 switch 里的 break、continue 跳转，目标要等分析完整个语句才知道，先记下来再回填
+		struct JumpTargets {
+			bool isLoop;  // switch 只能 break
+			std::vector<CodeBuffer::Mark> breaks;
+			std::vector<CodeBuffer::Mark> continues;
+		};
 	public:
 		Analyser(std::vector<Token> v)
-			: _tokens(std::move(v)), _offset(0), _instructions({}), _current_pos(0, 0) {}
+			: _tokens(std::move(v)), _offset(0), _current_pos(0, 0) {}
 		Analyser(Analyser&&) = delete;
 		Analyser(const Analyser&) = delete;
 		Analyser& operator=(Analyser) = delete;
 
-		// 对外接口：返回生成的指令集或报错
-		std::pair<std::map<int32_t ,std::vector<Instruction>>, std::optional<CompilationError>> Analyse();
-        // 提供全局符号表，在生成汇编体和常量表时需要使用
-        std::vector<Symbol> getConstants() { return _constant_symbols.getSymbols(); };
+		// 对外接口：返回编译结果或报错
+		// 编译结果会从 Analyser 里移动出去，所以只能调用一次
+		std::pair<Program, std::optional<CompilationError>> Analyse();
         // 获取函数数量
-        int32_t getFuncSize() { return _constant_symbols.getFuncSize(); };
+        int32_t getFuncSize() { return _func_symbols.getFuncSize(); };
 		void printSym();
+		// 分析每个函数期间的分配（--mem-stats 时才有计数）
+		const FunctionAllocs& getFunctionAllocs() const { return _function_allocs; }
 
 	private:
 		// 所有的递归子程序
@@ -58,7 +92,7 @@ namespace cc0 {
         std::optional<CompilationError> analyseFunctionCall(SymType& type, int32_t funcIndex);
         // <expression-list>
         // 第一个参数是指当前在哪个函数体内，第二个参数是指被调用的函数是哪个
-        std::optional<CompilationError> analyseExpressionList(int32_t funcIndex, int32_t constIndex, int32_t param_num);
+        std::optional<CompilationError> analyseExpressionList(int32_t funcIndex, int32_t callee, int32_t param_num);
 
         // <compound-statement>
         std::optional<CompilationError> analyseCompoundStatement(int32_t funcIndex);
@@ -70,6 +104,21 @@ namespace cc0 {
         std::optional<CompilationError> analyseConditionStatement(int32_t funcIndex, bool& isReturn);
         // <loop-statement>
         std::optional<CompilationError> analyseLoopStatement(int32_t funcIndex, bool& isReturn);
+        // 'for' '(' <for-init-statement> [<condition>] ';' [<for-update-expression>] ')' <statement>
+        std::optional<CompilationError> analyseForStatement(int32_t funcIndex, bool& isReturn);
+        // 'do' <statement> 'while' '(' <condition> ')' ';'
+        std::optional<CompilationError> analyseDoWhileStatement(int32_t funcIndex, bool& isReturn);
+        // 循环末尾的条件：剪下来的 <condition> 接到末尾，满足条件时跳回 begin，cond 里的跳转从 from 移到这里
+        void appendLoopCondition(int32_t funcIndex, const CodeBuffer::Fragment& condition, ConditionJumps& cond,
+                                 CodeBuffer::Mark from, int32_t begin);
+        // 回填循环或 switch 里的 break、continue，并出栈
+        void popJumpTargets(int32_t funcIndex, int32_t breakTarget, int32_t continueTarget);
+        // <switch-statement>
+        std::optional<CompilationError> analyseSwitchStatement(int32_t funcIndex, bool& isReturn);
+        // switch 的分派代码：在 cases[lo, hi) 里找栈顶的值，min、max 是已经知道的值的范围
+        // cases 按值排好序，second 是 case 的入口，跳到 defaultTarget == -1（没有 default）的跳转记在 toEnd 里
+        void emitSwitchDispatch(int32_t funcIndex, const std::vector<std::pair<int32_t, int32_t>>& cases, std::size_t lo, std::size_t hi,
+                                int64_t min, int64_t max, int32_t defaultTarget, std::vector<CodeBuffer::Mark>& toEnd);
         // <jump-statement>
         std::optional<CompilationError> analyseJumpStatement(int32_t funcIndex);
         // <print-statement>
@@ -86,7 +135,16 @@ namespace cc0 {
         // <assignment-expression>
         std::optional<CompilationError> analyseAssignmentExpression(int32_t funcIndex);
         // <condition>
-        std::optional<CompilationError> analyseCondition(TokenType& type, int32_t funcIndex);
+        std::optional<CompilationError> analyseCondition(ConditionJumps& cond, int32_t funcIndex);
+        // <and-condition>
+        std::optional<CompilationError> analyseAndCondition(ConditionJumps& cond, int32_t funcIndex);
+        // <unary-condition>
+        std::optional<CompilationError> analyseUnaryCondition(ConditionJumps& cond, int32_t funcIndex);
+        // <relational-condition>
+        std::optional<CompilationError> analyseRelationalCondition(ConditionJumps& cond, int32_t funcIndex);
+        // 生成最后一个条件跳转：条件为 jumpIf 时跳走，否则往下执行
+        // 返回所有条件为 jumpIf 时跳走、还要回填的跳转，另一边的跳转回填到这之后
+        std::vector<CodeBuffer::Mark> finishCondition(ConditionJumps& cond, bool jumpIf, int32_t funcIndex);
         // <expression>
         std::optional<CompilationError> analyseExpression(SymType& type, int32_t funcIndex);
         // <multiplicative-expression>
@@ -102,62 +160,68 @@ namespace cc0 {
 		// Token 缓冲区相关操作
 
 		// 返回下一个 token
-		std::optional<Token> nextToken();
+		TokenRef nextToken();
 		// 回退一个 token
 		void unreadToken();
 
+		// 返回函数的指令序列，funcIndex == -1 时返回启动代码
+		CodeBuffer& getCode(int32_t funcIndex);
+		// funcIndex 为 -1 时是全局 const 变量
+		std::vector<ConstSlot>& getConstSlots(int32_t funcIndex);
+		// 弹掉语句里函数调用不用的返回值，double 占 2 个 slot，void 没有返回值
+		void discardResult(int32_t funcIndex, SymType type);
+
 		// 下面是符号表相关操作
 		// 添加
-		void addVar(int32_t funcIndex, std::string name, bool isConst, SymType type);
+		void addVar(int32_t funcIndex, const std::string& name, bool isConst, SymType type);
 		// 添加函数，并返回函数位置
-		int32_t addFunc(std::string name, SymType type);
-        void addConstant(std::string name, SymType type);
+		int32_t addFunc(const std::string& name, SymType type);
 		// 是否已声明
         bool isMainExisted();
-        bool isDeclaredFunc(std::string name);
-		bool isDeclared(int32_t funcIndex, std::string name);
-        // 字符串字面量是否已存在
-        bool isConstantExisted(SymType type, std::string name);
+        bool isDeclaredFunc(const std::string& name);
+		bool isDeclared(int32_t funcIndex, const std::string& name);
 		// 变量是否初始化
-		bool isInit(int32_t funcIndex, std::string name);
+		bool isInit(int32_t funcIndex, const std::string& name);
 
 		// 获取参数数量，如果不是函数，返回-1
-        int32_t getFuncParamNum(std::string name);
-        void setFuncParamNum(std::string name, int32_t param_num);
+        int32_t getFuncParamNum(const std::string& name);
+        void setFuncParamNum(const std::string& name, int32_t param_num);
         // 获取函数返回值类型
-        SymType getFuncType(std::string name);
+        SymType getFuncType(const std::string& name);
         // 获取函数参数的类型
         SymType getFuncParamType(int32_t funcIndex, int32_t paramIndex);
         // 获取函数名
-        std::string getFuncName(int32_t funcIndex);
+        const std::string& getFuncName(int32_t funcIndex);
 
-        // 获取标识符在常量表中的位置
-        int32_t getConstantIndex(std::string name);
-        // 无视其他常量，只看函数是第几个
-        int32_t getFuncOrder(std::string name);
+        // 获取函数是第几个，也就是函数在 _func_symbols 中的位置
+        int32_t getFuncOrder(const std::string& name);
         // 获取变量在符号表中的索引
-        int32_t getVarIndex(int32_t funcIndex, std::string name);
+        int32_t getVarIndex(int32_t funcIndex, const std::string& name);
         // 获取变量类型
-        bool isConst(int32_t funcIndex, std::string name);
-        SymType getVarType(int32_t funcIndex, std::string name);
+        bool isConst(int32_t funcIndex, const std::string& name);
+        SymType getVarType(int32_t funcIndex, const std::string& name);
         // 设置变量为已初始化
-        void initVar(int32_t funcIndex, std::string name);
+        void initVar(int32_t funcIndex, const std::string& name);
 
 	private:
 		std::vector<Token> _tokens;
 		std::size_t _offset;
 		std::pair<uint64_t, uint64_t> _current_pos;
 
-        // 常量表：存储函数符号、某些大字节的东西比如字符串字面量
-        SymTable _constant_symbols;
-        // 符号表，key 是函数在常量表的位置
+        // 编译结果：常量池（函数名、字符串字面量等）、启动代码和各个函数的指令
+        Program _program;
+        // 函数表：函数的返回值类型、参数数量，以及函数名在常量池的下标
+        SymTable _func_symbols;
+        // 符号表，key 是函数在函数表的位置
         // key == -1 时，存储全局变量
-        // 否则是函数里的局部变量， key 对应常量表的函数符号
+        // 否则是函数里的局部变量， key 对应函数表的函数符号
         std::map<int32_t, SymTable> _var_symbols;
 
-        // 生成指令集
-        // key 是函数在常量表的位置
-        // key = -1 表示启动代码，否则就是对应函数体的内容
-        std::map<int32_t, std::vector<Instruction>> _instructions;
+        // 当前所在的循环和 switch，最里层的在最后
+        std::vector<JumpTargets> _jump_targets;
+
+        // 当前函数的临时内存，每分析完一个函数归还一次
+        ScratchArena _scratch;
+        FunctionAllocs _function_allocs;
 	};
 }
@@ -0,0 +1,103 @@
+#include <iostream>
+#include <cstring>
+#include <functional>
+#include <utility>
+#include "analyser/constantPool.h"
+
+namespace cc0 {
+
+    int32_t ConstantPool::addString(std::string_view str) {
+        auto hash = std::hash<std::string_view>()(str);
+        auto range = _string_index.equal_range(hash);
+        for(auto it = range.first; it != range.second; it++) {
+            if(getString(it->second) == str)
+                return it->second;
+        }
+        int32_t index = size();
+        _entries.push_back({ConstantType::STRING_CONSTANT, static_cast<uint32_t>(str.size()), _arena.size()});
+        _arena.insert(_arena.end(), str.begin(), str.end());
+        _string_index.emplace(hash, index);
+        return index;
+    }
+
+    int32_t ConstantPool::addInt(int32_t value) {
+        auto iter = _int_index.find(value);
+        if(iter != _int_index.end())
+            return iter->second;
+        int32_t index = size();
+        _entries.push_back({ConstantType::INT_CONSTANT, 0, static_cast<uint32_t>(value)});
+        _int_index.emplace(value, index);
+        return index;
+    }
+
+    int32_t ConstantPool::addDouble(double value) {
+        uint64_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        auto iter = _double_index.find(bits);
+        if(iter != _double_index.end())
+            return iter->second;
+        int32_t index = size();
+        _entries.push_back({ConstantType::DOUBLE_CONSTANT, 0, bits});
+        _double_index.emplace(bits, index);
+        return index;
+    }
+
+    int32_t ConstantPool::findString(std::string_view str) const {
+        auto range = _string_index.equal_range(std::hash<std::string_view>()(str));
+        for(auto it = range.first; it != range.second; it++) {
+            if(getString(it->second) == str)
+                return it->second;
+        }
+        return -1;
+    }
+
+    std::string_view ConstantPool::getString(int32_t index) const {
+        auto& entry = _entries[index];
+        return std::string_view(_arena.data() + entry.value, entry.length);
+    }
+
+    int32_t ConstantPool::getInt(int32_t index) const {
+        return static_cast<int32_t>(static_cast<uint32_t>(_entries[index].value));
+    }
+
+    double ConstantPool::getDouble(int32_t index) const {
+        double value;
+        std::memcpy(&value, &_entries[index].value, sizeof(value));
+        return value;
+    }
+
+    std::vector<int32_t> ConstantPool::retain(const std::vector<bool>& keep) {
+        std::vector<int32_t> map(_entries.size(), -1);
+        ConstantPool pool;
+        for(int32_t i=0; i<size(); i++) {
+            if(!keep[i])
+                continue;
+            switch(getType(i)) {
+                case STRING_CONSTANT: map[i] = pool.addString(getString(i)); break;
+                case INT_CONSTANT:    map[i] = pool.addInt(getInt(i)); break;
+                case DOUBLE_CONSTANT: map[i] = pool.addDouble(getDouble(i)); break;
+            }
+        }
+        *this = std::move(pool);
+        return map;
+    }
+
+    void ConstantPool::print() const {
+        std::cout << "size: " << _entries.size() << ", bytes: " << _arena.size() << std::endl;
+        for(int32_t i=0; i<size(); i++) {
+            std::cout << i << " ";
+            switch(getType(i)) {
+                case STRING_CONSTANT:
+                    std::cout << "S \"" << getString(i) << "\"";
+                    break;
+                case INT_CONSTANT:
+                    std::cout << "I " << getInt(i);
+                    break;
+                case DOUBLE_CONSTANT:
+                    std::cout << "D " << getDouble(i);
+                    break;
+            }
+            std::cout << std::endl;
+        }
+    }
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+
+namespace cc0 {
+
+    // 常量的类型，取值和二进制文件里 Constant 的 type 字段一致
+    enum ConstantType : std::uint8_t {
+        STRING_CONSTANT = 0,
+        INT_CONSTANT    = 1,
+        DOUBLE_CONSTANT = 2
+    };
+
+    // 常量池：函数名、字符串字面量、int/double 常量
+    // 相同的常量只保存一份（哈希去重），下标一经分配就不再改变，除非调用 retain 整体重新编号
+    // 字符串内容统一放在一块连续的字节区里，输出时直接引用，不再拷贝
+    class ConstantPool final {
+    private:
+        using int32_t = std::int32_t;
+        using uint32_t = std::uint32_t;
+        using uint64_t = std::uint64_t;
+
+    public:
+        ConstantPool() = default;
+
+        // 添加常量，返回常量在池中的下标；已经存在的常量直接返回原来的下标
+        int32_t addString(std::string_view str);
+        int32_t addInt(int32_t value);
+        int32_t addDouble(double value);
+        // 查找字符串常量的下标，不存在返回 -1
+        int32_t findString(std::string_view str) const;
+
+        int32_t size() const { return static_cast<int32_t>(_entries.size()); }
+        ConstantType getType(int32_t index) const { return _entries[index].type; }
+        // 返回的 string_view 指向字节区，在下一次 addString 之前有效
+        std::string_view getString(int32_t index) const;
+        int32_t getInt(int32_t index) const;
+        double getDouble(int32_t index) const;
+
+        // 只留下 keep 为 true 的常量，保持原来的先后顺序重新编号
+        // 返回旧下标 -> 新下标，删掉的常量对应 -1
+        std::vector<int32_t> retain(const std::vector<bool>& keep);
+
+        void print() const;
+
+    private:
+        struct Entry {
+            ConstantType type;
+            uint32_t length;  // 字符串长度
+            uint64_t value;   // 字符串在字节区的偏移 / int 的值 / double 的位模式
+        };
+
+        std::vector<Entry> _entries;
+        // 所有字符串内容首尾相接存放在这里
+        std::vector<char> _arena;
+        // 字符串内容的哈希 -> 下标，冲突时逐个比较内容
+        std::unordered_multimap<std::size_t, int32_t> _string_index;
+        std::unordered_map<int32_t, int32_t> _int_index;
+        // double 按位模式去重，0.0 和 -0.0 是不同的常量
+        std::unordered_map<uint64_t, int32_t> _double_index;
+    };
+}
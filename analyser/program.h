@@ -0,0 +1,102 @@
+#pragma once
+
+#include "instruction/codeBuffer.h"
+#include "error/error.h"
+#include "constantPool.h"
+
+#include <cstdint>
+#include <optional>
+#include <vector>
+#include <utility>
+
+namespace cc0 {
+
+    // .o 文件里这些数量都是 u2，参考虚拟机也只认这个格式，超出时只能报错
+    // 跳转目标不会超过函数的指令数，call 和 loadc 的操作数不会超过函数数和常量数，所以不需要单独检查
+    constexpr std::int32_t MAX_CONSTANTS = 65535;
+    constexpr std::int32_t MAX_STRING_LENGTH = 65535;
+    constexpr std::int32_t MAX_FUNCTIONS = 65535;
+    constexpr std::int32_t MAX_INSTRUCTIONS = 65535;
+
+    // 用表达式初始化的 int/char 类型 const 变量，供常量传播使用：
+    // offset 是它在栈帧里的位置，初始化表达式的代码是指令 [begin, end)
+    // 下标针对语法分析生成的代码，常量折叠用完后就清空，之后的优化不能再用
+    struct ConstSlot {
+        std::int32_t offset;
+        std::int32_t begin;
+        std::int32_t end;
+    };
+
+    // 一个函数的编译结果，对应 .functions 中的一项和它的函数体
+    class Function final {
+    private:
+        using int32_t = std::int32_t;
+    public:
+        Function(int32_t nameIndex, int32_t paramsSize, int32_t level)
+            : _name_index(nameIndex), _params_size(paramsSize), _level(level) {}
+
+        int32_t getNameIndex() const { return _name_index; }
+        void setNameIndex(int32_t nameIndex) { _name_index = nameIndex; }
+        int32_t getParamsSize() const { return _params_size; }
+        void setParamsSize(int32_t paramsSize) { _params_size = paramsSize; }
+        // 每个参数按顺序占的 slot 数，double 是 2
+        const std::vector<int32_t>& getParamSlots() const { return _param_slots; }
+        void addParam(int32_t slots) { _param_slots.push_back(slots); }
+        int32_t getLevel() const { return _level; }
+        const CodeBuffer& getInstructions() const { return _instructions; }
+        CodeBuffer& getInstructions() { return _instructions; }
+        std::vector<ConstSlot>& getConstSlots() { return _const_slots; }
+
+    private:
+        int32_t _name_index;   // 函数名在常量池的下标
+        int32_t _params_size;  // 参数占用的 slot 数
+        std::vector<int32_t> _param_slots;
+        int32_t _level;        // 函数嵌套的层级
+        CodeBuffer _instructions;
+        std::vector<ConstSlot> _const_slots;  // 局部 const 变量
+    };
+
+    // 整个程序的编译结果：常量池、启动代码、函数表
+    // 由 Analyser 生成后整体移动给调用者，各个输出只读取引用，不再拷贝指令
+    class Program final {
+    public:
+        Program() = default;
+        Program(Program&&) = default;
+        Program& operator=(Program&&) = default;
+        Program(const Program&) = delete;
+        Program& operator=(const Program&) = delete;
+
+        const ConstantPool& getConstants() const { return _constants; }
+        ConstantPool& getConstants() { return _constants; }
+        const CodeBuffer& getStartCode() const { return _start_code; }
+        CodeBuffer& getStartCode() { return _start_code; }
+        // 下标就是函数在 .functions 里的位置，也就是 call 指令的操作数
+        const std::vector<Function>& getFunctions() const { return _functions; }
+        std::vector<Function>& getFunctions() { return _functions; }
+        // 全局 const 变量，初始化代码在启动代码里
+        std::vector<ConstSlot>& getGlobalConstSlots() { return _global_const_slots; }
+
+        // 能否写成 .o 文件，不能时返回超出的是哪一项
+        std::optional<ErrorCode> checkLimits() const {
+            if(_constants.size() > MAX_CONSTANTS)
+                return ErrTooManyConstants;
+            for(std::int32_t i=0; i<_constants.size(); i++)
+                if(_constants.getType(i) == STRING_CONSTANT && _constants.getString(i).size() > MAX_STRING_LENGTH)
+                    return ErrStringTooLong;
+            if(_functions.size() > MAX_FUNCTIONS)
+                return ErrTooManyFunctions;
+            if(_start_code.size() > MAX_INSTRUCTIONS)
+                return ErrFunctionTooLarge;
+            for(auto& func : _functions)
+                if(func.getInstructions().size() > MAX_INSTRUCTIONS)
+                    return ErrFunctionTooLarge;
+            return {};
+        }
+
+    private:
+        ConstantPool _constants;
+        CodeBuffer _start_code;
+        std::vector<Function> _functions;
+        std::vector<ConstSlot> _global_const_slots;
+    };
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstddef>
+#include <memory_resource>
+
+namespace cc0 {
+
+    // 分析一个函数时使用的临时内存
+    // 函数体里的临时对象（循环条件的备份、强制类型转换的类型栈等）都从这里分配，
+    // 分配只是移动指针，释放什么都不做；整个函数分析完后调用 release() 一次性归还。
+    // 开头的 4K 内置缓冲区用完后才会向上游（全局 new/delete）申请新的块，
+    // 所以一般的函数在这里根本不会调用 malloc；申请了的话会计入 --mem-stats 里这个函数的分配次数。
+    class ScratchArena final {
+    public:
+        ScratchArena() : _resource(_buffer, sizeof(_buffer), std::pmr::new_delete_resource()) {}
+        ScratchArena(const ScratchArena&) = delete;
+        ScratchArena& operator=(const ScratchArena&) = delete;
+
+        std::pmr::memory_resource* resource() { return &_resource; }
+
+        // 归还所有临时内存
+        void release() { _resource.release(); }
+
+    private:
+        alignas(std::max_align_t) std::byte _buffer[4096];
+        std::pmr::monotonic_buffer_resource _resource;
+    };
+}
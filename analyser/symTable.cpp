@@ -4,164 +4,146 @@
 
 namespace cc0 {
 
+    int32_t SymTable::find(const std::string& name) const {
+        auto iter = _name_ids.find(name);
+        if(iter == _name_ids.end())
+            return -1;
+        return iter->second;
+    }
+
+    int32_t SymTable::add(const std::string& name, uint8_t flags, SymType type, int32_t index) {
+        int32_t id = size();
+        _names.emplace_back(name);
+        _flags.push_back(flags);
+        _types.push_back(static_cast<uint8_t>(type));
+        _indices.push_back(index);
+        _param_nums.push_back(0);
+        _name_ids.emplace(name, id);
+        return id;
+    }
+
+    Symbol SymTable::getSymbol(int32_t id) const {
+        Symbol symbol(_names[id], _flags[id] & FUNC_FLAG, _flags[id] & CONST_FLAG,
+                      static_cast<SymType>(_types[id]), _indices[id], _param_nums[id]);
+        if(_flags[id] & INIT_FLAG)
+            symbol.initVar();
+        return symbol;
+    }
+
     std::vector<Symbol> SymTable::getFunc() {
         std::vector<Symbol> res;
-        for(auto& it: _symbols) {
-            if (it.isFunction())
-                res.emplace_back(it);
+        for(int32_t i=0; i<size(); i++) {
+            if(_flags[i] & FUNC_FLAG)
+                res.emplace_back(getSymbol(i));
         }
         return res;
     }
 
     int32_t SymTable::getFuncSize() {
         int32_t order = 0;
-        for(int i=0; i<_next_index; i++) {
-            if(_symbols[i].isFunction())
-                order++;
-        }
+        for(auto flags: _flags)
+            order += flags & FUNC_FLAG;
         return order;
     }
 
     SymType SymTable::getFuncParamType(int index) {
-        return _symbols[index].getType();
+        return static_cast<SymType>(_types[index]);
     }
 
-    void SymTable::addVar(std::string name, bool isConst, SymType type) {
-        _symbols.emplace_back(new Symbol(name, false, isConst, type, _next_index, 0));
-        _next_index++;
+    void SymTable::addVar(const std::string& name, bool isConst, SymType type) {
+        add(name, isConst ? CONST_FLAG : 0, type, _next_index);
+        // double 占 2 个 slot
+        _next_index += type == DOUBLE_TYPE ? 2 : 1;
     }
 
-    int SymTable::getVarIndex(std::string name) {
-        for(int i=0; i<_next_index; i++) {
-            if(name == _symbols[i].getName())
-                return _symbols[i].getIndex();
-        }
+    int SymTable::getVarIndex(const std::string& name) {
+        auto id = find(name);
+        return id == -1 ? -1 : _indices[id];
     }
 
-    int32_t SymTable::addFunc(std::string name, SymType type) {
-        _symbols.emplace_back(new Symbol(name, true, false, type, _next_index, 0));
-        return _next_index++;
+    int32_t SymTable::addFunc(const std::string& name, SymType type, int32_t nameIndex) {
+        // 函数符号的 index 存的是函数名在常量池的下标
+        return add(name, FUNC_FLAG, type, nameIndex);
     }
 
-    bool SymTable::isDeclared(std::string name) {
-        for(int i=0; i<_next_index; i++) {
-            if(name == _symbols[i].getName())
-                return true;
-        }
-        return false;
+    bool SymTable::isDeclared(const std::string& name) {
+        return find(name) != -1;
     }
 
-    bool SymTable::isFunction(std::string name) {
-        for(int i=0; i<_next_index; i++) {
-            if(name == _symbols[i].getName()) {
-                if(_symbols[i].isFunction())
-                    return true;
-                else
-                    return false;
-            }
-        }
-        return false;
+    bool SymTable::isFunction(const std::string& name) {
+        auto id = find(name);
+        return id != -1 && (_flags[id] & FUNC_FLAG);
     }
 
     bool SymTable::isMainExisted() {
-        for(int i=0; i<_next_index; i++) {
-            if(_symbols[i].getName() == "main")
-                return true;
-        }
-        return false;
-    }
-
-    bool SymTable::isConstantExisted(cc0::SymType type, std::string name) {
-        for(int i=0; i<_next_index; i++) {
-            if(_symbols[i].getName() == name && _symbols[i].getType() == type)
-                return true;
-        }
-        return false;
+        return find("main") != -1;
     }
 
-    SymType SymTable::getType(std::string name) {
-        for(int i=0; i<_next_index; i++) {
-            if(name == _symbols[i].getName())
-                return _symbols[i].getType();
-        }
+    SymType SymTable::getType(const std::string& name) {
+        auto id = find(name);
+        return id == -1 ? SymType::VOID_TYPE : static_cast<SymType>(_types[id]);
     }
 
-    bool SymTable::isConst(std::string name) {
-        for(int i=0; i<_next_index; i++) {
-            if(name == _symbols[i].getName())
-                return _symbols[i].isConst();
-        }
+    bool SymTable::isConst(const std::string& name) {
+        auto id = find(name);
+        return id != -1 && (_flags[id] & CONST_FLAG);
     }
 
-    SymType SymTable::getFuncType(std::string name) {
-        for(int i=0; i<_next_index; i++) {
-            if(name == _symbols[i].getName() && _symbols[i].isFunction())
-                return _symbols[i].getType();
-        }
+    SymType SymTable::getFuncType(const std::string& name) {
+        auto id = find(name);
+        if(id == -1 || !(_flags[id] & FUNC_FLAG))
+            return SymType::VOID_TYPE;
+        return static_cast<SymType>(_types[id]);
     }
 
-    int32_t SymTable::getFuncParamNum(std::string name) {
-        for(int i=0; i<_next_index; i++) {
-            if(name == _symbols[i].getName() && _symbols[i].isFunction())
-                return _symbols[i].getParamNum();
-        }
-        return -1;
+    int32_t SymTable::getFuncParamNum(const std::string& name) {
+        auto id = find(name);
+        if(id == -1 || !(_flags[id] & FUNC_FLAG))
+            return -1;
+        return _param_nums[id];
     }
 
-    void SymTable::setFuncParamNum(std::string name, int32_t param_num) {
-        for(int i=0; i<_next_index; i++) {
-            if(name == _symbols[i].getName() && _symbols[i].isFunction()) {
-                _symbols[i].setParamNum(param_num);
-                return;
-            }
-        }
+    void SymTable::setFuncParamNum(const std::string& name, int32_t param_num) {
+        auto id = find(name);
+        if(id != -1 && (_flags[id] & FUNC_FLAG))
+            _param_nums[id] = param_num;
     }
 
-    int32_t SymTable::getIndex(std::string name) {
-        for(int i=0; i<_next_index; i++) {
-            if(name == _symbols[i].getName())
-                return _symbols[i].getIndex();
-        }
+    int32_t SymTable::getIndex(const std::string& name) {
+        auto id = find(name);
+        return id == -1 ? -1 : _indices[id];
     }
 
-    int32_t SymTable::getFuncOrder(std::string name) {
+    int32_t SymTable::getFuncOrder(const std::string& name) {
+        // 在它之前有几个函数；找不到时和原来一样返回函数总数
+        auto id = find(name);
+        int32_t end = id == -1 ? size() : id;
         int32_t order = 0;
-        for(int i=0; i<_next_index; i++) {
-            if(_symbols[i].isFunction()) {
-                if(name == _symbols[i].getName())
-                    break;
-                order++;
-            }
-        }
+        for(int32_t i=0; i<end; i++)
+            order += _flags[i] & FUNC_FLAG;
         return order;
     }
 
-    std::string SymTable::getNameByIndex(int32_t index) {
-        return _symbols[index].getName();
+    const std::string& SymTable::getNameByIndex(int32_t index) {
+        return _names[index];
     }
 
-    bool SymTable::isInit(std::string name) {
-        for(int i=0; i<_next_index; i++) {
-            if(name == _symbols[i].getName())
-                return _symbols[i].isInit();
-        }
+    bool SymTable::isInit(const std::string& name) {
+        auto id = find(name);
+        return id != -1 && (_flags[id] & INIT_FLAG);
     }
 
-    void SymTable::initVar(std::string name) {
-        for(int i=0; i<_next_index; i++) {
-            if(name == _symbols[i].getName()) {
-                _symbols[i].initVar();
-                return;
-            }
-        }
+    void SymTable::initVar(const std::string& name) {
+        auto id = find(name);
+        if(id != -1)
+            _flags[id] |= INIT_FLAG;
     }
 
     void SymTable::print() {
-        std::cout << "size: " << _symbols.size() << std::endl;
-        for(int i=0; i<_next_index; i++) {
-            std::cout << i << " name=" << _symbols[i].getName() << ", isFunc=" << std::boolalpha << _symbols[i].isFunction() << ", type=" << _symbols[i].getType() << ", index=" << _symbols[i].getIndex() << ", isInit=" << std::boolalpha << _symbols[i].isInit() << ", params=" << _symbols[i].getParamNum() << std::endl;
+        std::cout << "size: " << size() << std::endl;
+        for(int32_t i=0; i<size(); i++) {
+            std::cout << i << " name=" << _names[i] << ", isFunc=" << std::boolalpha << bool(_flags[i] & FUNC_FLAG) << ", type=" << int(_types[i]) << ", index=" << _indices[i] << ", isInit=" << std::boolalpha << bool(_flags[i] & INIT_FLAG) << ", params=" << _param_nums[i] << std::endl;
         }
     }
 
 }
-
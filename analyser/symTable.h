@@ -1,20 +1,36 @@
 #pragma once
 
 #include <cstdint>
+#include <string>
+#include <vector>
+#include <unordered_map>
 #include "symbol.h"
 
 namespace cc0 {
 
+    // 符号表按列存储：名字、标志位、类型、索引、参数数量各占一个数组，
+    // 同一个符号在各个数组里的下标相同（即它的 name id）。
+    // 按名字查找走哈希表，只看标志位的查询只扫描紧凑的字节数组。
     class SymTable final {
     private:
         using int32_t = std::int32_t;
+        using uint8_t = std::uint8_t;
+
+        // 标志位，每个符号一个字节
+        enum SymFlag : uint8_t {
+            FUNC_FLAG  = 1 << 0,  // 函数
+            CONST_FLAG = 1 << 1,  // const 变量
+            INIT_FLAG  = 1 << 2   // 已初始化
+        };
 
     public:
         SymTable() {};
 
         // 返回函数表
         std::vector<Symbol> getFunc();
-        std::vector<Symbol> getSymbols() { return _symbols; }
+        // 取出第 id 个符号
+        Symbol getSymbol(int32_t id) const;
+        int32_t size() const { return static_cast<int32_t>(_names.size()); }
 
         // 获取函数数量
         int32_t getFuncSize();
@@ -22,43 +38,53 @@ namespace cc0 {
         SymType getFuncParamType(int index);
 
         // 添加变量/常量
-        void addVar(std::string name, bool isConst, SymType type);
+        void addVar(const std::string& name, bool isConst, SymType type);
         // 获取变量位置
-        int getVarIndex(std::string name);
-        // 添加定义的函数
-        int32_t addFunc(std::string name, SymType type);
+        int getVarIndex(const std::string& name);
+        // 已经添加的变量一共占多少个 slot
+        int32_t getSlotCount() const { return _next_index; }
+        // 添加定义的函数，nameIndex 是函数名在常量池的下标，返回函数是第几个
+        int32_t addFunc(const std::string& name, SymType type, int32_t nameIndex);
         // 标识符是否已存在
-        bool isDeclared(std::string name);
+        bool isDeclared(const std::string& name);
         // 标识符是否为函数
-        bool isFunction(std::string name);
+        bool isFunction(const std::string& name);
         // 是否有 main 函数
         bool isMainExisted();
-        // 字面量是否已存在
-        bool isConstantExisted(SymType type, std::string name);
         // 获取符号类型
-        bool isConst(std::string name);
-        SymType getType(std::string name);
-        SymType getFuncType(std::string name);
+        bool isConst(const std::string& name);
+        SymType getType(const std::string& name);
+        SymType getFuncType(const std::string& name);
         // 获取函数参数数量
-        int32_t getFuncParamNum(std::string name);
+        int32_t getFuncParamNum(const std::string& name);
         // 修改参数数量
-        void setFuncParamNum(std::string name, int32_t param_num);
+        void setFuncParamNum(const std::string& name, int32_t param_num);
         // 获取符号在符号表的位置
-        int32_t getIndex(std::string name);
+        int32_t getIndex(const std::string& name);
         // 无视变量，只看函数是第几个
-        int32_t getFuncOrder(std::string name);
+        int32_t getFuncOrder(const std::string& name);
         // 获取函数名
-        std::string getNameByIndex(int32_t index);
+        const std::string& getNameByIndex(int32_t index);
         // 初始化变量
-        void initVar(std::string name);
+        void initVar(const std::string& name);
         // 是否初始化
-        bool isInit(std::string name);
+        bool isInit(const std::string& name);
 
         void print();
 
+    private:
+        // 查找名字对应的 name id，不存在返回 -1
+        int32_t find(const std::string& name) const;
+        int32_t add(const std::string& name, uint8_t flags, SymType type, int32_t index);
 
     private:
-        std::vector<Symbol> _symbols;
+        std::vector<std::string> _names;
+        std::vector<uint8_t> _flags;
+        std::vector<uint8_t> _types;       // SymType
+        std::vector<int32_t> _indices;     // 变量：在栈上的位置；函数：函数名在常量池的下标
+        std::vector<int32_t> _param_nums;  // 函数的参数数量
+        // 名字 -> name id
+        std::unordered_map<std::string, int32_t> _name_ids;
         int32_t _next_index = 0;
     };
 }
@@ -24,7 +24,6 @@ namespace cc0 {
     public:
         Symbol(std::string name, bool isFunc, bool isConst, SymType type, int32_t index, int32_t param_num)
             :_name(std::move(name)), _isFunc(isFunc), _isConst(isConst), _type(type), _index(index), _param_num(param_num) {};
-        Symbol(Symbol* t) { _name = t->_name; _isFunc = t->_isFunc; _isConst = t->_isConst; _type = t->_type; _index = t->_index; _param_num = t->_param_num; };
 
     public:
         std::string getName() { return _name; };
@@ -0,0 +1,114 @@
+#include "emitter/assemblyWriter.h"
+#include "fmts.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <thread>
+
+namespace cc0 {
+
+    namespace {
+        // 指令总数少于这个数时不值得开线程
+        constexpr std::int64_t PARALLEL_THRESHOLD = 1 << 15;
+    }
+
+    AssemblyWriter::AssemblyWriter(const Program& program, unsigned threads) {
+        auto& funcs = program.getFunctions();
+        std::vector<fmt::memory_buffer> bodies(funcs.size());
+
+        std::int64_t instructions = 0;
+        for(auto& func : funcs)
+            instructions += func.getInstructions().size();
+        if(threads == 0)
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        if(instructions < PARALLEL_THRESHOLD)
+            threads = 1;
+        threads = static_cast<unsigned>(std::min<std::size_t>(threads, funcs.size()));
+
+        // 每个线程从 next 领下一个还没格式化的函数
+        std::atomic<std::size_t> next{0};
+        auto work = [&]() {
+            for(std::size_t i = next++; i < funcs.size(); i = next++)
+                formatFunction(funcs[i], i, bodies[i]);
+        };
+        std::vector<std::thread> workers;
+        for(unsigned i = 1; i < threads; i++)
+            workers.emplace_back(work);
+        formatHeader(program, _text);
+        work();
+        for(auto& worker : workers)
+            worker.join();
+
+        std::size_t size = _text.size();
+        for(auto& body : bodies)
+            size += body.size();
+        _text.reserve(size);
+        for(auto& body : bodies)
+            _text.append(body.data(), body.data() + body.size());
+    }
+
+    void AssemblyWriter::formatHeader(const Program& program, fmt::memory_buffer& buf) {
+        // 输出常量表
+        auto& consts = program.getConstants();
+        fmt::format_to(buf, ".constants:\n");
+        for(std::int32_t i=0; i<consts.size(); i++) {
+            //          下标  常量的类型       常量的值
+            switch(consts.getType(i)) {
+                case STRING_CONSTANT:
+                    fmt::format_to(buf, "{} S \"{}\"\n", i, consts.getString(i));
+                    break;
+                case INT_CONSTANT:
+                    fmt::format_to(buf, "{} I {}\n", i, consts.getInt(i));
+                    break;
+                case DOUBLE_CONSTANT:
+                    fmt::format_to(buf, "{} D {:.17g}\n", i, consts.getDouble(i));
+                    break;
+            }
+        }
+
+        // 输出启动代码
+        fmt::format_to(buf, ".start:\n");
+        int index = 0;
+        for(auto intro : program.getStartCode())
+            formatInstruction(index++, intro, buf);
+
+        // 输出函数表
+        auto& funcs = program.getFunctions();
+        fmt::format_to(buf, ".functions:\n");
+        for(std::size_t i=0; i<funcs.size(); i++) {
+            //          下标 函数名在.constants中的下标 参数占用的slot数 函数嵌套的层级
+            fmt::format_to(buf, "{} {} {} {}\n", i, funcs[i].getNameIndex(), funcs[i].getParamsSize(), funcs[i].getLevel());
+        }
+    }
+
+    void AssemblyWriter::formatFunction(const Function& func, std::size_t index, fmt::memory_buffer& buf) {
+        fmt::format_to(buf, ".F{}:\n", index);
+        int j = 0;
+        for(auto intro : func.getInstructions())
+            formatInstruction(j++, intro, buf);
+    }
+
+    void AssemblyWriter::formatInstruction(int index, const Instruction& intro, fmt::memory_buffer& buf) {
+        // 和 formatter<Instruction> 的输出一致，只是不经过格式串解析，
+        // 汇编文件里绝大部分都是这种行
+        auto append = [&buf](const char* begin, const char* end) { buf.append(begin, end); };
+        fmt::format_int number(index);
+        append(number.data(), number.data() + number.size());
+        append("   ", "   " + 3);
+        auto& info = opcodeInfo(intro.getOperation());
+        const char* name = info.mnemonic != nullptr ? info.mnemonic : "???";
+        append(name, name + std::strlen(name));
+        if(info.operand_count >= 1) {
+            fmt::format_int x(intro.getX());
+            append(" ", " " + 1);
+            append(x.data(), x.data() + x.size());
+        }
+        if(info.operand_count >= 2) {
+            fmt::format_int y(intro.getY());
+            append(", ", ", " + 2);
+            append(y.data(), y.data() + y.size());
+        }
+        buf.push_back('\n');
+    }
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "analyser/program.h"
+
+#include "fmt/format.h"
+
+#include <cstddef>
+#include <ostream>
+#include <vector>
+
+namespace cc0 {
+
+    // 把 Program 输出成文本汇编
+    // 每个函数体单独格式化到自己的 memory_buffer 里，函数多、指令多的时候分给多个线程并行完成，
+    // 最后拼成一块一次性写出，不再逐行 flush
+    class AssemblyWriter final {
+    public:
+        // threads 为 0 时按硬件线程数决定
+        explicit AssemblyWriter(const Program& program, unsigned threads = 0);
+
+        const fmt::memory_buffer& getText() const { return _text; }
+        void writeTo(std::ostream& out) const { out.write(_text.data(), _text.size()); }
+
+    private:
+        // .constants、.start 和 .functions
+        static void formatHeader(const Program& program, fmt::memory_buffer& buf);
+        // .F{index} 和它的指令
+        static void formatFunction(const Function& func, std::size_t index, fmt::memory_buffer& buf);
+        // 一行指令：序号、助记符、操作数
+        static void formatInstruction(int index, const Instruction& intro, fmt::memory_buffer& buf);
+
+    private:
+        fmt::memory_buffer _text;
+    };
+}
@@ -0,0 +1,93 @@
+#include "emitter/objectWriter.h"
+
+namespace cc0 {
+
+    std::size_t ObjectWriter::objectSize(const Program& program) {
+        // magic + version + constants_count
+        std::size_t size = 4 + 4 + 2;
+        auto& consts = program.getConstants();
+        for(std::int32_t i=0; i<consts.size(); i++) {
+            switch(consts.getType(i)) {
+                case STRING_CONSTANT:
+                    size += 1 + 2 + consts.getString(i).size();
+                    break;
+                case INT_CONSTANT:
+                    size += 1 + 4;
+                    break;
+                case DOUBLE_CONSTANT:
+                    size += 1 + 8;
+                    break;
+            }
+        }
+        // start_code
+        size += 2 + program.getStartCode().byteSize();
+        // functions_count
+        size += 2;
+        for(auto& func : program.getFunctions())
+            size += 2 + 2 + 2 + 2 + func.getInstructions().byteSize();
+        return size;
+    }
+
+    ObjectWriter::ObjectWriter(const Program& program) : _bytes(objectSize(program)) {
+        _p = _bytes.data();
+
+        // magic
+        putU4(0x43303A29);
+        // version
+        putU4(0x00000001);
+
+        // constants_count
+        auto& consts = program.getConstants();
+        putU2(static_cast<std::uint16_t>(consts.size()));
+        // constants
+        for(std::int32_t i=0; i<consts.size(); i++) {
+            switch(consts.getType(i)) {
+                case STRING_CONSTANT: {
+                    // 字符串常量（函数名、字符串字面量）：长度 + 内容
+                    putU1(STRING_CONSTANT);
+                    auto str = consts.getString(i);
+                    putU2(static_cast<std::uint16_t>(str.size()));
+                    putBytes(str.data(), str.size());
+                    break;
+                }
+                case INT_CONSTANT:
+                    putU1(INT_CONSTANT);
+                    putU4(static_cast<std::uint32_t>(consts.getInt(i)));
+                    break;
+                case DOUBLE_CONSTANT: {
+                    putU1(DOUBLE_CONSTANT);
+                    double value = consts.getDouble(i);
+                    std::uint64_t bits;
+                    std::memcpy(&bits, &value, sizeof(bits));
+                    putU8(bits);
+                    break;
+                }
+            }
+        }
+
+        // start_code
+        putCode(program.getStartCode());
+
+        // functions_count
+        auto& funcs = program.getFunctions();
+        putU2(static_cast<std::uint16_t>(funcs.size()));
+        // functions
+        for(auto& func : funcs) {
+            // u2 name_index; u2 params_size; u2 level;
+            putU2(static_cast<std::uint16_t>(func.getNameIndex()));
+            putU2(static_cast<std::uint16_t>(func.getParamsSize()));
+            putU2(static_cast<std::uint16_t>(func.getLevel()));
+            putCode(func.getInstructions());
+        }
+    }
+
+    void ObjectWriter::putCode(const CodeBuffer& code) {
+        putU2(static_cast<std::uint16_t>(code.size()));
+        // CodeBuffer 里 u2 的操作数占 4 字节，逐条收窄成文件里的宽度；
+        // 超出 u2 的情况已经由 Program::checkLimits 拒绝
+        auto p = reinterpret_cast<std::uint8_t*>(_p);
+        for(auto it = code.begin(); it != code.end(); ++it)
+            p += encodeInstruction(*it, p);
+        _p = reinterpret_cast<char*>(p);
+    }
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "analyser/program.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <stdlib.h>
+#endif
+
+namespace cc0 {
+
+    // 主机字节序 -> 大端序
+    inline std::uint16_t toBigEndian(std::uint16_t v) {
+#if defined(_MSC_VER)
+        return _byteswap_ushort(v);
+#elif defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        return v;
+#else
+        return __builtin_bswap16(v);
+#endif
+    }
+
+    inline std::uint32_t toBigEndian(std::uint32_t v) {
+#if defined(_MSC_VER)
+        return _byteswap_ulong(v);
+#elif defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        return v;
+#else
+        return __builtin_bswap32(v);
+#endif
+    }
+
+    inline std::uint64_t toBigEndian(std::uint64_t v) {
+#if defined(_MSC_VER)
+        return _byteswap_uint64(v);
+#elif defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        return v;
+#else
+        return __builtin_bswap64(v);
+#endif
+    }
+
+    // 把整个 Program 序列化成 .o 文件：
+    // 先算出文件的总长度，一次分配好缓冲区，再顺序写入各个字段，最后一次性输出
+    class ObjectWriter final {
+    public:
+        explicit ObjectWriter(const Program& program);
+
+        const std::vector<char>& getBytes() const { return _bytes; }
+        void writeTo(std::ostream& out) const { out.write(_bytes.data(), _bytes.size()); }
+
+    private:
+        // 计算文件的总长度
+        static std::size_t objectSize(const Program& program);
+
+        void putU1(std::uint8_t v) { *_p++ = static_cast<char>(v); }
+        void putU2(std::uint16_t v) { put(toBigEndian(v)); }
+        void putU4(std::uint32_t v) { put(toBigEndian(v)); }
+        void putU8(std::uint64_t v) { put(toBigEndian(v)); }
+        void putBytes(const void* data, std::size_t size) { std::memcpy(_p, data, size); _p += size; }
+        // u2 instructions_count; Instruction instructions[instructions_count];
+        void putCode(const CodeBuffer& code);
+
+        template<typename T>
+        void put(T v) { putBytes(&v, sizeof(v)); }
+
+    private:
+        std::vector<char> _bytes;
+        char* _p;
+    };
+}
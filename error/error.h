@@ -44,6 +44,10 @@ namespace cc0 {
         ErrInvalidReturnStatement,
         ErrInvalidPrintStatement,
         ErrInvalidScanStatement,
+        ErrInvalidSwitchStatement,
+        ErrDuplicateCase,  // switch 里 case 的值重复
+        ErrBreakOutsideLoop,  // break 不在循环或 switch 里
+        ErrContinueOutsideLoop,
 
         ErrExpressionType,
         ErrInvalidCastExpression,
@@ -66,7 +70,13 @@ namespace cc0 {
 		ErrNotInitialized,
 		ErrInvalidAssignment,
 		ErrInvalidPrint,
-		ErrIncompleteCommit
+		ErrIncompleteCommit,
+
+		// 超出二进制格式里 u2 字段的上限
+		ErrTooManyConstants,
+		ErrStringTooLong,
+		ErrTooManyFunctions,
+		ErrFunctionTooLarge
 	};
 
 	class CompilationError final{
@@ -81,6 +81,18 @@ namespace fmt {
             case cc0::ErrInvalidScanStatement:
                 name = "The scan statement is invalid.";
                 break;
+            case cc0::ErrInvalidSwitchStatement:
+                name = "The switch statement is invalid.";
+                break;
+            case cc0::ErrDuplicateCase:
+                name = "The case value has appeared in the same switch.";
+                break;
+            case cc0::ErrBreakOutsideLoop:
+                name = "The break statement must be inside a loop or switch.";
+                break;
+            case cc0::ErrContinueOutsideLoop:
+                name = "The continue statement must be inside a loop.";
+                break;
             case cc0::ErrInvalidCastExpression:
                 name = "The cast expression is invalid.";
                 break;
@@ -145,6 +157,18 @@ namespace fmt {
                 break;
             case cc0::ErrTest:
                 name = "Test.";
+                break;
+            case cc0::ErrTooManyConstants:
+                name = "Too many constants, the object file allows at most 65535.";
+                break;
+            case cc0::ErrStringTooLong:
+                name = "The string literal is too long, the object file allows at most 65535 bytes.";
+                break;
+            case cc0::ErrTooManyFunctions:
+                name = "Too many functions, the object file allows at most 65535.";
+                break;
+            case cc0::ErrFunctionTooLarge:
+                name = "The function has too many instructions, the object file allows at most 65535.";
                 break;
 			}
 			return format_to(ctx.out(), name);
@@ -249,6 +273,9 @@ namespace fmt {
             case cc0::RETURN:
                 name = "Return";
                 break;
+            case cc0::BREAK:
+                name = "Break";
+                break;
             case cc0::CONTINUE:
                 name = "Continue";
                 break;
@@ -306,6 +333,18 @@ namespace fmt {
             case cc0::COMMA_SIGN:
                 name = "CommaSign";
                 break;
+            case cc0::COLON:
+                name = "Colon";
+                break;
+            case cc0::NOT_SIGN:
+                name = "NotSign";
+                break;
+            case cc0::AND_SIGN:
+                name = "AndSign";
+                break;
+            case cc0::OR_SIGN:
+                name = "OrSign";
+                break;
             default:
                 break;
 			}
@@ -322,187 +361,8 @@ namespace fmt {
 
 		template <typename FormatContext>
 		auto format(const cc0::Operation &p, FormatContext &ctx) {
-			std::string name;
-			switch (p) {
-			case cc0::NOP:
-				name = "nop";
-				break;
-			case cc0::BIPUSH:
-				name = "bipush";
-				break;
-			case cc0::IPUSH:
-				name = "ipush";
-				break;
-			case cc0::POP:
-				name = "pop";
-				break;
-			case cc0::POP2:
-				name = "pop2";
-				break;
-			case cc0::POPN:
-				name = "popn";
-				break;
-			case cc0::DUP:
-				name = "dup";
-				break;
-			case cc0::DUP2:
-				name = "dup2";
-				break;
-			case cc0::LOADC:
-				name = "loadc";
-				break;
-            case cc0::LOADA:
-                name = "loada";
-            break;
-            case cc0::NEW:
-                name = "new";
-            break;
-            case cc0::SNEW:
-                name = "snew";
-            break;
-            case cc0::ILOAD:
-                name = "iload";
-            break;
-            case cc0::DLOAD:
-                name = "dload";
-            break;
-            case cc0::ALOAD:
-                name = "aload";
-            break;
-            case cc0::IALOAD:
-                name = "iaload";
-            break;
-            case cc0::DALOAD:
-                name = "daload";
-            break;
-            case cc0::AALOAD:
-                name = "aaload";
-                break;
-            case cc0::ISTORE:
-                name = "istore";
-                break;
-            case cc0::DSTORE:
-                name = "dstore";
-                break;
-            case cc0::ASTORE:
-                name = "astore";
-                break;
-            case cc0::IASTORE:
-                name = "iastore";
-                break;
-            case cc0::DASTORE:
-                name = "dastore";
-                break;
-            case cc0::AASTORE:
-                name = "aastore";
-                break;
-            case cc0::IADD:
-                name = "iadd";
-                break;
-            case cc0::DADD:
-                name = "dadd";
-                break;
-            case cc0::ISUB:
-                name = "isub";
-                break;
-            case cc0::DSUB:
-                name = "dsub";
-                break;
-            case cc0::IMUL:
-                name = "imul";
-                break;
-            case cc0::DMUL:
-                name = "dmul";
-                break;
-            case cc0::IDIV:
-                name = "idiv";
-                break;
-            case cc0::DDIV:
-                name = "ddiv";
-                break;
-            case cc0::INEG:
-                name = "ineg";
-                break;
-            case cc0::DNEG:
-                name = "dneg";
-                break;
-            case cc0::ICMP:
-                name = "icmp";
-                break;
-            case cc0::DCMP:
-                name = "dcmp";
-                break;
-            case cc0::I2D:
-                name = "i2d";
-                break;
-            case cc0::D2I:
-                name = "d2i";
-                break;
-            case cc0::I2C:
-                name = "i2c";
-                break;
-            case cc0::JMP:
-                name = "jmp";
-                break;
-            case cc0::JE:
-                name = "je";
-                break;
-            case cc0::JNE:
-                name = "jne";
-                break;
-            case cc0::JL:
-                name = "jl";
-                break;
-            case cc0::JGE:
-                name = "jge";
-                break;
-            case cc0::JG:
-                name = "jg";
-                break;
-            case cc0::JLE:
-                name = "jle";
-                break;
-            case cc0::CALL:
-                name = "call";
-                break;
-            case cc0::RET:
-                name = "ret";
-                break;
-            case cc0::IRET:
-                name = "iret";
-                break;
-            case cc0::DRET:
-                name = "dret";
-                break;
-            case cc0::ARET:
-                name = "aret";
-                break;
-            case cc0::IPRINT:
-                name = "iprint";
-                break;
-            case cc0::DPRINT:
-                name = "dprint";
-                break;
-            case cc0::CPRINT:
-                name = "cprint";
-                break;
-            case cc0::SPRINT:
-                name = "sprint";
-                break;
-            case cc0::PRINTL:
-                name = "printl";
-                break;
-            case cc0::ISCAN:
-                name = "iscan";
-                break;
-            case cc0::DSCAN:
-                name = "dscan";
-                break;
-            case cc0::CSCAN:
-                name = "cscan";
-                break;
-        }
-			return format_to(ctx.out(), name);
+			auto name = cc0::opcodeInfo(p).mnemonic;
+			return format_to(ctx.out(), "{}", name != nullptr ? name : "???");
 		}
 	};
 	template<>
@@ -512,13 +372,15 @@ namespace fmt {
 
 		template <typename FormatContext>
 		auto format(const cc0::Instruction &p, FormatContext &ctx) {
-		    if(p.getX() == -1 && p.getY() == -1)
-                return format_to(ctx.out(), "{}", p.getOperation());
-		    if(p.getX() != -1 && p.getY() == -1)
-                return format_to(ctx.out(), "{} {}", p.getOperation(), p.getX());
-            if(p.getX() == -1 && p.getY() != -1)
-                return format_to(ctx.out(), "{} {}", p.getOperation(), p.getY());
-            return format_to(ctx.out(), "{} {}, {}", p.getOperation(), p.getX(), p.getY());
+		    // 操作数的个数以指令描述表为准
+		    switch(cc0::opcodeInfo(p.getOperation()).operand_count) {
+		        case 0:
+		            return format_to(ctx.out(), "{}", p.getOperation());
+		        case 1:
+		            return format_to(ctx.out(), "{} {}", p.getOperation(), p.getX());
+		        default:
+		            return format_to(ctx.out(), "{} {}, {}", p.getOperation(), p.getX(), p.getY());
+		    }
 		}
 	};
 }
\ No newline at end of file
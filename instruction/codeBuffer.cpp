@@ -0,0 +1,71 @@
+#include "instruction/codeBuffer.h"
+
+namespace cc0 {
+
+    CodeBuffer::CodeBuffer(const std::vector<Instruction>& instructions) {
+        std::size_t bytes = 0;
+        for(auto& instruction : instructions)
+            bytes += opcodeInfo(instruction.getOperation()).code_size;
+        _bytes.resize(bytes);
+        auto p = _bytes.data();
+        for(auto& instruction : instructions)
+            p += encodeCode(instruction, p);
+        _count = static_cast<int32_t>(instructions.size());
+    }
+
+    void CodeBuffer::patchX(Mark at, int32_t x) {
+        Instruction instruction = decodeCode(_bytes.data() + at.offset);
+        instruction.setX(x);
+        encodeCode(instruction, _bytes.data() + at.offset);
+    }
+
+    void CodeBuffer::insert(Mark at, Operation opr, int32_t x, int32_t y) {
+        uint8_t bytes[16];
+        auto len = encodeCode(Instruction(opr, x, y), bytes);
+        _bytes.insert(_bytes.begin() + at.offset, bytes, bytes + len);
+        _count++;
+    }
+
+    CodeBuffer::Fragment CodeBuffer::cut(Mark from, std::pmr::memory_resource* resource) {
+        Fragment fragment{ std::pmr::vector<uint8_t>(_bytes.begin() + from.offset, _bytes.end(), resource),
+                           from.index, _count - from.index };
+        _bytes.resize(from.offset);
+        _count = from.index;
+        return fragment;
+    }
+
+    void CodeBuffer::append(const Fragment& fragment) {
+        auto old = _bytes.size();
+        _bytes.insert(_bytes.end(), fragment.bytes.begin(), fragment.bytes.end());
+        int32_t delta = _count - fragment.index;
+        _count += fragment.count;
+        if(delta == 0)
+            return;
+        // 片段内部的跳转目标跟着平移
+        for(auto p = _bytes.data() + old; p != _bytes.data() + _bytes.size(); p += opcodeInfo(static_cast<Operation>(*p)).code_size) {
+            if(!opcodeInfo(static_cast<Operation>(*p)).is_branch)
+                continue;
+            Instruction instruction = decodeCode(p);
+            int32_t target = instruction.getX();
+            if(target >= fragment.index && target < fragment.index + fragment.count) {
+                instruction.setX(target + delta);
+                encodeCode(instruction, p);
+            }
+        }
+    }
+
+    std::size_t CodeBuffer::byteSize() const {
+        std::size_t bytes = 0;
+        for(auto it = begin(); it != end(); ++it)
+            bytes += opcodeInfo(it.getOperation()).size;
+        return bytes;
+    }
+
+    std::vector<Instruction> CodeBuffer::decode() const {
+        std::vector<Instruction> instructions;
+        instructions.reserve(_count);
+        for(auto it = begin(); it != end(); ++it)
+            instructions.emplace_back(*it);
+        return instructions;
+    }
+}
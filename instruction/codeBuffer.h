@@ -0,0 +1,105 @@
+#pragma once
+
+#include "instruction.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory_resource>
+#include <vector>
+
+namespace cc0 {
+
+    // 一个函数（或启动代码）的指令序列，按接近二进制文件的格式紧凑保存：
+    // 每条指令是 1 字节操作码加上大端序的操作数，只是 u2 的操作数（跳转目标、常量和函数的下标）
+    // 放宽到 4 字节，超过 65535 条指令的函数也能原样保存、输出汇编，写 .o 时再收窄（见 ObjectWriter）。
+    // 跳转指令的操作数是目标指令的序号，所以这里同时维护指令条数。
+    class CodeBuffer final {
+    private:
+        using int32_t = std::int32_t;
+        using uint8_t = std::uint8_t;
+        using uint32_t = std::uint32_t;
+
+    public:
+        // 某条指令在缓冲区里的位置：字节偏移和指令序号
+        // 在它之前插入或删除指令后，原来的 Mark 就失效了
+        struct Mark {
+            uint32_t offset;
+            int32_t index;
+        };
+
+        // 从缓冲区剪下来的一段指令，可以再接到末尾
+        struct Fragment {
+            std::pmr::vector<uint8_t> bytes;
+            int32_t index;  // 剪下来之前第一条指令的序号
+            int32_t count;  // 指令条数
+        };
+
+        // 逐条解码的只读迭代器
+        class Iterator final {
+        public:
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = Instruction;
+            using difference_type = std::ptrdiff_t;
+            using pointer = const Instruction*;
+            using reference = Instruction;
+
+            explicit Iterator(const uint8_t* p) : _p(p) {}
+
+            Instruction operator*() const { return decodeCode(_p); }
+            Operation getOperation() const { return static_cast<Operation>(*_p); }
+            Iterator& operator++() { _p += opcodeInfo(getOperation()).code_size; return *this; }
+            Iterator operator++(int) { Iterator it = *this; ++*this; return it; }
+            bool operator==(const Iterator& rhs) const { return _p == rhs._p; }
+            bool operator!=(const Iterator& rhs) const { return _p != rhs._p; }
+        private:
+            const uint8_t* _p;
+        };
+
+    public:
+        CodeBuffer() = default;
+        explicit CodeBuffer(const std::vector<Instruction>& instructions);
+
+        // 指令条数
+        int32_t size() const { return _count; }
+        bool empty() const { return _count == 0; }
+        // 写成 .o 文件后的字节数（u2 的操作数按 2 字节算），要逐条累加
+        std::size_t byteSize() const;
+
+        Iterator begin() const { return Iterator(_bytes.data()); }
+        Iterator end() const { return Iterator(_bytes.data() + _bytes.size()); }
+
+        // 下一条指令将要写入的位置
+        Mark mark() const { return { static_cast<uint32_t>(_bytes.size()), _count }; }
+
+        // 在末尾添加一条指令，返回它的位置，之后可以用 patchX 回填操作数
+        Mark emplace_back(Operation opr, int32_t x = -1, int32_t y = -1) {
+            Mark at = mark();
+            auto old = _bytes.size();
+            _bytes.resize(old + opcodeInfo(opr).code_size);
+            encodeCode(Instruction(opr, x, y), _bytes.data() + old);
+            _count++;
+            return at;
+        }
+
+        // 修改 at 处指令的第一个操作数，比如回填跳转地址
+        void patchX(Mark at, int32_t x);
+        // 读取 at 处的指令
+        Instruction at(Mark at) const { return decodeCode(_bytes.data() + at.offset); }
+        // 在 at 处插入一条指令，后面的指令整体后移
+        // 后移的指令里的跳转目标不会修改
+        void insert(Mark at, Operation opr, int32_t x = -1, int32_t y = -1);
+        // 剪下 from 到末尾的所有指令
+        Fragment cut(Mark from, std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+        // 把剪下来的指令接到末尾
+        // 片段内部的跳转（目标在片段原来的范围里）会随片段一起移动
+        void append(const Fragment& fragment);
+
+        // 解码成 Instruction 序列，供需要随机访问、改写代码的优化使用
+        std::vector<Instruction> decode() const;
+
+    private:
+        std::vector<uint8_t> _bytes;
+        int32_t _count = 0;
+    };
+}
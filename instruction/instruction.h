@@ -1,8 +1,8 @@
 #pragma once
 
+#include <array>
+#include <cstddef>
 #include <cstdint>
-#include <unordered_map>
-#include <vector>
 
 namespace cc0 {
 
@@ -68,32 +68,123 @@ namespace cc0 {
         CSCAN   = 0xb2
 	};
 
-	const std::unordered_map<cc0::Operation, std::vector<int>> paramOpt = {
-	        // bipush byte(1) (0x01)
-            {Operation::BIPUSH, {1} },
-            // ipush value(4) (0x02)
-            {Operation::IPUSH, {4} },
-            // popn count(4) (0x06)
-            {Operation::POPN, {4} },
-            // loadc index(2) (0x09)
-            {Operation::LOADC, {2} },
-            // loada level_diff(2), offset(4) (0x0a)
-            {Operation::LOADA, {2, 4} },
-            // snew count(4) (0x0c)
-            {Operation::SNEW, {4} },
-            // call index(2) (0x80)
-            {Operation::CALL, {2} },
-            // jmp offset(2) (0x70)
-            {Operation::JMP, {2} },
-            // je offset(2) (0x71)
-            {Operation::JE, {2} },
-            {Operation::JNE, {2} },
-            {Operation::JL, {2} },
-            {Operation::JLE, {2} },
-            {Operation::JG, {2} },
-            {Operation::JGE, {2} },
+	// 指令的静态描述，下标是操作码
+	// pop/push 是指令从栈上弹出/压入的 slot 数（int、地址占 1 个 slot，double 占 2 个）
+	struct OpcodeInfo {
+	    const char* mnemonic;            // 助记符，nullptr 表示不是合法的操作码
+	    std::uint8_t operand_count;      // 操作数个数
+	    std::uint8_t operand_widths[2];  // 每个操作数编码后的字节数
+	    std::uint8_t size;               // 整条指令编码后的字节数，含 1 字节操作码
+	    std::uint8_t code_widths[2];     // 在 CodeBuffer 里每个操作数的字节数：u2 放宽到 4 字节
+	    std::uint8_t code_size;          // 整条指令在 CodeBuffer 里的字节数
+	    std::int8_t pop;                 // VARIABLE_EFFECT 表示取决于操作数或常量、函数
+	    std::int8_t push;
+	    bool is_branch;                  // 第一个操作数是跳转目标（jmp、jcc）
+	    bool is_return;                  // ret、iret、dret、aret
 	};
-	
+
+	constexpr std::int8_t VARIABLE_EFFECT = -1;
+
+	namespace detail {
+	    constexpr void setOpcode(OpcodeInfo* table, Operation op, const char* mnemonic, std::int8_t pop, std::int8_t push,
+	                             std::uint8_t width0 = 0, std::uint8_t width1 = 0) {
+	        OpcodeInfo& info = table[static_cast<std::uint8_t>(op)];
+	        info.mnemonic = mnemonic;
+	        info.operand_count = (width0 != 0) + (width1 != 0);
+	        info.operand_widths[0] = width0;
+	        info.operand_widths[1] = width1;
+	        info.size = 1 + width0 + width1;
+	        // 超过 65535 条指令的函数里跳转目标会超出 u2，先按 4 字节保存，写 .o 之前再检查
+	        info.code_widths[0] = width0 == 2 ? 4 : width0;
+	        info.code_widths[1] = width1 == 2 ? 4 : width1;
+	        info.code_size = 1 + info.code_widths[0] + info.code_widths[1];
+	        info.pop = pop;
+	        info.push = push;
+	        info.is_branch = op >= Operation::JMP && op <= Operation::JLE;
+	        info.is_return = op >= Operation::RET && op <= Operation::ARET;
+	    }
+
+	    constexpr std::array<OpcodeInfo, 256> makeOpcodeTable() {
+	        std::array<OpcodeInfo, 256> table{};
+	        constexpr auto V = VARIABLE_EFFECT;
+	        OpcodeInfo* t = &table[0];
+	        //                  操作码             助记符      pop push 操作数宽度
+	        setOpcode(t, Operation::NOP,     "nop",     0, 0);
+	        setOpcode(t, Operation::BIPUSH,  "bipush",  0, 1, 1);   // byte(1)
+	        setOpcode(t, Operation::IPUSH,   "ipush",   0, 1, 4);   // value(4)
+	        setOpcode(t, Operation::POP,     "pop",     1, 0);
+	        setOpcode(t, Operation::POP2,    "pop2",    2, 0);
+	        setOpcode(t, Operation::POPN,    "popn",    V, 0, 4);   // count(4)
+	        setOpcode(t, Operation::DUP,     "dup",     1, 2);
+	        setOpcode(t, Operation::DUP2,    "dup2",    2, 4);
+	        setOpcode(t, Operation::LOADC,   "loadc",   0, V, 2);   // index(2)，double 常量压 2 个 slot
+	        setOpcode(t, Operation::LOADA,   "loada",   0, 1, 2, 4);  // level_diff(2), offset(4)
+	        setOpcode(t, Operation::NEW,     "new",     1, 1);
+	        setOpcode(t, Operation::SNEW,    "snew",    0, V, 4);   // count(4)
+	        setOpcode(t, Operation::ILOAD,   "iload",   1, 1);
+	        setOpcode(t, Operation::DLOAD,   "dload",   1, 2);
+	        setOpcode(t, Operation::ALOAD,   "aload",   1, 1);
+	        setOpcode(t, Operation::IALOAD,  "iaload",  2, 1);
+	        setOpcode(t, Operation::DALOAD,  "daload",  2, 2);
+	        setOpcode(t, Operation::AALOAD,  "aaload",  2, 1);
+	        setOpcode(t, Operation::ISTORE,  "istore",  2, 0);
+	        setOpcode(t, Operation::DSTORE,  "dstore",  3, 0);
+	        setOpcode(t, Operation::ASTORE,  "astore",  2, 0);
+	        setOpcode(t, Operation::IASTORE, "iastore", 3, 0);
+	        setOpcode(t, Operation::DASTORE, "dastore", 4, 0);
+	        setOpcode(t, Operation::AASTORE, "aastore", 3, 0);
+	        setOpcode(t, Operation::IADD,    "iadd",    2, 1);
+	        setOpcode(t, Operation::DADD,    "dadd",    4, 2);
+	        setOpcode(t, Operation::ISUB,    "isub",    2, 1);
+	        setOpcode(t, Operation::DSUB,    "dsub",    4, 2);
+	        setOpcode(t, Operation::IMUL,    "imul",    2, 1);
+	        setOpcode(t, Operation::DMUL,    "dmul",    4, 2);
+	        setOpcode(t, Operation::IDIV,    "idiv",    2, 1);
+	        setOpcode(t, Operation::DDIV,    "ddiv",    4, 2);
+	        setOpcode(t, Operation::INEG,    "ineg",    1, 1);
+	        setOpcode(t, Operation::DNEG,    "dneg",    2, 2);
+	        setOpcode(t, Operation::ICMP,    "icmp",    2, 1);
+	        setOpcode(t, Operation::DCMP,    "dcmp",    4, 1);
+	        setOpcode(t, Operation::I2D,     "i2d",     1, 2);
+	        setOpcode(t, Operation::D2I,     "d2i",     2, 1);
+	        setOpcode(t, Operation::I2C,     "i2c",     1, 1);
+	        setOpcode(t, Operation::JMP,     "jmp",     0, 0, 2);   // offset(2)
+	        setOpcode(t, Operation::JE,      "je",      1, 0, 2);
+	        setOpcode(t, Operation::JNE,     "jne",     1, 0, 2);
+	        setOpcode(t, Operation::JL,      "jl",      1, 0, 2);
+	        setOpcode(t, Operation::JGE,     "jge",     1, 0, 2);
+	        setOpcode(t, Operation::JG,      "jg",      1, 0, 2);
+	        setOpcode(t, Operation::JLE,     "jle",     1, 0, 2);
+	        setOpcode(t, Operation::CALL,    "call",    V, V, 2);   // index(2)，参数和返回值取决于被调用的函数
+	        setOpcode(t, Operation::RET,     "ret",     0, 0);
+	        setOpcode(t, Operation::IRET,    "iret",    1, 0);
+	        setOpcode(t, Operation::DRET,    "dret",    2, 0);
+	        setOpcode(t, Operation::ARET,    "aret",    1, 0);
+	        setOpcode(t, Operation::IPRINT,  "iprint",  1, 0);
+	        setOpcode(t, Operation::DPRINT,  "dprint",  2, 0);
+	        setOpcode(t, Operation::CPRINT,  "cprint",  1, 0);
+	        setOpcode(t, Operation::SPRINT,  "sprint",  1, 0);
+	        setOpcode(t, Operation::PRINTL,  "printl",  0, 0);
+	        setOpcode(t, Operation::ISCAN,   "iscan",   0, 1);
+	        setOpcode(t, Operation::DSCAN,   "dscan",   0, 2);
+	        setOpcode(t, Operation::CSCAN,   "cscan",   0, 1);
+	        return table;
+	    }
+	}
+
+	// 所有操作码的描述表，编译期生成
+	// 生成二进制、输出汇编、分析栈的深度等都查这张表
+	inline constexpr std::array<OpcodeInfo, 256> opcodeTable = detail::makeOpcodeTable();
+
+	constexpr const OpcodeInfo& opcodeInfo(Operation op) {
+	    return opcodeTable[static_cast<std::uint8_t>(op)];
+	}
+
+	static_assert(opcodeInfo(Operation::LOADA).size == 7, "loada level_diff(2), offset(4)");
+	static_assert(opcodeInfo(Operation::JMP).code_size == 5, "jump targets are kept as u4 in CodeBuffer");
+	static_assert(opcodeInfo(Operation::JGE).is_branch && !opcodeInfo(Operation::CALL).is_branch, "jmp..jle are branches");
+	static_assert(opcodeInfo(Operation::DRET).is_return && opcodeInfo(Operation::DRET).pop == 2, "dret pops a double");
+
 	class Instruction final {
 	private:
         using int32_t = std::int32_t;
@@ -126,4 +217,53 @@ namespace cc0 {
 		swap(lhs._x, rhs._x);
 		swap(lhs._y, rhs._y);
 	}
-}
\ No newline at end of file
+
+	namespace detail {
+	    inline std::size_t encode(const Instruction& instruction, const std::uint8_t* widths, std::uint8_t* out) {
+	        const OpcodeInfo& info = opcodeInfo(instruction.getOperation());
+	        out[0] = static_cast<std::uint8_t>(instruction.getOperation());
+	        std::size_t pos = 1;
+	        const std::uint32_t operands[2] = { static_cast<std::uint32_t>(instruction.getX()), static_cast<std::uint32_t>(instruction.getY()) };
+	        for (int i = 0; i < info.operand_count; i++) {
+	            for (int shift = (widths[i] - 1) * 8; shift >= 0; shift -= 8)
+	                out[pos++] = static_cast<std::uint8_t>(operands[i] >> shift);
+	        }
+	        return pos;
+	    }
+
+	    inline Instruction decode(const std::uint8_t* in, bool wide) {
+	        auto opr = static_cast<Operation>(in[0]);
+	        const OpcodeInfo& info = opcodeInfo(opr);
+	        const std::uint8_t* widths = wide ? info.code_widths : info.operand_widths;
+	        std::int32_t operands[2] = { -1, -1 };
+	        std::size_t pos = 1;
+	        for (int i = 0; i < info.operand_count; i++) {
+	            std::uint32_t value = 0;
+	            for (int j = 0; j < widths[i]; j++)
+	                value = (value << 8) | in[pos++];
+	            operands[i] = static_cast<std::int32_t>(value);
+	        }
+	        return Instruction(opr, operands[0], operands[1]);
+	    }
+	}
+
+	// 把指令按 .o 文件的格式（大端序）编码到 out，返回写入的字节数（即 opcodeInfo(op).size）
+	// out 至少要有 opcodeInfo(op).size 个字节；超出 u2 的操作数会被截断，调用前要检查
+	inline std::size_t encodeInstruction(const Instruction& instruction, std::uint8_t* out) {
+		return detail::encode(instruction, opcodeInfo(instruction.getOperation()).operand_widths, out);
+	}
+
+	// 从 in 处解码一条 .o 格式的指令，操作数按无符号数读出（和虚拟机一致）
+	inline Instruction decodeInstruction(const std::uint8_t* in) {
+		return detail::decode(in, false);
+	}
+
+	// 同上，但按 CodeBuffer 里的宽度（opcodeInfo(op).code_size），u2 的操作数不会截断
+	inline std::size_t encodeCode(const Instruction& instruction, std::uint8_t* out) {
+		return detail::encode(instruction, opcodeInfo(instruction.getOperation()).code_widths, out);
+	}
+
+	inline Instruction decodeCode(const std::uint8_t* in) {
+		return detail::decode(in, true);
+	}
+}
@@ -0,0 +1,53 @@
+#include "ir/deadCode.h"
+
+namespace cc0::ir {
+
+    std::int64_t DeadCode::run(Function& func, ConstantPool&) {
+        using int32_t = std::int32_t;
+        auto& insts = func.insts();
+        std::vector<bool> live(insts.size(), false);
+        std::vector<int32_t> work;
+        auto mark = [&](int32_t v) {
+            if(!live[v]) {
+                live[v] = true;
+                work.push_back(v);
+            }
+        };
+        for(auto& block : func.blocks()) {
+            if(block.removed)
+                continue;
+            for(auto v : block.body)
+                if(hasSideEffects(func, insts[v]) || insts[v].opcode == Opcode::PARAM)
+                    mark(v);
+            if(block.value != -1)
+                mark(block.value);
+        }
+        while(!work.empty()) {
+            auto v = work.back();
+            work.pop_back();
+            for(auto arg : insts[v].args)
+                mark(arg);
+        }
+
+        std::int64_t removed = 0;
+        auto sweep = [&](std::vector<int32_t>& list) {
+            std::vector<int32_t> kept;
+            for(auto v : list) {
+                if(live[v]) {
+                    kept.push_back(v);
+                    continue;
+                }
+                insts[v].opcode = Opcode::NOP;
+                insts[v].args.clear();
+                insts[v].block = -1;
+                removed++;
+            }
+            list.swap(kept);
+        };
+        for(auto& block : func.blocks()) {
+            sweep(block.phis);
+            sweep(block.body);
+        }
+        return removed;
+    }
+}
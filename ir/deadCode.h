@@ -0,0 +1,14 @@
+#pragma once
+
+#include "ir/passManager.h"
+
+namespace cc0::ir {
+
+    // 删除无用的值：从有副作用的指令和块结尾用到的值出发，沿参数标记，
+    // 没有标记到的纯运算、全局变量的读和 phi（包括只在循环里互相使用的 phi）都删掉
+    class DeadCode final : public Pass {
+    public:
+        const char* name() const override { return "dce"; }
+        std::int64_t run(Function& func, ConstantPool& consts) override;
+    };
+}
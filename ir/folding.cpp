@@ -0,0 +1,241 @@
+#include "ir/folding.h"
+
+#include <cmath>
+#include <limits>
+
+namespace cc0::ir {
+
+    namespace {
+        // 按 32 位补码回绕
+        std::int32_t wrap(std::int64_t value) {
+            return static_cast<std::int32_t>(static_cast<std::uint32_t>(value));
+        }
+
+        bool isIntConst(const Inst& inst, std::int32_t& value) {
+            if(inst.opcode != Opcode::CONST)
+                return false;
+            value = inst.imm;
+            return true;
+        }
+
+        bool isDoubleConst(const Inst& inst, const ConstantPool& consts, double& value) {
+            if(inst.opcode != Opcode::LOADC || inst.type != Type::DOUBLE)
+                return false;
+            value = consts.getDouble(inst.imm);
+            return true;
+        }
+
+        bool branchTaken(Operation op, std::int32_t value) {
+            switch(op) {
+                case Operation::JE:  return value == 0;
+                case Operation::JNE: return value != 0;
+                case Operation::JL:  return value < 0;
+                case Operation::JGE: return value >= 0;
+                case Operation::JG:  return value > 0;
+                default:             return value <= 0;  // JLE
+            }
+        }
+
+        class Folder final {
+        private:
+            using int32_t = std::int32_t;
+            using int64_t = std::int64_t;
+
+        public:
+            Folder(Function& func, ConstantPool& consts) : _func(func), _consts(consts) {}
+
+            int64_t run();
+
+        private:
+            // 折叠一条指令，返回是否有变化
+            bool fold(int32_t v);
+            bool foldPhi(int32_t v);
+            bool foldBranch(int32_t b);
+
+            void makeInt(int32_t v, int32_t value) {
+                auto& inst = _func.inst(v);
+                inst.opcode = Opcode::CONST;
+                inst.operation = Operation::NOP;
+                inst.type = Type::INT;
+                inst.imm = value;
+                inst.args.clear();
+            }
+            void makeDouble(int32_t v, double value) {
+                auto& inst = _func.inst(v);
+                inst.opcode = Opcode::LOADC;
+                inst.operation = Operation::NOP;
+                inst.type = Type::DOUBLE;
+                inst.imm = _consts.addDouble(value);
+                inst.args.clear();
+            }
+            // v 的所有使用换成 with
+            void forward(int32_t v, int32_t with) {
+                // with 可能是刚建的 UNDEF
+                while(_forward.size() < _func.insts().size())
+                    _forward.push_back(static_cast<int32_t>(_forward.size()));
+                _forward[v] = with;
+                _func.erase(v);
+            }
+
+        private:
+            Function& _func;
+            ConstantPool& _consts;
+            std::vector<int32_t> _forward;
+        };
+
+        bool Folder::fold(int32_t v) {
+            auto& inst = _func.inst(v);
+            if(inst.opcode != Opcode::OP)
+                return false;
+            auto op = inst.operation;
+            auto& args = inst.args;
+            int32_t a = 0, b = 0;
+            double x = 0, y = 0;
+            bool int0 = isIntConst(_func.inst(args[0]), a);
+            bool int1 = args.size() > 1 && isIntConst(_func.inst(args[1]), b);
+            bool double0 = isDoubleConst(_func.inst(args[0]), _consts, x);
+            bool double1 = args.size() > 1 && isDoubleConst(_func.inst(args[1]), _consts, y);
+            switch(op) {
+                case Operation::IADD:
+                    if(int0 && int1) { makeInt(v, wrap(static_cast<int64_t>(a) + b)); return true; }
+                    if(int1 && b == 0) { forward(v, args[0]); return true; }
+                    if(int0 && a == 0) { forward(v, args[1]); return true; }
+                    return false;
+                case Operation::ISUB:
+                    if(int0 && int1) { makeInt(v, wrap(static_cast<int64_t>(a) - b)); return true; }
+                    if(int1 && b == 0) { forward(v, args[0]); return true; }
+                    if(args[0] == args[1]) { makeInt(v, 0); return true; }
+                    return false;
+                case Operation::IMUL:
+                    if(int0 && int1) { makeInt(v, wrap(static_cast<int64_t>(a) * b)); return true; }
+                    if(int1 && b == 1) { forward(v, args[0]); return true; }
+                    if(int0 && a == 1) { forward(v, args[1]); return true; }
+                    if((int1 && b == 0) || (int0 && a == 0)) { makeInt(v, 0); return true; }
+                    return false;
+                case Operation::IDIV:
+                    if(int0 && int1 && b != 0 && !(a == std::numeric_limits<int32_t>::min() && b == -1)) {
+                        makeInt(v, a / b);
+                        return true;
+                    }
+                    if(int1 && b == 1) { forward(v, args[0]); return true; }
+                    return false;
+                case Operation::ICMP:
+                    if(int0 && int1) { makeInt(v, a < b ? -1 : (a > b ? 1 : 0)); return true; }
+                    if(args[0] == args[1]) { makeInt(v, 0); return true; }
+                    return false;
+                case Operation::INEG:
+                    if(int0) { makeInt(v, wrap(-static_cast<int64_t>(a))); return true; }
+                    return false;
+                case Operation::I2C:
+                    if(int0) { makeInt(v, a & 0xff); return true; }
+                    return false;
+                case Operation::I2D:
+                    if(int0) { makeDouble(v, a); return true; }
+                    return false;
+                case Operation::D2I:
+                    // 超出 int 范围的转换在虚拟机里是未定义的，留到运行时
+                    if(double0 && x > -2147483649.0 && x < 2147483648.0) { makeInt(v, static_cast<int32_t>(x)); return true; }
+                    return false;
+                case Operation::DNEG:
+                    if(double0) { makeDouble(v, -x); return true; }
+                    return false;
+                case Operation::DADD:
+                    if(double0 && double1) { makeDouble(v, x + y); return true; }
+                    return false;
+                case Operation::DSUB:
+                    if(double0 && double1) { makeDouble(v, x - y); return true; }
+                    return false;
+                case Operation::DMUL:
+                    if(double0 && double1) { makeDouble(v, x * y); return true; }
+                    return false;
+                case Operation::DDIV:
+                    if(double0 && double1 && y != 0) { makeDouble(v, x / y); return true; }
+                    return false;
+                case Operation::DCMP:
+                    if(double0 && double1 && !std::isnan(x) && !std::isnan(y)) { makeInt(v, x < y ? -1 : (x > y ? 1 : 0)); return true; }
+                    return false;
+                default:
+                    return false;
+            }
+        }
+
+        bool Folder::foldPhi(int32_t v) {
+            int32_t same = -1;
+            for(auto arg : _func.inst(v).args) {
+                if(arg == v || arg == same)
+                    continue;
+                if(same != -1)
+                    return false;
+                same = arg;
+            }
+            forward(v, same == -1 ? _func.undef(_func.inst(v).type) : same);
+            return true;
+        }
+
+        bool Folder::foldBranch(int32_t b) {
+            auto& block = _func.block(b);
+            int32_t value;
+            if(block.terminator != Terminator::BRANCH || !isIntConst(_func.inst(block.value), value))
+                return false;
+            auto taken = branchTaken(block.operation, value);
+            auto dead = block.succs[taken ? 1 : 0];
+            _func.removeEdge(b, dead);
+            block.terminator = Terminator::JUMP;
+            block.value = -1;
+            return true;
+        }
+
+        std::int64_t Folder::run() {
+            int64_t changes = 0;
+            bool removed = false;
+            for(bool changed=true; changed; ) {
+                changed = false;
+                _forward.resize(_func.insts().size());
+                for(int32_t v=0; v<static_cast<int32_t>(_forward.size()); v++)
+                    _forward[v] = v;
+                for(auto b : _func.reversePostOrder()) {
+                    // 遍历的时候会删掉指令，先拷贝一份
+                    auto phis = _func.block(b).phis;
+                    for(auto v : phis) {
+                        for(auto& arg : _func.inst(v).args)
+                            arg = resolve(_forward, arg);
+                        if(foldPhi(v)) {
+                            changes++;
+                            changed = true;
+                        }
+                    }
+                    auto body = _func.block(b).body;
+                    for(auto v : body) {
+                        for(auto& arg : _func.inst(v).args)
+                            arg = resolve(_forward, arg);
+                        if(fold(v)) {
+                            changes++;
+                            changed = true;
+                        }
+                    }
+                    auto& block = _func.block(b);
+                    if(block.value != -1)
+                        block.value = resolve(_forward, block.value);
+                    if(foldBranch(b)) {
+                        changes++;
+                        changed = true;
+                        removed = true;
+                    }
+                }
+                while(_forward.size() < _func.insts().size())
+                    _forward.push_back(static_cast<int32_t>(_forward.size()));
+                _func.replaceUses(_forward);
+                if(removed) {
+                    _func.removeUnreachable();
+                    removed = false;
+                }
+            }
+            return changes;
+        }
+    }
+
+    std::int64_t Folding::run(Function& func, ConstantPool& consts) {
+        Folder folder(func, consts);
+        return folder.run();
+    }
+}
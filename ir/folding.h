@@ -0,0 +1,16 @@
+#pragma once
+
+#include "ir/passManager.h"
+
+namespace cc0::ir {
+
+    // 常量折叠和代数化简：
+    // 参数都是常量的运算算出结果（规则和栈式代码上的常量折叠相同：除以 0、INT_MIN / -1、
+    // 超出 int 范围的 d2i 和 NaN 的比较留到运行时），x + 0、x * 1、x / 1 等直接换成 x，
+    // 条件是常量的分支变成无条件跳转并删掉到不了的块，参数都相同的 phi 换成这个参数
+    class Folding final : public Pass {
+    public:
+        const char* name() const override { return "fold"; }
+        std::int64_t run(Function& func, ConstantPool& consts) override;
+    };
+}
@@ -0,0 +1,343 @@
+#include "ir/ir.h"
+
+#include "fmt/format.h"
+
+#include <algorithm>
+
+namespace cc0::ir {
+
+    bool signatureOf(Operation op, Type& operand, std::int32_t& arity, Type& result) {
+        switch(op) {
+            case Operation::IADD: case Operation::ISUB: case Operation::IMUL: case Operation::IDIV: case Operation::ICMP:
+                operand = Type::INT; arity = 2; result = Type::INT; return true;
+            case Operation::INEG: case Operation::I2C:
+                operand = Type::INT; arity = 1; result = Type::INT; return true;
+            case Operation::I2D:
+                operand = Type::INT; arity = 1; result = Type::DOUBLE; return true;
+            case Operation::D2I:
+                operand = Type::DOUBLE; arity = 1; result = Type::INT; return true;
+            case Operation::DADD: case Operation::DSUB: case Operation::DMUL: case Operation::DDIV:
+                operand = Type::DOUBLE; arity = 2; result = Type::DOUBLE; return true;
+            case Operation::DCMP:
+                operand = Type::DOUBLE; arity = 2; result = Type::INT; return true;
+            case Operation::DNEG:
+                operand = Type::DOUBLE; arity = 1; result = Type::DOUBLE; return true;
+            default:
+                return false;
+        }
+    }
+
+    bool hasSideEffects(const Function& func, const Inst& inst) {
+        if(inst.opcode == Opcode::OP && inst.operation == Operation::IDIV) {
+            auto& divisor = func.inst(inst.args[1]);
+            return divisor.opcode != Opcode::CONST || divisor.imm == 0 || divisor.imm == -1;
+        }
+        return inst.opcode == Opcode::STORE || inst.opcode == Opcode::CALL
+               || inst.opcode == Opcode::INPUT || inst.opcode == Opcode::OUTPUT;
+    }
+
+    std::int32_t resolve(std::vector<std::int32_t>& forward, std::int32_t v) {
+        auto root = v;
+        while(forward[root] != root)
+            root = forward[root];
+        while(forward[v] != root) {
+            auto next = forward[v];
+            forward[v] = root;
+            v = next;
+        }
+        return root;
+    }
+
+    Operation invertBranch(Operation op) {
+        switch(op) {
+            case Operation::JE:  return Operation::JNE;
+            case Operation::JNE: return Operation::JE;
+            case Operation::JL:  return Operation::JGE;
+            case Operation::JGE: return Operation::JL;
+            case Operation::JG:  return Operation::JLE;
+            case Operation::JLE: return Operation::JG;
+            default:             return op;
+        }
+    }
+
+    std::int32_t Function::addBlock() {
+        _blocks.emplace_back();
+        return static_cast<int32_t>(_blocks.size()) - 1;
+    }
+
+    std::int32_t Function::add(int32_t b, Inst inst) {
+        auto v = static_cast<int32_t>(_insts.size());
+        inst.block = b;
+        if(b != -1) {
+            auto& block = _blocks[b];
+            (inst.opcode == Opcode::PHI ? block.phis : block.body).push_back(v);
+        }
+        _insts.push_back(std::move(inst));
+        return v;
+    }
+
+    std::int32_t Function::undef(Type type) {
+        auto& v = type == Type::DOUBLE ? _undef_double : _undef_int;
+        // 没有用到时可能已经被删掉了
+        if(v == -1 || _insts[v].opcode != Opcode::UNDEF) {
+            Inst inst;
+            inst.opcode = Opcode::UNDEF;
+            inst.type = type;
+            // 放在入口块最前面，支配所有的使用
+            v = add(-1, std::move(inst));
+            _insts[v].block = 0;
+            auto& body = _blocks[0].body;
+            body.insert(body.begin(), v);
+        }
+        return v;
+    }
+
+    void Function::erase(int32_t v) {
+        auto& inst = _insts[v];
+        if(inst.opcode == Opcode::NOP)
+            return;
+        if(inst.block != -1) {
+            auto& list = inst.opcode == Opcode::PHI ? _blocks[inst.block].phis : _blocks[inst.block].body;
+            list.erase(std::find(list.begin(), list.end(), v));
+        }
+        inst.opcode = Opcode::NOP;
+        inst.args.clear();
+        inst.block = -1;
+    }
+
+    void Function::replaceUses(std::vector<int32_t>& forward) {
+        for(auto& inst : _insts)
+            for(auto& arg : inst.args)
+                arg = resolve(forward, arg);
+        for(auto& block : _blocks)
+            if(block.value != -1)
+                block.value = resolve(forward, block.value);
+    }
+
+    void Function::removeEdge(int32_t from, int32_t to) {
+        auto& target = _blocks[to];
+        auto it = std::find(target.preds.begin(), target.preds.end(), from);
+        if(it == target.preds.end())
+            return;
+        auto index = it - target.preds.begin();
+        target.preds.erase(it);
+        for(auto phi : target.phis)
+            _insts[phi].args.erase(_insts[phi].args.begin() + index);
+        auto& source = _blocks[from].succs;
+        source.erase(std::find(source.begin(), source.end(), to));
+    }
+
+    std::int32_t Function::removeUnreachable() {
+        std::vector<bool> reachable(_blocks.size(), false);
+        for(auto b : reversePostOrder())
+            reachable[b] = true;
+        int32_t removed = 0;
+        for(int32_t b=0; b<static_cast<int32_t>(_blocks.size()); b++) {
+            if(reachable[b] || _blocks[b].removed)
+                continue;
+            auto succs = _blocks[b].succs;
+            for(auto s : succs)
+                removeEdge(b, s);
+            for(auto v : _blocks[b].phis)
+                _insts[v].opcode = Opcode::NOP;
+            for(auto v : _blocks[b].body)
+                _insts[v].opcode = Opcode::NOP;
+            _blocks[b] = Block();
+            _blocks[b].removed = true;
+            removed++;
+        }
+        // 只剩一个前驱的块，phi 直接换成唯一的参数
+        std::vector<int32_t> forward(_insts.size());
+        for(int32_t v=0; v<static_cast<int32_t>(forward.size()); v++)
+            forward[v] = v;
+        bool trivial = false;
+        for(auto& block : _blocks) {
+            if(block.removed || block.preds.size() != 1)
+                continue;
+            for(auto phi : block.phis) {
+                forward[phi] = _insts[phi].args[0];
+                _insts[phi].opcode = Opcode::NOP;
+                trivial = true;
+            }
+            block.phis.clear();
+        }
+        if(trivial)
+            replaceUses(forward);
+        return removed;
+    }
+
+    std::vector<std::int32_t> Function::reversePostOrder() const {
+        std::vector<int32_t> order;
+        std::vector<std::uint8_t> state(_blocks.size(), 0);
+        // 迭代的 DFS，栈里存块和下一个要看的后继
+        std::vector<std::pair<int32_t, std::size_t>> stack{ { 0, 0 } };
+        state[0] = 1;
+        while(!stack.empty()) {
+            auto& [b, next] = stack.back();
+            auto& succs = _blocks[b].succs;
+            if(next < succs.size()) {
+                auto s = succs[next++];
+                if(state[s] == 0) {
+                    state[s] = 1;
+                    stack.emplace_back(s, 0);
+                }
+                continue;
+            }
+            order.push_back(b);
+            stack.pop_back();
+        }
+        std::reverse(order.begin(), order.end());
+        return order;
+    }
+
+    std::vector<std::int32_t> Function::dominators() const {
+        // Cooper-Harvey-Kennedy 的迭代算法
+        auto order = reversePostOrder();
+        std::vector<int32_t> index(_blocks.size(), -1);
+        for(std::size_t i=0; i<order.size(); i++)
+            index[order[i]] = static_cast<int32_t>(i);
+        std::vector<int32_t> idom(_blocks.size(), -1);
+        idom[0] = 0;
+        auto intersect = [&](int32_t a, int32_t b) {
+            while(a != b) {
+                while(index[a] > index[b])
+                    a = idom[a];
+                while(index[b] > index[a])
+                    b = idom[b];
+            }
+            return a;
+        };
+        for(bool changed=true; changed; ) {
+            changed = false;
+            for(std::size_t i=1; i<order.size(); i++) {
+                auto b = order[i];
+                int32_t dom = -1;
+                for(auto p : _blocks[b].preds)
+                    if(idom[p] != -1)
+                        dom = dom == -1 ? p : intersect(p, dom);
+                if(dom != idom[b]) {
+                    idom[b] = dom;
+                    changed = true;
+                }
+            }
+        }
+        return idom;
+    }
+
+    std::vector<std::int32_t> Function::postDominators() const {
+        // 反过来的图上同样的算法，所有 return 的块连到一个虚拟的出口
+        auto exit = static_cast<int32_t>(_blocks.size());
+        std::vector<int32_t> order;
+        std::vector<std::uint8_t> state(_blocks.size() + 1, 0);
+        std::vector<std::pair<int32_t, std::size_t>> stack{ { exit, 0 } };
+        std::vector<int32_t> returns;
+        for(auto b : reversePostOrder())
+            if(_blocks[b].terminator == Terminator::RETURN)
+                returns.push_back(b);
+        state[exit] = 1;
+        while(!stack.empty()) {
+            auto& [b, next] = stack.back();
+            auto& preds = b == exit ? returns : _blocks[b].preds;
+            if(next < preds.size()) {
+                auto p = preds[next++];
+                if(state[p] == 0) {
+                    state[p] = 1;
+                    stack.emplace_back(p, 0);
+                }
+                continue;
+            }
+            order.push_back(b);
+            stack.pop_back();
+        }
+        std::reverse(order.begin(), order.end());
+        std::vector<int32_t> index(_blocks.size() + 1, -1);
+        for(std::size_t i=0; i<order.size(); i++)
+            index[order[i]] = static_cast<int32_t>(i);
+        std::vector<int32_t> ipdom(_blocks.size() + 1, -1);
+        ipdom[exit] = exit;
+        auto intersect = [&](int32_t a, int32_t b) {
+            while(a != b) {
+                while(index[a] > index[b])
+                    a = ipdom[a];
+                while(index[b] > index[a])
+                    b = ipdom[b];
+            }
+            return a;
+        };
+        for(bool changed=true; changed; ) {
+            changed = false;
+            for(std::size_t i=1; i<order.size(); i++) {
+                auto b = order[i];
+                int32_t dom = _blocks[b].terminator == Terminator::RETURN ? exit : -1;
+                for(auto s : _blocks[b].succs)
+                    if(ipdom[s] != -1)
+                        dom = dom == -1 ? s : intersect(s, dom);
+                if(dom != ipdom[b]) {
+                    ipdom[b] = dom;
+                    changed = true;
+                }
+            }
+        }
+        ipdom.pop_back();
+        return ipdom;
+    }
+
+    std::string Function::toString() const {
+        static const char* types[] = { "void", "int", "double" };
+        fmt::memory_buffer buf;
+        auto printInst = [&](int32_t v) {
+            auto& inst = _insts[v];
+            if(inst.type != Type::VOID)
+                fmt::format_to(buf, "    %{}: {} = ", v, types[static_cast<int>(inst.type)]);
+            else
+                fmt::format_to(buf, "    ");
+            switch(inst.opcode) {
+                case Opcode::PARAM:  fmt::format_to(buf, "param {}", inst.imm); break;
+                case Opcode::UNDEF:  fmt::format_to(buf, "undef"); break;
+                case Opcode::CONST:  fmt::format_to(buf, "const {}", inst.imm); break;
+                case Opcode::LOADC:  fmt::format_to(buf, "loadc {}", inst.imm); break;
+                case Opcode::LOAD:   fmt::format_to(buf, "load global {}", inst.imm); break;
+                case Opcode::STORE:  fmt::format_to(buf, "store global {}", inst.imm); break;
+                case Opcode::CALL:   fmt::format_to(buf, "call {}", inst.imm); break;
+                case Opcode::PHI:    fmt::format_to(buf, "phi"); break;
+                case Opcode::NOP:    fmt::format_to(buf, "nop"); break;
+                default:             fmt::format_to(buf, "{}", opcodeInfo(inst.operation).mnemonic); break;
+            }
+            for(std::size_t i=0; i<inst.args.size(); i++)
+                fmt::format_to(buf, "{} %{}", i == 0 ? "" : ",", inst.args[i]);
+            fmt::format_to(buf, "\n");
+        };
+        for(int32_t b=0; b<static_cast<int32_t>(_blocks.size()); b++) {
+            auto& block = _blocks[b];
+            if(block.removed)
+                continue;
+            fmt::format_to(buf, "B{}:", b);
+            if(!block.preds.empty()) {
+                fmt::format_to(buf, "  ; preds");
+                for(auto p : block.preds)
+                    fmt::format_to(buf, " B{}", p);
+            }
+            fmt::format_to(buf, "\n");
+            for(auto v : block.phis)
+                printInst(v);
+            for(auto v : block.body)
+                printInst(v);
+            switch(block.terminator) {
+                case Terminator::JUMP:
+                    fmt::format_to(buf, "    jmp B{}\n", block.succs[0]);
+                    break;
+                case Terminator::BRANCH:
+                    fmt::format_to(buf, "    {} %{}, B{}, B{}\n", opcodeInfo(block.operation).mnemonic, block.value,
+                                   block.succs[0], block.succs[1]);
+                    break;
+                case Terminator::RETURN:
+                    if(block.value != -1)
+                        fmt::format_to(buf, "    {} %{}\n", opcodeInfo(block.operation).mnemonic, block.value);
+                    else
+                        fmt::format_to(buf, "    {}\n", opcodeInfo(block.operation).mnemonic);
+                    break;
+            }
+        }
+        return fmt::to_string(buf);
+    }
+}
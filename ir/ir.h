@@ -0,0 +1,129 @@
+#pragma once
+
+#include "instruction/instruction.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace cc0::ir {
+
+    // 中间表示：SSA 形式的寄存器代码
+    // 每个值由一条指令定义、只赋值一次，有 int 或 double 类型；
+    // 基本块开头的 phi 按前驱的顺序从各个前驱取值。
+    // 栈式代码里的局部变量、参数和操作数栈上的临时值在这里都是普通的值，
+    // 只有全局变量的读写还是内存操作
+
+    enum class Type : std::uint8_t {
+        VOID,
+        INT,     // int、char、字符串常量的地址，占 1 个 slot
+        DOUBLE   // 占 2 个 slot
+    };
+
+    inline std::int32_t slotsOf(Type type) {
+        return type == Type::DOUBLE ? 2 : (type == Type::INT ? 1 : 0);
+    }
+
+    enum class Opcode : std::uint8_t {
+        PARAM,    // 参数，imm 是它在栈帧里的 slot
+        UNDEF,    // 没有初始化的值（snew 分配的 slot）
+        CONST,    // int 常量，值是 imm
+        LOADC,    // 常量池里的 double 或字符串，imm 是下标
+        OP,       // 纯运算，operation 是 iadd、dcmp、i2d 等
+        LOAD,     // 读全局变量，imm 是偏移
+        STORE,    // 写全局变量，imm 是偏移
+        CALL,     // 调用函数，imm 是函数下标，返回 void 时 type 是 VOID
+        INPUT,    // iscan、dscan、cscan
+        OUTPUT,   // iprint、dprint、cprint、sprint、printl
+        PHI,
+        NOP       // 删掉的指令
+    };
+
+    // 一条指令，它的下标就是它定义的值的编号
+    struct Inst {
+        Opcode opcode = Opcode::NOP;
+        Operation operation = Operation::NOP;
+        Type type = Type::VOID;
+        std::int32_t imm = 0;
+        std::vector<std::int32_t> args;   // phi 的参数和所在块的 preds 一一对应
+        std::int32_t block = -1;          // 所在的块
+    };
+
+    enum class Terminator : std::uint8_t {
+        JUMP,     // 跳到 succs[0]
+        BRANCH,   // operation 是 je..jle，value 满足条件跳到 succs[0]，否则到 succs[1]
+        RETURN    // operation 是 ret、iret、dret，返回 value（ret 没有）
+    };
+
+    struct Block {
+        std::vector<std::int32_t> phis;
+        std::vector<std::int32_t> body;
+        Terminator terminator = Terminator::RETURN;
+        Operation operation = Operation::RET;
+        std::int32_t value = -1;
+        std::vector<std::int32_t> succs;
+        std::vector<std::int32_t> preds;
+        bool removed = false;
+    };
+
+    // 一个函数的中间表示，块 0 是入口，块的先后顺序就是生成栈式代码时的排列顺序
+    class Function final {
+    private:
+        using int32_t = std::int32_t;
+
+    public:
+        explicit Function(int32_t paramsSize) : _params_size(paramsSize) {}
+
+        int32_t getParamsSize() const { return _params_size; }
+
+        std::vector<Inst>& insts() { return _insts; }
+        const std::vector<Inst>& insts() const { return _insts; }
+        Inst& inst(int32_t v) { return _insts[v]; }
+        const Inst& inst(int32_t v) const { return _insts[v]; }
+        std::vector<Block>& blocks() { return _blocks; }
+        const std::vector<Block>& blocks() const { return _blocks; }
+        Block& block(int32_t b) { return _blocks[b]; }
+        const Block& block(int32_t b) const { return _blocks[b]; }
+
+        int32_t addBlock();
+        // 新建一条指令，追加到块 b 的末尾（phi 追加到 phis），b 为 -1 时不放进任何块
+        int32_t add(int32_t b, Inst inst);
+        // 某个类型的 UNDEF，整个函数共用一个，放在入口块
+        int32_t undef(Type type);
+
+        // 把指令从所在的块里拿掉，变成 NOP
+        void erase(int32_t v);
+        // 按 forward 替换所有参数（forward[v] == v 表示不替换，可以成链）
+        void replaceUses(std::vector<int32_t>& forward);
+        // 删掉块 from -> to 这条边，to 的 phi 去掉对应的参数
+        void removeEdge(int32_t from, int32_t to);
+        // 删掉从入口到不了的块，返回删掉的块数
+        int32_t removeUnreachable();
+
+        // 可达块的逆后序
+        std::vector<int32_t> reversePostOrder() const;
+        // 每个块的直接支配者，入口是它自己，不可达的是 -1
+        std::vector<int32_t> dominators() const;
+        // 每个块的直接后必经块，只会接着 return 的是 blocks().size()，到不了 return 的是 -1
+        std::vector<int32_t> postDominators() const;
+
+        std::string toString() const;
+
+    private:
+        int32_t _params_size;
+        std::vector<Inst> _insts;
+        std::vector<Block> _blocks;
+        int32_t _undef_int = -1;
+        int32_t _undef_double = -1;
+    };
+
+    // 纯运算的操作数类型、个数和结果类型，不是纯运算时返回 false
+    bool signatureOf(Operation op, Type& operand, std::int32_t& arity, Type& result);
+    // 指令有没有副作用（不能删掉、不能和别的副作用交换顺序）；读全局变量不算。
+    // 除数不是 0、-1 以外的常量的 idiv 可能在运行时报错，也算有副作用
+    bool hasSideEffects(const Function& func, const Inst& inst);
+    // 对 v 做 find，并把路径上的 forward 直接指向结果
+    std::int32_t resolve(std::vector<std::int32_t>& forward, std::int32_t v);
+    // 条件相反的跳转
+    Operation invertBranch(Operation op);
+}
@@ -0,0 +1,630 @@
+#include "ir/lifting.h"
+#include "optimizer/cfg.h"
+
+#include <utility>
+
+namespace cc0::ir {
+
+    namespace {
+        // 栈上一个 slot 里放的东西：某个值的第 part 个 slot，或者 loada 压入的地址
+        struct Word {
+            std::int32_t value = -1;   // -1 表示没有初始化
+            std::int32_t part = 0;
+            bool address = false;
+            std::int32_t level = 0;
+            std::int32_t offset = 0;
+        };
+
+        // 推算汇合处每个 slot 的类型用的格
+        struct WordType {
+            enum Kind : std::uint8_t { NONE, INT, LOW, HIGH, ADDRESS, CONFLICT };
+            Kind kind = NONE;
+            std::int32_t level = 0;
+            std::int32_t offset = 0;
+
+            bool operator==(const WordType& rhs) const {
+                return kind == rhs.kind && (kind != ADDRESS || (level == rhs.level && offset == rhs.offset));
+            }
+        };
+
+        WordType join(const WordType& a, const WordType& b) {
+            if(a.kind == WordType::NONE)
+                return b;
+            if(b.kind == WordType::NONE || a == b)
+                return a;
+            return WordType{ WordType::CONFLICT };
+        }
+
+        // 只看类型模拟一条指令，认不出的指令返回 false
+        bool simulateTypes(const Instruction& instruction, std::vector<WordType>& stack,
+                           const ConstantPool& consts, const std::vector<CallEffect>& calls) {
+            auto op = instruction.getOperation();
+            std::int32_t pop, push;
+            if(!stackEffect(instruction, consts, calls, pop, push) || pop > static_cast<std::int32_t>(stack.size()))
+                return false;
+            auto top = [&](std::int32_t k) { return stack[stack.size() - 1 - k]; };
+            switch(op) {
+                case Operation::LOADA:
+                    stack.push_back(WordType{ WordType::ADDRESS, instruction.getX(), instruction.getY() });
+                    return true;
+                case Operation::ILOAD:
+                case Operation::DLOAD: {
+                    auto address = top(0);
+                    stack.pop_back();
+                    for(std::int32_t k=0; k<push; k++) {
+                        if(address.kind == WordType::ADDRESS && address.level == 0) {
+                            if(address.offset + k >= static_cast<std::int32_t>(stack.size()))
+                                return false;
+                            stack.push_back(stack[address.offset + k]);
+                        }
+                        else
+                            stack.push_back(WordType{ push == 1 ? WordType::INT : (k == 0 ? WordType::LOW : WordType::HIGH) });
+                    }
+                    return true;
+                }
+                case Operation::ISTORE:
+                case Operation::DSTORE: {
+                    auto address = top(pop - 1);
+                    std::vector<WordType> value(stack.end() - (pop - 1), stack.end());
+                    stack.resize(stack.size() - pop);
+                    if(address.kind == WordType::ADDRESS && address.level == 0) {
+                        if(address.offset + pop - 1 > static_cast<std::int32_t>(stack.size()))
+                            return false;
+                        for(std::int32_t k=0; k<pop-1; k++)
+                            stack[address.offset + k] = value[k];
+                    }
+                    return true;
+                }
+                case Operation::DUP:
+                case Operation::DUP2:
+                    for(std::int32_t k=0; k<pop; k++)
+                        stack.push_back(stack[stack.size() - pop]);
+                    return true;
+                default:
+                    stack.resize(stack.size() - pop);
+                    if(op == Operation::SNEW)
+                        stack.resize(stack.size() + push);
+                    else if(push == 1)
+                        stack.push_back(WordType{ WordType::INT });
+                    else if(push == 2) {
+                        stack.push_back(WordType{ WordType::LOW });
+                        stack.push_back(WordType{ WordType::HIGH });
+                    }
+                    return true;
+            }
+        }
+
+        class Lifter final {
+        private:
+            using int32_t = std::int32_t;
+
+        public:
+            Lifter(const std::vector<Instruction>& code, int32_t paramsSize, const ConstantPool& consts,
+                   const std::vector<CallEffect>& calls)
+                : _code(code), _consts(consts), _calls(calls), _cfg(code), _func(paramsSize) {}
+
+            std::optional<Function> run();
+
+        private:
+            // 参数里哪些是 double：函数里用 dload 读过它
+            bool findParams();
+            // 推算每个块开头各个 slot 的类型
+            bool inferTypes();
+            // 模拟一个块，生成指令和跳转，exit 是离开块时的栈
+            bool liftBlock(int32_t c);
+            // 汇合处的 phi 从各个前驱离开时的栈取值
+            bool fillPhis();
+            // 删掉参数都相同的 phi
+            void removeTrivialPhis();
+
+            // 把栈上的 slot 读成 int/double 值，类型对不上时返回 -1
+            int32_t intOf(const Word& word);
+            int32_t doubleOf(const Word& low, const Word& high);
+
+            int32_t emit(int32_t b, Opcode opcode, Operation operation, Type type, int32_t imm,
+                         std::vector<int32_t> args = {}) {
+                Inst inst;
+                inst.opcode = opcode;
+                inst.operation = operation;
+                inst.type = type;
+                inst.imm = imm;
+                inst.args = std::move(args);
+                return _func.add(b, std::move(inst));
+            }
+
+        private:
+            const std::vector<Instruction>& _code;
+            const ConstantPool& _consts;
+            const std::vector<CallEffect>& _calls;
+            ControlFlowGraph _cfg;
+            Function _func;
+            std::vector<int32_t> _depths;
+            std::vector<bool> _double_param;
+            std::vector<std::vector<WordType>> _entry_types;  // 按控制流图的块
+            std::vector<int32_t> _block_of;                   // 控制流图的块 -> IR 的块
+            std::vector<std::vector<Word>> _exit;             // IR 的块离开时的栈
+            std::vector<std::vector<std::pair<int32_t, int32_t>>> _phi_slots;  // IR 的块里 phi 对应的 slot
+        };
+
+        std::int32_t Lifter::intOf(const Word& word) {
+            if(word.address)
+                return -1;
+            if(word.value == -1)
+                return _func.undef(Type::INT);
+            auto& inst = _func.inst(word.value);
+            return inst.type == Type::INT && word.part == 0 ? word.value : -1;
+        }
+
+        std::int32_t Lifter::doubleOf(const Word& low, const Word& high) {
+            if(low.address || high.address)
+                return -1;
+            if(low.value == -1 && high.value == -1)
+                return _func.undef(Type::DOUBLE);
+            if(low.value != high.value || low.part != 0 || high.part != 1)
+                return -1;
+            return _func.inst(low.value).type == Type::DOUBLE ? low.value : -1;
+        }
+
+        bool Lifter::findParams() {
+            auto params = _func.getParamsSize();
+            _double_param.assign(params, false);
+            for(std::size_t i=0; i+1<_code.size(); i++) {
+                auto& instruction = _code[i];
+                if(instruction.getOperation() == Operation::LOADA && instruction.getX() == 0
+                   && instruction.getY() < params && _code[i + 1].getOperation() == Operation::DLOAD) {
+                    auto k = instruction.getY();
+                    if(k + 1 >= params)
+                        return false;
+                    _double_param[k] = true;
+                }
+            }
+            for(int32_t k=0; k+1<params; k++)
+                if(_double_param[k] && _double_param[k + 1])
+                    return false;
+            return true;
+        }
+
+        bool Lifter::inferTypes() {
+            auto& blocks = _cfg.blocks();
+            _entry_types.assign(blocks.size(), {});
+            std::vector<bool> visited(blocks.size(), false);
+            auto& entry = _entry_types[0];
+            for(int32_t k=0; k<_func.getParamsSize(); k++) {
+                if(_double_param[k]) {
+                    entry.push_back(WordType{ WordType::LOW });
+                    entry.push_back(WordType{ WordType::HIGH });
+                    k++;
+                }
+                else
+                    entry.push_back(WordType{ WordType::INT });
+            }
+            std::vector<int32_t> work{ 0 };
+            visited[0] = true;
+            while(!work.empty()) {
+                auto b = work.back();
+                work.pop_back();
+                auto stack = _entry_types[b];
+                for(auto i=blocks[b].begin; i<blocks[b].end; i++)
+                    if(!simulateTypes(_code[i], stack, _consts, _calls))
+                        return false;
+                for(auto s : blocks[b].succs) {
+                    auto& types = _entry_types[s];
+                    if(!visited[s]) {
+                        visited[s] = true;
+                        types = stack;
+                        work.push_back(s);
+                        continue;
+                    }
+                    if(types.size() != stack.size())
+                        return false;
+                    bool changed = false;
+                    for(std::size_t k=0; k<types.size(); k++) {
+                        auto joined = join(types[k], stack[k]);
+                        if(!(joined == types[k])) {
+                            types[k] = joined;
+                            changed = true;
+                        }
+                    }
+                    if(changed)
+                        work.push_back(s);
+                }
+            }
+            return true;
+        }
+
+        bool Lifter::liftBlock(int32_t c) {
+            auto& block = _cfg.block(c);
+            auto b = _block_of[c];
+            auto& ir = _func.block(b);
+
+            // 只有一个前驱时直接继承它离开时的栈，否则每个 slot 一个 phi
+            std::vector<Word> stack;
+            if(ir.preds.size() == 1)
+                stack = _exit[ir.preds[0]];
+            else {
+                auto& types = _entry_types[c];
+                stack.resize(types.size());
+                for(std::size_t k=0; k<types.size(); k++) {
+                    if(types[k].kind == WordType::INT) {
+                        stack[k].value = emit(b, Opcode::PHI, Operation::NOP, Type::INT, 0);
+                        _phi_slots[b].emplace_back(stack[k].value, static_cast<int32_t>(k));
+                    }
+                    else if(types[k].kind == WordType::LOW && k + 1 < types.size() && types[k + 1].kind == WordType::HIGH) {
+                        auto v = emit(b, Opcode::PHI, Operation::NOP, Type::DOUBLE, 0);
+                        _phi_slots[b].emplace_back(v, static_cast<int32_t>(k));
+                        stack[k] = Word{ v, 0 };
+                        stack[k + 1] = Word{ v, 1 };
+                        k++;
+                    }
+                    else if(types[k].kind == WordType::ADDRESS) {
+                        // 所有路径上都是同一个地址（比如展开的函数调用前压好的赋值目标）
+                        stack[k].address = true;
+                        stack[k].level = types[k].level;
+                        stack[k].offset = types[k].offset;
+                    }
+                }
+            }
+
+            auto pushValue = [&](int32_t v) {
+                stack.push_back(Word{ v, 0 });
+                if(_func.inst(v).type == Type::DOUBLE)
+                    stack.push_back(Word{ v, 1 });
+            };
+            auto popWord = [&](Word& word) {
+                if(stack.empty())
+                    return false;
+                word = stack.back();
+                stack.pop_back();
+                return true;
+            };
+            auto popValue = [&](Type type, int32_t& v) {
+                Word low, high;
+                if(type == Type::DOUBLE) {
+                    if(!popWord(high) || !popWord(low))
+                        return false;
+                    v = doubleOf(low, high);
+                }
+                else {
+                    if(!popWord(low))
+                        return false;
+                    v = intOf(low);
+                }
+                return v != -1;
+            };
+
+            for(auto i=block.begin; i<block.end; i++) {
+                auto& instruction = _code[i];
+                auto op = instruction.getOperation();
+                Type operand, result;
+                int32_t arity;
+                if(signatureOf(op, operand, arity, result)) {
+                    std::vector<int32_t> args(arity);
+                    for(auto k=arity-1; k>=0; k--)
+                        if(!popValue(operand, args[k]))
+                            return false;
+                    pushValue(emit(b, Opcode::OP, op, result, 0, std::move(args)));
+                    continue;
+                }
+                int32_t v;
+                Word word, low, high;
+                switch(op) {
+                    case Operation::NOP:
+                        break;
+                    case Operation::BIPUSH:
+                    case Operation::IPUSH:
+                        pushValue(emit(b, Opcode::CONST, Operation::NOP, Type::INT, instruction.getX()));
+                        break;
+                    case Operation::LOADC: {
+                        auto index = instruction.getX();
+                        auto type = _consts.getType(index);
+                        if(type == INT_CONSTANT)
+                            pushValue(emit(b, Opcode::CONST, Operation::NOP, Type::INT, _consts.getInt(index)));
+                        else
+                            pushValue(emit(b, Opcode::LOADC, Operation::NOP, type == DOUBLE_CONSTANT ? Type::DOUBLE : Type::INT, index));
+                        break;
+                    }
+                    case Operation::LOADA:
+                        if(instruction.getX() != 0 && instruction.getX() != 1)
+                            return false;
+                        word.address = true;
+                        word.level = instruction.getX();
+                        word.offset = instruction.getY();
+                        stack.push_back(word);
+                        break;
+                    case Operation::ILOAD:
+                    case Operation::DLOAD: {
+                        auto slots = op == Operation::DLOAD ? 2 : 1;
+                        if(!popWord(word) || !word.address)
+                            return false;
+                        if(word.level == 1) {
+                            pushValue(emit(b, Opcode::LOAD, Operation::NOP, slots == 2 ? Type::DOUBLE : Type::INT, word.offset));
+                            break;
+                        }
+                        // 局部的 slot 原样复制，double 的一半也可以
+                        if(word.offset + slots > static_cast<int32_t>(stack.size()))
+                            return false;
+                        for(int32_t k=0; k<slots; k++) {
+                            if(stack[word.offset + k].address)
+                                return false;
+                            stack.push_back(stack[word.offset + k]);
+                        }
+                        break;
+                    }
+                    case Operation::ISTORE:
+                    case Operation::DSTORE: {
+                        auto slots = op == Operation::DSTORE ? 2 : 1;
+                        std::vector<Word> value(slots);
+                        for(auto k=slots-1; k>=0; k--)
+                            if(!popWord(value[k]) || value[k].address)
+                                return false;
+                        if(!popWord(word) || !word.address)
+                            return false;
+                        if(word.level == 1) {
+                            v = slots == 2 ? doubleOf(value[0], value[1]) : intOf(value[0]);
+                            if(v == -1)
+                                return false;
+                            emit(b, Opcode::STORE, Operation::NOP, Type::VOID, word.offset, { v });
+                            break;
+                        }
+                        if(word.offset + slots > static_cast<int32_t>(stack.size()))
+                            return false;
+                        for(int32_t k=0; k<slots; k++)
+                            stack[word.offset + k] = value[k];
+                        break;
+                    }
+                    case Operation::DUP:
+                    case Operation::DUP2: {
+                        auto slots = op == Operation::DUP2 ? 2 : 1;
+                        if(static_cast<int32_t>(stack.size()) < slots)
+                            return false;
+                        for(int32_t k=0; k<slots; k++)
+                            stack.push_back(stack[stack.size() - slots]);
+                        break;
+                    }
+                    case Operation::POP:
+                    case Operation::POP2:
+                    case Operation::POPN: {
+                        auto slots = op == Operation::POP ? 1 : (op == Operation::POP2 ? 2 : instruction.getX());
+                        if(static_cast<int32_t>(stack.size()) < slots)
+                            return false;
+                        stack.resize(stack.size() - slots);
+                        break;
+                    }
+                    case Operation::SNEW:
+                        stack.resize(stack.size() + instruction.getX());
+                        break;
+                    case Operation::CALL: {
+                        auto f = instruction.getX();
+                        if(f < 0 || f >= static_cast<int32_t>(_calls.size()))
+                            return false;
+                        auto& effect = _calls[f];
+                        if(static_cast<int32_t>(stack.size()) < effect.pop)
+                            return false;
+                        // 实参按 slot 分组：double 的两半连在一起时是一个 double，其余是 int
+                        std::vector<Word> words(stack.end() - effect.pop, stack.end());
+                        stack.resize(stack.size() - effect.pop);
+                        std::vector<int32_t> args;
+                        for(std::size_t k=0; k<words.size(); ) {
+                            auto& w = words[k];
+                            if(w.value != -1 && !w.address && _func.inst(w.value).type == Type::DOUBLE) {
+                                if(k + 1 >= words.size() || (v = doubleOf(w, words[k + 1])) == -1)
+                                    return false;
+                                k += 2;
+                            }
+                            else {
+                                if((v = intOf(w)) == -1)
+                                    return false;
+                                k++;
+                            }
+                            args.push_back(v);
+                        }
+                        auto type = effect.push == 2 ? Type::DOUBLE : (effect.push == 1 ? Type::INT : Type::VOID);
+                        v = emit(b, Opcode::CALL, Operation::NOP, type, f, std::move(args));
+                        if(type != Type::VOID)
+                            pushValue(v);
+                        break;
+                    }
+                    case Operation::IPRINT:
+                    case Operation::CPRINT:
+                    case Operation::SPRINT:
+                    case Operation::DPRINT:
+                        if(!popValue(op == Operation::DPRINT ? Type::DOUBLE : Type::INT, v))
+                            return false;
+                        emit(b, Opcode::OUTPUT, op, Type::VOID, 0, { v });
+                        break;
+                    case Operation::PRINTL:
+                        emit(b, Opcode::OUTPUT, op, Type::VOID, 0);
+                        break;
+                    case Operation::ISCAN:
+                    case Operation::CSCAN:
+                    case Operation::DSCAN:
+                        pushValue(emit(b, Opcode::INPUT, op, op == Operation::DSCAN ? Type::DOUBLE : Type::INT, 0));
+                        break;
+                    case Operation::JMP:
+                        break;
+                    case Operation::JE: case Operation::JNE: case Operation::JL:
+                    case Operation::JGE: case Operation::JG: case Operation::JLE:
+                        if(!popValue(Type::INT, v))
+                            return false;
+                        if(ir.terminator == Terminator::BRANCH) {
+                            ir.operation = op;
+                            ir.value = v;
+                        }
+                        break;
+                    case Operation::RET:
+                        break;
+                    case Operation::IRET:
+                    case Operation::DRET:
+                        if(!popValue(op == Operation::DRET ? Type::DOUBLE : Type::INT, v))
+                            return false;
+                        ir.value = v;
+                        break;
+                    default:
+                        return false;
+                }
+            }
+            _exit[b] = std::move(stack);
+            return true;
+        }
+
+        bool Lifter::fillPhis() {
+            for(int32_t b=0; b<static_cast<int32_t>(_func.blocks().size()); b++) {
+                auto& block = _func.block(b);
+                for(auto [phi, k] : _phi_slots[b]) {
+                    auto type = _func.inst(phi).type;
+                    std::vector<int32_t> args;
+                    for(auto p : block.preds) {
+                        auto& exit = _exit[p];
+                        if(k + slotsOf(type) > static_cast<int32_t>(exit.size()))
+                            return false;
+                        auto v = type == Type::DOUBLE ? doubleOf(exit[k], exit[k + 1]) : intOf(exit[k]);
+                        // 类型对不上的 slot 在汇合处已经没用了（比如共用 slot 的两个变量），当作未初始化
+                        if(v == -1)
+                            v = _func.undef(type);
+                        args.push_back(v);
+                    }
+                    _func.inst(phi).args = std::move(args);
+                }
+            }
+            return true;
+        }
+
+        void Lifter::removeTrivialPhis() {
+            auto& insts = _func.insts();
+            std::vector<int32_t> forward(insts.size());
+            for(int32_t v=0; v<static_cast<int32_t>(forward.size()); v++)
+                forward[v] = v;
+            // 去掉一个 phi 可能让别的 phi 变得多余，直到不再变化
+            for(bool changed=true; changed; ) {
+                changed = false;
+                for(auto& block : _func.blocks()) {
+                    for(auto phi : block.phis) {
+                        if(insts[phi].opcode != Opcode::PHI)
+                            continue;
+                        int32_t same = -1;
+                        bool trivial = true;
+                        for(auto arg : insts[phi].args) {
+                            arg = resolve(forward, arg);
+                            if(arg == phi || arg == same)
+                                continue;
+                            if(same != -1) {
+                                trivial = false;
+                                break;
+                            }
+                            same = arg;
+                        }
+                        if(!trivial)
+                            continue;
+                        if(same == -1) {
+                            same = _func.undef(insts[phi].type);
+                            while(forward.size() < insts.size())
+                                forward.push_back(static_cast<int32_t>(forward.size()));
+                        }
+                        forward[phi] = same;
+                        insts[phi].opcode = Opcode::NOP;
+                        changed = true;
+                    }
+                }
+            }
+            for(auto& block : _func.blocks()) {
+                std::vector<int32_t> phis;
+                for(auto phi : block.phis)
+                    if(insts[phi].opcode == Opcode::PHI)
+                        phis.push_back(phi);
+                block.phis.swap(phis);
+            }
+            // 中途可能新建了 UNDEF
+            for(auto v=static_cast<int32_t>(forward.size()); v<static_cast<int32_t>(insts.size()); v++)
+                forward.push_back(v);
+            _func.replaceUses(forward);
+        }
+
+        std::optional<Function> Lifter::run() {
+            auto n = static_cast<int32_t>(_code.size());
+            if(n == 0)
+                return std::nullopt;
+            _depths = stackDepths(_code, _func.getParamsSize(), _consts, _calls);
+            if(_depths.empty() || !findParams() || !inferTypes())
+                return std::nullopt;
+
+            // 块 0 是入口，定义参数；控制流图里可达的块按原来的顺序排在后面
+            auto& blocks = _cfg.blocks();
+            auto entry = _func.addBlock();
+            _block_of.assign(blocks.size(), -1);
+            for(int32_t c=0; c<static_cast<int32_t>(blocks.size()); c++)
+                if(_cfg.isReachable(c))
+                    _block_of[c] = _func.addBlock();
+            _exit.resize(_func.blocks().size());
+            _phi_slots.resize(_func.blocks().size());
+
+            // 先连好所有的边，phi 的参数按 preds 的顺序
+            auto link = [&](int32_t from, int32_t to) {
+                _func.block(from).succs.push_back(to);
+                _func.block(to).preds.push_back(from);
+            };
+            _func.block(entry).terminator = Terminator::JUMP;
+            link(entry, _block_of[0]);
+            for(int32_t c=0; c<static_cast<int32_t>(blocks.size()); c++) {
+                auto b = _block_of[c];
+                if(b == -1)
+                    continue;
+                auto& ir = _func.block(b);
+                auto& last = _code[blocks[c].end - 1];
+                auto op = last.getOperation();
+                auto next = _cfg.blockOf(blocks[c].end);
+                if(opcodeInfo(op).is_return) {
+                    ir.terminator = Terminator::RETURN;
+                    ir.operation = op;
+                }
+                else if(op == Operation::JMP) {
+                    if(last.getX() >= n)
+                        return std::nullopt;
+                    ir.terminator = Terminator::JUMP;
+                    link(b, _block_of[_cfg.blockOf(last.getX())]);
+                }
+                else if(opcodeInfo(op).is_branch) {
+                    if(last.getX() >= n || next == -1)
+                        return std::nullopt;
+                    auto taken = _block_of[_cfg.blockOf(last.getX())];
+                    auto fallthrough = _block_of[next];
+                    // 两个方向相同时条件只算不用
+                    ir.terminator = taken == fallthrough ? Terminator::JUMP : Terminator::BRANCH;
+                    link(b, taken);
+                    if(taken != fallthrough)
+                        link(b, fallthrough);
+                }
+                else {
+                    // 顺序执行到下一个块，不能执行到函数末尾
+                    if(next == -1)
+                        return std::nullopt;
+                    ir.terminator = Terminator::JUMP;
+                    link(b, _block_of[next]);
+                }
+            }
+
+            auto& exit = _exit[entry];
+            for(int32_t k=0; k<_func.getParamsSize(); k++) {
+                auto type = _double_param[k] ? Type::DOUBLE : Type::INT;
+                auto v = emit(entry, Opcode::PARAM, Operation::NOP, type, k);
+                exit.push_back(Word{ v, 0 });
+                if(type == Type::DOUBLE) {
+                    exit.push_back(Word{ v, 1 });
+                    k++;
+                }
+            }
+            for(auto c : _cfg.reversePostOrder())
+                if(!liftBlock(c))
+                    return std::nullopt;
+            if(!fillPhis())
+                return std::nullopt;
+            removeTrivialPhis();
+            return std::move(_func);
+        }
+    }
+
+    std::optional<Function> lift(const std::vector<Instruction>& code, std::int32_t paramsSize,
+                                 const ConstantPool& consts, const std::vector<CallEffect>& calls) {
+        Lifter lifter(code, paramsSize, consts, calls);
+        return lifter.run();
+    }
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "analyser/constantPool.h"
+#include "ir/ir.h"
+#include "optimizer/stackDepth.h"
+
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+namespace cc0::ir {
+
+    // 把一个函数的栈式代码变成 SSA：
+    // 栈帧里的每个 slot（参数、局部变量、操作数栈上的临时值）都当作变量，
+    // 沿基本块模拟操作数栈，loada 0 + iload/istore 变成直接使用/重新定义变量，
+    // 有多个前驱的块开头给每个 slot 放一个 phi，最后删掉多余的 phi。
+    // double 占的两个 slot 必须作为一个整体使用（整体读写或者逐个 slot 原样拷贝）。
+    // 认不出的代码（数组、读写地址不确定、栈深度或者 slot 的类型在汇合处对不上）返回空，
+    // 这样的函数保持原来的代码
+    std::optional<Function> lift(const std::vector<Instruction>& code, std::int32_t paramsSize,
+                                 const ConstantPool& consts, const std::vector<CallEffect>& calls);
+}
@@ -0,0 +1,181 @@
+#include "ir/loopInvariants.h"
+
+#include <algorithm>
+#include <map>
+
+namespace cc0::ir {
+
+    namespace {
+        class Hoister final {
+        private:
+            using int32_t = std::int32_t;
+            using int64_t = std::int64_t;
+
+        public:
+            explicit Hoister(Function& func) : _func(func) {}
+
+            int64_t run();
+
+        private:
+            // a 是否支配 b
+            bool dominates(int32_t a, int32_t b) const {
+                while(b != a && b != 0 && b != -1)
+                    b = _idom[b];
+                return b == a;
+            }
+            // 回边的起点往回走到 header 为止，得到循环里所有的块
+            std::vector<bool> bodyOf(int32_t header, const std::vector<int32_t>& latches) const;
+            // 找到或者插入 preheader，没有唯一的外部前驱时返回 -1
+            int32_t preheaderOf(int32_t header, const std::vector<bool>& body);
+            int64_t hoist(int32_t header, const std::vector<int32_t>& latches);
+
+        private:
+            Function& _func;
+            std::vector<int32_t> _idom;
+        };
+
+        std::vector<bool> Hoister::bodyOf(int32_t header, const std::vector<int32_t>& latches) const {
+            std::vector<bool> body(_func.blocks().size(), false);
+            body[header] = true;
+            std::vector<int32_t> work;
+            for(auto latch : latches)
+                if(!body[latch]) {
+                    body[latch] = true;
+                    work.push_back(latch);
+                }
+            while(!work.empty()) {
+                auto b = work.back();
+                work.pop_back();
+                for(auto p : _func.block(b).preds)
+                    if(!body[p]) {
+                        body[p] = true;
+                        work.push_back(p);
+                    }
+            }
+            return body;
+        }
+
+        std::int32_t Hoister::preheaderOf(int32_t header, const std::vector<bool>& body) {
+            int32_t outside = -1;
+            for(auto p : _func.block(header).preds) {
+                if(body[p])
+                    continue;
+                if(outside != -1)
+                    return -1;
+                outside = p;
+            }
+            if(outside == -1)
+                return -1;
+            if(_func.block(outside).succs.size() == 1)
+                return outside;
+            // 在 outside -> header 这条边上插一个块，header 的 phi 参数顺序不变
+            auto pre = _func.addBlock();
+            auto& block = _func.block(pre);
+            block.terminator = Terminator::JUMP;
+            block.succs.push_back(header);
+            block.preds.push_back(outside);
+            auto& succs = _func.block(outside).succs;
+            *std::find(succs.begin(), succs.end(), header) = pre;
+            auto& preds = _func.block(header).preds;
+            *std::find(preds.begin(), preds.end(), outside) = pre;
+            _idom.push_back(outside);
+            _idom[header] = pre;
+            return pre;
+        }
+
+        std::int64_t Hoister::hoist(int32_t header, const std::vector<int32_t>& latches) {
+            auto body = bodyOf(header, latches);
+            auto pre = preheaderOf(header, body);
+            if(pre == -1)
+                return 0;
+            body.resize(_func.blocks().size(), false);
+
+            // 循环里写到的全局变量，有 call 时所有的全局变量都可能被改
+            bool calls = false;
+            std::vector<std::pair<int32_t, int32_t>> stores;
+            std::vector<int32_t> order;
+            for(auto b : _func.reversePostOrder()) {
+                if(!body[b])
+                    continue;
+                order.push_back(b);
+                for(auto v : _func.block(b).body) {
+                    auto& inst = _func.inst(v);
+                    if(inst.opcode == Opcode::CALL)
+                        calls = true;
+                    else if(inst.opcode == Opcode::STORE)
+                        stores.emplace_back(inst.imm, inst.imm + slotsOf(_func.inst(inst.args[0]).type));
+                }
+            }
+            auto invariantLoad = [&](const Inst& inst) {
+                if(calls)
+                    return false;
+                auto end = inst.imm + slotsOf(inst.type);
+                for(auto [begin, stop] : stores)
+                    if(begin < end && inst.imm < stop)
+                        return false;
+                return true;
+            };
+            auto hoistable = [&](const Inst& inst) {
+                switch(inst.opcode) {
+                    case Opcode::CONST:
+                    case Opcode::LOADC:
+                        return true;
+                    case Opcode::LOAD:
+                        return invariantLoad(inst);
+                    case Opcode::OP:
+                        return inst.operation != Operation::DDIV && !hasSideEffects(_func, inst);
+                    default:
+                        return false;
+                }
+            };
+
+            int64_t hoisted = 0;
+            for(auto b : order) {
+                auto& block = _func.block(b);
+                std::vector<int32_t> kept;
+                for(auto v : block.body) {
+                    auto& inst = _func.inst(v);
+                    bool invariant = hoistable(inst);
+                    for(auto arg : inst.args)
+                        if(body[_func.inst(arg).block])
+                            invariant = false;
+                    if(!invariant) {
+                        kept.push_back(v);
+                        continue;
+                    }
+                    inst.block = pre;
+                    _func.block(pre).body.push_back(v);
+                    if(inst.opcode == Opcode::OP || inst.opcode == Opcode::LOAD)
+                        hoisted++;
+                }
+                _func.block(b).body.swap(kept);
+            }
+            return hoisted;
+        }
+
+        std::int64_t Hoister::run() {
+            _idom = _func.dominators();
+            // 每个 header 的回边，内层循环（块少的）先处理，外提出来的值还可以继续往外提
+            std::map<int32_t, std::vector<int32_t>> loops;
+            for(auto b : _func.reversePostOrder())
+                for(auto s : _func.block(b).succs)
+                    if(dominates(s, b))
+                        loops[s].push_back(b);
+            std::vector<std::pair<std::size_t, int32_t>> order;
+            for(auto& [header, latches] : loops) {
+                auto body = bodyOf(header, latches);
+                order.emplace_back(std::count(body.begin(), body.end(), true), header);
+            }
+            std::sort(order.begin(), order.end());
+            int64_t hoisted = 0;
+            for(auto [size, header] : order)
+                hoisted += hoist(header, loops[header]);
+            return hoisted;
+        }
+    }
+
+    std::int64_t LoopInvariants::run(Function& func, ConstantPool&) {
+        Hoister hoister(func);
+        return hoister.run();
+    }
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include "ir/passManager.h"
+
+namespace cc0::ir {
+
+    // 循环不变量外提：参数都在循环外面定义（或者本身已经外提）的纯运算移到循环前面的 preheader。
+    // 循环只有一个从外面进来的前驱时才处理，这个前驱还有别的后继时在这条边上插一个新块当 preheader。
+    // 全局变量的读在循环里没有写这个变量、没有 call 时也外提；
+    // 除法只在除数是不为 0、-1 的常量时外提，ddiv 不外提，不会在不执行循环体的时候多出一个运行时错误
+    class LoopInvariants final : public Pass {
+    public:
+        const char* name() const override { return "licm"; }
+        std::int64_t run(Function& func, ConstantPool& consts) override;
+    };
+}
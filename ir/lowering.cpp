@@ -0,0 +1,980 @@
+#include "ir/lowering.h"
+#include "analyser/program.h"
+
+#include <algorithm>
+#include <functional>
+
+namespace cc0::ir {
+
+    namespace {
+        // 值的集合，每个值一位
+        class ValueSet final {
+        public:
+            explicit ValueSet(std::size_t n = 0) : _words((n + 63) / 64, 0) {}
+
+            bool test(std::int32_t v) const { return (_words[v / 64] >> (v % 64)) & 1; }
+            void set(std::int32_t v) { _words[v / 64] |= std::uint64_t(1) << (v % 64); }
+            void reset(std::int32_t v) { _words[v / 64] &= ~(std::uint64_t(1) << (v % 64)); }
+            bool unite(const ValueSet& other) {
+                bool changed = false;
+                for(std::size_t k=0; k<_words.size(); k++) {
+                    auto word = _words[k] | other._words[k];
+                    changed = changed || word != _words[k];
+                    _words[k] = word;
+                }
+                return changed;
+            }
+            template<typename F>
+            void forEach(F&& f) const {
+                for(std::size_t k=0; k<_words.size(); k++)
+                    for(auto word = _words[k]; word != 0; word &= word - 1)
+                        f(static_cast<std::int32_t>(k * 64 + __builtin_ctzll(word)));
+            }
+        private:
+            std::vector<std::uint64_t> _words;
+        };
+
+        // 值在栈式代码里的去处
+        enum class Place : std::uint8_t {
+            NONE,     // 没有用到：纯运算不生成，有副作用的算完弹掉
+            REMAT,    // 常量、UNDEF，每次使用时重新压栈
+            INLINE,   // 在唯一的使用处算出来
+            DUP,      // 用两次，第二次紧接着第一次：在第一次的使用处算出来，第二次 dup 一份
+            STACK,    // 算出来以后留在操作数栈上，用到的地方都 dup 一份（switch 逐个比较的值）
+            SLOT      // 放在栈帧的 slot 里（参数、phi、多次使用或者跨块使用的值）
+        };
+
+        // 依赖执行顺序的指令：副作用、读全局变量和可能除以 0 的除法
+        bool isOrdered(const Function& func, const Inst& inst) {
+            return hasSideEffects(func, inst) || inst.opcode == Opcode::LOAD
+                   || (inst.opcode == Opcode::OP && (inst.operation == Operation::IDIV || inst.operation == Operation::DDIV));
+        }
+
+        class Lowerer final {
+        private:
+            using int32_t = std::int32_t;
+
+        public:
+            explicit Lowerer(const Function& func) : _func(func), _insts(func.insts()) {}
+
+            std::optional<std::vector<Instruction>> run();
+
+        private:
+            // 从副作用和跳转出发标记用到的值，统计使用次数，决定每个值的去处
+            void classify();
+            // 找出块里能 dup 的值，已经不能 dup 的改回放在 slot 里，有改动时返回 true
+            bool findDups(int32_t b);
+            // 内联的值改变了有序指令的执行顺序时，把最早错位的那个（连同尽量多的内联的使用者）改回放在 slot 里，
+            // 有改动时返回 true
+            bool fixOrder(int32_t b);
+            // w 是不是内联在 v 里算出来
+            bool inTree(int32_t v, int32_t w) const;
+            // 一个根（不内联的指令或者块结尾）实际读的 slot 值
+            void collectLeaves(int32_t v, std::vector<int32_t>& leaves) const;
+            // switch 逐个比较的值：从第一次比较到分支汇合的地方一直留在操作数栈上，每次比较 dup 一份，
+            // 不用每次从 slot 里读；汇合的块开头再弹掉
+            void findStacked();
+            // 块的条件一路往左内联下去最先用到的值，条件不是这样算的时候是 -1
+            int32_t leftmostLeaf(int32_t b) const;
+            // phi 在几条边上的参数是同一个常量、从入口不经过 phi 所在的块就能走到这几条边时，
+            // 在入口就把常量放进 phi 的 slot（和语法分析在声明的时候初始化局部变量一样），这几条边上就不用拷贝了
+            void findSeeds();
+            // 拷贝到 phi 的 slot 时可以省掉的参数：常量已经预先放好了，或者是 UNDEF
+            bool skipCopy(int32_t phi, int32_t arg) const;
+            // 活跃分析、干涉图、合并 phi、分配 slot
+            void allocate();
+            // 生成代码
+            void emitBlock(int32_t b, int32_t next);
+            void emitValue(int32_t v);
+            void emitTree(int32_t v);
+            // 生成把一个值压栈的几条指令
+            void emitPush(const std::vector<Instruction>& push, Type type);
+            void emitCopies(int32_t from, int32_t to);
+            bool hasCopies(int32_t from, int32_t to);
+            void emitJump(Operation op, int32_t target);
+            // 从入口块开始只靠 JUMP 连起来、每块只有一个前驱的一串块，这里边执行边分配 slot
+            void findLazyBlocks();
+            // 在入口把预先放好的常量放进 phi 的 slot
+            void emitSeed(int32_t phi);
+            // 入口的这串块里把栈帧分配到 slot 为止
+            void growFrame(int32_t slot);
+            // 入口的这串块跳到 to 时，slot 接着已分配部分的 phi 直接把参数压上去
+            void pushCopies(int32_t from, int32_t to);
+
+            int32_t find(int32_t v) {
+                while(_parent[v] != v)
+                    v = _parent[v] = _parent[_parent[v]];
+                return v;
+            }
+            int32_t slotOf(int32_t v) { return _slot[find(v)]; }
+
+        private:
+            const Function& _func;
+            const std::vector<Inst>& _insts;
+            std::vector<int32_t> _layout;        // 生成代码时块的顺序
+            std::vector<bool> _live;             // 用到的指令
+            std::vector<int32_t> _uses;
+            std::vector<int32_t> _user;          // 唯一使用者，块的结尾用 -1 - 块号表示
+            std::vector<int32_t> _pos;           // 在所在块的 body 里的下标
+            std::vector<bool> _pinned;           // 为了执行顺序放进 slot 的值，不再 dup
+            std::vector<bool> _duplicated;       // 生成代码时已经算过一次的 DUP 值
+            // 留在操作数栈上的值：在块开头压上去、条件里最先用到时 dup、在块开头弹掉，没有是 -1
+            std::vector<int32_t> _push_at;
+            std::vector<int32_t> _on_stack;
+            std::vector<int32_t> _pop_at;
+            int32_t _top_value = -1;             // 正在生成的条件里，栈顶已经有的值
+            std::vector<int32_t> _seeds;         // 在入口预先放好常量的 phi
+            std::vector<int32_t> _seed;          // 每个 phi 预先放好的常量，没有是 -1
+            std::vector<Place> _place;
+            std::vector<int32_t> _parent;        // 合并成一类的值共用 slot
+            std::vector<int32_t> _slot;          // 每一类的 slot
+            int32_t _frame = 0;
+            // 入口的那串块，按执行顺序
+            std::vector<int32_t> _lazy;
+            // 已经分配好的 slot 数：下一个 slot 的值直接压栈，和语法分析声明局部变量一样，
+            // 不用先 snew 再存；离开入口的那串块或者要用更靠后的 slot 时再 snew 补齐
+            int32_t _top = 0;
+            std::vector<int32_t> _open;          // 入口的那串块开始时的 _top，其余的块是 -1
+            // 跳出入口的那串块时已经这样压上去的 phi，从 _pushed_from 出发的这条边上不再拷贝
+            std::vector<int32_t> _pushed;
+            int32_t _pushed_from = -1;
+
+            std::vector<Instruction> _code;
+            int32_t _label = 0;                  // 最后一个跳转目标的下标，之前的代码不一定刚执行过
+            std::vector<int32_t> _block_start;
+            // 待回填的跳转：指令下标和目标块
+            std::vector<std::pair<int32_t, int32_t>> _fixups;
+            // 关键边上的拷贝放在函数末尾：起点块、目标块、跳到这里的指令
+            struct Stub {
+                int32_t from;
+                int32_t to;
+                int32_t jump;
+            };
+            std::vector<Stub> _stubs;
+        };
+
+        void Lowerer::classify() {
+            auto n = _insts.size();
+            _live.assign(n, false);
+            _uses.assign(n, 0);
+            _user.assign(n, -1);
+            _place.assign(n, Place::NONE);
+            _pos.assign(n, -1);
+            _pinned.assign(n, false);
+
+            std::vector<int32_t> work;
+            auto mark = [&](int32_t v) {
+                if(!_live[v]) {
+                    _live[v] = true;
+                    work.push_back(v);
+                }
+            };
+            for(auto b : _layout) {
+                auto& block = _func.block(b);
+                for(auto v : block.body)
+                    if(hasSideEffects(_func, _insts[v]) || _insts[v].opcode == Opcode::PARAM)
+                        mark(v);
+                if(block.value != -1)
+                    mark(block.value);
+            }
+            while(!work.empty()) {
+                auto v = work.back();
+                work.pop_back();
+                for(auto arg : _insts[v].args)
+                    mark(arg);
+            }
+
+            for(auto b : _layout) {
+                auto& block = _func.block(b);
+                for(std::size_t i=0; i<block.body.size(); i++)
+                    _pos[block.body[i]] = static_cast<int32_t>(i);
+                auto count = [&](int32_t v, int32_t user) {
+                    _uses[v]++;
+                    _user[v] = user;
+                };
+                for(auto v : block.phis)
+                    if(_live[v])
+                        for(auto arg : _insts[v].args)
+                            count(arg, v);
+                for(auto v : block.body)
+                    if(_live[v])
+                        for(auto arg : _insts[v].args)
+                            count(arg, v);
+                if(block.value != -1)
+                    count(block.value, -1 - b);
+            }
+
+            for(auto b : _layout) {
+                auto& block = _func.block(b);
+                for(auto v : block.phis)
+                    if(_live[v])
+                        _place[v] = Place::SLOT;
+                for(auto v : block.body) {
+                    auto& inst = _insts[v];
+                    if(inst.opcode == Opcode::CONST || inst.opcode == Opcode::LOADC || inst.opcode == Opcode::UNDEF)
+                        _place[v] = Place::REMAT;
+                    else if(inst.opcode == Opcode::PARAM)
+                        _place[v] = Place::SLOT;
+                    else if(inst.type == Type::VOID || _uses[v] == 0)
+                        _place[v] = Place::NONE;
+                    else if(_uses[v] == 1) {
+                        auto user = _user[v];
+                        bool local = user < 0 ? -1 - user == b
+                                              : _insts[user].block == b && _insts[user].opcode != Opcode::PHI;
+                        _place[v] = local ? Place::INLINE : Place::SLOT;
+                    }
+                    else
+                        _place[v] = Place::SLOT;
+                }
+                findDups(b);
+                while(fixOrder(b) && findDups(b)) {}
+            }
+        }
+
+        bool Lowerer::findDups(int32_t b) {
+            auto& block = _func.block(b);
+            // 参数 v 算完紧接着算下一个参数，它一路往左内联下去最先用到的又是 v 时，栈顶正好就是 v
+            std::vector<int32_t> found;
+            for(auto p : block.body) {
+                if(!_live[p] || _place[p] == Place::REMAT)
+                    continue;
+                auto& args = _insts[p].args;
+                for(std::size_t i=0; i+1<args.size(); i++) {
+                    auto v = args[i];
+                    if(_uses[v] != 2 || _insts[v].block != b || _pinned[v] || _insts[v].opcode == Opcode::PARAM
+                       || (_place[v] != Place::SLOT && _place[v] != Place::DUP))
+                        continue;
+                    for(auto w = args[i + 1]; ; w = _insts[w].args[0]) {
+                        if(w == v) {
+                            found.push_back(v);
+                            break;
+                        }
+                        if(_place[w] != Place::INLINE || _insts[w].args.empty())
+                            break;
+                    }
+                }
+            }
+            bool changed = false;
+            for(auto v : block.body) {
+                bool dup = std::find(found.begin(), found.end(), v) != found.end();
+                if(dup && _place[v] == Place::SLOT) {
+                    _place[v] = Place::DUP;
+                    changed = true;
+                }
+                else if(!dup && _place[v] == Place::DUP) {
+                    _place[v] = Place::SLOT;
+                    _pinned[v] = true;
+                    changed = true;
+                }
+            }
+            return changed;
+        }
+
+        bool Lowerer::fixOrder(int32_t b) {
+            auto& block = _func.block(b);
+            std::vector<int32_t> expected;
+            for(auto v : block.body)
+                if(_live[v] && isOrdered(_func, _insts[v]))
+                    expected.push_back(v);
+            if(expected.empty())
+                return false;
+            // 按内联后的实际顺序列出有序指令，和原来的顺序比较
+            for(bool changed=false; ; changed=true) {
+                std::vector<int32_t> actual, seen;
+                std::function<void(int32_t)> walk = [&](int32_t v) {
+                    for(auto arg : _insts[v].args) {
+                        if(_place[arg] == Place::DUP && std::find(seen.begin(), seen.end(), arg) == seen.end()) {
+                            seen.push_back(arg);
+                            walk(arg);
+                        }
+                        else if(_place[arg] == Place::INLINE)
+                            walk(arg);
+                    }
+                    if(isOrdered(_func, _insts[v]))
+                        actual.push_back(v);
+                };
+                for(auto v : block.body)
+                    if(_live[v] && _place[v] != Place::INLINE && _place[v] != Place::DUP)
+                        walk(v);
+                if(block.value != -1 && _place[block.value] == Place::INLINE)
+                    walk(block.value);
+                auto mismatch = std::mismatch(expected.begin(), expected.end(), actual.begin());
+                if(mismatch.first == expected.end())
+                    return changed;
+                // 应该先执行的那个被推迟了，让它在原来的位置算好放进 slot；
+                // 它的内联的使用者和它之间没有别的有序指令的话，放使用者就够了，少拆开一些表达式
+                auto v = *mismatch.first;
+                for(;;) {
+                    auto user = _user[v];
+                    if(user < 0 || _place[user] != Place::INLINE)
+                        break;
+                    bool covered = true;
+                    for(auto it=mismatch.first+1; covered && it!=expected.end() && _pos[*it] < _pos[user]; ++it)
+                        covered = inTree(user, *it);
+                    if(!covered)
+                        break;
+                    v = user;
+                }
+                _place[v] = Place::SLOT;
+                _pinned[v] = true;
+            }
+        }
+
+        bool Lowerer::inTree(int32_t v, int32_t w) const {
+            if(v == w)
+                return true;
+            for(auto arg : _insts[v].args)
+                if((_place[arg] == Place::INLINE || _place[arg] == Place::DUP) && inTree(arg, w))
+                    return true;
+            return false;
+        }
+
+        void Lowerer::collectLeaves(int32_t v, std::vector<int32_t>& leaves) const {
+            for(auto arg : _insts[v].args) {
+                if(_place[arg] == Place::INLINE || _place[arg] == Place::DUP)
+                    collectLeaves(arg, leaves);
+                else if(_place[arg] == Place::SLOT)
+                    leaves.push_back(arg);
+            }
+        }
+
+        int32_t Lowerer::leftmostLeaf(int32_t b) const {
+            auto& block = _func.block(b);
+            if(block.terminator != Terminator::BRANCH)
+                return -1;
+            // 块里除了条件不能再算别的
+            for(auto v : block.body)
+                if(_live[v] && _insts[v].opcode != Opcode::PARAM && _place[v] != Place::INLINE && _place[v] != Place::REMAT)
+                    return -1;
+            auto v = block.value;
+            while(_place[v] == Place::INLINE && !_insts[v].args.empty())
+                v = _insts[v].args[0];
+            return _place[v] == Place::SLOT ? v : -1;
+        }
+
+        void Lowerer::findStacked() {
+            auto blocks = static_cast<int32_t>(_func.blocks().size());
+            _push_at.assign(blocks, -1);
+            _on_stack.assign(blocks, -1);
+            _pop_at.assign(blocks, -1);
+            std::vector<int32_t> ipdom;
+            for(auto head : _layout) {
+                auto v = leftmostLeaf(head);
+                if(v == -1 || _on_stack[head] != -1)
+                    continue;
+                // 条件都从 v 开始、只从上一次比较过来的块
+                std::vector<int32_t> compares{ head };
+                for(std::size_t i=0; i<compares.size(); i++)
+                    for(auto s : _func.block(compares[i]).succs)
+                        if(s != head && _on_stack[s] == -1 && _func.block(s).preds.size() == 1 && leftmostLeaf(s) == v)
+                            compares.push_back(s);
+                // v 是上一块最后算出来的、只在这些比较里用到时，算完就留在栈上，连 slot 都不用；
+                // 否则要先读出来再压栈、最后还要弹掉，比较少的时候不如每次读 slot
+                bool stacked = false;
+                auto& first = _func.block(head);
+                if(_insts[v].opcode != Opcode::PARAM && _uses[v] == static_cast<int32_t>(compares.size()) && first.preds.size() == 1) {
+                    auto& prev = _func.block(first.preds[0]);
+                    auto last = std::find_if(prev.body.rbegin(), prev.body.rend(), [&](int32_t w) {
+                        return _live[w] && _insts[w].opcode != Opcode::PARAM && _place[w] != Place::INLINE && _place[w] != Place::REMAT;
+                    });
+                    stacked = prev.terminator == Terminator::JUMP && last != prev.body.rend() && *last == v;
+                }
+                if(!stacked && compares.size() < 3)
+                    continue;
+                // 从第一次比较出发、不经过汇合的块能到的地方都只能从这些地方进来，才能保证栈上一直是 v
+                if(ipdom.empty())
+                    ipdom = _func.postDominators();
+                auto exit = ipdom[head];
+                if(exit == -1 || (exit != blocks && _pop_at[exit] != -1))
+                    continue;
+                std::vector<bool> inside(blocks, false);
+                std::vector<int32_t> region{ head };
+                inside[head] = true;
+                for(std::size_t i=0; i<region.size(); i++)
+                    for(auto s : _func.block(region[i]).succs)
+                        if(s != exit && !inside[s]) {
+                            inside[s] = true;
+                            region.push_back(s);
+                        }
+                bool closed = true;
+                for(auto b : region)
+                    for(auto p : _func.block(b).preds)
+                        closed = closed && (b == head ? !inside[p] : inside[p]);
+                if(exit != blocks)
+                    for(auto p : _func.block(exit).preds)
+                        closed = closed && inside[p];
+                if(!closed)
+                    continue;
+                for(auto c : compares)
+                    _on_stack[c] = v;
+                if(stacked)
+                    _place[v] = Place::STACK;
+                else
+                    _push_at[head] = v;
+                if(exit != blocks)
+                    _pop_at[exit] = v;
+            }
+        }
+
+        void Lowerer::findSeeds() {
+            _seed.assign(_insts.size(), -1);
+            if(!_func.block(0).preds.empty())
+                return;
+            auto same = [&](int32_t v, int32_t c) {
+                return _insts[v].opcode == Opcode::CONST && _insts[v].type == _insts[c].type && _insts[v].imm == _insts[c].imm;
+            };
+            for(auto b : _layout) {
+                auto& block = _func.block(b);
+                std::vector<bool> reached;
+                for(auto phi : block.phis) {
+                    if(!_live[phi])
+                        continue;
+                    // 出现最多的常量
+                    auto& args = _insts[phi].args;
+                    int32_t best = -1, most = 0;
+                    for(auto arg : args) {
+                        if(_insts[arg].opcode != Opcode::CONST)
+                            continue;
+                        auto count = static_cast<int32_t>(std::count_if(args.begin(), args.end(), [&](int32_t other) {
+                            return same(other, arg);
+                        }));
+                        if(count > most) {
+                            best = arg;
+                            most = count;
+                        }
+                    }
+                    if(best == -1)
+                        continue;
+                    // 从这个块出发能走到的边上，slot 里已经是 phi 或者别的参数了
+                    if(reached.empty()) {
+                        reached.assign(_func.blocks().size(), false);
+                        std::vector<int32_t> work(block.succs.begin(), block.succs.end());
+                        while(!work.empty()) {
+                            auto r = work.back();
+                            work.pop_back();
+                            if(reached[r])
+                                continue;
+                            reached[r] = true;
+                            for(auto s : _func.block(r).succs)
+                                work.push_back(s);
+                        }
+                    }
+                    bool ok = true;
+                    for(std::size_t i=0; i<args.size(); i++)
+                        ok = ok && !(same(args[i], best) && reached[block.preds[i]]);
+                    if(!ok)
+                        continue;
+                    _seed[phi] = best;
+                    _seeds.push_back(phi);
+                }
+            }
+        }
+
+        bool Lowerer::skipCopy(int32_t phi, int32_t arg) const {
+            if(_insts[arg].opcode == Opcode::UNDEF)
+                return true;
+            auto seed = _seed[phi];
+            return seed != -1 && _insts[arg].opcode == Opcode::CONST && _insts[arg].type == _insts[seed].type
+                   && _insts[arg].imm == _insts[seed].imm;
+        }
+
+        void Lowerer::allocate() {
+            auto n = static_cast<int32_t>(_insts.size());
+            auto blocks = static_cast<int32_t>(_func.blocks().size());
+
+            // 块内的根：放在 slot 里或者不用的、不内联的指令，按顺序带上它读的 slot 值
+            struct Root {
+                int32_t def;    // 定义的 slot 值，没有是 -1
+                std::vector<int32_t> leaves;
+            };
+            std::vector<std::vector<Root>> roots(blocks);
+            std::vector<ValueSet> uses(blocks, ValueSet(n)), defs(blocks, ValueSet(n));
+            std::vector<ValueSet> phi_uses(blocks, ValueSet(n));   // 作为后继 phi 的参数在块末尾用到
+            for(auto b : _layout) {
+                auto& block = _func.block(b);
+                for(auto v : block.phis)
+                    if(_live[v])
+                        defs[b].set(v);
+                for(auto v : block.body) {
+                    if(!_live[v] && _insts[v].opcode != Opcode::PARAM)
+                        continue;
+                    if(_place[v] == Place::INLINE || _place[v] == Place::DUP || _place[v] == Place::REMAT)
+                        continue;
+                    Root root{ _place[v] == Place::SLOT ? v : -1, {} };
+                    collectLeaves(v, root.leaves);
+                    roots[b].push_back(std::move(root));
+                }
+                if(block.value != -1) {
+                    Root root{ -1, {} };
+                    if(_place[block.value] == Place::SLOT)
+                        root.leaves.push_back(block.value);
+                    else if(_place[block.value] == Place::INLINE)
+                        collectLeaves(block.value, root.leaves);
+                    roots[b].push_back(std::move(root));
+                }
+                for(auto s : block.succs) {
+                    auto& succ = _func.block(s);
+                    auto index = std::find(succ.preds.begin(), succ.preds.end(), b) - succ.preds.begin();
+                    for(auto phi : succ.phis) {
+                        if(!_live[phi])
+                            continue;
+                        auto arg = _insts[phi].args[index];
+                        if(_place[arg] == Place::SLOT)
+                            phi_uses[b].set(arg);
+                        // 预先放好的常量从入口一直占着 phi 的 slot 到这里
+                        else if(_seed[phi] != -1 && skipCopy(phi, arg) && _insts[arg].opcode == Opcode::CONST)
+                            phi_uses[b].set(phi);
+                    }
+                }
+                // 块内向上暴露的使用
+                for(auto it=roots[b].rbegin(); it!=roots[b].rend(); ++it) {
+                    if(it->def != -1) {
+                        defs[b].set(it->def);
+                        uses[b].reset(it->def);
+                    }
+                    for(auto leaf : it->leaves)
+                        uses[b].set(leaf);
+                }
+                for(auto v : block.phis)
+                    uses[b].reset(v);
+            }
+
+            // 活跃变量分析
+            std::vector<ValueSet> live_in(blocks, ValueSet(n)), live_out(blocks, ValueSet(n));
+            for(bool changed=true; changed; ) {
+                changed = false;
+                for(auto it=_layout.rbegin(); it!=_layout.rend(); ++it) {
+                    auto b = *it;
+                    ValueSet out = phi_uses[b];
+                    for(auto s : _func.block(b).succs)
+                        out.unite(live_in[s]);
+                    live_out[b] = out;
+                    ValueSet in(n);
+                    in.unite(uses[b]);
+                    out.forEach([&](int32_t v) {
+                        if(!defs[b].test(v))
+                            in.set(v);
+                    });
+                    changed = live_in[b].unite(in) || changed;
+                }
+            }
+
+            // 干涉图：定义的时候和所有活跃的值干涉
+            std::vector<std::vector<int32_t>> adjacent(n);
+            auto interfere = [&](int32_t a, int32_t c) {
+                if(a != c) {
+                    adjacent[a].push_back(c);
+                    adjacent[c].push_back(a);
+                }
+            };
+            for(auto b : _layout) {
+                auto live = live_out[b];
+                for(auto it=roots[b].rbegin(); it!=roots[b].rend(); ++it) {
+                    if(it->def != -1) {
+                        live.reset(it->def);
+                        live.forEach([&](int32_t v) { interfere(it->def, v); });
+                    }
+                    for(auto leaf : it->leaves)
+                        live.set(leaf);
+                }
+                auto& block = _func.block(b);
+                if(b == 0)
+                    for(auto phi : _seeds)
+                        live.forEach([&](int32_t v) { interfere(phi, v); });
+                for(auto phi : block.phis) {
+                    if(!_live[phi])
+                        continue;
+                    live.reset(phi);
+                    live.forEach([&](int32_t v) { interfere(phi, v); });
+                    for(auto other : block.phis)
+                        if(other != phi && _live[other])
+                            interfere(phi, other);
+                }
+            }
+
+            // phi 和参数合并成一类：类型相同、互不干涉
+            _parent.resize(n);
+            for(int32_t v=0; v<n; v++)
+                _parent[v] = v;
+            std::vector<int32_t> fixed(n, -1);   // 参数所在的类固定在参数的 slot
+            std::vector<std::vector<int32_t>> members(n);
+            for(int32_t v=0; v<n; v++) {
+                members[v].push_back(v);
+                if(_insts[v].opcode == Opcode::PARAM)
+                    fixed[v] = _insts[v].imm;
+            }
+            auto conflict = [&](int32_t a, int32_t c) {
+                for(auto v : members[a])
+                    for(auto w : adjacent[v])
+                        if(find(w) == c)
+                            return true;
+                return false;
+            };
+            for(auto b : _layout) {
+                for(auto phi : _func.block(b).phis) {
+                    if(!_live[phi])
+                        continue;
+                    for(auto arg : _insts[phi].args) {
+                        if(_place[arg] != Place::SLOT || _insts[arg].type != _insts[phi].type)
+                            continue;
+                        auto a = find(phi), c = find(arg);
+                        if(a == c || (fixed[a] != -1 && fixed[c] != -1) || conflict(a, c))
+                            continue;
+                        _parent[c] = a;
+                        if(fixed[a] == -1)
+                            fixed[a] = fixed[c];
+                        members[a].insert(members[a].end(), members[c].begin(), members[c].end());
+                        members[c].clear();
+                    }
+                }
+            }
+
+            // 按值的先后顺序贪心地分配最低的空闲 slot
+            _slot.assign(n, -1);
+            _frame = _func.getParamsSize();
+            auto size = [&](int32_t c) { return slotsOf(_insts[c].type); };
+            for(int32_t c=0; c<n; c++)
+                if(find(c) == c && fixed[c] != -1)
+                    _slot[c] = fixed[c];
+            // 入口的那串块里的值按定义的顺序接着参数往上放，生成代码时直接压栈，不用 loada 再存；
+            // 最后跳到的块的 phi 也一样，它们的参数在跳转之前压上去
+            int32_t next = _frame;
+            auto push = [&](int32_t v) {
+                auto c = find(v);
+                if(_slot[c] == -1) {
+                    _slot[c] = next;
+                    next += size(c);
+                }
+            };
+            for(auto phi : _seeds)
+                push(phi);
+            for(auto b : _lazy)
+                for(auto v : _func.block(b).body)
+                    if(_live[v] && _place[v] == Place::SLOT && _insts[v].opcode != Opcode::PARAM)
+                        push(v);
+            if(!_lazy.empty() && _func.block(_lazy.back()).terminator == Terminator::JUMP)
+                for(auto phi : _func.block(_func.block(_lazy.back()).succs[0]).phis)
+                    if(_live[phi])
+                        push(phi);
+            for(int32_t v=0; v<n; v++) {
+                auto c = find(v);
+                if(_place[v] != Place::SLOT || _slot[c] != -1)
+                    continue;
+                std::vector<std::pair<int32_t, int32_t>> taken;
+                for(auto m : members[c])
+                    for(auto w : adjacent[m]) {
+                        auto d = find(w);
+                        if(_slot[d] != -1)
+                            taken.emplace_back(_slot[d], _slot[d] + size(d));
+                    }
+                std::sort(taken.begin(), taken.end());
+                int32_t slot = 0;
+                for(auto [begin, end] : taken) {
+                    if(slot + size(c) <= begin)
+                        break;
+                    slot = std::max(slot, end);
+                }
+                _slot[c] = slot;
+            }
+            for(int32_t c=0; c<n; c++)
+                if(find(c) == c && _slot[c] != -1)
+                    _frame = std::max(_frame, _slot[c] + size(c));
+        }
+
+        void Lowerer::emitTree(int32_t v) {
+            auto& inst = _insts[v];
+            if(v == _top_value) {
+                _top_value = -1;
+                _code.emplace_back(inst.type == Type::DOUBLE ? Operation::DUP2 : Operation::DUP);
+                return;
+            }
+            switch(_place[v]) {
+                case Place::SLOT:
+                    emitPush({ Instruction(Operation::LOADA, 0, slotOf(v)),
+                               Instruction(inst.type == Type::DOUBLE ? Operation::DLOAD : Operation::ILOAD) }, inst.type);
+                    return;
+                case Place::REMAT:
+                    if(inst.opcode == Opcode::CONST)
+                        emitPush({ Instruction(inst.imm >= 0 && inst.imm <= 255 ? Operation::BIPUSH : Operation::IPUSH, inst.imm) },
+                                 inst.type);
+                    else if(inst.opcode == Opcode::LOADC)
+                        _code.emplace_back(Operation::LOADC, inst.imm);
+                    else if(inst.type == Type::DOUBLE)
+                        _code.emplace_back(Operation::SNEW, 2);
+                    else
+                        _code.emplace_back(Operation::BIPUSH, 0);
+                    return;
+                case Place::DUP:
+                    if(_duplicated[v])
+                        _code.emplace_back(inst.type == Type::DOUBLE ? Operation::DUP2 : Operation::DUP);
+                    else {
+                        emitValue(v);
+                        _duplicated[v] = true;
+                    }
+                    return;
+                default:
+                    emitValue(v);
+                    return;
+            }
+        }
+
+        void Lowerer::emitPush(const std::vector<Instruction>& push, Type type) {
+            // 刚刚压过同一个值（中间没有跳转目标）的话复制一份就行
+            if(_code.size() >= _label + push.size() && std::equal(push.begin(), push.end(), _code.end() - push.size()))
+                _code.emplace_back(type == Type::DOUBLE ? Operation::DUP2 : Operation::DUP);
+            else
+                _code.insert(_code.end(), push.begin(), push.end());
+        }
+
+        // 算出 v 本身，结果留在栈顶
+        void Lowerer::emitValue(int32_t v) {
+            auto& inst = _insts[v];
+            for(auto arg : inst.args)
+                emitTree(arg);
+            switch(inst.opcode) {
+                case Opcode::OP:
+                case Opcode::INPUT:
+                case Opcode::OUTPUT:
+                    _code.emplace_back(inst.operation);
+                    break;
+                case Opcode::LOAD:
+                    _code.emplace_back(Operation::LOADA, 1, inst.imm);
+                    _code.emplace_back(inst.type == Type::DOUBLE ? Operation::DLOAD : Operation::ILOAD);
+                    break;
+                case Opcode::CALL:
+                    _code.emplace_back(Operation::CALL, inst.imm);
+                    break;
+                default:
+                    break;
+            }
+        }
+
+        bool Lowerer::hasCopies(int32_t from, int32_t to) {
+            auto& succ = _func.block(to);
+            auto index = std::find(succ.preds.begin(), succ.preds.end(), from) - succ.preds.begin();
+            for(auto phi : succ.phis) {
+                if(!_live[phi])
+                    continue;
+                auto arg = _insts[phi].args[index];
+                if(!skipCopy(phi, arg) && (_place[arg] != Place::SLOT || slotOf(arg) != slotOf(phi)))
+                    return true;
+            }
+            return false;
+        }
+
+        void Lowerer::pushCopies(int32_t from, int32_t to) {
+            auto& succ = _func.block(to);
+            auto index = std::find(succ.preds.begin(), succ.preds.end(), from) - succ.preds.begin();
+            _pushed_from = from;
+            // 新压的 slot 原来没有值，不会被别的参数读到，按 slot 的顺序压就行
+            for(bool found=true; found; ) {
+                found = false;
+                for(auto phi : succ.phis) {
+                    if(!_live[phi] || slotOf(phi) != _top)
+                        continue;
+                    emitTree(_insts[phi].args[index]);
+                    _pushed.push_back(phi);
+                    _top += slotsOf(_insts[phi].type);
+                    found = true;
+                }
+            }
+        }
+
+        void Lowerer::emitCopies(int32_t from, int32_t to) {
+            // 并行拷贝：先把所有的目标地址和源值压栈，再倒着逐个写回，不用考虑拷贝之间的依赖
+            auto& succ = _func.block(to);
+            auto index = std::find(succ.preds.begin(), succ.preds.end(), from) - succ.preds.begin();
+            std::vector<Operation> stores;
+            for(auto phi : succ.phis) {
+                if(!_live[phi])
+                    continue;
+                if(from == _pushed_from && std::find(_pushed.begin(), _pushed.end(), phi) != _pushed.end())
+                    continue;
+                auto arg = _insts[phi].args[index];
+                if(skipCopy(phi, arg) || (_place[arg] == Place::SLOT && slotOf(arg) == slotOf(phi)))
+                    continue;
+                _code.emplace_back(Operation::LOADA, 0, slotOf(phi));
+                emitTree(arg);
+                stores.push_back(_insts[phi].type == Type::DOUBLE ? Operation::DSTORE : Operation::ISTORE);
+            }
+            for(auto it=stores.rbegin(); it!=stores.rend(); ++it)
+                _code.emplace_back(*it);
+        }
+
+        void Lowerer::emitJump(Operation op, int32_t target) {
+            _fixups.emplace_back(static_cast<int32_t>(_code.size()), target);
+            _code.emplace_back(op, 0);
+        }
+
+        void Lowerer::findLazyBlocks() {
+            // 入口块有前驱（循环回到函数开头）时不能边执行边分配
+            if(!_func.block(0).preds.empty())
+                return;
+            for(int32_t b=0; ; ) {
+                _lazy.push_back(b);
+                auto& block = _func.block(b);
+                if(block.terminator != Terminator::JUMP)
+                    return;
+                // 块按编号排列，编号更大的后继在后面生成，那时再接着这里的 _top
+                auto target = block.succs[0];
+                auto& succ = _func.block(target);
+                if(target < b || succ.preds.size() != 1 || !succ.phis.empty())
+                    return;
+                b = target;
+            }
+        }
+
+        void Lowerer::emitSeed(int32_t phi) {
+            auto slot = slotOf(phi);
+            auto type = _insts[phi].type;
+            if(slot >= _top) {
+                growFrame(slot);
+                emitTree(_seed[phi]);
+                _top += slotsOf(type);
+                return;
+            }
+            _code.emplace_back(Operation::LOADA, 0, slot);
+            emitTree(_seed[phi]);
+            _code.emplace_back(type == Type::DOUBLE ? Operation::DSTORE : Operation::ISTORE);
+        }
+
+        void Lowerer::growFrame(int32_t slot) {
+            if(_top < slot)
+                _code.emplace_back(Operation::SNEW, slot - _top);
+            _top = std::max(_top, slot);
+        }
+
+        void Lowerer::emitBlock(int32_t b, int32_t next) {
+            auto& block = _func.block(b);
+            _block_start[b] = _label = static_cast<int32_t>(_code.size());
+            _top = _open[b] != -1 ? _open[b] : _frame;
+            if(_pop_at[b] != -1)
+                _code.emplace_back(_insts[_pop_at[b]].type == Type::DOUBLE ? Operation::POP2 : Operation::POP);
+            if(_push_at[b] != -1) {
+                growFrame(_frame);
+                emitTree(_push_at[b]);
+            }
+            if(b == 0)
+                for(auto phi : _seeds)
+                    emitSeed(phi);
+            for(auto v : block.body) {
+                auto& inst = _insts[v];
+                if(inst.opcode == Opcode::PARAM || !_live[v] || _place[v] == Place::INLINE || _place[v] == Place::DUP
+                   || _place[v] == Place::REMAT)
+                    continue;
+                if(_place[v] == Place::SLOT && slotOf(v) >= _top) {
+                    // 还没分配的 slot：补齐前面的，再把值压上去
+                    growFrame(slotOf(v));
+                    emitValue(v);
+                    _top += slotsOf(inst.type);
+                }
+                else if(_place[v] == Place::STACK) {
+                    // 之后要用 slot 的话得在它下面，先分配好
+                    growFrame(_frame);
+                    emitValue(v);
+                }
+                else if(_place[v] == Place::SLOT) {
+                    _code.emplace_back(Operation::LOADA, 0, slotOf(v));
+                    emitValue(v);
+                    _code.emplace_back(inst.type == Type::DOUBLE ? Operation::DSTORE : Operation::ISTORE);
+                }
+                else if(inst.opcode == Opcode::STORE) {
+                    _code.emplace_back(Operation::LOADA, 1, inst.imm);
+                    emitTree(inst.args[0]);
+                    _code.emplace_back(_insts[inst.args[0]].type == Type::DOUBLE ? Operation::DSTORE : Operation::ISTORE);
+                }
+                else {
+                    emitValue(v);
+                    if(inst.type != Type::VOID)
+                        _code.emplace_back(inst.type == Type::DOUBLE ? Operation::POP2 : Operation::POP);
+                }
+            }
+            // 离开入口的那串块之前把栈帧分配完，返回时就不用了
+            switch(block.terminator) {
+                case Terminator::RETURN:
+                    if(block.value != -1)
+                        emitTree(block.value);
+                    _code.emplace_back(block.operation);
+                    break;
+                case Terminator::JUMP: {
+                    auto target = block.succs[0];
+                    auto lazy = std::find(_lazy.begin(), _lazy.end(), b);
+                    if(lazy != _lazy.end() && lazy + 1 != _lazy.end()) {
+                        _open[target] = _top;
+                        if(target != next)
+                            emitJump(Operation::JMP, target);
+                        break;
+                    }
+                    if(_top < _frame)
+                        pushCopies(b, target);
+                    growFrame(_frame);
+                    emitCopies(b, target);
+                    if(target != next)
+                        emitJump(Operation::JMP, target);
+                    break;
+                }
+                case Terminator::BRANCH: {
+                    auto taken = block.succs[0], other = block.succs[1];
+                    auto op = block.operation;
+                    growFrame(_frame);
+                    _top_value = _on_stack[b];
+                    emitTree(block.value);
+                    // 要跳的一边没有拷贝、顺序执行的一边是下一块时最好，必要时把条件反过来
+                    if(taken == next && !hasCopies(b, taken)) {
+                        std::swap(taken, other);
+                        op = invertBranch(op);
+                    }
+                    if(hasCopies(b, taken)) {
+                        _stubs.push_back(Stub{ b, taken, static_cast<int32_t>(_code.size()) });
+                        _code.emplace_back(op, 0);
+                    }
+                    else
+                        emitJump(op, taken);
+                    emitCopies(b, other);
+                    if(other != next)
+                        emitJump(Operation::JMP, other);
+                    break;
+                }
+            }
+        }
+
+        std::optional<std::vector<Instruction>> Lowerer::run() {
+            for(auto b : _func.reversePostOrder())
+                _layout.push_back(b);
+            // 按块原来的顺序排列，和源代码的结构一致
+            std::sort(_layout.begin(), _layout.end());
+            findLazyBlocks();
+            classify();
+            findStacked();
+            findSeeds();
+            allocate();
+
+            _open.assign(_func.blocks().size(), -1);
+            _duplicated.assign(_insts.size(), false);
+            _top = _func.getParamsSize();
+            if(_lazy.empty())
+                growFrame(_frame);
+            else
+                _open[0] = _top;
+            _block_start.assign(_func.blocks().size(), -1);
+            for(std::size_t i=0; i<_layout.size(); i++)
+                emitBlock(_layout[i], i + 1 < _layout.size() ? _layout[i + 1] : -1);
+            for(auto& stub : _stubs) {
+                _label = static_cast<int32_t>(_code.size());
+                _code[stub.jump].setX(_label);
+                emitCopies(stub.from, stub.to);
+                emitJump(Operation::JMP, stub.to);
+            }
+            for(auto [index, target] : _fixups)
+                _code[index].setX(_block_start[target]);
+            if(_code.size() > static_cast<std::size_t>(MAX_INSTRUCTIONS))
+                return std::nullopt;
+            return std::move(_code);
+        }
+    }
+
+    std::optional<std::vector<Instruction>> lower(const Function& func) {
+        Lowerer lowerer(func);
+        return lowerer.run();
+    }
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include "instruction/instruction.h"
+#include "ir/ir.h"
+
+#include <optional>
+#include <vector>
+
+namespace cc0::ir {
+
+    // 把 SSA 变回栈式代码：
+    // 常量每次使用时重新压栈；只在本块里用一次的值不落地，直接在使用的地方算出来留在操作数栈上；
+    // 其余的值放进栈帧里的 slot，按干涉图着色分配，phi 和它的参数尽量合并到同一个 slot，
+    // 这样 phi 在边上的拷贝大多不用生成。
+    // 参数固定在原来的 slot；入口一路往下只有一个前驱的那串块里，下一个 slot 的值直接压栈，
+    // 和语法分析声明局部变量一样，离开这串块时再用一条 snew 分配其余的 slot。
+    // switch 逐个比较的值留在操作数栈上，每次比较 dup 一份。
+    // 代码超过 MAX_INSTRUCTIONS 条时返回空
+    std::optional<std::vector<Instruction>> lower(const Function& func);
+}
@@ -0,0 +1,70 @@
+#include "ir/passManager.h"
+#include "ir/lifting.h"
+#include "ir/lowering.h"
+#include "optimizer/cfg.h"
+
+#include <algorithm>
+
+namespace cc0::ir {
+
+    namespace {
+        // 估计执行代码的开销：每条指令按所在循环的深度加权，每深一层算 8 倍。
+        // 外提会在循环前面多出几条指令，按条数比较会把它当成变差
+        std::int64_t weightedCost(const std::vector<Instruction>& code) {
+            ControlFlowGraph cfg(code);
+            std::int64_t cost = 0;
+            for(std::int32_t b=0; b<static_cast<std::int32_t>(cfg.blocks().size()); b++) {
+                if(!cfg.isReachable(b))
+                    continue;
+                auto& block = cfg.block(b);
+                cost += static_cast<std::int64_t>(block.end - block.begin) << (3 * std::min(cfg.loopDepth(b), 6));
+            }
+            return cost;
+        }
+    }
+
+    void PassManager::add(std::unique_ptr<Pass> pass) {
+        _counts.emplace_back(pass->name(), 0);
+        _passes.push_back(std::move(pass));
+    }
+
+    bool PassManager::run() {
+        auto calls = callEffects(_program);
+        bool changed = false;
+        for(auto& func : _program.getFunctions())
+            changed = optimize(func, calls) || changed;
+        return changed;
+    }
+
+    bool PassManager::optimize(cc0::Function& func, const std::vector<CallEffect>& calls) {
+        auto& buffer = func.getInstructions();
+        auto code = buffer.decode();
+        auto& consts = _program.getConstants();
+        auto ir = lift(code, func.getParamsSize(), consts, calls);
+        if(!ir) {
+            _rejected++;
+            return false;
+        }
+        _lifted++;
+        int64_t changes = 0;
+        std::vector<int64_t> counts(_passes.size(), 0);
+        for(std::size_t k=0; k<_passes.size(); k++) {
+            counts[k] = _passes[k]->run(*ir, consts);
+            changes += counts[k];
+        }
+        auto lowered = lower(*ir);
+        if(!lowered)
+            return false;
+        // 变回栈式代码后不一定更好（比如跨块的值存进 slot，原来用 dup 的地方变成 loada + iload），
+        // 先比按循环深度加权的指令条数，一样时再比字节数
+        auto cost = weightedCost(code), new_cost = weightedCost(*lowered);
+        CodeBuffer result(*lowered);
+        auto bytes = buffer.byteSize(), new_bytes = result.byteSize();
+        if(new_cost > cost || (new_cost == cost && (new_bytes > bytes || (changes == 0 && new_bytes == bytes))))
+            return false;
+        for(std::size_t k=0; k<_passes.size(); k++)
+            _counts[k].second += counts[k];
+        buffer = std::move(result);
+        return true;
+    }
+}
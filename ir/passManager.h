@@ -0,0 +1,57 @@
+#pragma once
+
+#include "analyser/program.h"
+#include "ir/ir.h"
+#include "optimizer/stackDepth.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace cc0::ir {
+
+    // SSA 上的一个优化，在一个函数上运行，返回改动的次数（折叠的指令数、删掉的值数等）
+    // 会新增常量（比如折叠出的 double）时写进 consts
+    class Pass {
+    public:
+        virtual ~Pass() = default;
+
+        virtual const char* name() const = 0;
+        virtual std::int64_t run(Function& func, ConstantPool& consts) = 0;
+    };
+
+    // 把每个函数变成 SSA，依次运行各个 Pass，再变回栈式代码。
+    // 变不成 SSA 的函数（见 lift）保持原样；启动代码只有一个块的全局变量初始化，不处理。
+    // 重新生成的代码按循环深度加权的指令条数比原来多、一样多但字节数变多，
+    // 或者各个 Pass 都没有改动而代码也没有变短时保持原样
+    class PassManager final {
+    private:
+        using int32_t = std::int32_t;
+        using int64_t = std::int64_t;
+
+    public:
+        explicit PassManager(Program& program) : _program(program) {}
+
+        void add(std::unique_ptr<Pass> pass);
+
+        // 返回是否修改了程序
+        bool run();
+
+        int64_t getLifted() const { return _lifted; }
+        int64_t getRejected() const { return _rejected; }
+        // 每个 Pass 在所有函数上的改动次数，按添加的顺序
+        const std::vector<std::pair<std::string, int64_t>>& getCounts() const { return _counts; }
+
+    private:
+        bool optimize(cc0::Function& func, const std::vector<CallEffect>& calls);
+
+    private:
+        Program& _program;
+        std::vector<std::unique_ptr<Pass>> _passes;
+        std::vector<std::pair<std::string, int64_t>> _counts;
+        int64_t _lifted = 0;
+        int64_t _rejected = 0;
+    };
+}
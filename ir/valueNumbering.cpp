@@ -0,0 +1,117 @@
+#include "ir/valueNumbering.h"
+
+#include <map>
+#include <tuple>
+#include <utility>
+
+namespace cc0::ir {
+
+    namespace {
+        // 纯运算和常量的值：opcode、operation、类型、imm、参数
+        using Key = std::tuple<Opcode, Operation, Type, std::int32_t, std::vector<std::int32_t>>;
+
+        bool isCommutative(Operation op) {
+            return op == Operation::IADD || op == Operation::IMUL || op == Operation::DADD || op == Operation::DMUL;
+        }
+    }
+
+    std::int64_t ValueNumbering::run(Function& func, ConstantPool&) {
+        using int32_t = std::int32_t;
+        auto idom = func.dominators();
+        auto& blocks = func.blocks();
+        std::vector<std::vector<int32_t>> children(blocks.size());
+        for(int32_t b=1; b<static_cast<int32_t>(blocks.size()); b++)
+            if(idom[b] != -1)
+                children[idom[b]].push_back(b);
+
+        std::vector<int32_t> forward(func.insts().size());
+        for(int32_t v=0; v<static_cast<int32_t>(forward.size()); v++)
+            forward[v] = v;
+        std::map<Key, int32_t> available;
+        std::int64_t replaced = 0;
+
+        // 支配树的先序遍历，离开一个块时撤销它加进 available 的项
+        struct Frame {
+            int32_t block;
+            std::size_t next;
+            std::vector<std::map<Key, int32_t>::iterator> added;
+        };
+        std::vector<Frame> stack;
+        stack.push_back(Frame{ 0, 0, {} });
+        auto visit = [&](Frame& frame) {
+            auto& block = func.block(frame.block);
+            // 块内读到的全局变量：偏移 -> 值
+            std::map<int32_t, int32_t> loaded;
+            std::vector<int32_t> kept;
+            for(auto v : block.body) {
+                auto& inst = func.inst(v);
+                for(auto& arg : inst.args)
+                    arg = resolve(forward, arg);
+                if(inst.opcode == Opcode::LOAD) {
+                    auto it = loaded.find(inst.imm);
+                    if(it != loaded.end() && func.inst(it->second).type == inst.type) {
+                        forward[v] = it->second;
+                        inst.opcode = Opcode::NOP;
+                        inst.block = -1;
+                        replaced++;
+                        continue;
+                    }
+                    loaded[inst.imm] = v;
+                }
+                else if(inst.opcode == Opcode::STORE) {
+                    // 写 double 会改到 imm、imm + 1 两个 slot，和它们重叠的读都作废
+                    auto size = slotsOf(func.inst(inst.args[0]).type);
+                    for(auto it=loaded.begin(); it!=loaded.end(); ) {
+                        auto end = it->first + slotsOf(func.inst(it->second).type);
+                        if(it->first < inst.imm + size && inst.imm < end)
+                            it = loaded.erase(it);
+                        else
+                            ++it;
+                    }
+                    loaded[inst.imm] = inst.args[0];
+                }
+                else if(inst.opcode == Opcode::CALL)
+                    loaded.clear();
+                else if((inst.opcode == Opcode::OP && !hasSideEffects(func, inst)) || inst.opcode == Opcode::CONST
+                        || inst.opcode == Opcode::LOADC) {
+                    auto args = inst.args;
+                    if(inst.opcode == Opcode::OP && isCommutative(inst.operation) && args[0] > args[1])
+                        std::swap(args[0], args[1]);
+                    auto [it, inserted] = available.emplace(Key{ inst.opcode, inst.operation, inst.type, inst.imm, args }, v);
+                    if(!inserted) {
+                        // 常量本来就在每次使用时重新压栈，合并它们只是为了让参数相同的运算能对上，不计数
+                        if(inst.opcode == Opcode::OP)
+                            replaced++;
+                        forward[v] = it->second;
+                        inst.opcode = Opcode::NOP;
+                        inst.args.clear();
+                        inst.block = -1;
+                        continue;
+                    }
+                    frame.added.push_back(it);
+                }
+                kept.push_back(v);
+            }
+            block.body.swap(kept);
+            if(block.value != -1)
+                block.value = resolve(forward, block.value);
+        };
+        visit(stack.back());
+        while(!stack.empty()) {
+            auto& frame = stack.back();
+            auto& next = children[frame.block];
+            if(frame.next < next.size()) {
+                auto child = next[frame.next++];
+                stack.push_back(Frame{ child, 0, {} });
+                visit(stack.back());
+                continue;
+            }
+            for(auto it : frame.added)
+                available.erase(it);
+            stack.pop_back();
+        }
+        // phi 的参数可能来自回边，最后统一替换
+        func.replaceUses(forward);
+        return replaced;
+    }
+}
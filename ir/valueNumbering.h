@@ -0,0 +1,15 @@
+#pragma once
+
+#include "ir/passManager.h"
+
+namespace cc0::ir {
+
+    // 全局值编号：沿支配树往下走，运算、参数都相同的纯运算和常量
+    // 如果支配它的块里已经算过，就换成之前的结果（加法和乘法不区分参数的顺序）。
+    // 全局变量的读只在块内合并：中间没有写这个变量、没有 call 时重复读换成上一次读到或写入的值
+    class ValueNumbering final : public Pass {
+    public:
+        const char* name() const override { return "gvn"; }
+        std::int64_t run(Function& func, ConstantPool& consts) override;
+    };
+}
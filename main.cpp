@@ -1,228 +1,139 @@
 #include "argparse.hpp"
 #include "fmt/core.h"
+#include "fmt/format.h"
 
 #include "tokenizer/tokenizer.h"
 #include "analyser/analyser.h"
+#include "memstats/memStats.h"
+#include "emitter/objectWriter.h"
+#include "emitter/assemblyWriter.h"
+#include "optimizer/optimizer.h"
+#include "verifier/verifier.h"
 #include "fmts.hpp"
 #include "main.h"
 
 #include <iostream>
 #include <fstream>
 
+// --mem-stats 时记录各阶段的内存使用，否则为 nullptr
+cc0::MemStats* mem_stats = nullptr;
+
 std::vector<cc0::Token> _tokenize(std::istream& input) {
 	cc0::Tokenizer tkz(input);
-	auto p = tkz.AllTokens();
+	std::pair<std::vector<cc0::Token>, std::optional<cc0::CompilationError>> p;
+	{
+		cc0::MemStats::Scope scope(mem_stats, "tokenize");
+		p = tkz.AllTokens();
+	}
 	if (p.second.has_value()) {
 		fmt::print(stderr, "Tokenization error: {}\n", p.second.value());
 		exit(2);
 	}
-	return p.first;
-}
-
-void Tokenize(std::istream& input, std::ostream& output) {
-	auto v = _tokenize(input);
-	for (auto& it : v)
-		output << fmt::format("{}\n", it);
-	return;
+	return std::move(p.first);
 }
 
-void ToAssembly(std::istream& input, std::ostream& output){
-	auto tks = _tokenize(input);
-	// 打印词法分析输出结果
-//    for (auto& it : tks)
-//        output << fmt::format("{}\n", it);
-	cc0::Analyser analyser(tks);
-	auto p = analyser.Analyse();
+// 语法分析并生成代码，编译结果直接移动出来，不拷贝
+cc0::Program _analyse(std::vector<cc0::Token> tks) {
+	cc0::Analyser analyser(std::move(tks));
+	std::pair<cc0::Program, std::optional<cc0::CompilationError>> p;
+	{
+		cc0::MemStats::Scope scope(mem_stats, "analyse");
+		p = analyser.Analyse();
+	}
+	if (mem_stats != nullptr)
+		mem_stats->setFunctionAllocs(analyser.getFunctionAllocs());
 //	analyser.printSym();
 	if (p.second.has_value()) {
 		fmt::print(stderr, "Syntactic analysis error: {}\n", p.second.value());
 		exit(2);
 	}
-	// 输出常量表
-	auto consts = analyser.getConstants();
-	auto const_size = consts.size();
-	output << ".constants:" << std::endl;
-	for(int i=0; i<const_size; i++) {
-	    //          下标  常量的类型       常量的值
-	    output << i << " S \"" << consts[i].getName() << "\"" << std::endl;
-	    // 这里其实就不让数字放在常量表了
-	}
-
-    // 输出启动代码
-	auto v = p.first;
-	output << ".start:" << std::endl;
-	auto size = v[-1].size();
-	for (int i=0; i<size; i++)
-		output << fmt::format("{}   {}\n", i, v[-1][i]);
-
-	// int32_t funcs_size = analyser.getFuncSize();  // v.size()-1
-	// std::cout << funcs_size << " = " << v.size()-1 << std::endl;
-    // 输出函数表
-    output << ".functions:" << std::endl;
-    int funcIndex = 0;
-    for(int i=0; i<const_size; i++) {
-        if(consts[i].isFunction())
-            //          下标 函数名在.constants中的下标 参数占用的slot数 函数嵌套的层级
-            output << funcIndex++ << " " << i << " " << consts[i].getParamNum() << " 1" << std::endl;
-    }
-
-    funcIndex = 0;
-    for(int i=0; i<const_size; i++) {
-        // 注意函数在const的位置i就是函数指令在vector的位置
-        if(consts[i].isFunction()) {
-            output << ".F" << funcIndex << ":" << std::endl;
-            funcIndex++;
-            // auto index = consts[i].getIndex(); 就是 i
-            auto size = v[i].size();
-            for(int j=0; j<size; j++)
-                output << fmt::format("{}   {}\n", j, v[i][j]);
-        }
-    }
-
-	return;
+	return std::move(p.first);
 }
 
-void writeBytes(void* addr, int count, std::ostream& out) {
-    char bytes[8];
-    assert(0 < count && count <= 8);
-    char* p = reinterpret_cast<char*>(addr) + (count-1);
-    for(int i=0; i<count; i++)
-        bytes[i] = *p--;
-    out.write(bytes, count);
+// 按优化级别优化，show_stats 时把每个优化删掉了多少指令输出到 stderr
+void Optimize(cc0::Program& program, int level, bool show_stats) {
+	cc0::MemStats::Scope scope(mem_stats, "optimize");
+	cc0::Optimizer optimizer(level);
+	optimizer.run(program);
+	if (show_stats)
+		fmt::print(stderr, "{}", optimizer.report());
 }
 
-void ToBinary(std::istream& input, std::ostream& out) {
-    auto tks = _tokenize(input);
-    cc0::Analyser analyser(tks);
-    auto p = analyser.Analyse();
-//	analyser.printSym();
-    if (p.second.has_value()) {
-        fmt::print(stderr, "Syntactic analysis error: {}\n", p.second.value());
-        exit(2);
-    }
-    // 获取常量表
-    auto consts = analyser.getConstants();
+// 校验生成的字节码，出错时报告位置并退出，否则把每个函数的最大栈深度输出到 stderr
+void Verify(const cc0::Program& program) {
+	cc0::MemStats::Scope scope(mem_stats, "verify");
+	cc0::Verifier verifier(program);
+	auto err = verifier.run();
+	if (err.has_value()) {
+		auto& e = err.value();
+		std::string where = ".start";
+		if (e.function != -1)
+			where = std::string(program.getConstants().getString(program.getFunctions()[e.function].getNameIndex()));
+		fmt::print(stderr, "Verification error: {} instruction {}: {}\n", where, e.index, e.message);
+		exit(2);
+	}
+	fmt::print(stderr, "{}", verifier.report());
+}
 
-    // 输出 magic
-    out.write("\x43\x30\x3A\x29", 4);
-    // 输出 version
-    out.write("\x00\x00\x00\x01", 4);
+void Tokenize(const std::vector<cc0::Token>& tokens, std::ostream& output) {
+	cc0::MemStats::Scope scope(mem_stats, "emit-tokens");
+	fmt::memory_buffer buf;
+	for (auto& it : tokens)
+		fmt::format_to(buf, "{}\n", it);
+	output.write(buf.data(), buf.size());
+}
 
-    // constants_count
-    cc0::u2 constants_count = consts.size();
-    writeBytes(&constants_count, sizeof(constants_count), out);
-    // constants
-    for(auto& constant: consts) {
-        // 字符串常量（函数、字符串字面量）
-        if(constant.isFunction() || constant.getType()==cc0::SymType::STRING_TYPE) {
-            out.write("\x00", 1);
-            std::string str = constant.getName();
-            cc0::u2 len = str.length();
-            // 输出字符串长度
-            writeBytes(&len, sizeof(len), out);
-            // 再输出字符串内容
-            out.write(str.c_str(), len);
-        } else if(constant.getType() == cc0::SymType::INT_TYPE) {
-            // 整数常量，其实还没有这个东西
-            out.write("\x01", 1);
-            // 那就不写了
-        } else if(constant.getType() == cc0::SymType::DOUBLE_TYPE) {
-            // 浮点数常量，其实也没实现
-            out.write("\x02", 1);
-            // 等实现了再说
-        }
-    }
+void ToAssembly(const cc0::Program& program, std::ostream& output) {
+	cc0::MemStats::Scope scope(mem_stats, "emit-assembly");
+	// 整个汇编文本先格式化到内存里，再一次性输出
+	cc0::AssemblyWriter writer(program);
+	writer.writeTo(output);
+}
 
-    auto to_binary = [&](const std::vector<cc0::Instruction>& v) {
-        // u2 instructions_count;
-        cc0::u2 intro_size = v.size();
-        writeBytes(&intro_size, sizeof(intro_size), out);
-        // Instruction instructions[instructions_count];
-        for(auto& intro: v) {
-            // 输出指令
-            cc0::u1 opt = static_cast<cc0::u1>(intro.getOperation());
-            writeBytes(&opt, sizeof(opt), out);
-            // 指令后有没有参数
-            auto iter = cc0::paramOpt.find(intro.getOperation());
-            if(iter != cc0::paramOpt.end()) {
-                auto params = iter->second;
-                switch(params[0]) {
-                    case 1: {
-                        cc0::u1 x = intro.getX();
-                        writeBytes(&x, 1, out);
-                        break;
-                    }
-                    case 2: {
-                        cc0::u2 x = intro.getX();
-                        writeBytes(&x, 2, out);
-                        break;
-                    }
-                    case 4: {
-                        cc0::u4 x = intro.getX();
-                        writeBytes(&x, 4, out);
-                        break;
-                    }
-                    default:
-                        break;
-                }
-                if(params.size() == 2) {
-                    switch(params[1]) {
-                        case 1: {
-                            cc0::u1 y = intro.getY();
-                            writeBytes(&y, 1, out);
-                            break;
-                        }
-                        case 2: {
-                            cc0::u2 y = intro.getY();
-                            writeBytes(&y, 2, out);
-                            break;
-                        }
-                        case 4: {
-                            cc0::u4 y = intro.getY();
-                            writeBytes(&y, 4, out);
-                            break;
-                        }
-                        default:
-                            break;
-                    }
-                }
-            }
-        }
-    };
+void ToBinary(const cc0::Program& program, std::ostream& out) {
+    cc0::MemStats::Scope scope(mem_stats, "emit-binary");
+    // 整个文件先写进一块缓冲区，再一次性输出
+    cc0::ObjectWriter writer(program);
+    writer.writeTo(out);
+}
 
-    // 指令全在这里: 启动代码、函数指令
-    auto introductions_code = p.first;
-    // start_code
-    auto start_code = introductions_code[-1];
-    to_binary(start_code);
+// 一次编译可以同时生成多种输出
+struct Output {
+	const char* flag;       // 命令行参数
+	const char* extension;  // 同时生成多种输出时，文件名 = 基本名 + 后缀
+	std::string file;
+	std::ofstream stream;
+};
 
-    // functions_count
-    cc0::u2 functions_count = introductions_code.size() - 1;
-    writeBytes(&functions_count, sizeof(functions_count), out);
+// 去掉文件名的后缀：foo/bar.c0 -> foo/bar
+std::string stripExtension(const std::string& file) {
+	auto dot = file.find_last_of('.');
+	auto slash = file.find_last_of("/\\");
+	if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+		return file;
+	return file.substr(0, dot);
+}
 
-    // functions
-    for(int i=0; i<constants_count; i++) {
-        // 注意常量和函数是放在一起的
-        if(consts[i].isFunction()) {
-            // u2 name_index; // name: CO_binary_file.strings[name_index]
-            cc0::u2 funcIndex = i;
-            writeBytes(&funcIndex, sizeof(funcIndex), out);
-            // u2 params_size;
-            cc0::u2 paramSize = consts[i].getParamNum();
-            writeBytes(&paramSize, sizeof(paramSize), out);
-            // u2 level;
-            cc0::u2 level = 1;
-            writeBytes(&level, sizeof(level), out);
-            to_binary(introductions_code[i]);
-        }
-    }
-    return;
+// 打开输出文件，"-" 表示标准输出
+std::ostream* openOutput(Output& output) {
+	if (output.file == "-")
+		return &std::cout;
+	output.stream.open(output.file, std::ios::out | std::ios::trunc | std::ios::binary);
+	if (!output.stream) {
+		fmt::print(stderr, "Fail to open {} for writing.\n", output.file);
+		exit(2);
+	}
+	return &output.stream;
 }
 
 int main(int argc, char** argv) {
 	argparse::ArgumentParser program("cc0");
 	program.add_argument("input")
 		.help("speicify the file to be compiled.");
+	program.add_argument("-t")
+		.default_value(false)
+		.implicit_value(true)
+		.help("dump the tokens of the input file.");
 	program.add_argument("-c")
 		.default_value(false)
 		.implicit_value(true)
@@ -234,7 +145,32 @@ int main(int argc, char** argv) {
 	program.add_argument("-o", "--output")
 		.required()
 		.default_value(std::string("-"))
-		.help("specify the output file.");
+		.help("specify the output file. With several of -t/-s/-c it is the base name, "
+		      "and .tokens/.s/.o are appended (default: the input file name without its extension).");
+	program.add_argument("-O0")
+		.default_value(false)
+		.implicit_value(true)
+		.help("do not optimize (default).");
+	program.add_argument("-O1")
+		.default_value(false)
+		.implicit_value(true)
+		.help("fold constants, turn self tail calls into loops, run the peephole optimizer and drop unused functions.");
+	program.add_argument("-O2")
+		.default_value(false)
+		.implicit_value(true)
+		.help("-O1 plus liveness-based local slot allocation, inlining of small leaf functions, loop-invariant code motion, local common-subexpression elimination and SSA-based folding, global value numbering, code motion and dead code elimination.");
+	program.add_argument("--opt-stats")
+		.default_value(false)
+		.implicit_value(true)
+		.help("print how many instructions and bytes each optimization removed to stderr.");
+	program.add_argument("--verify")
+		.default_value(false)
+		.implicit_value(true)
+		.help("verify the generated code (stack heights and slot types) and print the maximum stack depth of each function to stderr.");
+	program.add_argument("--mem-stats")
+		.default_value(false)
+		.implicit_value(true)
+		.help("print allocation counts and peak memory of each phase to stderr as JSON.");
 
 	try {
 		program.parse_args(argc, argv);
@@ -247,10 +183,38 @@ int main(int argc, char** argv) {
 
 	auto input_file = program.get<std::string>("input");
 	auto output_file = program.get<std::string>("--output");
+
+	Output outputs[] = {
+		{ "-t", ".tokens", "", {} },
+		{ "-s", ".s", "", {} },
+		{ "-c", ".o", "", {} },
+	};
+	Output& tokens_output = outputs[0];
+	Output& assembly_output = outputs[1];
+	Output& binary_output = outputs[2];
+	int requested = 0;
+	for (auto& output : outputs)
+		requested += program[output.flag] == true;
+	if (requested == 0) {
+		fmt::print(stderr, "You must choose tokenization or syntactic analysis.");
+		exit(2);
+	}
+	// 只有一种输出时 -o 就是文件名；有多种输出时 -o 是基本名
+	std::string base = output_file;
+	if (requested > 1 && base == "-") {
+		base = stripExtension(input_file);
+		if (base == "-") {
+			fmt::print(stderr, "Several outputs need a base name from -o when reading from stdin.\n");
+			exit(2);
+		}
+	}
+	for (auto& output : outputs) {
+		if (program[output.flag] == true)
+			output.file = requested > 1 ? base + output.extension : output_file;
+	}
+
 	std::istream* input;
-	std::ostream* output;
 	std::ifstream inf;
-	std::ofstream outf;
 	if (input_file != "-") {
 		inf.open(input_file, std::ios::in);
 		if (!inf) {
@@ -261,30 +225,51 @@ int main(int argc, char** argv) {
 	}
 	else
 		input = &std::cin;
-	if (output_file != "-") {
-		outf.open(output_file, std::ios::out | std::ios::trunc);
-		if (!outf) {
-			fmt::print(stderr, "Fail to open {} for writing.\n", output_file);
-			exit(2);
-		}
-		output = &outf;
-	}
-	else
-		output = &std::cout;
-	if (program["-c"] == true && program["-s"] == true) {
-		fmt::print(stderr, "You can only perform tokenization or syntactic analysis at one time.");
-		exit(2);
-	}
-	if (program["-c"] == true) {
-	    // 生成二进制
-		ToBinary(*input, *output);
+
+	// 同时给出多个 -O 时取最高的级别
+	int opt_level = 0;
+	if (program["-O2"] == true)
+		opt_level = 2;
+	else if (program["-O1"] == true)
+		opt_level = 1;
+	bool opt_stats = program["--opt-stats"] == true;
+	bool verify = program["--verify"] == true;
+
+	cc0::MemStats stats;
+	if (program["--mem-stats"] == true) {
+		cc0::MemStats::enable();
+		mem_stats = &stats;
 	}
-	else if (program["-s"] == true) {
-		ToAssembly(*input, *output);
+
+	// 只做一次词法分析和语法分析，结果交给各个输出
+	auto tokens = _tokenize(*input);
+	if (!tokens_output.file.empty())
+		Tokenize(tokens, *openOutput(tokens_output));
+	if (!assembly_output.file.empty() || !binary_output.file.empty()) {
+		auto program = _analyse(std::move(tokens));
+		if (opt_level > 0)
+			Optimize(program, opt_level, opt_stats);
+		if (verify)
+			Verify(program);
+		if (!assembly_output.file.empty())
+			ToAssembly(program, *openOutput(assembly_output));
+		if (!binary_output.file.empty()) {
+			// .o 里的数量都是 u2，超出时报错，不能截断后输出一个坏文件
+			auto err = program.checkLimits();
+			if (err.has_value()) {
+				fmt::print(stderr, "Object file error: {}\n", err.value());
+				exit(2);
+			}
+			ToBinary(program, *openOutput(binary_output));
+		}
 	}
-	else {
-		fmt::print(stderr, "You must choose tokenization or syntactic analysis.");
-		exit(2);
+
+	if (mem_stats != nullptr) {
+		// 先把输出写完，emit 阶段才算完整
+		for (auto& output : outputs)
+			output.stream.flush();
+		std::cout.flush();
+		fmt::print(stderr, "{}", stats.toJson());
 	}
 	return 0;
-}
\ No newline at end of file
+}
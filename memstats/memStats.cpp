@@ -0,0 +1,212 @@
+#include "memstats/memStats.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#elif defined(__APPLE__)
+#include <malloc/malloc.h>
+#elif defined(_WIN32)
+#include <malloc.h>
+#endif
+
+namespace {
+    using std::uint64_t;
+
+    // 只有 --mem-stats 时才计数，平时 new/delete 只多读一次这个标志
+    std::atomic<bool> g_enabled{false};
+    std::atomic<uint64_t> g_allocations{0};
+    std::atomic<uint64_t> g_deallocations{0};
+    std::atomic<uint64_t> g_bytes{0};
+    // 开始计数之前分配的块也可能在之后释放，存活字节数可能暂时是负的
+    std::atomic<std::int64_t> g_live_bytes{0};
+    std::atomic<std::int64_t> g_peak_live_bytes{0};
+
+    // 分配块的实际大小，new 和 delete 两边用同一个口径计算存活字节数
+    // 平台不支持时返回 0，这时只统计次数和 new 申请的字节数
+    std::size_t blockSize(void* p) {
+#if defined(__GLIBC__)
+        return malloc_usable_size(p);
+#elif defined(__APPLE__)
+        return malloc_size(p);
+#elif defined(_WIN32)
+        return _msize(p);
+#else
+        (void)p;
+        return 0;
+#endif
+    }
+
+    void* allocate(std::size_t size) {
+        if (size == 0)
+            size = 1;
+        void* p;
+        while ((p = std::malloc(size)) == nullptr) {
+            auto handler = std::get_new_handler();
+            if (handler == nullptr)
+                throw std::bad_alloc();
+            handler();
+        }
+        if (!g_enabled.load(std::memory_order_relaxed))
+            return p;
+        g_allocations.fetch_add(1, std::memory_order_relaxed);
+        g_bytes.fetch_add(size, std::memory_order_relaxed);
+        auto block = static_cast<std::int64_t>(blockSize(p));
+        auto live = g_live_bytes.fetch_add(block, std::memory_order_relaxed) + block;
+        auto peak = g_peak_live_bytes.load(std::memory_order_relaxed);
+        while (live > peak && !g_peak_live_bytes.compare_exchange_weak(peak, live, std::memory_order_relaxed))
+            ;
+        return p;
+    }
+
+    void deallocate(void* p) {
+        if (p == nullptr)
+            return;
+        if (g_enabled.load(std::memory_order_relaxed)) {
+            g_deallocations.fetch_add(1, std::memory_order_relaxed);
+            g_live_bytes.fetch_sub(static_cast<std::int64_t>(blockSize(p)), std::memory_order_relaxed);
+        }
+        std::free(p);
+    }
+
+    uint64_t nonNegative(std::int64_t value) {
+        return value < 0 ? 0 : static_cast<uint64_t>(value);
+    }
+
+    // 从 /proc/self/status 读取 VmHWM（RSS 峰值，单位 KB），读不到返回 -1
+    std::int64_t readPeakRss() {
+#if defined(__linux__)
+        std::FILE* f = std::fopen("/proc/self/status", "r");
+        if (f == nullptr)
+            return -1;
+        char line[256];
+        std::int64_t kb = -1;
+        while (std::fgets(line, sizeof(line), f) != nullptr) {
+            if (std::strncmp(line, "VmHWM:", 6) == 0) {
+                kb = std::strtoll(line + 6, nullptr, 10);
+                break;
+            }
+        }
+        std::fclose(f);
+        return kb;
+#else
+        return -1;
+#endif
+    }
+
+    // 把 RSS 峰值重置为当前 RSS，这样每个阶段的峰值互不影响
+    // 需要 Linux 4.0 以上；失败时读到的是进程启动以来的峰值
+    void resetPeakRss() {
+#if defined(__linux__)
+        std::FILE* f = std::fopen("/proc/self/clear_refs", "w");
+        if (f == nullptr)
+            return;
+        std::fputs("5", f);
+        std::fclose(f);
+#endif
+    }
+
+    void appendField(std::string& out, const char* key, std::int64_t value, bool last = false) {
+        out += '"';
+        out += key;
+        out += "\": ";
+        out += std::to_string(value);
+        if (!last)
+            out += ", ";
+    }
+
+    void appendField(std::string& out, const char* key, uint64_t value, bool last = false) {
+        appendField(out, key, static_cast<std::int64_t>(value), last);
+    }
+}
+
+// 替换全局的 operator new/delete，数组版本和 nothrow 版本默认会转发到这里
+// 对齐版本（align_val_t）没有替换，它们的分配不计入统计
+void* operator new(std::size_t size) {
+    return allocate(size);
+}
+
+void operator delete(void* p) noexcept {
+    deallocate(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+    deallocate(p);
+}
+
+namespace cc0 {
+
+    void MemStats::enable() {
+        g_enabled.store(true, std::memory_order_relaxed);
+    }
+
+    AllocCounters MemStats::counters() {
+        AllocCounters c;
+        c.allocations = g_allocations.load(std::memory_order_relaxed);
+        c.deallocations = g_deallocations.load(std::memory_order_relaxed);
+        c.bytes = g_bytes.load(std::memory_order_relaxed);
+        c.live_bytes = nonNegative(g_live_bytes.load(std::memory_order_relaxed));
+        c.peak_live_bytes = nonNegative(g_peak_live_bytes.load(std::memory_order_relaxed));
+        return c;
+    }
+
+    AllocDelta MemStats::since(const AllocCounters& start) {
+        auto now = counters();
+        return { now.allocations - start.allocations, now.deallocations - start.deallocations, now.bytes - start.bytes };
+    }
+
+    void MemStats::begin(const char* name) {
+        _name = name;
+        // 堆的峰值从当前存活的字节数重新开始算
+        g_peak_live_bytes.store(g_live_bytes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        resetPeakRss();
+        _start = counters();
+    }
+
+    void MemStats::end() {
+        auto now = counters();
+        _phases.push_back({_name,
+                           now.allocations - _start.allocations,
+                           now.deallocations - _start.deallocations,
+                           now.bytes - _start.bytes,
+                           now.peak_live_bytes,
+                           now.live_bytes,
+                           readPeakRss()});
+    }
+
+    std::string MemStats::toJson() const {
+        std::string out = "{\n  \"phases\": [\n";
+        for (std::size_t i = 0; i < _phases.size(); i++) {
+            auto& phase = _phases[i];
+            out += "    {\"name\": \"" + phase.name + "\", ";
+            appendField(out, "allocations", phase.allocations);
+            appendField(out, "deallocations", phase.deallocations);
+            appendField(out, "bytes", phase.bytes);
+            appendField(out, "peak_heap_bytes", phase.peak_heap_bytes);
+            appendField(out, "live_heap_bytes", phase.live_heap_bytes);
+            appendField(out, "peak_rss_kb", phase.peak_rss_kb, true);
+            out += i + 1 == _phases.size() ? "}\n" : "},\n";
+        }
+        out += "  ],\n  \"functions\": [\n";
+        for (std::size_t i = 0; i < _functions.size(); i++) {
+            out += "    {";
+            auto& [name, allocs] = _functions[i];
+            out += "\"function\": \"" + name + "\", ";
+            appendField(out, "allocations", allocs.allocations);
+            appendField(out, "deallocations", allocs.deallocations);
+            appendField(out, "bytes", allocs.bytes, true);
+            out += i + 1 == _functions.size() ? "}\n" : "},\n";
+        }
+        auto total = counters();
+        out += "  ],\n  \"total\": {";
+        appendField(out, "allocations", total.allocations);
+        appendField(out, "deallocations", total.deallocations);
+        appendField(out, "bytes", total.bytes, true);
+        out += "}\n}\n";
+        return out;
+    }
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace cc0 {
+
+    // 全局 operator new/delete 的计数
+    // memStats.cpp 替换了全局的 new/delete，MemStats::enable() 之后所有经过它们的分配都会被统计
+    struct AllocCounters {
+        std::uint64_t allocations = 0;    // new 的次数
+        std::uint64_t deallocations = 0;  // delete 的次数
+        std::uint64_t bytes = 0;          // new 申请的总字节数
+        std::uint64_t live_bytes = 0;     // 当前还没释放的字节数
+        std::uint64_t peak_live_bytes = 0;
+    };
+
+    // 一段时间内（例如分析一个函数时）经过全局 new/delete 的分配
+    struct AllocDelta {
+        std::uint64_t allocations = 0;
+        std::uint64_t deallocations = 0;
+        std::uint64_t bytes = 0;
+    };
+    // 每个函数名和分析它时的分配，按源码里的顺序。
+    // 优化会删掉函数、改变 .functions 里的下标，所以用函数名对应
+    using FunctionAllocs = std::vector<std::pair<std::string, AllocDelta>>;
+
+    // 记录编译各个阶段（词法分析、语法分析、输出）的内存使用，--mem-stats 时启用
+    // 每个阶段统计：分配次数、字节数、堆的峰值，以及进程常驻内存（RSS）的峰值
+    class MemStats final {
+    public:
+        // 一个阶段的统计结果
+        struct Phase {
+            std::string name;
+            std::uint64_t allocations;
+            std::uint64_t deallocations;
+            std::uint64_t bytes;
+            std::uint64_t peak_heap_bytes;  // 阶段内堆上同时存活的最大字节数
+            std::uint64_t live_heap_bytes;  // 阶段结束时还没释放的字节数
+            std::int64_t peak_rss_kb;       // 阶段内 RSS 的峰值，拿不到时为 -1
+        };
+
+        // 在作用域内统计一个阶段；stats 为 nullptr 时什么也不做
+        class Scope final {
+        public:
+            Scope(MemStats* stats, const char* name) : _stats(stats) {
+                if (_stats != nullptr)
+                    _stats->begin(name);
+            }
+            ~Scope() {
+                if (_stats != nullptr)
+                    _stats->end();
+            }
+            Scope(const Scope&) = delete;
+            Scope& operator=(const Scope&) = delete;
+        private:
+            MemStats* _stats;
+        };
+
+    public:
+        MemStats() = default;
+
+        // 开始/结束一个阶段，阶段不能嵌套
+        void begin(const char* name);
+        void end();
+        // 语法分析时每个函数的分配
+        void setFunctionAllocs(const FunctionAllocs& allocs) { _functions = allocs; }
+
+        const std::vector<Phase>& getPhases() const { return _phases; }
+        std::string toJson() const;
+
+        // 开始计数，只在 --mem-stats 时调用；之前的分配不计入
+        static void enable();
+        // 当前的计数，没有 enable() 时都是 0
+        static AllocCounters counters();
+        // start 之后的分配次数、释放次数和字节数
+        static AllocDelta since(const AllocCounters& start);
+
+    private:
+        std::vector<Phase> _phases;
+        FunctionAllocs _functions;
+        // 当前阶段开始时的计数
+        std::string _name;
+        AllocCounters _start;
+    };
+}
@@ -0,0 +1,238 @@
+#include "optimizer/cfg.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace cc0 {
+
+    ControlFlowGraph::ControlFlowGraph(const std::vector<Instruction>& code) {
+        _offsets.resize(code.size() + 1);
+        uint32_t offset = 0;
+        for(std::size_t i=0; i<code.size(); i++) {
+            _offsets[i] = offset;
+            offset += opcodeInfo(code[i].getOperation()).size;
+        }
+        _offsets[code.size()] = offset;
+
+        buildBlocks(code);
+        computeOrder();
+        computeDominators();
+        findLoops();
+    }
+
+    int32_t ControlFlowGraph::blockOf(int32_t index) const {
+        if(index < 0 || index >= static_cast<int32_t>(_block_of.size()))
+            return -1;
+        return _block_of[index];
+    }
+
+    bool ControlFlowGraph::dominates(int32_t a, int32_t b) const {
+        if(!isReachable(a) || !isReachable(b))
+            return false;
+        return _dom_pre[a] <= _dom_pre[b] && _dom_post[b] <= _dom_post[a];
+    }
+
+    int32_t ControlFlowGraph::indexAt(uint32_t offset) const {
+        auto it = std::lower_bound(_offsets.begin(), _offsets.end(), offset);
+        if(it == _offsets.end() || *it != offset)
+            return -1;
+        return static_cast<int32_t>(it - _offsets.begin());
+    }
+
+    // 块的首指令：第一条指令、跳转目标、跳转和返回之后的指令
+    void ControlFlowGraph::buildBlocks(const std::vector<Instruction>& code) {
+        auto n = static_cast<int32_t>(code.size());
+        std::vector<bool> leader(n + 1, false);
+        leader[0] = true;
+        for(int32_t i=0; i<n; i++) {
+            auto& info = opcodeInfo(code[i].getOperation());
+            if(info.is_branch) {
+                auto target = code[i].getX();
+                if(target >= 0 && target < n)
+                    leader[target] = true;
+            }
+            if(info.is_branch || info.is_return)
+                leader[i + 1] = true;
+        }
+
+        _block_of.resize(n);
+        for(int32_t i=0; i<n; i++) {
+            if(leader[i]) {
+                _blocks.emplace_back();
+                _blocks.back().begin = i;
+            }
+            _blocks.back().end = i + 1;
+            _block_of[i] = static_cast<int32_t>(_blocks.size()) - 1;
+        }
+
+        for(std::size_t b=0; b<_blocks.size(); b++) {
+            auto& block = _blocks[b];
+            auto& last = code[block.end - 1];
+            auto& info = opcodeInfo(last.getOperation());
+            auto addEdge = [this, b](int32_t index) {
+                // 跳到代码末尾（index == n）没有后继块
+                auto to = blockOf(index);
+                if(to == -1)
+                    return;
+                auto& succs = _blocks[b].succs;
+                if(std::find(succs.begin(), succs.end(), to) != succs.end())
+                    return;
+                succs.push_back(to);
+                _blocks[to].preds.push_back(static_cast<int32_t>(b));
+            };
+            if(info.is_return)
+                continue;
+            if(last.getOperation() != Operation::JMP)
+                addEdge(block.end);
+            if(info.is_branch)
+                addEdge(last.getX());
+        }
+    }
+
+    // 从入口出发的深度优先遍历，用显式栈避免大函数上递归过深
+    void ControlFlowGraph::computeOrder() {
+        auto n = _blocks.size();
+        _rpo_index.assign(n, -1);
+        if(n == 0)
+            return;
+        std::vector<bool> visited(n, false);
+        // (块, 下一个要访问的后继)
+        std::vector<std::pair<int32_t, std::size_t>> stack;
+        std::vector<int32_t> postorder;
+        postorder.reserve(n);
+        stack.emplace_back(0, 0);
+        visited[0] = true;
+        while(!stack.empty()) {
+            auto& [b, next] = stack.back();
+            auto& succs = _blocks[b].succs;
+            if(next < succs.size()) {
+                auto s = succs[next++];
+                if(!visited[s]) {
+                    visited[s] = true;
+                    stack.emplace_back(s, 0);
+                }
+            }
+            else {
+                postorder.push_back(b);
+                stack.pop_back();
+            }
+        }
+        _rpo.assign(postorder.rbegin(), postorder.rend());
+        for(std::size_t i=0; i<_rpo.size(); i++)
+            _rpo_index[_rpo[i]] = static_cast<int32_t>(i);
+    }
+
+    // Cooper, Harvey, Kennedy: A Simple, Fast Dominance Algorithm
+    void ControlFlowGraph::computeDominators() {
+        if(_rpo.empty())
+            return;
+        auto intersect = [this](int32_t a, int32_t b) {
+            while(a != b) {
+                while(_rpo_index[a] > _rpo_index[b])
+                    a = _blocks[a].idom;
+                while(_rpo_index[b] > _rpo_index[a])
+                    b = _blocks[b].idom;
+            }
+            return a;
+        };
+        _blocks[_rpo[0]].idom = _rpo[0];
+        bool changed = true;
+        while(changed) {
+            changed = false;
+            for(std::size_t i=1; i<_rpo.size(); i++) {
+                auto b = _rpo[i];
+                int32_t idom = -1;
+                for(auto p : _blocks[b].preds) {
+                    if(_blocks[p].idom == -1)
+                        continue;
+                    idom = idom == -1 ? p : intersect(p, idom);
+                }
+                if(_blocks[b].idom != idom) {
+                    _blocks[b].idom = idom;
+                    changed = true;
+                }
+            }
+        }
+
+        // 给支配树编号
+        auto n = _blocks.size();
+        std::vector<std::vector<int32_t>> children(n);
+        for(std::size_t i=1; i<_rpo.size(); i++)
+            children[_blocks[_rpo[i]].idom].push_back(_rpo[i]);
+        _dom_pre.assign(n, -1);
+        _dom_post.assign(n, -1);
+        int32_t pre = 0, post = 0;
+        std::vector<std::pair<int32_t, std::size_t>> stack;
+        stack.emplace_back(_rpo[0], 0);
+        _dom_pre[_rpo[0]] = pre++;
+        while(!stack.empty()) {
+            auto& [b, next] = stack.back();
+            if(next < children[b].size()) {
+                auto c = children[b][next++];
+                _dom_pre[c] = pre++;
+                stack.emplace_back(c, 0);
+            }
+            else {
+                _dom_post[b] = post++;
+                stack.pop_back();
+            }
+        }
+    }
+
+    // 按逆后序从后往前处理循环头，内层循环先于外层被发现：
+    // 从回边起点沿前驱往回走，遇到已经属于某个循环的块就跳到那个循环当前最外层的头，
+    // 并把它挂到新循环下面，这样每个块只会被加入一次
+    void ControlFlowGraph::findLoops() {
+        auto outermost = [this](int32_t loop) {
+            while(_loops[loop].parent != -1)
+                loop = _loops[loop].parent;
+            return loop;
+        };
+
+        for(auto it = _rpo.rbegin(); it != _rpo.rend(); ++it) {
+            auto header = *it;
+            std::vector<int32_t> latches;
+            for(auto p : _blocks[header].preds)
+                if(dominates(header, p))
+                    latches.push_back(p);
+            if(latches.empty())
+                continue;
+
+            auto current = static_cast<int32_t>(_loops.size());
+            _loops.emplace_back();
+            _loops[current].header = header;
+            _loops[current].latches = latches;
+            _blocks[header].loop = current;
+
+            std::vector<int32_t> worklist(latches.begin(), latches.end());
+            while(!worklist.empty()) {
+                auto b = worklist.back();
+                worklist.pop_back();
+                if(b == header || !isReachable(b))
+                    continue;
+                if(_blocks[b].loop == -1) {
+                    _blocks[b].loop = current;
+                    worklist.insert(worklist.end(), _blocks[b].preds.begin(), _blocks[b].preds.end());
+                    continue;
+                }
+                auto inner = outermost(_blocks[b].loop);
+                if(inner == current)
+                    continue;
+                _loops[inner].parent = current;
+                auto& preds = _blocks[_loops[inner].header].preds;
+                worklist.insert(worklist.end(), preds.begin(), preds.end());
+            }
+        }
+
+        // 外层循环在 _loops 里排在后面，从后往前就能先算出外层的深度
+        for(auto i = static_cast<int32_t>(_loops.size()) - 1; i >= 0; i--)
+            if(_loops[i].parent != -1)
+                _loops[i].depth = _loops[_loops[i].parent].depth + 1;
+        for(auto b : _rpo)
+            for(auto loop = _blocks[b].loop; loop != -1; loop = _loops[loop].parent)
+                if(b != _loops[loop].header)
+                    _loops[loop].blocks.push_back(b);
+        for(auto& loop : _loops)
+            loop.blocks.insert(loop.blocks.begin(), loop.header);
+    }
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "instruction/instruction.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace cc0 {
+
+    // 基本块：指令下标区间 [begin, end)，只有第一条指令可以是跳转目标，
+    // 只有最后一条指令可以是跳转或返回
+    struct BasicBlock {
+        std::int32_t begin = 0;
+        std::int32_t end = 0;
+        std::vector<std::int32_t> preds;
+        // 顺序执行的后继在前，跳转目标在后；两者相同时只记一次
+        std::vector<std::int32_t> succs;
+        std::int32_t idom = -1;   // 直接支配者，入口块是它自己，不可达的块是 -1
+        std::int32_t loop = -1;   // 所在的最内层循环，不在循环里是 -1
+    };
+
+    // 自然循环：由回边 latch -> header（header 支配 latch）确定
+    struct Loop {
+        std::int32_t header = 0;
+        std::int32_t parent = -1;              // 外层循环
+        std::int32_t depth = 1;                // 最外层是 1
+        std::vector<std::int32_t> latches;     // 回边的起点
+        std::vector<std::int32_t> blocks;      // 循环里所有的块（包括内层循环的），header 在最前
+    };
+
+    // 一个函数（或启动代码）的控制流图
+    // 构建的各个步骤都是线性的（支配树用 Cooper-Harvey-Kennedy 的迭代算法，
+    // 在结构化代码上一两轮就收敛），大函数上也可以放心使用
+    class ControlFlowGraph final {
+    private:
+        using int32_t = std::int32_t;
+        using uint32_t = std::uint32_t;
+
+    public:
+        explicit ControlFlowGraph(const std::vector<Instruction>& code);
+
+        // 块 0 是入口
+        const std::vector<BasicBlock>& blocks() const { return _blocks; }
+        const BasicBlock& block(int32_t b) const { return _blocks[b]; }
+        // 可达块的逆后序，入口在最前
+        const std::vector<int32_t>& reversePostOrder() const { return _rpo; }
+        // 内层循环总是排在外层循环之前
+        const std::vector<Loop>& loops() const { return _loops; }
+
+        // 指令所在的块；index 等于指令条数时（跳到函数末尾）返回 -1
+        int32_t blockOf(int32_t index) const;
+        bool isReachable(int32_t b) const { return _blocks[b].idom != -1; }
+        // a 是否支配 b（包括 a == b）
+        bool dominates(int32_t a, int32_t b) const;
+        // 块的循环嵌套深度，不在循环里是 0
+        int32_t loopDepth(int32_t b) const { return _blocks[b].loop == -1 ? 0 : _loops[_blocks[b].loop].depth; }
+
+        // 指令下标和它在 CodeBuffer 里字节偏移的相互转换
+        // offsetOf(指令条数) 是代码的总字节数；offset 不在指令边界上时 indexAt 返回 -1
+        uint32_t offsetOf(int32_t index) const { return _offsets[index]; }
+        int32_t indexAt(uint32_t offset) const;
+        // 块的起始字节偏移
+        uint32_t blockOffset(int32_t b) const { return _offsets[_blocks[b].begin]; }
+
+        std::size_t instructionCount() const { return _offsets.size() - 1; }
+
+    private:
+        void buildBlocks(const std::vector<Instruction>& code);
+        void computeOrder();
+        void computeDominators();
+        void findLoops();
+
+    private:
+        std::vector<BasicBlock> _blocks;
+        std::vector<Loop> _loops;
+        std::vector<int32_t> _rpo;
+        // 块在逆后序里的位置，不可达是 -1
+        std::vector<int32_t> _rpo_index;
+        // 支配树上先序、后序遍历的序号，用来 O(1) 判断支配关系
+        std::vector<int32_t> _dom_pre;
+        std::vector<int32_t> _dom_post;
+        // 每条指令所在的块
+        std::vector<int32_t> _block_of;
+        // 每条指令的字节偏移，最后多一项是总长度
+        std::vector<uint32_t> _offsets;
+    };
+}
@@ -0,0 +1,33 @@
+#include "optimizer/codeEdit.h"
+
+namespace cc0 {
+
+    void retargetJumps(std::vector<Instruction>& code, const std::vector<std::int32_t>& map) {
+        for(auto& instruction : code)
+            if(opcodeInfo(instruction.getOperation()).is_branch)
+                instruction.setX(map[instruction.getX()]);
+    }
+
+    void compactCode(std::vector<Instruction>& code, const std::vector<bool>& keep) {
+        std::vector<std::int32_t> map(code.size() + 1);
+        std::int32_t next = 0;
+        for(std::size_t i=0; i<code.size(); i++) {
+            map[i] = next;
+            if(keep[i])
+                code[next++] = code[i];
+        }
+        map[code.size()] = next;
+        code.resize(next);
+        retargetJumps(code, map);
+    }
+
+    std::vector<bool> findJumpTargets(const std::vector<Instruction>& code) {
+        std::vector<bool> target(code.size() + 1, false);
+        for(auto& instruction : code) {
+            auto x = instruction.getX();
+            if(opcodeInfo(instruction.getOperation()).is_branch && x >= 0 && x <= static_cast<std::int32_t>(code.size()))
+                target[x] = true;
+        }
+        return target;
+    }
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include "instruction/instruction.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace cc0 {
+
+    // 各个优化共用的改写代码的小工具
+
+    // 用旧下标 -> 新下标的映射重定位所有跳转，map 的长度是旧指令条数加 1
+    void retargetJumps(std::vector<Instruction>& code, const std::vector<std::int32_t>& map);
+
+    // 删除 keep 为 false 的指令，跳转目标随之重定位：
+    // 指向被删除指令的跳转改为指向它后面第一条留下的指令
+    void compactCode(std::vector<Instruction>& code, const std::vector<bool>& keep);
+
+    // 每条指令是不是跳转目标，长度是指令条数加 1（最后一项对应代码末尾）
+    std::vector<bool> findJumpTargets(const std::vector<Instruction>& code);
+}
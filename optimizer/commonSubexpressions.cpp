@@ -0,0 +1,356 @@
+#include "optimizer/commonSubexpressions.h"
+#include "optimizer/codeEdit.h"
+
+#include <algorithm>
+#include <array>
+#include <map>
+#include <utility>
+
+namespace cc0 {
+
+    namespace {
+        // 一个块最多用多少个临时 slot
+        constexpr std::int32_t MAX_TEMP_SLOTS = 16;
+        // 第一次算出时存进临时 slot 要多 4 条指令：loada、store、loada、load
+        constexpr std::int32_t SAVE_COST = 4;
+
+        bool isPureOperation(Operation op) {
+            switch(op) {
+                case Operation::IADD: case Operation::ISUB: case Operation::IMUL: case Operation::IDIV:
+                case Operation::INEG: case Operation::ICMP: case Operation::I2C: case Operation::I2D:
+                case Operation::D2I: case Operation::DADD: case Operation::DSUB: case Operation::DMUL:
+                case Operation::DDIV: case Operation::DNEG: case Operation::DCMP:
+                    return true;
+                default:
+                    return false;
+            }
+        }
+
+        bool isCommutative(Operation op) {
+            return op == Operation::IADD || op == Operation::IMUL || op == Operation::DADD || op == Operation::DMUL;
+        }
+
+        // 模拟的操作数栈上的一项
+        struct Item {
+            std::int32_t number = -1;   // 值编号
+            std::int32_t slots = 1;
+            std::int32_t begin = -1;    // 计算它的连续指令 [begin, end]，-1 表示不能整段替换
+            std::int32_t end = -1;
+            bool address = false;       // loada 压入的地址
+            std::int32_t level = 0;
+            std::int32_t offset = 0;
+        };
+
+        // 再次出现的值 [begin, end] 换成 dup 或读临时 slot
+        struct Replacement {
+            std::int32_t end;
+            bool dup;
+            std::int32_t number;
+            std::int32_t length;
+            std::int32_t slots;
+        };
+
+        // 存进临时 slot 的值，第一次出现在 [begin, end]
+        struct Group {
+            std::int32_t begin;
+            std::int32_t end;
+            std::int32_t slots;
+            std::int32_t saved = 0;     // 各次复用省下的指令数
+            std::int32_t offset = -1;   // 在块里的临时 slot 里的位置
+        };
+
+        // 一个基本块里的值编号
+        class BlockNumbering final {
+        private:
+            using int32_t = std::int32_t;
+
+        public:
+            // 操作数的编号组成 key，key 相同的值编号相同
+            int32_t number(const std::array<int32_t, 4>& key) {
+                auto it = _numbers.emplace(key, static_cast<int32_t>(_numbers.size())).first;
+                return it->second;
+            }
+            int32_t fresh() { return number({ -1, _fresh++, 0, 0 }); }
+
+            // 变量当前的版本，store、call 之后读到的是新的值
+            int32_t version(int32_t level, int32_t offset) const {
+                auto it = _versions.find({ level, offset });
+                auto v = std::max(it == _versions.end() ? 0 : it->second, _all_written);
+                return level == 1 ? std::max(v, _globals_written) : v;
+            }
+            void write(int32_t level, int32_t offset) { _versions[{ level, offset }] = ++_clock; }
+            void writeUnknown() { _all_written = ++_clock; }
+            void call() { _globals_written = ++_clock; }
+
+        private:
+            std::map<std::array<int32_t, 4>, int32_t> _numbers;
+            std::map<std::pair<int32_t, int32_t>, int32_t> _versions;
+            int32_t _fresh = 0;
+            int32_t _clock = 0;
+            int32_t _all_written = 0;
+            int32_t _globals_written = 0;
+        };
+    }
+
+    bool CommonSubexpressionEliminator::rewrite(std::vector<Instruction>& code, int32_t params,
+                                                const std::vector<CallEffect>& calls) {
+        auto& consts = _program.getConstants();
+        auto n = static_cast<int32_t>(code.size());
+        auto targets = findJumpTargets(code);
+
+        // 整个函数上的改写，下标都是原来的
+        std::map<int32_t, Replacement> replacements;
+        std::map<int32_t, std::vector<std::pair<int32_t, int32_t>>> save_begin;  // begin -> (end, 临时 slot)
+        std::map<int32_t, std::pair<int32_t, int32_t>> save_end;                 // end -> (临时 slot, slots)
+        std::vector<int32_t> temp_of_replacement(n, -1);
+        int32_t temp_slots = 0;
+        int64_t duplicated = 0;
+        int64_t reused = 0;
+
+        for(int32_t begin=0; begin<n; ) {
+            auto end = begin + 1;
+            while(end < n && !targets[end] && !opcodeInfo(code[end - 1].getOperation()).is_branch
+                  && !opcodeInfo(code[end - 1].getOperation()).is_return)
+                end++;
+
+            BlockNumbering numbering;
+            std::map<int32_t, std::pair<int32_t, int32_t>> first;  // 编号 -> 第一次出现的 [begin, end]
+            std::map<int32_t, int32_t> last_end;                    // 编号 -> 上一次出现的结尾
+            std::map<int32_t, Replacement> block_replacements;
+            std::map<int32_t, Group> groups;
+            std::vector<Item> stack;
+            std::vector<Item> popped;
+
+            // 算完一个值之后看它是否出现过
+            auto finish = [&](const Item& item) {
+                if(item.begin == -1)
+                    return;
+                auto seen = first.find(item.number);
+                if(seen == first.end()) {
+                    first.emplace(item.number, std::make_pair(item.begin, item.end));
+                    last_end[item.number] = item.end;
+                    return;
+                }
+                // 包含在这一次里面的替换不再需要
+                auto it = block_replacements.lower_bound(item.begin);
+                while(it != block_replacements.end() && it->first <= item.end) {
+                    if(!it->second.dup)
+                        groups[it->second.number].saved -= it->second.length - 2;
+                    it = block_replacements.erase(it);
+                }
+                auto length = item.end - item.begin + 1;
+                if(last_end[item.number] == item.begin - 1)
+                    block_replacements.emplace(item.begin, Replacement{ item.end, true, item.number, length, item.slots });
+                else if(!item.address && length > 2) {
+                    auto& group = groups.try_emplace(item.number, Group{ seen->second.first, seen->second.second, item.slots }).first->second;
+                    group.saved += length - 2;
+                    block_replacements.emplace(item.begin, Replacement{ item.end, false, item.number, length, item.slots });
+                }
+                last_end[item.number] = item.end;
+            };
+
+            for(int32_t i=begin; i<end; i++) {
+                auto& instruction = code[i];
+                auto op = instruction.getOperation();
+                int32_t pop, push;
+                if(!stackEffect(instruction, consts, calls, pop, push))
+                    return false;
+                Item result;
+                result.begin = i;
+                result.end = i;
+                result.slots = push;
+                if(op == Operation::BIPUSH || op == Operation::IPUSH || op == Operation::LOADC) {
+                    result.number = numbering.number({ 0, op == Operation::LOADC, instruction.getX(), 0 });
+                    stack.push_back(result);
+                    finish(result);
+                    continue;
+                }
+                if(op == Operation::LOADA) {
+                    result.address = true;
+                    result.level = instruction.getX();
+                    result.offset = instruction.getY();
+                    result.number = numbering.number({ 1, result.level, result.offset, 0 });
+                    stack.push_back(result);
+                    finish(result);
+                    continue;
+                }
+
+                // 按 slot 数弹出；弹出半个 double 说明看错了，不改这个函数
+                popped.clear();
+                for(int32_t slots=pop; slots>0; ) {
+                    Item item;
+                    if(!stack.empty()) {
+                        item = stack.back();
+                        stack.pop_back();
+                    }
+                    else
+                        item.number = numbering.fresh();
+                    slots -= item.slots;
+                    if(slots < 0)
+                        return false;
+                    popped.insert(popped.begin(), item);
+                }
+                // 操作数和运算之间不能夹着别的指令，才能整段替换
+                auto next = i;
+                for(auto it=popped.rbegin(); it!=popped.rend(); ++it) {
+                    if(it->begin == -1 || it->end != next - 1)
+                        result.begin = -1;
+                    next = it->begin;
+                    if(result.begin != -1)
+                        result.begin = it->begin;
+                }
+
+                if(op == Operation::ILOAD || op == Operation::DLOAD) {
+                    auto& address = popped[0];
+                    if(address.address) {
+                        auto version = numbering.version(address.level, address.offset);
+                        if(op == Operation::DLOAD)
+                            version = std::max(version, numbering.version(address.level, address.offset + 1));
+                        result.number = numbering.number({ 2, static_cast<int32_t>(op), address.number, version });
+                    }
+                    else {
+                        result.number = numbering.fresh();
+                        result.begin = -1;
+                    }
+                    stack.push_back(result);
+                    finish(result);
+                    continue;
+                }
+                if(op == Operation::ISTORE || op == Operation::DSTORE) {
+                    auto& address = popped[0];
+                    if(address.address)
+                        for(int32_t k=0; k<pop-1; k++)
+                            numbering.write(address.level, address.offset + k);
+                    else
+                        numbering.writeUnknown();
+                    continue;
+                }
+                if(isPureOperation(op)) {
+                    auto a = popped[0].number;
+                    auto b = popped.size() > 1 ? popped[1].number : -1;
+                    if(isCommutative(op) && b < a)
+                        std::swap(a, b);
+                    result.number = numbering.number({ 3, static_cast<int32_t>(op), a, b });
+                    stack.push_back(result);
+                    finish(result);
+                    continue;
+                }
+                if(op == Operation::CALL)
+                    numbering.call();
+                // 其余指令的结果都是新的值，double 作为一项
+                if(push == 2 && op != Operation::SNEW && op != Operation::DUP)
+                    stack.push_back(Item{ numbering.fresh(), 2 });
+                else
+                    for(int32_t k=0; k<push; k++)
+                        stack.push_back(Item{ numbering.fresh(), 1 });
+            }
+
+            // 第一次出现的 [begin, end] 要原样输出，才能在前后插入存临时 slot 的指令：
+            // 和别的替换部分重叠不行；从 dup 开始也不行，dup 复制的是前一个值，中间不能插入 loada
+            auto keepsFirst = [&](const Group& group) {
+                for(auto& [at, replacement] : block_replacements) {
+                    if(at > group.end || replacement.end < group.begin)
+                        continue;
+                    if(at < group.begin || replacement.end > group.end || (at == group.begin && replacement.dup))
+                        return false;
+                }
+                return true;
+            };
+
+            // 省下的指令多于存临时 slot 的代价才用临时 slot，按第一次出现的位置分配
+            int32_t block_slots = 0;
+            std::vector<Group*> saved_groups;
+            for(auto& [number, group] : groups)
+                if(group.saved > SAVE_COST && block_slots + group.slots <= MAX_TEMP_SLOTS && keepsFirst(group)) {
+                    group.offset = block_slots;
+                    block_slots += group.slots;
+                    saved_groups.push_back(&group);
+                }
+            for(auto& [at, replacement] : block_replacements) {
+                if(!replacement.dup) {
+                    auto& group = groups[replacement.number];
+                    if(group.offset == -1)
+                        continue;
+                    temp_of_replacement[at] = params + group.offset;
+                    reused++;
+                }
+                else
+                    duplicated++;
+                replacements.emplace(at, replacement);
+            }
+            for(auto group : saved_groups) {
+                save_begin[group->begin].emplace_back(group->end, params + group->offset);
+                save_end[group->end] = { params + group->offset, group->slots };
+            }
+            temp_slots = std::max(temp_slots, block_slots);
+            begin = end;
+        }
+        if(replacements.empty())
+            return false;
+
+        // 临时 slot 紧挨着参数，其余 loada 0 的偏移后移 temp_slots；跳到开头的（尾调用）跳过 snew
+        std::vector<Instruction> out;
+        std::vector<int32_t> map(n + 1);
+        if(temp_slots > 0)
+            out.emplace_back(Operation::SNEW, temp_slots);
+        for(int32_t i=0; i<n; i++) {
+            map[i] = static_cast<int32_t>(out.size());
+            auto saves = save_begin.find(i);
+            if(saves != save_begin.end()) {
+                // 从同一处开始的，外层的先压地址
+                std::sort(saves->second.begin(), saves->second.end(), std::greater<>());
+                for(auto& [save_end_at, temp] : saves->second)
+                    out.emplace_back(Operation::LOADA, 0, temp);
+            }
+            auto replacement = replacements.find(i);
+            if(replacement != replacements.end()) {
+                auto& r = replacement->second;
+                if(r.dup)
+                    out.emplace_back(r.slots == 2 ? Operation::DUP2 : Operation::DUP);
+                else {
+                    out.emplace_back(Operation::LOADA, 0, temp_of_replacement[i]);
+                    out.emplace_back(r.slots == 2 ? Operation::DLOAD : Operation::ILOAD);
+                }
+                for(auto k=i+1; k<=r.end; k++)
+                    map[k] = static_cast<int32_t>(out.size()) - 1;
+                i = r.end;
+            }
+            else {
+                auto& instruction = code[i];
+                if(instruction.getOperation() == Operation::LOADA && instruction.getX() == 0 && instruction.getY() >= params)
+                    out.emplace_back(Operation::LOADA, 0, instruction.getY() + temp_slots);
+                else
+                    out.push_back(instruction);
+            }
+            auto save = save_end.find(i);
+            if(save != save_end.end()) {
+                auto [temp, slots] = save->second;
+                out.emplace_back(slots == 2 ? Operation::DSTORE : Operation::ISTORE);
+                out.emplace_back(Operation::LOADA, 0, temp);
+                out.emplace_back(slots == 2 ? Operation::DLOAD : Operation::ILOAD);
+            }
+        }
+        map[n] = static_cast<int32_t>(out.size());
+        if(out.size() > static_cast<std::size_t>(MAX_INSTRUCTIONS))
+            return false;
+        retargetJumps(out, map);
+        code.swap(out);
+        _duplicated += duplicated;
+        _reused += reused;
+        _temp_slots += temp_slots;
+        return true;
+    }
+
+    bool CommonSubexpressionEliminator::run() {
+        auto calls = callEffects(_program);
+        bool changed = false;
+        for(auto& func : _program.getFunctions()) {
+            auto code = func.getInstructions().decode();
+            if(!rewrite(code, func.getParamsSize(), calls))
+                continue;
+            func.getInstructions() = CodeBuffer(code);
+            changed = true;
+        }
+        return changed;
+    }
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "analyser/program.h"
+#include "optimizer/stackDepth.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace cc0 {
+
+    // 基本块内的公共子表达式消除：
+    // 沿块模拟操作数栈，给每个值编号（常量、地址、变量的某个版本、运算和操作数的编号），
+    // 编号相同的值再次出现时不再重新计算：
+    //   上一次算出的值正好在栈顶（例如 x * x、x = x + 1 里的两次 loada）就换成 dup/dup2；
+    //   否则第一次算出时顺便存进临时 slot，之后改成 loada + iload，只在能省下指令时才这样做。
+    // 临时 slot 在函数开头用一条 snew 分配，紧挨着参数，其余 loada 0 的偏移随之后移。
+    // store 使变量的旧版本失效，call 使全局变量失效；启动代码里 loada 0 就是全局变量，不做
+    class CommonSubexpressionEliminator final {
+    private:
+        using int32_t = std::int32_t;
+        using int64_t = std::int64_t;
+
+    public:
+        explicit CommonSubexpressionEliminator(Program& program) : _program(program) {}
+
+        // 返回是否修改了程序
+        bool run();
+
+        int64_t getDuplicated() const { return _duplicated; }
+        int64_t getReused() const { return _reused; }
+        int64_t getTempSlots() const { return _temp_slots; }
+
+    private:
+        // 改写一个函数，没有可以消除的表达式时返回 false
+        bool rewrite(std::vector<Instruction>& code, int32_t params, const std::vector<CallEffect>& calls);
+
+    private:
+        Program& _program;
+        int64_t _duplicated = 0;
+        int64_t _reused = 0;
+        int64_t _temp_slots = 0;
+    };
+}
@@ -0,0 +1,403 @@
+#include "optimizer/constantFolding.h"
+#include "optimizer/codeEdit.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace cc0 {
+
+    namespace {
+        // 模拟的操作数栈上的一项
+        struct Value {
+            enum Kind : std::uint8_t { UNKNOWN, INT, DOUBLE };
+            Kind kind = UNKNOWN;
+            std::int32_t slots = 1;  // double 占 2 个 slot
+            std::int32_t i = 0;
+            double d = 0;
+            std::int32_t at = -1;    // out 里压入它的那条指令，-1 表示不是由单条压栈指令得到的
+        };
+
+        bool isConditionalJump(Operation op) {
+            return op >= Operation::JE && op <= Operation::JLE;
+        }
+
+        bool isConstantPush(const Instruction& instruction) {
+            return instruction.getOperation() == Operation::IPUSH || instruction.getOperation() == Operation::BIPUSH;
+        }
+
+        // 按 32 位补码回绕
+        std::int32_t wrap(std::int64_t value) {
+            return static_cast<std::int32_t>(static_cast<std::uint32_t>(value));
+        }
+
+        // int 的二元运算，不能在编译期算的返回 false
+        bool foldInt(Operation op, std::int32_t a, std::int32_t b, std::int32_t& result) {
+            switch(op) {
+                case Operation::IADD: result = wrap(static_cast<std::int64_t>(a) + b); return true;
+                case Operation::ISUB: result = wrap(static_cast<std::int64_t>(a) - b); return true;
+                case Operation::IMUL: result = wrap(static_cast<std::int64_t>(a) * b); return true;
+                case Operation::IDIV:
+                    if(b == 0 || (a == std::numeric_limits<std::int32_t>::min() && b == -1))
+                        return false;
+                    result = a / b;
+                    return true;
+                case Operation::ICMP: result = a < b ? -1 : (a > b ? 1 : 0); return true;
+                default: return false;
+            }
+        }
+
+        // double 的二元运算，结果是 double 或者 int（dcmp）
+        bool foldDouble(Operation op, double a, double b, Value& result) {
+            result.kind = Value::DOUBLE;
+            result.slots = 2;
+            switch(op) {
+                case Operation::DADD: result.d = a + b; return true;
+                case Operation::DSUB: result.d = a - b; return true;
+                case Operation::DMUL: result.d = a * b; return true;
+                case Operation::DDIV:
+                    if(b == 0)
+                        return false;
+                    result.d = a / b;
+                    return true;
+                case Operation::DCMP:
+                    if(std::isnan(a) || std::isnan(b))
+                        return false;
+                    result.kind = Value::INT;
+                    result.slots = 1;
+                    result.i = a < b ? -1 : (a > b ? 1 : 0);
+                    return true;
+                default: return false;
+            }
+        }
+
+        // 条件跳转是否会跳转
+        bool jumpTaken(Operation op, std::int32_t value) {
+            switch(op) {
+                case Operation::JE:  return value == 0;
+                case Operation::JNE: return value != 0;
+                case Operation::JL:  return value < 0;
+                case Operation::JGE: return value >= 0;
+                case Operation::JG:  return value > 0;
+                default:             return value <= 0;  // JLE
+            }
+        }
+    }
+
+    void ConstantFolder::fold(const std::vector<Instruction>& code, const std::vector<bool>& target, int32_t begin, int32_t end,
+                              const KnownSlots* const* levels, std::vector<Instruction>& out, std::vector<int32_t>* map) {
+        auto& consts = _program.getConstants();
+        std::vector<Value> stack;
+
+        // 弹出 n 个 slot；栈里记录的项不够时视为弹出了未知的值
+        auto popSlots = [&stack](int32_t n) {
+            while(n > 0 && !stack.empty()) {
+                n -= stack.back().slots;
+                stack.pop_back();
+            }
+            // 弹出了 double 的一半，说明模拟出错了，之前的都不再可信
+            if(n < 0)
+                stack.clear();
+        };
+        auto pushUnknown = [&stack](int32_t n) {
+            for(int32_t k=0; k<n; k++)
+                stack.emplace_back();
+        };
+        // 记下马上要写入 out 的那条指令压入的已知 int
+        auto pushInt = [&](int32_t value) {
+            Value v;
+            v.kind = Value::INT;
+            v.i = value;
+            v.at = static_cast<int32_t>(out.size());
+            stack.push_back(v);
+        };
+        auto emitInt = [&](int32_t value) {
+            pushInt(value);
+            out.emplace_back(Operation::IPUSH, value);
+        };
+        auto emitDouble = [&](double value) {
+            Value v;
+            v.kind = Value::DOUBLE;
+            v.slots = 2;
+            v.d = value;
+            v.at = static_cast<int32_t>(out.size());
+            stack.push_back(v);
+            out.emplace_back(Operation::LOADC, consts.addDouble(value));
+        };
+        // 栈顶的 n 项都是已知的 kind 类型的值，并且正好是 out 末尾的 n 条指令压入的
+        auto tailKnown = [&](std::size_t n, Value::Kind kind) {
+            if(stack.size() < n || out.size() < n)
+                return false;
+            for(std::size_t k=0; k<n; k++) {
+                auto& v = stack[stack.size() - n + k];
+                if(v.kind != kind || v.at != static_cast<int32_t>(out.size() - n + k))
+                    return false;
+            }
+            return true;
+        };
+        // 去掉栈顶 n 项和压入它们的指令
+        auto dropTail = [&](std::size_t n) {
+            stack.resize(stack.size() - n);
+            out.resize(out.size() - n);
+        };
+
+        for(int32_t i=begin; i<end; i++) {
+            if(map != nullptr)
+                (*map)[i] = static_cast<int32_t>(out.size());
+            // 基本块的开头，栈上的值来自不同的前驱
+            if(target[i])
+                stack.clear();
+            auto& instruction = code[i];
+            auto op = instruction.getOperation();
+            auto& info = opcodeInfo(op);
+
+            switch(op) {
+                case Operation::BIPUSH:
+                case Operation::IPUSH:
+                    pushInt(instruction.getX());
+                    out.push_back(instruction);
+                    continue;
+                case Operation::LOADC:
+                    if(consts.getType(instruction.getX()) == INT_CONSTANT)
+                        pushInt(consts.getInt(instruction.getX()));
+                    else if(consts.getType(instruction.getX()) == DOUBLE_CONSTANT) {
+                        Value v;
+                        v.kind = Value::DOUBLE;
+                        v.slots = 2;
+                        v.d = consts.getDouble(instruction.getX());
+                        v.at = static_cast<int32_t>(out.size());
+                        stack.push_back(v);
+                    }
+                    else
+                        pushUnknown(1);
+                    out.push_back(instruction);
+                    continue;
+                case Operation::LOADA: {
+                    // loada + iload 读的是值已知的 const 变量
+                    auto level = instruction.getX();
+                    if(i + 1 < end && !target[i + 1] && code[i + 1].getOperation() == Operation::ILOAD
+                       && (level == 0 || level == 1) && levels[level] != nullptr) {
+                        auto it = levels[level]->find(instruction.getY());
+                        if(it != levels[level]->end()) {
+                            emitInt(it->second);
+                            _propagated++;
+                            i++;
+                            if(map != nullptr)
+                                (*map)[i] = static_cast<int32_t>(out.size()) - 1;
+                            continue;
+                        }
+                    }
+                    break;
+                }
+                case Operation::IADD:
+                case Operation::ISUB:
+                case Operation::IMUL:
+                case Operation::IDIV:
+                case Operation::ICMP: {
+                    int32_t result;
+                    if(tailKnown(2, Value::INT) && foldInt(op, stack[stack.size() - 2].i, stack.back().i, result)) {
+                        dropTail(2);
+                        emitInt(result);
+                        _folded++;
+                        continue;
+                    }
+                    break;
+                }
+                case Operation::DADD:
+                case Operation::DSUB:
+                case Operation::DMUL:
+                case Operation::DDIV:
+                case Operation::DCMP: {
+                    Value result;
+                    if(tailKnown(2, Value::DOUBLE) && foldDouble(op, stack[stack.size() - 2].d, stack.back().d, result)) {
+                        dropTail(2);
+                        if(result.kind == Value::INT)
+                            emitInt(result.i);
+                        else
+                            emitDouble(result.d);
+                        _folded++;
+                        continue;
+                    }
+                    break;
+                }
+                case Operation::INEG:
+                case Operation::I2C:
+                case Operation::I2D:
+                    if(tailKnown(1, Value::INT)) {
+                        auto value = stack.back().i;
+                        dropTail(1);
+                        if(op == Operation::INEG)
+                            emitInt(wrap(-static_cast<std::int64_t>(value)));
+                        else if(op == Operation::I2C)
+                            emitInt(value & 0xff);
+                        else
+                            emitDouble(value);
+                        _folded++;
+                        continue;
+                    }
+                    break;
+                case Operation::DNEG:
+                case Operation::D2I:
+                    if(tailKnown(1, Value::DOUBLE)) {
+                        auto value = stack.back().d;
+                        // 超出 int 范围的转换在虚拟机里是未定义的，留到运行时
+                        if(op == Operation::D2I && !(value > -2147483649.0 && value < 2147483648.0))
+                            break;
+                        dropTail(1);
+                        if(op == Operation::DNEG)
+                            emitDouble(-value);
+                        else
+                            emitInt(static_cast<int32_t>(value));
+                        _folded++;
+                        continue;
+                    }
+                    break;
+                default:
+                    if(isConditionalJump(op) && tailKnown(1, Value::INT)) {
+                        auto taken = jumpTaken(op, stack.back().i);
+                        dropTail(1);
+                        _branches++;
+                        if(taken) {
+                            out.emplace_back(Operation::JMP, instruction.getX());
+                            stack.clear();
+                        }
+                        continue;
+                    }
+                    break;
+            }
+
+            // 不能折叠的指令照抄，按栈效果更新模拟的栈
+            out.push_back(instruction);
+            if(op == Operation::SNEW)
+                pushUnknown(instruction.getX());
+            else if(op == Operation::POPN)
+                popSlots(instruction.getX());
+            else if(info.pop == VARIABLE_EFFECT || info.push == VARIABLE_EFFECT)
+                stack.clear();  // call：参数个数和返回值都要看被调用的函数，不再跟踪
+            else {
+                popSlots(info.pop);
+                pushUnknown(info.push);
+            }
+            if(info.is_branch || info.is_return)
+                stack.clear();
+        }
+    }
+
+    ConstantFolder::KnownSlots ConstantFolder::evaluateSlots(const std::vector<Instruction>& code, const std::vector<bool>& target,
+                                                             const std::vector<ConstSlot>& slots, const KnownSlots* outer) {
+        KnownSlots known;
+        // 初始化表达式里可以用到同一个栈帧里前面的 const 变量
+        const KnownSlots* levels[2] = { &known, outer };
+        std::vector<Instruction> out;
+        for(auto& slot : slots) {
+            out.clear();
+            fold(code, target, slot.begin, slot.end, levels, out, nullptr);
+            if(out.size() == 1 && isConstantPush(out[0]))
+                known.emplace(slot.offset, out[0].getX());
+        }
+        return known;
+    }
+
+    void ConstantFolder::run() {
+        // 每段代码和它用到的 const 变量
+        struct Frame {
+            std::vector<Instruction> code;
+            std::vector<int32_t> map;
+            std::vector<ConstSlot>* slots;
+            KnownSlots known;
+            std::vector<bool> keep;
+            bool changed = false;
+        };
+        auto& functions = _program.getFunctions();
+        std::vector<Frame> frames(functions.size() + 1);
+        auto& start = frames[0];
+
+        // 先算全局 const 的值，函数里的局部 const 可能用到它们
+        start.code = _program.getStartCode().decode();
+        start.slots = &_program.getGlobalConstSlots();
+        auto start_target = findJumpTargets(start.code);
+        start.known = evaluateSlots(start.code, start_target, *start.slots, nullptr);
+        for(std::size_t f=0; f<functions.size(); f++) {
+            auto& frame = frames[f + 1];
+            frame.code = functions[f].getInstructions().decode();
+            frame.slots = &functions[f].getConstSlots();
+        }
+
+        // 折叠每段代码：启动代码里 level_diff 0 是全局变量；函数里 0 是局部变量，1 是全局变量
+        auto before = _folded + _propagated + _branches;
+        for(std::size_t f=0; f<frames.size(); f++) {
+            auto& frame = frames[f];
+            auto target = f == 0 ? start_target : findJumpTargets(frame.code);
+            if(f != 0)
+                frame.known = evaluateSlots(frame.code, target, *frame.slots, &start.known);
+            const KnownSlots* levels[2] = { &frame.known, f == 0 ? nullptr : &start.known };
+            auto n = static_cast<int32_t>(frame.code.size());
+            std::vector<Instruction> out;
+            out.reserve(frame.code.size());
+            frame.map.resize(n + 1);
+            fold(frame.code, target, 0, n, levels, out, &frame.map);
+            frame.map[n] = static_cast<int32_t>(out.size());
+            retargetJumps(out, frame.map);
+            frame.code.swap(out);
+            frame.keep.assign(frame.code.size(), true);
+            frame.changed = _folded + _propagated + _branches != before;
+            before = _folded + _propagated + _branches;
+        }
+
+        // 删掉不再被读取的 const 变量：初始化代码已经折叠成一条压栈指令，并且没有 loada 再指向它
+        // 从偏移大的往小的删，前面删除时修改的偏移不会影响后面的判断
+        auto removeSlots = [&](Frame& owner, bool global) {
+            std::vector<ConstSlot> slots(owner.slots->begin(), owner.slots->end());
+            std::sort(slots.begin(), slots.end(), [](const ConstSlot& a, const ConstSlot& b) { return a.offset > b.offset; });
+            for(auto& slot : slots) {
+                if(owner.known.find(slot.offset) == owner.known.end())
+                    continue;
+                auto first = owner.map[slot.begin];
+                if(owner.map[slot.end] - first != 1 || !owner.keep[first] || !isConstantPush(owner.code[first]))
+                    continue;
+                // 访问这个栈帧的代码：全局变量是启动代码的 level 0 和所有函数的 level 1
+                auto visit = [&](auto&& action) {
+                    if(!global)
+                        action(owner, 0);
+                    else {
+                        action(frames[0], 0);
+                        for(std::size_t f=1; f<frames.size(); f++)
+                            action(frames[f], 1);
+                    }
+                };
+                bool used = false;
+                visit([&](Frame& frame, int32_t level) {
+                    for(auto& instruction : frame.code)
+                        used = used || (instruction.getOperation() == Operation::LOADA && instruction.getX() == level
+                                        && instruction.getY() == slot.offset);
+                });
+                if(used)
+                    continue;
+                owner.keep[first] = false;
+                owner.changed = true;
+                visit([&](Frame& frame, int32_t level) {
+                    for(auto& instruction : frame.code) {
+                        if(instruction.getOperation() == Operation::LOADA && instruction.getX() == level && instruction.getY() > slot.offset) {
+                            instruction = Instruction(Operation::LOADA, level, instruction.getY() - 1);
+                            frame.changed = true;
+                        }
+                    }
+                });
+                _slots_removed++;
+            }
+        };
+        removeSlots(start, true);
+        for(std::size_t f=1; f<frames.size(); f++)
+            removeSlots(frames[f], false);
+
+        for(std::size_t f=0; f<frames.size(); f++) {
+            auto& frame = frames[f];
+            if(frame.changed) {
+                compactCode(frame.code, frame.keep);
+                (f == 0 ? _program.getStartCode() : functions[f - 1].getInstructions()) = CodeBuffer(frame.code);
+            }
+            // 下标已经不再对应，以后的优化不能再用
+            frame.slots->clear();
+        }
+    }
+}
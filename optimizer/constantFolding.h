@@ -0,0 +1,52 @@
+#pragma once
+
+#include "analyser/program.h"
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace cc0 {
+
+    // 常量折叠和常量传播：
+    // 在基本块内模拟操作数栈，操作数都是紧挨着压入的常量时，把计算（含类型转换、比较）换成结果的压栈；
+    // 条件已知的 jcc 换成 jmp 或直接删掉；
+    // 初始化表达式能折叠成常量的 int/char const 变量，把读取它的 loada + iload 换成常量，
+    // 之后它的栈上位置不再被使用，就连同初始化代码一起删掉，后面的变量的偏移前移。
+    // int 运算按 32 位补码回绕，和虚拟机一致；除以 0 和 INT_MIN / -1 留到运行时
+    class ConstantFolder final {
+    private:
+        using int32_t = std::int32_t;
+        using int64_t = std::int64_t;
+
+    public:
+        explicit ConstantFolder(Program& program) : _program(program) {}
+
+        void run();
+
+        int64_t getFolded() const { return _folded; }
+        int64_t getPropagated() const { return _propagated; }
+        int64_t getBranchesFolded() const { return _branches; }
+        int64_t getSlotsRemoved() const { return _slots_removed; }
+
+    private:
+        // 一个栈帧里值已知的 const 变量：偏移 -> 值
+        using KnownSlots = std::unordered_map<int32_t, int32_t>;
+
+        // 折叠 code 的 [begin, end)，结果写到 out，跳转的操作数仍是旧下标
+        // target 标出了跳转目标；levels[level_diff] 是 loada 的 level_diff 对应的栈帧里值已知的 const 变量
+        // map 不为空时记录旧下标到新下标的映射
+        void fold(const std::vector<Instruction>& code, const std::vector<bool>& target, int32_t begin, int32_t end,
+                  const KnownSlots* const* levels, std::vector<Instruction>& out, std::vector<int32_t>* map);
+        // 求出一个栈帧里各个 const 变量的值，outer 是外层（全局）栈帧里已知的值
+        KnownSlots evaluateSlots(const std::vector<Instruction>& code, const std::vector<bool>& target,
+                                 const std::vector<ConstSlot>& slots, const KnownSlots* outer);
+
+    private:
+        Program& _program;
+        int64_t _folded = 0;
+        int64_t _propagated = 0;
+        int64_t _branches = 0;
+        int64_t _slots_removed = 0;
+    };
+}
@@ -0,0 +1,118 @@
+#include "optimizer/deadFunctions.h"
+
+#include <utility>
+
+namespace cc0 {
+
+    namespace {
+        // 依次把 code 里 op 指令的第一个操作数交给 visit，visit 返回新的操作数
+        // call 和 loadc 的操作数宽度不变，直接在缓冲区里改
+        template<typename Visit>
+        void rewriteOperands(CodeBuffer& code, Operation op, Visit&& visit) {
+            CodeBuffer::Mark at = { 0, 0 };
+            for(auto it = code.begin(); it != code.end(); ++it) {
+                auto current = it.getOperation();
+                if(current == op) {
+                    auto x = (*it).getX();
+                    auto y = visit(x);
+                    if(y != x)
+                        code.patchX(at, y);
+                }
+                at.offset += opcodeInfo(current).code_size;
+                at.index++;
+            }
+        }
+
+        template<typename Visit>
+        void visitOperands(const CodeBuffer& code, Operation op, Visit&& visit) {
+            for(auto it = code.begin(); it != code.end(); ++it)
+                if(it.getOperation() == op)
+                    visit((*it).getX());
+        }
+    }
+
+    std::vector<bool> DeadFunctionEliminator::findLiveFunctions() const {
+        auto& functions = _program.getFunctions();
+        auto& consts = _program.getConstants();
+        std::vector<bool> live(functions.size(), false);
+        std::vector<int32_t> work;
+        auto call = [&](int32_t index) {
+            if(index >= 0 && index < static_cast<int32_t>(functions.size()) && !live[index]) {
+                live[index] = true;
+                work.push_back(index);
+            }
+        };
+
+        bool has_main = false;
+        for(std::size_t f=0; f<functions.size(); f++) {
+            auto name = functions[f].getNameIndex();
+            if(consts.getType(name) == STRING_CONSTANT && consts.getString(name) == "main") {
+                call(static_cast<int32_t>(f));
+                has_main = true;
+            }
+        }
+        if(!has_main)
+            return {};
+        visitOperands(_program.getStartCode(), Operation::CALL, call);
+        while(!work.empty()) {
+            auto f = work.back();
+            work.pop_back();
+            visitOperands(functions[f].getInstructions(), Operation::CALL, call);
+        }
+        return live;
+    }
+
+    bool DeadFunctionEliminator::run() {
+        auto live = findLiveFunctions();
+        if(live.empty())
+            return false;
+
+        // 删掉不会被调用的函数，记下函数的新序号
+        auto& functions = _program.getFunctions();
+        std::vector<int32_t> order(functions.size(), -1);
+        std::vector<Function> kept;
+        kept.reserve(functions.size());
+        for(std::size_t f=0; f<functions.size(); f++) {
+            if(!live[f])
+                continue;
+            order[f] = static_cast<int32_t>(kept.size());
+            kept.push_back(std::move(functions[f]));
+        }
+        _functions_removed = static_cast<int64_t>(functions.size() - kept.size());
+        functions.swap(kept);
+
+        // 留下的函数名和 loadc 用到的常量
+        auto& consts = _program.getConstants();
+        std::vector<bool> used(consts.size(), false);
+        auto use = [&used](int32_t index) { used[index] = true; };
+        visitOperands(_program.getStartCode(), Operation::LOADC, use);
+        for(auto& func : functions) {
+            used[func.getNameIndex()] = true;
+            visitOperands(func.getInstructions(), Operation::LOADC, use);
+        }
+        int32_t count = 0;
+        for(bool u : used)
+            count += u;
+        _constants_removed = consts.size() - count;
+        if(_functions_removed == 0 && _constants_removed == 0)
+            return false;
+
+        // 重新编号
+        std::vector<int32_t> index;
+        if(_constants_removed != 0)
+            index = consts.retain(used);
+        auto renumber = [&](CodeBuffer& code) {
+            if(_functions_removed != 0)
+                rewriteOperands(code, Operation::CALL, [&order](int32_t x) { return order[x]; });
+            if(_constants_removed != 0)
+                rewriteOperands(code, Operation::LOADC, [&index](int32_t x) { return index[x]; });
+        };
+        renumber(_program.getStartCode());
+        for(auto& func : functions) {
+            renumber(func.getInstructions());
+            if(_constants_removed != 0)
+                func.setNameIndex(index[func.getNameIndex()]);
+        }
+        return true;
+    }
+}
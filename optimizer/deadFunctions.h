@@ -0,0 +1,37 @@
+#pragma once
+
+#include "analyser/program.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace cc0 {
+
+    // 删除无用的函数和常量：
+    // 从 main 和启动代码出发沿着 call 求出可能被调用的函数，其余的函数整个删掉；
+    // 然后只留下留下来的函数名和代码里 loadc 用到的常量。
+    // 函数表和常量池按原来的顺序重新编号，call 和 loadc 的操作数随之修改
+    class DeadFunctionEliminator final {
+    private:
+        using int32_t = std::int32_t;
+        using int64_t = std::int64_t;
+
+    public:
+        explicit DeadFunctionEliminator(Program& program) : _program(program) {}
+
+        // 返回是否修改了程序；没有 main 时什么也不做
+        bool run();
+
+        int64_t getFunctionsRemoved() const { return _functions_removed; }
+        int64_t getConstantsRemoved() const { return _constants_removed; }
+
+    private:
+        // 被调用的函数，没有 main 时返回空
+        std::vector<bool> findLiveFunctions() const;
+
+    private:
+        Program& _program;
+        int64_t _functions_removed = 0;
+        int64_t _constants_removed = 0;
+    };
+}
@@ -0,0 +1,169 @@
+#include "optimizer/inliner.h"
+
+#include <utility>
+
+namespace cc0 {
+
+    namespace {
+        constexpr std::int32_t MAX_ROUNDS = 4;
+    }
+
+    std::vector<Instruction> Inliner::expand(const Callee& callee, int32_t params, int32_t depth) const {
+        auto& code = callee.code;
+        auto n = static_cast<int32_t>(code.size());
+        auto base = depth - params;
+        // 先算出每条指令展开后的位置，返回指令展开成多条
+        std::vector<Instruction> out;
+        std::vector<int32_t> at(n + 1);
+        std::vector<int32_t> jumps;  // out 里需要重定位的跳转
+        std::vector<int32_t> exits;  // out 里跳到末尾的 jmp
+        for(int32_t j=0; j<n; j++) {
+            at[j] = static_cast<int32_t>(out.size());
+            auto& instruction = code[j];
+            auto op = instruction.getOperation();
+            auto& info = opcodeInfo(op);
+            if(op == Operation::LOADA && instruction.getX() == 0)
+                out.emplace_back(Operation::LOADA, 0, base + instruction.getY());
+            else if(info.is_branch) {
+                jumps.push_back(static_cast<int32_t>(out.size()));
+                out.push_back(instruction);
+            }
+            else if(info.is_return) {
+                // 返回值留在 base 处，d 是返回之前的栈深度（相对 base）
+                auto d = callee.depths[j];
+                if(d >= 0) {
+                    if(info.pop > 0 && d > info.pop) {
+                        out.emplace_back(Operation::LOADA, 0, base);
+                        out.emplace_back(Operation::LOADA, 0, base + d - info.pop);
+                        out.emplace_back(info.pop == 2 ? Operation::DLOAD : Operation::ILOAD);
+                        out.emplace_back(info.pop == 2 ? Operation::DSTORE : Operation::ISTORE);
+                    }
+                    if(d > info.pop)
+                        out.emplace_back(Operation::POPN, d - info.pop);
+                }
+                // 最后一条返回直接落到末尾
+                if(j + 1 < n) {
+                    exits.push_back(static_cast<int32_t>(out.size()));
+                    out.emplace_back(Operation::JMP, 0);
+                }
+            }
+            else
+                out.push_back(instruction);
+        }
+        at[n] = static_cast<int32_t>(out.size());
+        for(auto k : jumps)
+            out[k].setX(at[out[k].getX()]);
+        for(auto k : exits)
+            out[k].setX(at[n]);
+        return out;
+    }
+
+    bool Inliner::run() {
+        auto& functions = _program.getFunctions();
+        auto& consts = _program.getConstants();
+        auto calls = callEffects(_program);
+        auto f_count = static_cast<int32_t>(functions.size());
+        bool changed = false;
+
+        for(int32_t round=0; round<MAX_ROUNDS; round++) {
+            std::vector<std::vector<Instruction>> codes(f_count);
+            std::vector<int32_t> sites(f_count, 0);
+            for(int32_t f=0; f<f_count; f++) {
+                codes[f] = functions[f].getInstructions().decode();
+                for(auto& instruction : codes[f])
+                    if(instruction.getOperation() == Operation::CALL)
+                        sites[instruction.getX()]++;
+            }
+
+            // 这一轮可以展开的函数：叶子、不太大、每条指令的栈深度都确定
+            std::vector<Callee> callees(f_count);
+            bool any = false;
+            for(int32_t f=0; f<f_count; f++) {
+                auto& code = codes[f];
+                auto size = static_cast<int32_t>(code.size());
+                if(sites[f] == 0 || size == 0 || (size > _max_size && (sites[f] > 1 || size > 4 * _max_size)))
+                    continue;
+                bool leaf = true;
+                for(auto& instruction : code) {
+                    auto op = instruction.getOperation();
+                    leaf = leaf && op != Operation::CALL && op != Operation::ARET;
+                }
+                if(!leaf)
+                    continue;
+                auto depths = stackDepths(code, functions[f].getParamsSize(), consts, calls);
+                if(depths.empty())
+                    continue;
+                callees[f].code = code;
+                callees[f].depths = std::move(depths);
+                any = true;
+            }
+            if(!any)
+                break;
+            _rounds++;
+
+            bool round_changed = false;
+            for(int32_t f=0; f<f_count; f++) {
+                auto& code = codes[f];
+                auto n = static_cast<int32_t>(code.size());
+                bool has_site = false;
+                for(auto& instruction : code)
+                    has_site = has_site || (instruction.getOperation() == Operation::CALL
+                                            && instruction.getX() != f && !callees[instruction.getX()].code.empty());
+                if(!has_site)
+                    continue;
+                auto depths = stackDepths(code, functions[f].getParamsSize(), consts, calls);
+                if(depths.empty())
+                    continue;
+
+                // 每处调用展开后的代码，再算出调用者每条指令的新位置
+                std::vector<std::vector<Instruction>> expansions(n);
+                std::vector<bool> inlined(n, false);
+                std::vector<int32_t> map(n + 1);
+                int64_t size = 0;
+                int64_t count = 0;
+                for(int32_t i=0; i<n; i++) {
+                    map[i] = static_cast<int32_t>(size);
+                    auto& instruction = code[i];
+                    auto callee = instruction.getX();
+                    if(instruction.getOperation() == Operation::CALL && callee != f && !callees[callee].code.empty()
+                       && depths[i] >= 0) {
+                        expansions[i] = expand(callees[callee], functions[callee].getParamsSize(), depths[i]);
+                        inlined[i] = true;
+                        size += static_cast<int64_t>(expansions[i].size());
+                        count++;
+                    }
+                    else
+                        size++;
+                }
+                map[n] = static_cast<int32_t>(size);
+                // 展开后放不进 .o 的函数就不展开了
+                if(size > MAX_INSTRUCTIONS)
+                    continue;
+                _inlined += count;
+
+                std::vector<Instruction> out;
+                out.reserve(size);
+                for(int32_t i=0; i<n; i++) {
+                    if(inlined[i]) {
+                        auto start = static_cast<int32_t>(out.size());
+                        for(auto& instruction : expansions[i]) {
+                            out.push_back(instruction);
+                            if(opcodeInfo(instruction.getOperation()).is_branch)
+                                out.back().setX(start + instruction.getX());
+                        }
+                        continue;
+                    }
+                    out.push_back(code[i]);
+                    if(opcodeInfo(code[i].getOperation()).is_branch)
+                        out.back().setX(map[code[i].getX()]);
+                }
+                functions[f].getInstructions() = CodeBuffer(out);
+                round_changed = true;
+            }
+            if(!round_changed)
+                break;
+            changed = true;
+        }
+        return changed;
+    }
+}
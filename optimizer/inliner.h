@@ -0,0 +1,51 @@
+#pragma once
+
+#include "analyser/program.h"
+#include "optimizer/stackDepth.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace cc0 {
+
+    // 把小的叶子函数（不再调用别的函数）的函数体展开到 call 的位置：
+    // 实参已经在调用者的栈上，正好当作被调用者的参数，loada 0 的偏移加上实参在调用者栈帧里的位置，
+    // 被调用者的局部变量照样用 snew 分配在后面；返回指令换成把返回值存到第一个实参的位置、
+    // 弹出其余的 slot、再跳到展开代码的末尾，和 call 返回后的栈一样。
+    // 指令条数不超过 maxSize 的函数都展开，只有一处调用的函数放宽到 4 倍。
+    // 展开后变成叶子的函数下一轮还可以再展开到它的调用者里
+    class Inliner final {
+    private:
+        using int32_t = std::int32_t;
+        using int64_t = std::int64_t;
+
+    public:
+        static constexpr int32_t DEFAULT_MAX_SIZE = 24;
+
+        explicit Inliner(Program& program, int32_t maxSize = DEFAULT_MAX_SIZE)
+            : _program(program), _max_size(maxSize) {}
+
+        // 返回是否修改了程序
+        bool run();
+
+        int64_t getInlined() const { return _inlined; }
+        int64_t getRounds() const { return _rounds; }
+
+    private:
+        // 被调用者解码后的代码和每条指令前的栈深度，不能展开的函数 code 为空
+        struct Callee {
+            std::vector<Instruction> code;
+            std::vector<int32_t> depths;
+        };
+
+        // 在调用者里的一处展开，调用之前栈深度是 depth
+        // 跳转的目标是展开代码里的下标
+        std::vector<Instruction> expand(const Callee& callee, int32_t params, int32_t depth) const;
+
+    private:
+        Program& _program;
+        int32_t _max_size;
+        int64_t _inlined = 0;
+        int64_t _rounds = 0;
+    };
+}
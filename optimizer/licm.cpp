@@ -0,0 +1,324 @@
+#include "optimizer/licm.h"
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include <utility>
+
+namespace cc0 {
+
+    namespace {
+        // 一个函数里最多外提多少次，每次外提后重新建控制流图
+        constexpr std::int32_t MAX_ROUNDS = 32;
+        // 一个循环最多外提多少个值
+        constexpr std::size_t MAX_TEMPS = 8;
+
+        bool isPureOperation(Operation op) {
+            switch(op) {
+                case Operation::IADD: case Operation::ISUB: case Operation::IMUL: case Operation::INEG:
+                case Operation::ICMP: case Operation::I2C: case Operation::I2D: case Operation::D2I:
+                case Operation::DADD: case Operation::DSUB: case Operation::DMUL: case Operation::DNEG:
+                case Operation::DCMP:
+                    return true;
+                default:
+                    return false;
+            }
+        }
+
+        // 模拟的操作数栈上的一项
+        struct Item {
+            enum Kind : std::uint8_t { VALUE, ADDRESS };
+            Kind kind = VALUE;
+            std::int32_t slots = 1;
+            bool invariant = false;
+            bool leaf = true;           // 只是一个常量或一次读取，外提没有好处
+            std::int32_t begin = -1;    // 计算它的指令 [begin, end]，-1 表示来自块外
+            std::int32_t end = -1;
+            std::int32_t level = 0;     // 地址：loada 的两个操作数
+            std::int32_t offset = 0;
+            bool is_constant = false;   // bipush/ipush 压入的 int
+            std::int32_t constant = 0;
+        };
+
+        // 可以外提的表达式：指令 [begin, end]，值占 slots 个 slot
+        struct Candidate {
+            std::int32_t begin;
+            std::int32_t end;
+            std::int32_t slots;
+        };
+    }
+
+    bool LoopInvariantMotion::hoist(std::vector<Instruction>& code, const ControlFlowGraph& cfg, const Loop& loop,
+                                    const std::vector<int32_t>& depths, const std::vector<CallEffect>& calls) {
+        auto& blocks = cfg.blocks();
+        auto& consts = _program.getConstants();
+        auto n = static_cast<int32_t>(code.size());
+        auto entry = blocks[loop.header].begin;
+        // 外提的值压在循环入口的栈深度上
+        auto base = depths[entry];
+        if(loop.header == 0 || base < 0)
+            return false;
+        std::vector<bool> in_loop(blocks.size(), false);
+        for(auto b : loop.blocks)
+            in_loop[b] = true;
+        // preheader 一般插在 header 前面；循环体顺序执行进 header 时（条件在循环末尾的 while），
+        // 循环只能从跳转进入，preheader 放到代码最后，算完再跳到 header
+        bool inline_preheader = true;
+        if(entry > 0 && in_loop[cfg.blockOf(entry - 1)]) {
+            auto last = code[entry - 1].getOperation();
+            inline_preheader = last == Operation::JMP || opcodeInfo(last).is_return;
+        }
+
+        // 第一遍找出循环里写了哪些变量 (level, offset)，第二遍找出不变的表达式
+        std::set<std::pair<int32_t, int32_t>> written;
+        bool has_call = false;
+        std::vector<Candidate> candidates;
+        std::vector<Item> stack;
+        std::vector<Item> popped;
+        for(int pass=0; pass<2; pass++) {
+            for(auto b : loop.blocks) {
+                stack.clear();
+                for(int32_t i=blocks[b].begin; i<blocks[b].end; i++) {
+                    auto& instruction = code[i];
+                    auto op = instruction.getOperation();
+                    int32_t pop, push;
+                    if(!stackEffect(instruction, consts, calls, pop, push))
+                        return false;
+                    Item result;
+                    result.begin = i;
+                    result.end = i;
+                    if(op == Operation::BIPUSH || op == Operation::IPUSH || op == Operation::LOADC) {
+                        result.invariant = true;
+                        result.slots = push;
+                        result.is_constant = op != Operation::LOADC;
+                        result.constant = instruction.getX();
+                        stack.push_back(result);
+                        continue;
+                    }
+                    if(op == Operation::LOADA) {
+                        result.kind = Item::ADDRESS;
+                        result.level = instruction.getX();
+                        result.offset = instruction.getY();
+                        // 入口深度以上是临时值（函数展开、尾调用用到的），不是变量
+                        result.invariant = !(result.level == 0 && result.offset >= base);
+                        stack.push_back(result);
+                        continue;
+                    }
+
+                    // 按 slot 数弹出；弹出半个 double 说明看错了，放弃这个循环
+                    popped.clear();
+                    for(int32_t slots=pop; slots>0; ) {
+                        Item item;
+                        if(!stack.empty()) {
+                            item = stack.back();
+                            stack.pop_back();
+                        }
+                        slots -= item.slots;
+                        if(slots < 0)
+                            return false;
+                        popped.insert(popped.begin(), item);
+                    }
+
+                    if(op == Operation::ILOAD || op == Operation::DLOAD) {
+                        auto& address = popped[0];
+                        result.slots = push;
+                        result.begin = address.begin;
+                        result.invariant = pass == 1 && address.kind == Item::ADDRESS && address.invariant
+                                           && address.end == i - 1 && !(address.level == 1 && has_call);
+                        for(int32_t k=0; k<push && result.invariant; k++)
+                            result.invariant = written.count({ address.level, address.offset + k }) == 0;
+                        stack.push_back(result);
+                        continue;
+                    }
+                    if(op == Operation::ISTORE || op == Operation::DSTORE) {
+                        auto& address = popped[0];
+                        if(address.kind != Item::ADDRESS || address.begin == -1)
+                            return false;  // 不知道写到了哪里
+                        for(int32_t k=0; k<pop-1; k++)
+                            written.insert({ address.level, address.offset + k });
+                        continue;
+                    }
+                    has_call = has_call || op == Operation::CALL;
+
+                    // 除数是不为 0、-1 的常量时 idiv 不会出错，也可以外提
+                    bool pure = isPureOperation(op)
+                                || (op == Operation::IDIV && popped.size() == 2 && popped[1].is_constant
+                                    && popped[1].constant != 0 && popped[1].constant != -1);
+                    // 外提的是一段连续的指令，操作数之间、最后一个操作数和运算之间不能夹着别的指令
+                    bool invariant = pure;
+                    auto next = i;
+                    for(auto it=popped.rbegin(); it!=popped.rend(); ++it) {
+                        invariant = invariant && it->kind == Item::VALUE && it->invariant && it->end == next - 1;
+                        next = it->begin;
+                        if(it->begin != -1)
+                            result.begin = std::min(result.begin, it->begin);
+                    }
+                    if(invariant) {
+                        result.invariant = true;
+                        result.leaf = false;
+                        result.slots = push;
+                        stack.push_back(result);
+                        continue;
+                    }
+                    // 不变的值用在了会变的地方，它就是一个可以外提的表达式
+                    if(pass == 1)
+                        for(auto& item : popped)
+                            if(item.kind == Item::VALUE && item.invariant && !item.leaf)
+                                candidates.push_back({ item.begin, item.end, item.slots });
+                    // 结果都是未知的值，double 作为一项
+                    if(push == 2 && op != Operation::SNEW && op != Operation::DUP) {
+                        result.slots = 2;
+                        stack.push_back(result);
+                    }
+                    else
+                        for(int32_t k=0; k<push; k++)
+                            stack.push_back(Item{ Item::VALUE, 1, false, true, i, i });
+                }
+            }
+        }
+        if(candidates.empty())
+            return false;
+
+        // 相同的表达式共用一个外提的值
+        std::sort(candidates.begin(), candidates.end(),
+                  [](const Candidate& a, const Candidate& b) { return a.begin < b.begin; });
+        std::vector<std::vector<Instruction>> temps;
+        std::vector<int32_t> temp_offsets;
+        std::vector<int32_t> temp_sizes;
+        std::vector<int32_t> temp_of(n, -1);  // 候选表达式开头 -> 用哪个外提的值
+        std::vector<int32_t> end_of(n, -1);
+        int32_t temp_slots = 0;
+        for(auto& candidate : candidates) {
+            std::vector<Instruction> expression(code.begin() + candidate.begin, code.begin() + candidate.end + 1);
+            auto it = std::find(temps.begin(), temps.end(), expression);
+            int32_t t = static_cast<int32_t>(it - temps.begin());
+            if(it == temps.end()) {
+                if(temps.size() >= MAX_TEMPS)
+                    continue;
+                temps.push_back(std::move(expression));
+                temp_offsets.push_back(base + temp_slots);
+                temp_sizes.push_back(candidate.slots);
+                temp_slots += candidate.slots;
+            }
+            temp_of[candidate.begin] = t;
+            end_of[candidate.begin] = candidate.end;
+            _hoisted++;
+        }
+
+        // 重写：插入 preheader，候选表达式换成读取外提的值，
+        // 循环里相对栈顶的 loada 0 偏移加上外提的值的大小，离开循环的边先弹掉它们
+        auto popTemps = [temp_slots](std::vector<Instruction>& out) {
+            if(temp_slots == 1)
+                out.emplace_back(Operation::POP);
+            else if(temp_slots == 2)
+                out.emplace_back(Operation::POP2);
+            else
+                out.emplace_back(Operation::POPN, temp_slots);
+        };
+        std::vector<Instruction> out;
+        std::vector<int32_t> map(n + 1);
+        std::vector<std::pair<int32_t, int32_t>> jumps;  // out 里的跳转和它在原代码里的下标
+        int32_t preheader = 0;
+        for(int32_t b=0; b<static_cast<int32_t>(blocks.size()); b++) {
+            auto& block = blocks[b];
+            if(b == loop.header && inline_preheader) {
+                preheader = static_cast<int32_t>(out.size());
+                for(auto& expression : temps)
+                    out.insert(out.end(), expression.begin(), expression.end());
+            }
+            for(int32_t i=block.begin; i<block.end; i++) {
+                map[i] = static_cast<int32_t>(out.size());
+                auto& instruction = code[i];
+                if(in_loop[b] && temp_of[i] != -1) {
+                    auto t = temp_of[i];
+                    out.emplace_back(Operation::LOADA, 0, temp_offsets[t]);
+                    out.emplace_back(temp_sizes[t] == 2 ? Operation::DLOAD : Operation::ILOAD);
+                    for(auto k=i+1; k<=end_of[i]; k++)
+                        map[k] = static_cast<int32_t>(out.size()) - 1;
+                    i = end_of[i];
+                    continue;
+                }
+                if(in_loop[b] && instruction.getOperation() == Operation::LOADA && instruction.getX() == 0
+                   && instruction.getY() >= base)
+                    out.emplace_back(Operation::LOADA, 0, instruction.getY() + temp_slots);
+                else
+                    out.push_back(instruction);
+                if(opcodeInfo(instruction.getOperation()).is_branch)
+                    jumps.emplace_back(static_cast<int32_t>(out.size()) - 1, i);
+            }
+            // 顺序执行离开循环
+            auto last = code[block.end - 1].getOperation();
+            if(in_loop[b] && block.end < n && !in_loop[cfg.blockOf(block.end)]
+               && last != Operation::JMP && !opcodeInfo(last).is_return)
+                popTemps(out);
+        }
+        map[n] = static_cast<int32_t>(out.size());
+
+        // 跳转：从循环外跳到 header 的改成跳到 preheader，从循环里跳出去的经过一段弹栈的代码
+        std::map<int32_t, int32_t> exits;  // 原来的目标 -> 弹栈代码在 out 里的位置
+        std::vector<Instruction> pads;
+        auto padStart = static_cast<int32_t>(out.size());
+        if(!inline_preheader) {
+            preheader = padStart;
+            for(auto& expression : temps)
+                pads.insert(pads.end(), expression.begin(), expression.end());
+            pads.emplace_back(Operation::JMP, map[entry]);
+        }
+        for(auto [at, i] : jumps) {
+            auto target = code[i].getX();
+            if(target >= n)
+                return false;
+            bool from_loop = in_loop[cfg.blockOf(i)];
+            if(target == entry && !from_loop)
+                out[at].setX(preheader);
+            else if(from_loop && !in_loop[cfg.blockOf(target)]) {
+                auto it = exits.find(target);
+                if(it == exits.end()) {
+                    it = exits.emplace(target, padStart + static_cast<int32_t>(pads.size())).first;
+                    popTemps(pads);
+                    pads.emplace_back(Operation::JMP, map[target]);
+                }
+                out[at].setX(it->second);
+            }
+            else
+                out[at].setX(map[target]);
+        }
+        out.insert(out.end(), pads.begin(), pads.end());
+        if(out.size() > static_cast<std::size_t>(MAX_INSTRUCTIONS))
+            return false;
+        code.swap(out);
+        _loops_changed++;
+        return true;
+    }
+
+    bool LoopInvariantMotion::run() {
+        auto calls = callEffects(_program);
+        bool changed = false;
+        for(auto& func : _program.getFunctions()) {
+            auto code = func.getInstructions().decode();
+            bool func_changed = false;
+            // 每次外提后控制流图和栈深度都变了，重新计算；里层循环先处理
+            for(int32_t round=0; round<MAX_ROUNDS; round++) {
+                auto depths = stackDepths(code, func.getParamsSize(), _program.getConstants(), calls);
+                if(depths.empty())
+                    break;
+                ControlFlowGraph cfg(code);
+                bool hoisted = false;
+                for(auto& loop : cfg.loops()) {
+                    if(hoist(code, cfg, loop, depths, calls)) {
+                        hoisted = true;
+                        break;
+                    }
+                }
+                if(!hoisted)
+                    break;
+                func_changed = true;
+            }
+            if(func_changed) {
+                func.getInstructions() = CodeBuffer(code);
+                changed = true;
+            }
+        }
+        return changed;
+    }
+}
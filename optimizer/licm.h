@@ -0,0 +1,42 @@
+#pragma once
+
+#include "analyser/program.h"
+#include "optimizer/cfg.h"
+#include "optimizer/stackDepth.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace cc0 {
+
+    // 循环不变量外提：
+    // 循环里操作数都不在循环中被写的纯表达式（常量、循环里没有被 store 的局部变量和全局变量、
+    // 它们的算术运算和类型转换），在循环前面（preheader）算一次压在栈上，循环里改成 loada + iload。
+    // 这些值在整个循环期间留在循环入口的栈深度上，所以循环里相对栈顶的 loada 0 偏移要加上它们的大小，
+    // 每条离开循环的边先把它们弹掉。循环里有 call 时全局变量不算不变量；
+    // 除法只在除数是不为 0、-1 的常量时外提，不会在不执行循环体的时候多出一个运行时错误
+    class LoopInvariantMotion final {
+    private:
+        using int32_t = std::int32_t;
+        using int64_t = std::int64_t;
+
+    public:
+        explicit LoopInvariantMotion(Program& program) : _program(program) {}
+
+        // 返回是否修改了程序
+        bool run();
+
+        int64_t getLoopsChanged() const { return _loops_changed; }
+        int64_t getExpressionsHoisted() const { return _hoisted; }
+
+    private:
+        // 在 code 的一个循环上做外提，没有可以外提的表达式时返回 false
+        bool hoist(std::vector<Instruction>& code, const ControlFlowGraph& cfg, const Loop& loop,
+                   const std::vector<int32_t>& depths, const std::vector<CallEffect>& calls);
+
+    private:
+        Program& _program;
+        int64_t _loops_changed = 0;
+        int64_t _hoisted = 0;
+    };
+}
@@ -0,0 +1,196 @@
+#include "optimizer/optimizer.h"
+#include "ir/deadCode.h"
+#include "ir/folding.h"
+#include "ir/loopInvariants.h"
+#include "ir/passManager.h"
+#include "ir/valueNumbering.h"
+#include "optimizer/commonSubexpressions.h"
+#include "optimizer/constantFolding.h"
+#include "optimizer/deadFunctions.h"
+#include "optimizer/inliner.h"
+#include "optimizer/licm.h"
+#include "optimizer/tailCall.h"
+#include "optimizer/peephole.h"
+#include "optimizer/slotAllocation.h"
+
+#include "fmt/format.h"
+
+namespace cc0 {
+
+    namespace {
+        // 解码、优化、重新编码一段代码，pass 没有改动时保留原来的编码
+        template<typename Pass>
+        void rewriteCode(CodeBuffer& buffer, Pass&& pass) {
+            auto code = buffer.decode();
+            if(pass(code))
+                buffer = CodeBuffer(code);
+        }
+    }
+
+    std::pair<std::int64_t, std::int64_t> Optimizer::codeSize(const Program& program) {
+        std::int64_t instructions = program.getStartCode().size();
+        auto bytes = static_cast<std::int64_t>(program.getStartCode().byteSize());
+        for(auto& func : program.getFunctions()) {
+            instructions += func.getInstructions().size();
+            bytes += static_cast<std::int64_t>(func.getInstructions().byteSize());
+        }
+        return { instructions, bytes };
+    }
+
+    void Optimizer::run(Program& program) {
+        if(_level >= 1) {
+            runConstantFolding(program);
+            // 只认识语法分析生成的栈帧形状，要在尾调用和函数展开之前
+            if(_level >= 2)
+                runSlotAllocation(program);
+            // 尾递归改成循环后函数不再调用自己，可能变成可以展开的叶子函数
+            runTailCalls(program);
+            // 展开后的代码交给窥孔优化清理，被展开完的函数由最后的 dead-functions 删掉
+            if(_level >= 2) {
+                runInliner(program);
+                // 展开后循环里的 call 变成了普通指令，更多的表达式可以外提
+                runLicm(program);
+                // 外提之后循环里剩下的重复计算在块内消除
+                runCse(program);
+                // SSA 上的优化看得到跨块的值，生成代码时重新分配 slot，尽量少读写栈帧
+                runSsa(program);
+            }
+            runPeephole(program);
+            // 窥孔优化删掉的不可达代码里可能有 call，放在最后
+            runDeadFunctions(program);
+        }
+    }
+
+    std::string Optimizer::report() const {
+        fmt::memory_buffer buf;
+        for(auto& pass : _stats) {
+            fmt::format_to(buf, "{}: removed {} instructions, {} bytes\n", pass.name, pass.instructions_removed, pass.bytes_removed);
+            for(auto& [name, count] : pass.details)
+                fmt::format_to(buf, "    {:<20} {}\n", name, count);
+        }
+        return fmt::to_string(buf);
+    }
+
+    template<typename Pass>
+    void Optimizer::runPass(Program& program, const char* name, Pass&& pass) {
+        PassStats stats;
+        stats.name = name;
+        auto [instructions, bytes] = codeSize(program);
+        stats.details = pass();
+        auto [instructions_after, bytes_after] = codeSize(program);
+        stats.instructions_removed = instructions - instructions_after;
+        stats.bytes_removed = bytes - bytes_after;
+        _stats.push_back(std::move(stats));
+    }
+
+    void Optimizer::runConstantFolding(Program& program) {
+        runPass(program, "constant-folding", [&program]() -> PassStats::Details {
+            ConstantFolder folder(program);
+            folder.run();
+            return {
+                { "folded", folder.getFolded() },
+                { "propagated", folder.getPropagated() },
+                { "branches-folded", folder.getBranchesFolded() },
+                { "slots-removed", folder.getSlotsRemoved() },
+            };
+        });
+    }
+
+    void Optimizer::runSlotAllocation(Program& program) {
+        runPass(program, "slot-allocation", [&program]() -> PassStats::Details {
+            SlotAllocator allocator(program);
+            allocator.run();
+            return {
+                { "frames-shrunk", allocator.getFramesShrunk() },
+                { "slots-saved", allocator.getSlotsSaved() },
+            };
+        });
+    }
+
+    void Optimizer::runTailCalls(Program& program) {
+        runPass(program, "tail-calls", [&program]() -> PassStats::Details {
+            TailCallEliminator eliminator(program);
+            eliminator.run();
+            return {
+                { "calls-converted", eliminator.getConverted() },
+            };
+        });
+    }
+
+    void Optimizer::runInliner(Program& program) {
+        runPass(program, "inline", [&program]() -> PassStats::Details {
+            Inliner inliner(program);
+            inliner.run();
+            return {
+                { "calls-inlined", inliner.getInlined() },
+                { "rounds", inliner.getRounds() },
+            };
+        });
+    }
+
+    void Optimizer::runLicm(Program& program) {
+        runPass(program, "licm", [&program]() -> PassStats::Details {
+            LoopInvariantMotion motion(program);
+            motion.run();
+            return {
+                { "loops-changed", motion.getLoopsChanged() },
+                { "expressions-hoisted", motion.getExpressionsHoisted() },
+            };
+        });
+    }
+
+    void Optimizer::runCse(Program& program) {
+        runPass(program, "cse", [&program]() -> PassStats::Details {
+            CommonSubexpressionEliminator eliminator(program);
+            eliminator.run();
+            return {
+                { "duplicated", eliminator.getDuplicated() },
+                { "reused", eliminator.getReused() },
+                { "temp-slots", eliminator.getTempSlots() },
+            };
+        });
+    }
+
+    void Optimizer::runSsa(Program& program) {
+        runPass(program, "ssa", [&program]() -> PassStats::Details {
+            ir::PassManager manager(program);
+            manager.add(std::make_unique<ir::Folding>());
+            manager.add(std::make_unique<ir::ValueNumbering>());
+            manager.add(std::make_unique<ir::LoopInvariants>());
+            manager.add(std::make_unique<ir::DeadCode>());
+            manager.run();
+            PassStats::Details details = {
+                { "functions-lifted", manager.getLifted() },
+                { "functions-rejected", manager.getRejected() },
+            };
+            for(auto& [name, count] : manager.getCounts())
+                details.emplace_back(name, count);
+            return details;
+        });
+    }
+
+    void Optimizer::runPeephole(Program& program) {
+        runPass(program, "peephole", [&program]() {
+            PeepholeOptimizer peephole;
+            auto pass = [&peephole](std::vector<Instruction>& code) { return peephole.run(code); };
+            rewriteCode(program.getStartCode(), pass);
+            for(auto& func : program.getFunctions())
+                rewriteCode(func.getInstructions(), pass);
+            PassStats::Details details;
+            for(auto& [name, count] : peephole.getHits())
+                details.emplace_back(name, count);
+            return details;
+        });
+    }
+
+    void Optimizer::runDeadFunctions(Program& program) {
+        runPass(program, "dead-functions", [&program]() -> PassStats::Details {
+            DeadFunctionEliminator eliminator(program);
+            eliminator.run();
+            return {
+                { "functions-removed", eliminator.getFunctionsRemoved() },
+                { "constants-removed", eliminator.getConstantsRemoved() },
+            };
+        });
+    }
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "analyser/program.h"
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace cc0 {
+
+    // 一个优化在整个程序上的效果，--opt-stats 时输出
+    struct PassStats {
+        std::string name;
+        std::int64_t instructions_removed = 0;
+        std::int64_t bytes_removed = 0;
+        // 各条规则的命中次数等细节
+        using Details = std::vector<std::pair<std::string, std::int64_t>>;
+        Details details;
+    };
+
+    // 对语法分析生成的 Program 做优化，按优化级别决定做哪些：
+    //   -O0 不优化
+    //   -O1 常量折叠和传播、自身尾调用改成循环、窥孔优化、删除无用的函数和常量
+    //   -O2 在 -O1 的基础上按活跃区间分配局部变量的 slot、展开小的叶子函数、循环不变量外提、基本块内的公共子表达式消除，
+    //       最后在 SSA 上做折叠、全局值编号、循环不变量外提和死代码删除，重新分配 slot
+    class Optimizer final {
+    public:
+        explicit Optimizer(int level) : _level(level) {}
+
+        void run(Program& program);
+
+        const std::vector<PassStats>& getStats() const { return _stats; }
+        // 每个优化一行总数，下面缩进列出细节
+        std::string report() const;
+
+    private:
+        // 所有代码的指令条数和字节数
+        static std::pair<std::int64_t, std::int64_t> codeSize(const Program& program);
+        // 运行一个优化，记录它前后代码大小的变化；pass 做优化并返回细节
+        template<typename Pass>
+        void runPass(Program& program, const char* name, Pass&& pass);
+
+        void runConstantFolding(Program& program);
+        void runSlotAllocation(Program& program);
+        void runTailCalls(Program& program);
+        void runInliner(Program& program);
+        void runLicm(Program& program);
+        void runCse(Program& program);
+        void runSsa(Program& program);
+        void runPeephole(Program& program);
+        void runDeadFunctions(Program& program);
+
+    private:
+        int _level;
+        std::vector<PassStats> _stats;
+    };
+}
@@ -0,0 +1,237 @@
+#include "optimizer/peephole.h"
+#include "optimizer/cfg.h"
+#include "optimizer/codeEdit.h"
+
+namespace cc0 {
+
+    namespace {
+        // 扫描的最大轮数，正常的代码两三轮就不再变化
+        constexpr int MAX_ROUNDS = 16;
+
+        bool isConditionalJump(Operation op) {
+            return op >= Operation::JE && op <= Operation::JLE;
+        }
+
+        // 没有副作用、压入 1 个 slot 的指令
+        bool isPurePush(Operation op) {
+            return op == Operation::BIPUSH || op == Operation::IPUSH || op == Operation::LOADA || op == Operation::DUP;
+        }
+
+        // ipush 0..255 -> bipush（bipush 的操作数按无符号 byte 提升）
+        bool smallPush(const Instruction* in, std::int32_t, std::vector<Instruction>& out) {
+            if(in[0].getOperation() != Operation::IPUSH || in[0].getX() < 0 || in[0].getX() > 255)
+                return false;
+            out.emplace_back(Operation::BIPUSH, in[0].getX());
+            return true;
+        }
+
+        // i2d d2i 什么也不改变，类型转换的代码里常见
+        bool castPair(const Instruction* in, std::int32_t, std::vector<Instruction>&) {
+            return in[0].getOperation() == Operation::I2D && in[1].getOperation() == Operation::D2I;
+        }
+
+        // 跳到下一条指令：jmp 直接删掉，jcc 只留下弹出条件的效果
+        bool jumpToNext(const Instruction* in, std::int32_t index, std::vector<Instruction>& out) {
+            auto op = in[0].getOperation();
+            if(!opcodeInfo(op).is_branch || in[0].getX() != index + 1)
+                return false;
+            if(isConditionalJump(op))
+                out.emplace_back(Operation::POP);
+            return true;
+        }
+
+        // 压栈后马上弹出
+        bool deadPush(const Instruction* in, std::int32_t, std::vector<Instruction>&) {
+            auto first = in[0].getOperation(), second = in[1].getOperation();
+            return (isPurePush(first) && second == Operation::POP)
+                || (first == Operation::DUP2 && second == Operation::POP2);
+        }
+
+        // 结果马上被弹出的纯计算，改成直接弹出它的操作数
+        // （idiv 可能除以 0，不算纯计算）
+        bool deadValue(const Instruction* in, std::int32_t, std::vector<Instruction>& out) {
+            auto& info = opcodeInfo(in[0].getOperation());
+            auto second = in[1].getOperation();
+            if(!(info.push == 1 && second == Operation::POP) && !(info.push == 2 && second == Operation::POP2))
+                return false;
+            for(auto slots = info.pop; slots > 0; slots -= 2)
+                out.emplace_back(slots == 1 ? Operation::POP : Operation::POP2);
+            return true;
+        }
+
+        // jcc L; jmp M; L: -> 条件取反的 jcc M
+        bool invertBranch(const Instruction* in, std::int32_t index, std::vector<Instruction>& out) {
+            if(in[0].getX() != index + 2 || in[1].getOperation() != Operation::JMP)
+                return false;
+            Operation inverted;
+            switch(in[0].getOperation()) {
+                case Operation::JE:  inverted = Operation::JNE; break;
+                case Operation::JNE: inverted = Operation::JE;  break;
+                case Operation::JL:  inverted = Operation::JGE; break;
+                case Operation::JGE: inverted = Operation::JL;  break;
+                case Operation::JG:  inverted = Operation::JLE; break;
+                case Operation::JLE: inverted = Operation::JG;  break;
+                default: return false;
+            }
+            out.emplace_back(inverted, in[1].getX());
+            return true;
+        }
+
+        // icmp 和 0 比较的结果与原值符号相同，jcc 可以直接判断原值
+        bool compareZero(const Instruction* in, std::int32_t, std::vector<Instruction>& out) {
+            auto push = in[0].getOperation();
+            if((push != Operation::BIPUSH && push != Operation::IPUSH) || in[0].getX() != 0)
+                return false;
+            if(in[1].getOperation() != Operation::ICMP || !isConditionalJump(in[2].getOperation()))
+                return false;
+            out.push_back(in[2]);
+            return true;
+        }
+
+        // 相邻的 snew 合并成一条
+        bool mergeSnew(const Instruction* in, std::int32_t, std::vector<Instruction>& out) {
+            if(in[0].getOperation() != Operation::SNEW || in[1].getOperation() != Operation::SNEW)
+                return false;
+            out.emplace_back(Operation::SNEW, in[0].getX() + in[1].getX());
+            return true;
+        }
+
+        // snew 0、popn 0、nop
+        bool noEffect(const Instruction* in, std::int32_t, std::vector<Instruction>&) {
+            auto op = in[0].getOperation();
+            return op == Operation::NOP || ((op == Operation::SNEW || op == Operation::POPN) && in[0].getX() == 0);
+        }
+    }
+
+    const std::vector<PeepholeRule>& defaultPeepholeRules() {
+        static const std::vector<PeepholeRule> rules = {
+            { "no-effect",       1, { NOP, SNEW, POPN },                  noEffect },
+            { "jump-to-next",    1, { JMP, JE, JNE, JL, JGE, JG, JLE },   jumpToNext },
+            { "compare-zero",    3, { BIPUSH, IPUSH },                    compareZero },
+            { "ipush-to-bipush", 1, { IPUSH },                            smallPush },
+            { "i2d-d2i",         2, { I2D },                              castPair },
+            { "dead-push",       2, { BIPUSH, IPUSH, LOADA, DUP, DUP2 },  deadPush },
+            { "dead-value",      2, { ILOAD, ALOAD, DLOAD, IALOAD, DALOAD, AALOAD, IADD, DADD, ISUB, DSUB, IMUL, DMUL,
+                                     INEG, DNEG, ICMP, DCMP, I2D, D2I, I2C }, deadValue },
+            { "invert-branch",   2, { JE, JNE, JL, JGE, JG, JLE },        invertBranch },
+            { "merge-snew",      2, { SNEW },                             mergeSnew },
+        };
+        return rules;
+    }
+
+    PeepholeOptimizer::PeepholeOptimizer(std::vector<PeepholeRule> rules)
+        : _rules(std::move(rules)), _rule_hits(_rules.size(), 0) {
+        for(std::size_t r=0; r<_rules.size(); r++)
+            for(auto op : _rules[r].first)
+                _dispatch[static_cast<std::uint8_t>(op)].push_back(r);
+    }
+
+    bool PeepholeOptimizer::run(std::vector<Instruction>& code) {
+        bool changed = false;
+        for(int round = 0; round < MAX_ROUNDS; round++) {
+            bool again = threadJumps(code);
+            again = removeUnreachable(code) || again;
+            again = rewrite(code) || again;
+            if(!again)
+                break;
+            changed = true;
+        }
+        return changed;
+    }
+
+    std::vector<std::pair<const char*, std::int64_t>> PeepholeOptimizer::getHits() const {
+        std::vector<std::pair<const char*, int64_t>> hits;
+        for(std::size_t i=0; i<_rules.size(); i++)
+            hits.emplace_back(_rules[i].name, _rule_hits[i]);
+        hits.emplace_back("jump-threading", _threaded);
+        hits.emplace_back("unreachable-code", _unreachable);
+        return hits;
+    }
+
+    bool PeepholeOptimizer::rewrite(std::vector<Instruction>& code) {
+        auto n = static_cast<int32_t>(code.size());
+        auto target = findJumpTargets(code);
+
+        std::vector<Instruction> out;
+        out.reserve(code.size());
+        // 旧下标 -> 新下标，窗口被替换时窗口里的指令都映射到替换结果的开头
+        std::vector<int32_t> map(n + 1);
+        bool changed = false;
+        for(int32_t i=0; i<n; ) {
+            auto start = static_cast<int32_t>(out.size());
+            int32_t matched = 0;
+            for(auto r : _dispatch[static_cast<std::uint8_t>(code[i].getOperation())]) {
+                auto window = _rules[r].window;
+                if(i + window > n)
+                    continue;
+                bool crosses = false;
+                for(int32_t k=i+1; k<i+window; k++)
+                    crosses = crosses || target[k];
+                if(crosses || !_rules[r].rewrite(&code[i], i, out))
+                    continue;
+                _rule_hits[r]++;
+                matched = window;
+                break;
+            }
+            if(matched == 0) {
+                out.push_back(code[i]);
+                matched = 1;
+            }
+            else
+                changed = true;
+            for(int32_t k=i; k<i+matched; k++)
+                map[k] = start;
+            i += matched;
+        }
+        if(!changed)
+            return false;
+        map[n] = static_cast<int32_t>(out.size());
+        retargetJumps(out, map);
+        code.swap(out);
+        return true;
+    }
+
+    // jmp/jcc 的目标是 jmp 时直接跳到最终目标；jmp 的目标是 ret 时直接返回
+    bool PeepholeOptimizer::threadJumps(std::vector<Instruction>& code) {
+        auto n = static_cast<int32_t>(code.size());
+        bool changed = false;
+        for(auto& instruction : code) {
+            if(!opcodeInfo(instruction.getOperation()).is_branch)
+                continue;
+            auto target = instruction.getX();
+            // 跳转链最多跟 n 步，防止 jmp 自己构成的死循环
+            for(int32_t steps = 0; steps < n && target < n && code[target].getOperation() == Operation::JMP
+                                   && code[target].getX() != target; steps++)
+                target = code[target].getX();
+            if(target != instruction.getX()) {
+                instruction.setX(target);
+                _threaded++;
+                changed = true;
+            }
+            if(instruction.getOperation() == Operation::JMP && target < n && opcodeInfo(code[target].getOperation()).is_return) {
+                instruction = code[target];
+                _threaded++;
+                changed = true;
+            }
+        }
+        return changed;
+    }
+
+    bool PeepholeOptimizer::removeUnreachable(std::vector<Instruction>& code) {
+        ControlFlowGraph cfg(code);
+        std::vector<bool> keep(code.size(), true);
+        bool changed = false;
+        for(std::size_t b=0; b<cfg.blocks().size(); b++) {
+            if(cfg.isReachable(static_cast<int32_t>(b)))
+                continue;
+            auto& block = cfg.block(static_cast<int32_t>(b));
+            for(auto i = block.begin; i < block.end; i++)
+                keep[i] = false;
+            _unreachable += block.end - block.begin;
+            changed = true;
+        }
+        if(changed)
+            compactCode(code, keep);
+        return changed;
+    }
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "instruction/instruction.h"
+
+#include <array>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace cc0 {
+
+    // 窗口匹配时把替换后的指令追加到 out 并返回 true，不匹配时返回 false 且不能修改 out
+    // window 指向窗口的第一条指令，index 是它的下标；窗口里除第一条外都不是跳转目标。
+    // 替换结果里跳转指令的操作数仍然用旧的下标，由 PeepholeOptimizer 统一重定位
+    using PeepholeRewrite = bool (*)(const Instruction* window, std::int32_t index, std::vector<Instruction>& out);
+
+    struct PeepholeRule {
+        const char* name;
+        std::int32_t window;           // 窗口里的指令条数
+        std::vector<Operation> first;  // 窗口第一条指令可能的操作码，只在这些指令上尝试这条规则
+        PeepholeRewrite rewrite;
+    };
+
+    // 默认的规则表，按顺序尝试，先匹配的先用
+    const std::vector<PeepholeRule>& defaultPeepholeRules();
+
+    // 窥孔优化：用规则表在指令序列上滑动窗口做局部替换，
+    // 另外做跳转穿透（跳到 jmp 的跳转直接跳到最终目标）和删除不可达的基本块，
+    // 反复进行直到代码不再变化
+    class PeepholeOptimizer final {
+    private:
+        using int32_t = std::int32_t;
+        using int64_t = std::int64_t;
+
+    public:
+        explicit PeepholeOptimizer(std::vector<PeepholeRule> rules = defaultPeepholeRules());
+
+        // 返回是否修改了代码
+        bool run(std::vector<Instruction>& code);
+
+        // 各条规则（以及跳转穿透、不可达代码）累计的命中次数
+        std::vector<std::pair<const char*, int64_t>> getHits() const;
+
+    private:
+        // 一遍窗口扫描
+        bool rewrite(std::vector<Instruction>& code);
+        bool threadJumps(std::vector<Instruction>& code);
+        bool removeUnreachable(std::vector<Instruction>& code);
+
+    private:
+        std::vector<PeepholeRule> _rules;
+        // 操作码 -> 以它开头的规则，保持规则表里的顺序
+        std::array<std::vector<std::size_t>, 256> _dispatch;
+        std::vector<int64_t> _rule_hits;
+        int64_t _threaded = 0;
+        int64_t _unreachable = 0;
+    };
+}
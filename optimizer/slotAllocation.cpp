@@ -0,0 +1,274 @@
+#include "optimizer/slotAllocation.h"
+#include "optimizer/cfg.h"
+#include "optimizer/codeEdit.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace cc0 {
+
+    namespace {
+        // 局部变量的集合，每个变量一位
+        class UnitSet final {
+        public:
+            explicit UnitSet(std::size_t n = 0) : _words((n + 63) / 64, 0) {}
+
+            bool test(std::int32_t u) const { return (_words[u / 64] >> (u % 64)) & 1; }
+            void set(std::int32_t u) { _words[u / 64] |= std::uint64_t(1) << (u % 64); }
+            void reset(std::int32_t u) { _words[u / 64] &= ~(std::uint64_t(1) << (u % 64)); }
+            // 并上 other，返回是否有变化
+            bool unite(const UnitSet& other) {
+                bool changed = false;
+                for(std::size_t k=0; k<_words.size(); k++) {
+                    auto word = _words[k] | other._words[k];
+                    changed = changed || word != _words[k];
+                    _words[k] = word;
+                }
+                return changed;
+            }
+            template<typename F>
+            void forEach(F&& f) const {
+                for(std::size_t k=0; k<_words.size(); k++)
+                    for(auto word = _words[k]; word != 0; word &= word - 1)
+                        f(static_cast<std::int32_t>(k * 64 + __builtin_ctzll(word)));
+            }
+        private:
+            std::vector<std::uint64_t> _words;
+        };
+
+        // 一个局部变量：原来的偏移和大小，初始化代码是指令 [begin, end)
+        struct Unit {
+            std::int32_t offset = 0;
+            std::int32_t size = 1;
+            std::int32_t begin = 0;
+            std::int32_t end = 0;
+            bool initialized = true;
+            std::int32_t slot = -1;  // 新的偏移
+        };
+    }
+
+    bool SlotAllocator::run() {
+        auto calls = callEffects(_program);
+        bool changed = false;
+        for(auto& func : _program.getFunctions())
+            changed = allocate(func, calls) || changed;
+        return changed;
+    }
+
+    bool SlotAllocator::allocate(Function& func, const std::vector<CallEffect>& calls) {
+        auto code = func.getInstructions().decode();
+        auto n = static_cast<int32_t>(code.size());
+        auto params = func.getParamsSize();
+        auto depths = stackDepths(code, params, _program.getConstants(), calls);
+        if(depths.empty())
+            return false;
+
+        // 每条返回语句都在语句之间的深度上计算返回值，由此得到参数加局部变量的大小 frame
+        int32_t frame = -1;
+        for(int32_t i=0; i<n; i++) {
+            auto& info = opcodeInfo(code[i].getOperation());
+            if(!info.is_return || depths[i] < 0)
+                continue;
+            if(frame != -1 && frame != depths[i] - info.pop)
+                return false;
+            frame = depths[i] - info.pop;
+        }
+        if(frame <= params)
+            return false;
+
+        // 开头的声明：每条指令执行时栈的最低深度是执行前的深度减去弹出的 slot 数，
+        // 它的后缀最小值升高的地方，是某个变量的初始值算完、压到了它的位置上，这个位置从此一直被占着。
+        // 所以上一个变量的初始化结束后，到这里为止的指令就是这个变量的初始化；
+        // 按执行前的深度算不行，例如 f(1, 2.0) 的 int 实参先占住了 double 返回值的前一半
+        std::vector<int32_t> suffix_min(n + 1, std::numeric_limits<int32_t>::max());
+        for(int32_t i=n-1; i>=0; i--) {
+            int32_t pop, push;
+            if(depths[i] < 0 || !stackEffect(code[i], _program.getConstants(), calls, pop, push))
+                suffix_min[i] = suffix_min[i + 1];
+            else
+                suffix_min[i] = std::min(depths[i] - pop, suffix_min[i + 1]);
+        }
+        auto target = findJumpTargets(code);
+        std::vector<Unit> units;
+        int32_t level = params;
+        int32_t begin = 0;
+        for(int32_t i=0; i<n && level<frame; i++) {
+            auto& instruction = code[i];
+            auto& info = opcodeInfo(instruction.getOperation());
+            if(target[i] || info.is_branch || info.is_return || depths[i] < 0)
+                return false;
+            auto next = suffix_min[i + 1];
+            if(next <= level)
+                continue;
+            if(next - level > 2)
+                return false;
+            Unit unit;
+            unit.offset = level;
+            unit.size = next - level;
+            unit.begin = begin;
+            unit.end = i + 1;
+            unit.initialized = instruction.getOperation() != Operation::SNEW;
+            units.push_back(unit);
+            begin = i + 1;
+            level = next;
+        }
+        // 最后一个变量的初始化在哪里结束看不出来，它留在原来的压栈方式，放在共用的 slot 上面；
+        // 其他变量的初始化代码都在 [begin, end) 里
+        if(level != frame || units.size() < 3)
+            return false;
+        auto m = static_cast<int32_t>(units.size()) - 1;
+        auto& last = units[m];
+        std::vector<int32_t> unit_at(frame, -1);
+        for(int32_t u=0; u<=m; u++)
+            unit_at[units[u].offset] = u;
+        for(int32_t u=0; u<m; u++)
+            if(!units[u].initialized && units[u].end - units[u].begin != 1)
+                return false;
+
+        // 找出每条指令读写的变量：loada 0 压入的地址被 iload/dload 弹出是读，被 istore/dstore 弹出是写；
+        // 地址被别的指令用掉或者留到块外的函数不处理
+        ControlFlowGraph cfg(code);
+        auto& consts = _program.getConstants();
+        std::vector<int32_t> use_of(n, -1);
+        std::vector<int32_t> def_of(n, -1);
+        std::vector<int32_t> origins;
+        for(auto& block : cfg.blocks()) {
+            origins.clear();
+            for(int32_t i=block.begin; i<block.end; i++) {
+                auto& instruction = code[i];
+                auto op = instruction.getOperation();
+                if(op == Operation::LOADA && instruction.getX() == 0) {
+                    auto offset = instruction.getY();
+                    if(offset >= frame || (offset >= params && unit_at[offset] == -1))
+                        return false;
+                    // 参数和最后一个变量不参与分配
+                    origins.push_back(offset >= params && unit_at[offset] < m ? unit_at[offset] : -1);
+                    continue;
+                }
+                int32_t pop, push;
+                if(!stackEffect(instruction, consts, calls, pop, push))
+                    return false;
+                // 块开头之前压入的值来源未知，按 -1 处理
+                std::vector<int32_t> popped(pop, -1);
+                for(int32_t k=pop-1; k>=0 && !origins.empty(); k--) {
+                    popped[k] = origins.back();
+                    origins.pop_back();
+                }
+                if(op == Operation::ILOAD || op == Operation::DLOAD)
+                    use_of[i] = popped[0];
+                else if(op == Operation::ISTORE || op == Operation::DSTORE) {
+                    def_of[i] = popped[0];
+                    for(int32_t k=1; k<pop; k++)
+                        if(popped[k] != -1)
+                            return false;
+                }
+                else if(std::any_of(popped.begin(), popped.end(), [](int32_t u) { return u != -1; }))
+                    return false;
+                origins.insert(origins.end(), push, -1);
+            }
+            if(std::any_of(origins.begin(), origins.end(), [](int32_t u) { return u != -1; }))
+                return false;
+        }
+        // 声明时的初始值压栈也是一次写
+        for(int32_t u=0; u<m; u++) {
+            auto& unit = units[u];
+            if(!unit.initialized)
+                continue;
+            if(def_of[unit.end - 1] != -1)
+                return false;
+            def_of[unit.end - 1] = unit_at[unit.offset];
+        }
+
+        // 活跃分析，按块迭代到不动点
+        auto& blocks = cfg.blocks();
+        auto block_count = blocks.size();
+        std::vector<UnitSet> live_in(block_count, UnitSet(m)), live_out(block_count, UnitSet(m));
+        auto transfer = [&](int32_t b, UnitSet live, auto&& onDef) {
+            for(int32_t i=blocks[b].end-1; i>=blocks[b].begin; i--) {
+                if(def_of[i] != -1) {
+                    onDef(def_of[i], live);
+                    live.reset(def_of[i]);
+                }
+                if(use_of[i] != -1)
+                    live.set(use_of[i]);
+            }
+            return live;
+        };
+        auto& rpo = cfg.reversePostOrder();
+        for(bool changed = true; changed; ) {
+            changed = false;
+            for(auto it = rpo.rbegin(); it != rpo.rend(); ++it) {
+                auto b = *it;
+                for(auto s : blocks[b].succs)
+                    live_out[b].unite(live_in[s]);
+                auto in = transfer(b, live_out[b], [](int32_t, const UnitSet&) {});
+                changed = live_in[b].unite(in) || changed;
+            }
+        }
+
+        // 写一个变量时还活跃的变量都和它冲突
+        std::vector<UnitSet> interfere(m, UnitSet(m));
+        for(auto b : rpo) {
+            transfer(b, live_out[b], [&interfere](int32_t d, const UnitSet& live) {
+                live.forEach([&](int32_t v) {
+                    if(v != d) {
+                        interfere[d].set(v);
+                        interfere[v].set(d);
+                    }
+                });
+            });
+        }
+
+        // 按原来的顺序贪心地放到最低的不冲突的位置
+        int32_t new_frame = params;
+        for(int32_t u=0; u<m; u++) {
+            auto& unit = units[u];
+            for(int32_t slot=params; unit.slot==-1; slot++) {
+                bool free = true;
+                for(int32_t v=0; v<u && free; v++)
+                    free = !interfere[u].test(v) || slot + unit.size <= units[v].slot || units[v].slot + units[v].size <= slot;
+                if(free)
+                    unit.slot = slot;
+            }
+            new_frame = std::max(new_frame, unit.slot + unit.size);
+        }
+        last.slot = new_frame;
+        new_frame += last.size;
+        if(new_frame >= frame)
+            return false;
+
+        // 重写：一条 snew 分配整个栈帧，初始化改成存到新的位置
+        auto rename = [&](const Instruction& instruction) {
+            if(instruction.getOperation() == Operation::LOADA && instruction.getX() == 0 && instruction.getY() >= params)
+                return Instruction(Operation::LOADA, 0, units[unit_at[instruction.getY()]].slot);
+            return instruction;
+        };
+        std::vector<Instruction> out;
+        std::vector<int32_t> map(n + 1);
+        if(last.slot > params)
+            out.emplace_back(Operation::SNEW, last.slot - params);
+        for(int32_t u=0; u<m; u++) {
+            auto& unit = units[u];
+            for(int32_t i=unit.begin; i<unit.end; i++)
+                map[i] = static_cast<int32_t>(out.size());
+            if(!unit.initialized)
+                continue;
+            out.emplace_back(Operation::LOADA, 0, unit.slot);
+            for(int32_t i=unit.begin; i<unit.end; i++)
+                out.push_back(rename(code[i]));
+            out.emplace_back(unit.size == 2 ? Operation::DSTORE : Operation::ISTORE);
+        }
+        for(int32_t i=last.begin; i<n; i++) {
+            map[i] = static_cast<int32_t>(out.size());
+            out.push_back(rename(code[i]));
+        }
+        map[n] = static_cast<int32_t>(out.size());
+        retargetJumps(out, map);
+        if(out.size() > static_cast<std::size_t>(MAX_INSTRUCTIONS))
+            return false;
+        func.getInstructions() = CodeBuffer(out);
+        _frames_shrunk++;
+        _slots_saved += frame - new_frame;
+        return true;
+    }
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "analyser/program.h"
+#include "optimizer/stackDepth.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace cc0 {
+
+    // 按活跃区间给局部变量分配栈帧里的 slot：
+    // 局部变量都声明在函数开头，语法分析按声明顺序把它们的初始值压栈（没有初始化的用 snew 分配），
+    // 每个变量独占一个位置。这里对局部变量做活跃分析，活跃区间不相交的变量共用位置，
+    // 然后在函数开头用一条 snew 分配这些位置，初始化改成 loada + 表达式 + istore/dstore；
+    // 最后声明的变量仍然由初始化表达式压栈，紧接在它们上面。
+    // 只处理语法分析生成的形状，需要在改变栈深度的优化（尾调用、函数展开）之前运行；
+    // 看不懂的函数原样保留，省不下 slot 的函数也不改
+    class SlotAllocator final {
+    private:
+        using int32_t = std::int32_t;
+        using int64_t = std::int64_t;
+
+    public:
+        explicit SlotAllocator(Program& program) : _program(program) {}
+
+        // 返回是否修改了程序
+        bool run();
+
+        int64_t getFramesShrunk() const { return _frames_shrunk; }
+        int64_t getSlotsSaved() const { return _slots_saved; }
+
+    private:
+        bool allocate(Function& func, const std::vector<CallEffect>& calls);
+
+    private:
+        Program& _program;
+        int64_t _frames_shrunk = 0;
+        int64_t _slots_saved = 0;
+    };
+}
@@ -0,0 +1,90 @@
+#include "optimizer/stackDepth.h"
+
+namespace cc0 {
+
+    std::vector<CallEffect> callEffects(const Program& program) {
+        auto& functions = program.getFunctions();
+        std::vector<CallEffect> calls(functions.size());
+        for(std::size_t f=0; f<functions.size(); f++) {
+            calls[f].pop = functions[f].getParamsSize();
+            for(auto it = functions[f].getInstructions().begin(); it != functions[f].getInstructions().end(); ++it) {
+                auto& info = opcodeInfo(it.getOperation());
+                if(info.is_return) {
+                    calls[f].push = info.pop;
+                    calls[f].returns = true;
+                    break;
+                }
+            }
+        }
+        return calls;
+    }
+
+    bool stackEffect(const Instruction& instruction, const ConstantPool& consts, const std::vector<CallEffect>& calls,
+                     std::int32_t& pop, std::int32_t& push) {
+        auto op = instruction.getOperation();
+        auto& info = opcodeInfo(op);
+        pop = info.pop;
+        push = info.push;
+        switch(op) {
+            case Operation::POPN:
+                pop = instruction.getX();
+                break;
+            case Operation::SNEW:
+                push = instruction.getX();
+                break;
+            case Operation::LOADC:
+                if(instruction.getX() < 0 || instruction.getX() >= consts.size())
+                    return false;
+                push = consts.getType(instruction.getX()) == DOUBLE_CONSTANT ? 2 : 1;
+                break;
+            case Operation::CALL:
+                if(instruction.getX() < 0 || instruction.getX() >= static_cast<std::int32_t>(calls.size()))
+                    return false;
+                pop = calls[instruction.getX()].pop;
+                push = calls[instruction.getX()].push;
+                break;
+            default:
+                break;
+        }
+        return pop >= 0 && push >= 0;
+    }
+
+    std::vector<std::int32_t> stackDepths(const std::vector<Instruction>& code, std::int32_t entry,
+                                          const ConstantPool& consts, const std::vector<CallEffect>& calls) {
+        auto n = static_cast<std::int32_t>(code.size());
+        std::vector<std::int32_t> depth(n, -1);
+        std::vector<std::int32_t> work;
+        // 到达 i 时深度是 d，和已经记下的不一致时返回 false
+        auto reach = [&](std::int32_t i, std::int32_t d) {
+            if(i < 0 || i >= n)
+                return i == n;  // 落到代码末尾由虚拟机报错，这里不管
+            if(depth[i] == -1) {
+                depth[i] = d;
+                work.push_back(i);
+                return true;
+            }
+            return depth[i] == d;
+        };
+        if(n == 0)
+            return depth;
+        if(!reach(0, entry))
+            return {};
+        while(!work.empty()) {
+            auto i = work.back();
+            work.pop_back();
+            auto& instruction = code[i];
+            auto& info = opcodeInfo(instruction.getOperation());
+            std::int32_t pop, push;
+            if(!stackEffect(instruction, consts, calls, pop, push) || pop > depth[i])
+                return {};
+            if(info.is_return)
+                continue;
+            auto next = depth[i] - pop + push;
+            if(info.is_branch && !reach(instruction.getX(), next))
+                return {};
+            if(instruction.getOperation() != Operation::JMP && !reach(i + 1, next))
+                return {};
+        }
+        return depth;
+    }
+}
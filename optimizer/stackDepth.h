@@ -0,0 +1,29 @@
+#pragma once
+
+#include "analyser/program.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace cc0 {
+
+    // call 一个函数对调用者栈的影响：弹出参数占的 slot，压入返回值占的 slot
+    struct CallEffect {
+        std::int32_t pop = 0;
+        std::int32_t push = 0;
+        bool returns = false;  // 函数里有没有返回指令，没有时（例如尾递归改成的死循环）不会回到调用者
+    };
+
+    // 每个函数的 CallEffect，返回值的大小由函数里的返回指令决定（iret 1、dret 2、ret 0）
+    std::vector<CallEffect> callEffects(const Program& program);
+
+    // 指令对栈的影响，call 查 calls；没有对应的函数时返回 false
+    bool stackEffect(const Instruction& instruction, const ConstantPool& consts, const std::vector<CallEffect>& calls,
+                     std::int32_t& pop, std::int32_t& push);
+
+    // 每条指令执行之前栈上的 slot 数（从栈帧开头算起，包括参数和局部变量），不可达的指令是 -1
+    // entry 是入口处的深度，也就是参数占的 slot 数。
+    // 同一条指令从不同路径到达时深度不一样、弹出超过栈帧里已有的 slot 时说明代码有错，返回空
+    std::vector<std::int32_t> stackDepths(const std::vector<Instruction>& code, std::int32_t entry,
+                                          const ConstantPool& consts, const std::vector<CallEffect>& calls);
+}
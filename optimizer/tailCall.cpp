@@ -0,0 +1,82 @@
+#include "optimizer/tailCall.h"
+#include "optimizer/stackDepth.h"
+
+namespace cc0 {
+
+    namespace {
+        // i 处的指令最终是不是一条返回，沿 jmp 走，防止 jmp 成环
+        bool reachesReturn(const std::vector<Instruction>& code, std::int32_t i) {
+            auto n = static_cast<std::int32_t>(code.size());
+            for(std::int32_t steps=0; i >= 0 && i < n && steps < n; steps++) {
+                auto op = code[i].getOperation();
+                if(opcodeInfo(op).is_return)
+                    return true;
+                if(op != Operation::JMP && op != Operation::NOP)
+                    return false;
+                i = op == Operation::JMP ? code[i].getX() : i + 1;
+            }
+            return false;
+        }
+    }
+
+    bool TailCallEliminator::run() {
+        auto& functions = _program.getFunctions();
+        auto calls = callEffects(_program);
+        bool changed = false;
+        for(std::size_t f=0; f<functions.size(); f++) {
+            auto self = static_cast<int32_t>(f);
+            auto code = functions[f].getInstructions().decode();
+            auto n = static_cast<int32_t>(code.size());
+            bool found = false;
+            for(int32_t i=0; i+1<n && !found; i++)
+                found = code[i].getOperation() == Operation::CALL && code[i].getX() == self && reachesReturn(code, i + 1);
+            if(!found)
+                continue;
+            auto params = functions[f].getParamsSize();
+            auto& paramSlots = functions[f].getParamSlots();
+            auto depths = stackDepths(code, params, _program.getConstants(), calls);
+            if(depths.empty())
+                continue;
+
+            // call 换成：参数[k] = 实参[k]，弹到只剩参数，jmp 0
+            std::vector<Instruction> out;
+            std::vector<int32_t> map(n + 1);
+            int64_t converted = 0;
+            for(int32_t i=0; i<n; i++) {
+                map[i] = static_cast<int32_t>(out.size());
+                auto& instruction = code[i];
+                if(instruction.getOperation() != Operation::CALL || instruction.getX() != self || depths[i] < 0
+                   || !reachesReturn(code, i + 1)) {
+                    out.push_back(instruction);
+                    continue;
+                }
+                // 实参在参数上面，逐个参数拷贝不会互相覆盖；double 参数用 dload/dstore 整个拷贝
+                auto args = depths[i] - params;
+                for(int32_t k=0, p=0; k<params; p++) {
+                    auto slots = p < static_cast<int32_t>(paramSlots.size()) ? paramSlots[p] : 1;
+                    out.emplace_back(Operation::LOADA, 0, k);
+                    out.emplace_back(Operation::LOADA, 0, args + k);
+                    out.emplace_back(slots == 2 ? Operation::DLOAD : Operation::ILOAD);
+                    out.emplace_back(slots == 2 ? Operation::DSTORE : Operation::ISTORE);
+                    k += slots;
+                }
+                if(depths[i] > params)
+                    out.emplace_back(Operation::POPN, depths[i] - params);
+                // 跳转的操作数最后统一重定位，map[0] 一定是 0
+                out.emplace_back(Operation::JMP, 0);
+                converted++;
+            }
+            map[n] = static_cast<int32_t>(out.size());
+            // 只重定位原来的跳转，新生成的 jmp 0 映射后还是 0
+            for(auto& instruction : out)
+                if(opcodeInfo(instruction.getOperation()).is_branch)
+                    instruction.setX(map[instruction.getX()]);
+            if(out.size() > static_cast<std::size_t>(MAX_INSTRUCTIONS))
+                continue;
+            functions[f].getInstructions() = CodeBuffer(out);
+            _converted += converted;
+            changed = true;
+        }
+        return changed;
+    }
+}
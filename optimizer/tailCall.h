@@ -0,0 +1,29 @@
+#pragma once
+
+#include "analyser/program.h"
+
+#include <cstdint>
+
+namespace cc0 {
+
+    // 自身尾调用改成循环：call 自己之后紧接着返回（或者 jmp 到返回），
+    // 就把栈上的实参逐个存回参数的位置（double 用 dload/dstore），弹掉局部变量和临时值，再 jmp 到函数开头。
+    // 栈的深度不再随递归层数增长
+    class TailCallEliminator final {
+    private:
+        using int32_t = std::int32_t;
+        using int64_t = std::int64_t;
+
+    public:
+        explicit TailCallEliminator(Program& program) : _program(program) {}
+
+        // 返回是否修改了程序
+        bool run();
+
+        int64_t getConverted() const { return _converted; }
+
+    private:
+        Program& _program;
+        int64_t _converted = 0;
+    };
+}
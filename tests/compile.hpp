@@ -0,0 +1,59 @@
+#pragma once
+
+#include "catch2/catch.hpp"
+
+#include "tokenizer/tokenizer.h"
+#include "analyser/analyser.h"
+#include "optimizer/optimizer.h"
+#include "emitter/assemblyWriter.h"
+#include "emitter/objectWriter.h"
+
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace cc0::test {
+
+	// 按 level 级优化编译一段源代码，词法或语法错误直接让测试失败
+	// stats 不为空时存放各个优化的统计（见 Optimizer::getStats）
+	inline Program compile(const std::string& source, int level = 0, std::vector<PassStats>* stats = nullptr) {
+		std::istringstream in(source);
+		Tokenizer tkz(in);
+		auto tokens = tkz.AllTokens();
+		REQUIRE_FALSE(tokens.second.has_value());
+		Analyser analyser(std::move(tokens.first));
+		auto result = analyser.Analyse();
+		REQUIRE_FALSE(result.second.has_value());
+		if (level > 0) {
+			Optimizer optimizer(level);
+			optimizer.run(result.first);
+			if (stats != nullptr)
+				*stats = optimizer.getStats();
+		}
+		return std::move(result.first);
+	}
+
+	// 统计里 pass 这个优化的 detail 一项，没有时是 0
+	inline std::int64_t passDetail(const std::vector<PassStats>& stats, const std::string& pass, const std::string& detail) {
+		std::int64_t total = 0;
+		for (auto& s : stats)
+			if (s.name == pass)
+				for (auto& [name, count] : s.details)
+					if (name == detail)
+						total += count;
+		return total;
+	}
+
+	// -s 的输出
+	inline std::string toAssembly(const Program& program) {
+		AssemblyWriter writer(program);
+		return fmt::to_string(writer.getText());
+	}
+
+	// -c 的输出，调用前要先检查 Program::checkLimits
+	inline std::vector<char> toObject(const Program& program) {
+		ObjectWriter writer(program);
+		return writer.getBytes();
+	}
+}
@@ -0,0 +1,393 @@
+#pragma once
+
+#include "analyser/program.h"
+#include "instruction/instruction.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace cc0::test {
+
+	// 测试用的简化版虚拟机，语义和参考虚拟机一致：
+	// 可以直接执行 Program，也可以执行 ObjectWriter 写出的 .o 文件。
+	// 除了输出以外还记录执行了多少条指令，用来比较优化前后的运行开销，结果不受机器快慢影响。
+	// 运行时错误（除以 0、栈越界、超过指令条数上限）抛出 std::runtime_error。
+	class SimpleVM final {
+	private:
+		using int32_t = std::int32_t;
+		using int64_t = std::int64_t;
+		using uint8_t = std::uint8_t;
+		using uint32_t = std::uint32_t;
+		using uint64_t = std::uint64_t;
+
+		struct Constant {
+			ConstantType type;
+			std::string str;
+			int32_t i = 0;
+			double d = 0;
+		};
+
+		struct Func {
+			int32_t name;
+			int32_t params;
+			int32_t level;
+			std::vector<Instruction> code;
+		};
+
+		struct Frame {
+			int32_t func;   // -1 是启动代码
+			int32_t ip;
+			int32_t bp;
+			int32_t sl;     // 外层（静态链）栈帧在 _frames 里的下标
+		};
+
+		// 字符串常量的“地址”：常量下标加上这个标记
+		static constexpr int32_t STRING_TAG = 0x40000000;
+		// 堆从这个地址开始，和栈分开
+		static constexpr int32_t HEAP_BASE = 0x20000000;
+		// 栈按需增长，最多这么多个 slot
+		static constexpr int32_t STACK_SIZE = 1 << 26;
+
+	public:
+		explicit SimpleVM(const Program& program) {
+			auto& consts = program.getConstants();
+			for (int32_t i = 0; i < consts.size(); i++) {
+				Constant c;
+				c.type = consts.getType(i);
+				switch (c.type) {
+				case STRING_CONSTANT: c.str = std::string(consts.getString(i)); break;
+				case INT_CONSTANT: c.i = consts.getInt(i); break;
+				case DOUBLE_CONSTANT: c.d = consts.getDouble(i); break;
+				}
+				_constants.push_back(std::move(c));
+			}
+			_start = program.getStartCode().decode();
+			for (auto& func : program.getFunctions())
+				_functions.push_back({ func.getNameIndex(), func.getParamsSize(), func.getLevel(), func.getInstructions().decode() });
+		}
+
+		// object 是 .o 文件的全部内容
+		explicit SimpleVM(const std::vector<char>& object) {
+			auto p = reinterpret_cast<const uint8_t*>(object.data());
+			auto end = p + object.size();
+			auto take = [&](int bytes) {
+				if (end - p < bytes)
+					throw std::runtime_error("truncated object file");
+				uint32_t v = 0;
+				for (int i = 0; i < bytes; i++)
+					v = (v << 8) | *p++;
+				return v;
+			};
+			if (take(4) != 0x43303A29 || take(4) != 1)
+				throw std::runtime_error("bad magic or version");
+			for (uint32_t n = take(2); n > 0; n--) {
+				Constant c;
+				c.type = static_cast<ConstantType>(take(1));
+				switch (c.type) {
+				case STRING_CONSTANT: {
+					auto len = take(2);
+					if (static_cast<uint32_t>(end - p) < len)
+						throw std::runtime_error("truncated object file");
+					c.str.assign(reinterpret_cast<const char*>(p), len);
+					p += len;
+					break;
+				}
+				case INT_CONSTANT: c.i = static_cast<int32_t>(take(4)); break;
+				case DOUBLE_CONSTANT: {
+					uint64_t bits = take(4);
+					bits = (bits << 32) | take(4);
+					std::memcpy(&c.d, &bits, sizeof(c.d));
+					break;
+				}
+				default:
+					throw std::runtime_error("bad constant type");
+				}
+				_constants.push_back(std::move(c));
+			}
+			auto code = [&]() {
+				std::vector<Instruction> v;
+				for (uint32_t n = take(2); n > 0; n--) {
+					auto& info = opcodeInfo(static_cast<Operation>(*p));
+					if (info.mnemonic == nullptr || end - p < info.size)
+						throw std::runtime_error("bad instruction");
+					v.push_back(decodeInstruction(p));
+					p += info.size;
+				}
+				return v;
+			};
+			_start = code();
+			for (uint32_t n = take(2); n > 0; n--) {
+				Func f;
+				f.name = static_cast<int32_t>(take(2));
+				f.params = static_cast<int32_t>(take(2));
+				f.level = static_cast<int32_t>(take(2));
+				f.code = code();
+				_functions.push_back(std::move(f));
+			}
+			if (p != end)
+				throw std::runtime_error("trailing bytes in object file");
+		}
+
+		SimpleVM(const SimpleVM&) = delete;
+		SimpleVM& operator=(const SimpleVM&) = delete;
+
+		// 超过 limit 条指令还没结束就当作死循环
+		void setStepLimit(int64_t limit) { _step_limit = limit; }
+		// 上一次 run 执行了多少条指令
+		int64_t getSteps() const { return _steps; }
+
+		// 执行启动代码和 main，input 是标准输入的内容，返回标准输出的内容
+		std::string run(const std::string& input = "") {
+			_in.clear();
+			_in.str(input);
+			_out.str("");
+			_steps = 0;
+			_memory.assign(1 << 16, 0);
+			_heap.clear();
+			_sp = 0;
+			_frames.clear();
+			_frames.push_back({ -1, 0, 0, -1 });
+			execute();
+			int32_t main = -1;
+			for (int32_t i = 0; i < static_cast<int32_t>(_functions.size()); i++)
+				if (name(_functions[i]) == "main")
+					main = i;
+			if (main == -1)
+				throw std::runtime_error("no main");
+			call(main);
+			execute();
+			return _out.str();
+		}
+
+	private:
+		std::string name(const Func& func) const {
+			if (func.name < 0 || func.name >= static_cast<int32_t>(_constants.size()))
+				throw std::runtime_error("bad function name");
+			return _constants[func.name].str;
+		}
+
+		const std::vector<Instruction>& code(const Frame& frame) const {
+			return frame.func == -1 ? _start : _functions[frame.func].code;
+		}
+
+		int32_t& at(int32_t address) {
+			if (address >= HEAP_BASE && address - HEAP_BASE < static_cast<int32_t>(_heap.size()))
+				return _heap[address - HEAP_BASE];
+			if (address < 0 || address >= _sp)
+				throw std::runtime_error("bad address");
+			return _memory[address];
+		}
+
+		void push(int32_t v) {
+			if (_sp == static_cast<int32_t>(_memory.size())) {
+				if (_sp >= STACK_SIZE)
+					throw std::runtime_error("stack overflow");
+				_memory.resize(_memory.size() * 2, 0);
+			}
+			_memory[_sp++] = v;
+		}
+
+		int32_t pop() {
+			if (_sp <= _frames.back().bp)
+				throw std::runtime_error("stack underflow");
+			return _memory[--_sp];
+		}
+
+		void pushDouble(double d) {
+			uint64_t bits;
+			std::memcpy(&bits, &d, sizeof(bits));
+			push(static_cast<int32_t>(bits >> 32));
+			push(static_cast<int32_t>(bits));
+		}
+
+		double popDouble() {
+			uint64_t low = static_cast<uint32_t>(pop());
+			uint64_t high = static_cast<uint32_t>(pop());
+			uint64_t bits = (high << 32) | low;
+			double d;
+			std::memcpy(&d, &bits, sizeof(d));
+			return d;
+		}
+
+		double loadDouble(int32_t address) {
+			uint64_t bits = (static_cast<uint64_t>(static_cast<uint32_t>(at(address))) << 32) | static_cast<uint32_t>(at(address + 1));
+			double d;
+			std::memcpy(&d, &bits, sizeof(d));
+			return d;
+		}
+
+		void storeDouble(int32_t address, double d) {
+			uint64_t bits;
+			std::memcpy(&bits, &d, sizeof(bits));
+			at(address) = static_cast<int32_t>(bits >> 32);
+			at(address + 1) = static_cast<int32_t>(bits);
+		}
+
+		// 参数已经在栈顶，它们成为新栈帧的开头
+		void call(int32_t index) {
+			if (index < 0 || index >= static_cast<int32_t>(_functions.size()))
+				throw std::runtime_error("bad function index");
+			auto& func = _functions[index];
+			if (_sp - func.params < _frames.back().bp)
+				throw std::runtime_error("not enough arguments");
+			// 全局变量在启动代码的栈帧里，函数都是第 1 层
+			_frames.push_back({ index, 0, _sp - func.params, 0 });
+		}
+
+		// 弹出当前栈帧，把返回值（slots 个）留在调用者的栈顶
+		void ret(int32_t slots) {
+			int32_t value[2];
+			for (int32_t k = slots - 1; k >= 0; k--)
+				value[k] = pop();
+			_sp = _frames.back().bp;
+			_frames.pop_back();
+			for (int32_t k = 0; k < slots; k++)
+				push(value[k]);
+		}
+
+		static int32_t compare(double a, double b) { return a < b ? -1 : (a > b ? 1 : 0); }
+
+		// 执行到当前栈帧返回为止
+		void execute() {
+			auto depth = _frames.size();
+			while (_frames.size() >= depth) {
+				auto& frame = _frames.back();
+				auto& insts = code(frame);
+				if (frame.ip == static_cast<int32_t>(insts.size())) {
+					if (frame.func != -1)
+						throw std::runtime_error("function ends without return");
+					return;
+				}
+				if (frame.ip < 0 || frame.ip > static_cast<int32_t>(insts.size()))
+					throw std::runtime_error("bad jump target");
+				if (++_steps > _step_limit)
+					throw std::runtime_error("step limit exceeded");
+				auto& inst = insts[frame.ip++];
+				auto x = inst.getX();
+				auto jump = [&](bool taken) {
+					if (taken)
+						frame.ip = x;
+				};
+				switch (inst.getOperation()) {
+				case Operation::NOP: break;
+				case Operation::BIPUSH: push(x); break;
+				case Operation::IPUSH: push(x); break;
+				case Operation::POP: pop(); break;
+				case Operation::POP2: pop(); pop(); break;
+				case Operation::POPN: for (int32_t k = 0; k < x; k++) pop(); break;
+				case Operation::DUP: { auto v = pop(); push(v); push(v); break; }
+				case Operation::DUP2: { auto b = pop(); auto a = pop(); push(a); push(b); push(a); push(b); break; }
+				case Operation::LOADC: {
+					if (x < 0 || x >= static_cast<int32_t>(_constants.size()))
+						throw std::runtime_error("bad constant index");
+					auto& c = _constants[x];
+					if (c.type == INT_CONSTANT)
+						push(c.i);
+					else if (c.type == DOUBLE_CONSTANT)
+						pushDouble(c.d);
+					else
+						push(STRING_TAG + x);
+					break;
+				}
+				case Operation::LOADA: {
+					auto f = static_cast<int32_t>(_frames.size()) - 1;
+					for (int32_t k = 0; k < x; k++) {
+						f = _frames[f].sl;
+						if (f < 0)
+							throw std::runtime_error("bad level difference");
+					}
+					push(_frames[f].bp + inst.getY());
+					break;
+				}
+				case Operation::NEW: {
+					auto count = pop();
+					push(HEAP_BASE + static_cast<int32_t>(_heap.size()));
+					_heap.resize(_heap.size() + count, 0);
+					break;
+				}
+				case Operation::SNEW: for (int32_t k = 0; k < x; k++) push(0); break;
+				case Operation::ILOAD: case Operation::ALOAD: push(at(pop())); break;
+				case Operation::DLOAD: pushDouble(loadDouble(pop())); break;
+				case Operation::IALOAD: case Operation::AALOAD: { auto i = pop(); push(at(pop() + i)); break; }
+				case Operation::DALOAD: { auto i = pop(); pushDouble(loadDouble(pop() + 2 * i)); break; }
+				case Operation::ISTORE: case Operation::ASTORE: { auto v = pop(); at(pop()) = v; break; }
+				case Operation::DSTORE: { auto v = popDouble(); storeDouble(pop(), v); break; }
+				case Operation::IASTORE: case Operation::AASTORE: { auto v = pop(); auto i = pop(); at(pop() + i) = v; break; }
+				case Operation::DASTORE: { auto v = popDouble(); auto i = pop(); storeDouble(pop() + 2 * i, v); break; }
+				case Operation::IADD: { auto b = pop(); auto a = pop(); push(static_cast<int32_t>(static_cast<uint32_t>(a) + static_cast<uint32_t>(b))); break; }
+				case Operation::ISUB: { auto b = pop(); auto a = pop(); push(static_cast<int32_t>(static_cast<uint32_t>(a) - static_cast<uint32_t>(b))); break; }
+				case Operation::IMUL: { auto b = pop(); auto a = pop(); push(static_cast<int32_t>(static_cast<uint32_t>(a) * static_cast<uint32_t>(b))); break; }
+				case Operation::IDIV: {
+					auto b = pop(); auto a = pop();
+					if (b == 0)
+						throw std::runtime_error("division by zero");
+					push(b == -1 ? static_cast<int32_t>(0u - static_cast<uint32_t>(a)) : a / b);
+					break;
+				}
+				case Operation::DADD: { auto b = popDouble(); pushDouble(popDouble() + b); break; }
+				case Operation::DSUB: { auto b = popDouble(); pushDouble(popDouble() - b); break; }
+				case Operation::DMUL: { auto b = popDouble(); pushDouble(popDouble() * b); break; }
+				case Operation::DDIV: { auto b = popDouble(); pushDouble(popDouble() / b); break; }
+				case Operation::INEG: push(static_cast<int32_t>(0u - static_cast<uint32_t>(pop()))); break;
+				case Operation::DNEG: pushDouble(-popDouble()); break;
+				case Operation::ICMP: { auto b = pop(); auto a = pop(); push(a < b ? -1 : (a > b ? 1 : 0)); break; }
+				case Operation::DCMP: { auto b = popDouble(); push(compare(popDouble(), b)); break; }
+				case Operation::I2D: pushDouble(pop()); break;
+				case Operation::D2I: push(static_cast<int32_t>(popDouble())); break;
+				case Operation::I2C: push(pop() & 0xff); break;
+				case Operation::JMP: jump(true); break;
+				case Operation::JE: jump(pop() == 0); break;
+				case Operation::JNE: jump(pop() != 0); break;
+				case Operation::JL: jump(pop() < 0); break;
+				case Operation::JGE: jump(pop() >= 0); break;
+				case Operation::JG: jump(pop() > 0); break;
+				case Operation::JLE: jump(pop() <= 0); break;
+				case Operation::CALL: call(x); break;
+				case Operation::RET: ret(0); break;
+				case Operation::IRET: case Operation::ARET: ret(1); break;
+				case Operation::DRET: ret(2); break;
+				case Operation::IPRINT: _out << pop(); break;
+				case Operation::DPRINT: {
+					char buf[64];
+					std::snprintf(buf, sizeof(buf), "%f", popDouble());
+					_out << buf;
+					break;
+				}
+				case Operation::CPRINT: _out << static_cast<char>(pop()); break;
+				case Operation::SPRINT: {
+					auto index = pop() - STRING_TAG;
+					if (index < 0 || index >= static_cast<int32_t>(_constants.size()) || _constants[index].type != STRING_CONSTANT)
+						throw std::runtime_error("bad string");
+					_out << _constants[index].str;
+					break;
+				}
+				case Operation::PRINTL: _out << '\n'; break;
+				case Operation::ISCAN: { int32_t v = 0; if (!(_in >> v)) throw std::runtime_error("bad input"); push(v); break; }
+				case Operation::DSCAN: { double v = 0; if (!(_in >> v)) throw std::runtime_error("bad input"); pushDouble(v); break; }
+				case Operation::CSCAN: { char v = 0; if (!(_in >> v)) throw std::runtime_error("bad input"); push(static_cast<uint8_t>(v)); break; }
+				default:
+					throw std::runtime_error("bad instruction");
+				}
+			}
+		}
+
+	private:
+		std::vector<Constant> _constants;
+		std::vector<Instruction> _start;
+		std::vector<Func> _functions;
+
+		std::vector<int32_t> _memory;
+		std::vector<int32_t> _heap;
+		int32_t _sp = 0;
+		std::vector<Frame> _frames;
+		std::istringstream _in;
+		std::ostringstream _out;
+		int64_t _steps = 0;
+		int64_t _step_limit = 1000000000;
+	};
+}
@@ -0,0 +1,66 @@
+#include "catch2/catch.hpp"
+
+#include "tests/compile.hpp"
+#include "tests/simple_vm.hpp"
+
+#include <string>
+
+namespace {
+	const char* const program_source =
+		"int g = 5;\n"
+		"const int K = 10;\n"
+		"double half(int x) { return (double)x / 2; }\n"
+		"int fact(int n) {\n"
+		"    if (n <= 1) return 1;\n"
+		"    return n * fact(n - 1);\n"
+		"}\n"
+		"int main() {\n"
+		"    int i;\n"
+		"    char c;\n"
+		"    scan(i);\n"
+		"    scan(c);\n"
+		"    print(half(9), (int)half(7), (double)i * 2);\n"
+		"    while (i) { print(i); i = i - 1; }\n"
+		"    if (i >= 1) print(\"ge\"); else print(\"nge\");\n"
+		"    print(fact(10), -(3 - 10), 7 / 2, (char)(c + 1), K * g);\n"
+		"    return 0;\n"
+		"}\n";
+
+	const char* const program_output =
+		"4.500000 3 6.000000\n"
+		"3\n"
+		"2\n"
+		"1\n"
+		"nge\n"
+		"3628800 7 3 b 50\n";
+}
+
+TEST_CASE("Compile and run a program at every optimization level.") {
+	for (int level = 0; level <= 2; level++) {
+		auto program = cc0::test::compile(program_source, level);
+		cc0::test::SimpleVM vm(program);
+		REQUIRE(vm.run("3 a") == program_output);
+	}
+}
+
+TEST_CASE("The object file runs the same as the program it was written from.") {
+	auto program = cc0::test::compile(program_source);
+	REQUIRE_FALSE(program.checkLimits().has_value());
+	cc0::test::SimpleVM vm(cc0::test::toObject(program));
+	REQUIRE(vm.run("3 a") == program_output);
+}
+
+TEST_CASE("Integer division by zero traps.") {
+	auto source =
+		"int main() {\n"
+		"    int z, y;\n"
+		"    scan(z);\n"
+		"    y = 5 / z;\n"
+		"    print(1);\n"
+		"    return 0;\n"
+		"}\n";
+	for (int level = 0; level <= 2; level++) {
+		cc0::test::SimpleVM vm(cc0::test::compile(source, level));
+		REQUIRE_THROWS_AS(vm.run("0"), std::runtime_error);
+	}
+}
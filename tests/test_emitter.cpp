@@ -0,0 +1,77 @@
+#include "catch2/catch.hpp"
+
+#include "tests/compile.hpp"
+#include "tests/simple_vm.hpp"
+
+#include "fmt/format.h"
+
+#include <algorithm>
+#include <iterator>
+#include <string>
+
+namespace {
+	// main 里循环 3 次，循环体是 statements 条 s = s + i;，每条 7 条指令，
+	// 循环结束的跳转目标就在函数的末尾
+	std::string bigLoop(int statements) {
+		std::string source =
+			"int main() {\n"
+			"    int i = 0, s = 0;\n"
+			"    while (i < 3) {\n";
+		for (int k = 0; k < statements; k++)
+			source += "        s = s + i;\n";
+		source +=
+			"        i = i + 1;\n"
+			"    }\n"
+			"    print(s);\n"
+			"    return 0;\n"
+			"}\n";
+		return source;
+	}
+
+	// code 里最大的跳转目标
+	std::int32_t maxBranchTarget(const cc0::CodeBuffer& code) {
+		std::int32_t target = -1;
+		for (auto it = code.begin(); it != code.end(); ++it)
+			if (opcodeInfo(it.getOperation()).is_branch)
+				target = std::max(target, (*it).getX());
+		return target;
+	}
+}
+
+TEST_CASE("Assembly of a function over 65535 instructions keeps its jump targets.") {
+	for (int level = 0; level <= 1; level++) {
+		auto program = cc0::test::compile(bigLoop(10500), level);
+		auto& code = program.getFunctions()[0].getInstructions();
+		REQUIRE(code.size() > 70000);
+		auto target = maxBranchTarget(code);
+		REQUIRE(target > 65535);
+		REQUIRE(target < code.size());
+
+		std::int32_t index = 0;
+		for (auto it = code.begin(); it != code.end(); ++it, ++index)
+			if (opcodeInfo(it.getOperation()).is_branch && (*it).getX() == target)
+				break;
+		auto jump = *std::next(code.begin(), index);
+		auto line = fmt::format("\n{}   {} {}\n", index, opcodeInfo(jump.getOperation()).mnemonic, target);
+		REQUIRE(cc0::test::toAssembly(program).find(line) != std::string::npos);
+
+		cc0::test::SimpleVM vm(program);
+		REQUIRE(vm.run() == "31500\n");
+	}
+}
+
+TEST_CASE("A function over 65535 instructions cannot be written to an object file.") {
+	auto program = cc0::test::compile(bigLoop(10500));
+	auto err = program.checkLimits();
+	REQUIRE(err.has_value());
+	REQUIRE(err.value() == cc0::ErrFunctionTooLarge);
+}
+
+TEST_CASE("Jump targets above 32767 are written to the object file as u2.") {
+	auto program = cc0::test::compile(bigLoop(9000));
+	REQUIRE(program.getFunctions()[0].getInstructions().size() <= cc0::MAX_INSTRUCTIONS);
+	REQUIRE(maxBranchTarget(program.getFunctions()[0].getInstructions()) > 32767);
+	REQUIRE_FALSE(program.checkLimits().has_value());
+	cc0::test::SimpleVM vm(cc0::test::toObject(program));
+	REQUIRE(vm.run() == "27000\n");
+}
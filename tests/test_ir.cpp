@@ -0,0 +1,145 @@
+#include "catch2/catch.hpp"
+
+#include "tests/compile.hpp"
+#include "tests/simple_vm.hpp"
+
+#include "ir/deadCode.h"
+#include "ir/lifting.h"
+#include "ir/loopInvariants.h"
+#include "ir/lowering.h"
+#include "ir/passManager.h"
+#include "optimizer/stackDepth.h"
+
+#include <memory>
+#include <string>
+
+namespace {
+	// 每个函数都变成 SSA 再变回来，只做循环不变量外提和死代码删除
+	bool hoistOnSsa(cc0::ir::PassManager& manager) {
+		manager.add(std::make_unique<cc0::ir::LoopInvariants>());
+		manager.add(std::make_unique<cc0::ir::DeadCode>());
+		return manager.run();
+	}
+
+	std::int64_t passCount(const cc0::ir::PassManager& manager, const std::string& pass) {
+		for (auto& [name, count] : manager.getCounts())
+			if (name == pass)
+				return count;
+		return 0;
+	}
+}
+
+TEST_CASE("Hoisting on SSA is kept although the preheader makes the function longer.", "[ir]") {
+	auto source =
+		"int G = 3;\n"
+		"int work(int n, int m) {\n"
+		"    int i = 0; int s = 0;\n"
+		"    while (i < n) {\n"
+		"        s = s + n * m + G * 7;\n"
+		"        i = i + 1;\n"
+		"    }\n"
+		"    return s;\n"
+		"}\n"
+		"int main() {\n"
+		"    int n, m;\n"
+		"    scan(n); scan(m);\n"
+		"    print(work(n, m), work(3, 2), work(0, 1));\n"
+		"    return 0;\n"
+		"}\n";
+	auto before = cc0::test::compile(source, 1);
+	auto after = cc0::test::compile(source, 1);
+	cc0::ir::PassManager manager(after);
+	REQUIRE(hoistOnSsa(manager));
+	REQUIRE(passCount(manager, "licm") > 0);
+
+	cc0::test::SimpleVM before_vm(before);
+	cc0::test::SimpleVM after_vm(after);
+	auto expected = before_vm.run("1000 5");
+	REQUIRE(expected == "5021000 81 0\n");
+	REQUIRE(after_vm.run("1000 5") == expected);
+	CAPTURE(before_vm.getSteps(), after_vm.getSteps());
+	REQUIRE(after_vm.getSteps() < before_vm.getSteps());
+}
+
+TEST_CASE("Lifting to SSA and lowering back without any pass keeps every function's output and size.", "[ir]") {
+	auto source =
+		"int G = 3;\n"
+		"int work(int n, int m) {\n"
+		"    int i = 0; int s = 0;\n"
+		"    while (i < n) {\n"
+		"        s = s + n * m + G * 7;\n"
+		"        i = i + 1;\n"
+		"    }\n"
+		"    return s;\n"
+		"}\n"
+		"int pick(int x) {\n"
+		"    int r = 1;\n"
+		"    switch (x) {\n"
+		"        case 0: r = 3; break;\n"
+		"        case 1: r = 5; break;\n"
+		"        case 2: r = 7; break;\n"
+		"        case 5: r = 11; break;\n"
+		"        case 9: r = 13; break;\n"
+		"        case 40: r = 17; break;\n"
+		"    }\n"
+		"    return r;\n"
+		"}\n"
+		"int digit(int i) {\n"
+		"    switch (i / 7 - i / 7 / 10 * 10) {\n"
+		"        case 0: return 1;\n"
+		"        case 3: return 4;\n"
+		"    }\n"
+		"    return 0;\n"
+		"}\n"
+		"double half(double x, int k) {\n"
+		"    double y = x / 2;\n"
+		"    if (k > 0) return y + k;\n"
+		"    return y;\n"
+		"}\n"
+		"int fact(int n) {\n"
+		"    if (n <= 1) return 1;\n"
+		"    return n * fact(n - 1);\n"
+		"}\n"
+		"double ratio() {\n"
+		"    double d = (G + 3) * 92 / (G * G + 1);\n"
+		"    print(d);\n"
+		"    return d;\n"
+		"}\n"
+		"int main() {\n"
+		"    int n, i, s;\n"
+		"    scan(n);\n"
+		"    i = 0; s = 0;\n"
+		"    while (i < n) {\n"
+		"        s = s + pick(i) + digit(i * 3);\n"
+		"        i = i + 1;\n"
+		"    }\n"
+		"    print(work(n, 5), s, half(3, 2), half(3, 0), fact(10), ratio());\n"
+		"    return 0;\n"
+		"}\n";
+	for (int level = 0; level <= 2; level++) {
+		CAPTURE(level);
+		auto before = cc0::test::compile(source, level);
+		auto after = cc0::test::compile(source, level);
+		auto calls = cc0::callEffects(after);
+		for (auto& func : after.getFunctions()) {
+			CAPTURE(std::string(after.getConstants().getString(func.getNameIndex())));
+			auto code = func.getInstructions().decode();
+			auto lifted = cc0::ir::lift(code, func.getParamsSize(), after.getConstants(), calls);
+			REQUIRE(lifted.has_value());
+			auto lowered = cc0::ir::lower(*lifted);
+			REQUIRE(lowered.has_value());
+			cc0::CodeBuffer buffer(*lowered);
+			// 什么都没改的函数变回来不能变长
+			REQUIRE(lowered->size() <= code.size());
+			REQUIRE(buffer.byteSize() <= func.getInstructions().byteSize());
+			func.getInstructions() = std::move(buffer);
+		}
+
+		cc0::test::SimpleVM before_vm(before);
+		cc0::test::SimpleVM after_vm(after);
+		auto expected = before_vm.run("30");
+		REQUIRE(expected == "5130 81 3.500000 1.500000 3628800 55.000000\n55.000000\n");
+		REQUIRE(after_vm.run("30") == expected);
+		REQUIRE(after_vm.getSteps() <= before_vm.getSteps());
+	}
+}
@@ -0,0 +1,4 @@
+#define CATCH_CONFIG_MAIN
+// 新版 glibc 的 MINSIGSTKSZ 不再是常量，这个版本的 Catch2 的信号处理编译不过
+#define CATCH_CONFIG_NO_POSIX_SIGNALS
+#include "catch2/catch.hpp"
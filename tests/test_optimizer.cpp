@@ -0,0 +1,162 @@
+#include "catch2/catch.hpp"
+
+#include "tests/compile.hpp"
+#include "tests/simple_vm.hpp"
+
+#include "optimizer/commonSubexpressions.h"
+
+#include <cstdint>
+#include <string>
+#include <utility>
+
+namespace {
+	// 按 level 级优化编译并运行，返回输出和执行的指令条数
+	std::pair<std::string, std::int64_t> runAt(const std::string& source, int level, const std::string& input = "") {
+		cc0::test::SimpleVM vm(cc0::test::compile(source, level));
+		auto output = vm.run(input);
+		return { output, vm.getSteps() };
+	}
+
+	// 所有代码的指令条数
+	std::int64_t instructionCount(const cc0::Program& program) {
+		std::int64_t count = program.getStartCode().size();
+		for (auto& func : program.getFunctions())
+			count += func.getInstructions().size();
+		return count;
+	}
+
+	// 内层循环里的表达式除了 a、b 都是循环不变量
+	const char* const nest_source =
+		"int main() {\n"
+		"    int n; int m; int a = 0; int b; int s = 0;\n"
+		"    scan(n); scan(m);\n"
+		"    while (a < n) {\n"
+		"        b = 0;\n"
+		"        while (b < m) {\n"
+		"            s = s + (n * m + 7) + (n * 10 + m) + (n - m) * (n + m) + a * 2 + b;\n"
+		"            b = b + 1;\n"
+		"        }\n"
+		"        a = a + 1;\n"
+		"    }\n"
+		"    print(s);\n"
+		"    return 0;\n"
+		"}\n";
+}
+
+TEST_CASE("Loop-invariant motion hoists the invariant expressions of a nested loop at -O2.", "[licm]") {
+	std::vector<cc0::PassStats> stats;
+	cc0::test::compile(nest_source, 2, &stats);
+	REQUIRE(cc0::test::passDetail(stats, "licm", "expressions-hoisted") > 0);
+
+	auto [o1, o1_steps] = runAt(nest_source, 1, "300 307");
+	auto [o2, o2_steps] = runAt(nest_source, 2, "300 307");
+	REQUIRE(o1 == "-152008892\n");
+	REQUIRE(o2 == o1);
+	// 每轮内层循环执行的指令从 52 条左右减到 31 条左右
+	CAPTURE(o1_steps, o2_steps);
+	REQUIRE(o2_steps * 10 < o1_steps * 7);
+}
+
+TEST_CASE("Loop-invariant motion keeps the behaviour of loops that do not run or call functions.", "[licm]") {
+	auto source =
+		"int g = 7;\n"
+		"const int k = 3;\n"
+		"int bump() { g = g + 1; return g; }\n"
+		"int f(int n) {\n"
+		"    int i, t;\n"
+		"    double d, e;\n"
+		"    i = 0; t = 0; d = (double)n; e = (double)0;\n"
+		"    while (i < n) {\n"
+		"        if (i * (n / 2) > 40) return t + n * g;\n"
+		"        e = e + d * (double)k + (double)(n / 3);\n"
+		"        t = t + g * k + n / 2;\n"
+		"        i = i + 1;\n"
+		"    }\n"
+		"    print(e);\n"
+		"    return t;\n"
+		"}\n"
+		"int h(int n) {\n"
+		"    int i, t;\n"
+		"    i = 0; t = 0;\n"
+		"    while (i < n) {\n"
+		"        t = t + g * 2;\n"
+		"        bump();\n"
+		"        i = i + 1;\n"
+		"    }\n"
+		"    return t;\n"
+		"}\n"
+		"int q(int n, int z) {\n"
+		"    int i, t;\n"
+		"    i = 0; t = 0;\n"
+		"    while (i < n) {\n"
+		"        t = t + n / z;\n"
+		"        i = i + 1;\n"
+		"    }\n"
+		"    return t;\n"
+		"}\n"
+		"int main() {\n"
+		"    int x, z;\n"
+		"    scan(x); scan(z);\n"
+		"    print(f(x), f(x * 3), h(x), g, q(x, z));\n"
+		"    return 0;\n"
+		"}\n";
+	// z 为 0 时循环不执行的 q 不能因为外提了 n / z 而出错
+	for (auto input : { "5 1", "0 0", "30 2" }) {
+		auto expected = runAt(source, 0, input).first;
+		REQUIRE(runAt(source, 1, input).first == expected);
+		REQUIRE(runAt(source, 2, input).first == expected);
+	}
+}
+
+TEST_CASE("Common-subexpression elimination reuses repeated expressions within a block.", "[cse]") {
+	auto source =
+		"int g = 4;\n"
+		"int side() { g = g + 1; return g; }\n"
+		"int sum(int n, int acc) {\n"
+		"    if (n == 0) return acc;\n"
+		"    return sum(n - 1, acc + (n * 3 + g) * 2 - (n * 3 + g));\n"
+		"}\n"
+		"double dd(double x, int k) {\n"
+		"    double y;\n"
+		"    y = (x * (double)k + x) * (x * (double)k + x);\n"
+		"    return y - (x * (double)k + x);\n"
+		"}\n"
+		"int main() {\n"
+		"    int a, b, c;\n"
+		"    scan(a); scan(b);\n"
+		"    c = a * 10 + b - (b * 10 + a) + (a * 10 + b) * (b * 10 + a);\n"
+		"    print(c, a * a, (a + b) * (a + b));\n"
+		"    c = (a * b + g) + side() + (a * b + g);\n"
+		"    print(c, g);\n"
+		"    c = (a - b) * 7 + 1;\n"
+		"    a = a + 1;\n"
+		"    c = c + (a - b) * 7 + 1;\n"
+		"    print(c);\n"
+		"    print(sum(10, 0), dd((double)a, b));\n"
+		"    return 0;\n"
+		"}\n";
+
+	// 同一份 -O1 的代码，只多做一次公共子表达式消除，比较前后的指令条数和执行的指令数
+	auto before = cc0::test::compile(source, 1);
+	auto after = cc0::test::compile(source, 1);
+	cc0::CommonSubexpressionEliminator eliminator(after);
+	REQUIRE(eliminator.run());
+	REQUIRE(eliminator.getDuplicated() > 0);
+	REQUIRE(eliminator.getReused() > 0);
+
+	cc0::test::SimpleVM before_vm(before);
+	cc0::test::SimpleVM after_vm(after);
+	auto expected = before_vm.run("7 3");
+	REQUIRE(expected == "2737 49 100\n56 5\n65\n215 992.000000\n");
+	REQUIRE(after_vm.run("7 3") == expected);
+
+	CAPTURE(instructionCount(before), instructionCount(after), before_vm.getSteps(), after_vm.getSteps());
+	REQUIRE(instructionCount(after) < instructionCount(before));
+	REQUIRE(after_vm.getSteps() < before_vm.getSteps());
+
+	// -O2 里也会做
+	std::vector<cc0::PassStats> stats;
+	cc0::test::SimpleVM o2_vm(cc0::test::compile(source, 2, &stats));
+	REQUIRE(cc0::test::passDetail(stats, "cse", "duplicated") + cc0::test::passDetail(stats, "cse", "reused") > 0);
+	REQUIRE(o2_vm.run("7 3") == expected);
+}
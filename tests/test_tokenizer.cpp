@@ -0,0 +1,26 @@
+#include "catch2/catch.hpp"
+#include "tokenizer/tokenizer.h"
+
+#include <sstream>
+#include <vector>
+
+TEST_CASE("Tokenize a small function.") {
+	std::istringstream in(
+		"int main() {\n"
+		"    print(1 <= 'a', \"s\");\n"
+		"}\n");
+	cc0::Tokenizer tkz(in);
+	auto result = tkz.AllTokens();
+	REQUIRE_FALSE(result.second.has_value());
+	std::vector<cc0::TokenType> types;
+	for (auto& token : result.first)
+		types.push_back(token.GetType());
+	std::vector<cc0::TokenType> expected = {
+		cc0::INT, cc0::IDENTIFIER, cc0::LEFT_BRACKET, cc0::RIGHT_BRACKET, cc0::LEFT_BRACE,
+		cc0::PRINT, cc0::LEFT_BRACKET, cc0::INTEGER, cc0::LESS_EQUAL_SIGN, cc0::CHAR_TOKEN, cc0::COMMA_SIGN,
+		cc0::STRING, cc0::RIGHT_BRACKET, cc0::SEMICOLON, cc0::RIGHT_BRACE
+	};
+	REQUIRE(types == expected);
+	REQUIRE(result.first[1].GetStringValue() == "main");
+	REQUIRE(result.first[11].GetStringValue() == "s");
+}
@@ -34,7 +34,7 @@ namespace cc0 {
 		CONTINUE,
 		PRINT,
 		SCAN,
-		// 符号   ( ) { } < = > , ; ! + - * /
+		// 符号   ( ) { } < = > , ; : ! && || + - * /
 		PLUS_SIGN,   // +
 		MINUS_SIGN,  // -
 		MULTIPLICATION_SIGN,  // *
@@ -51,7 +51,11 @@ namespace cc0 {
         GREATER_EQUAL_SIGN,  // >=
         NONEQUAL_SIGN,  // !=
         EQUAL_SIGN,    // ==
-        COMMA_SIGN     // ,
+        COMMA_SIGN,    // ,
+        COLON,         // :
+        NOT_SIGN,      // !
+        AND_SIGN,      // &&
+        OR_SIGN        // ||
 	};
 
 	class Token final {
@@ -67,9 +71,9 @@ namespace cc0 {
 		Token(TokenType type, std::any value, uint64_t start_line, uint64_t start_column, uint64_t end_line, uint64_t end_column)
 			: _type(type), _value(std::move(value)), _start_pos(start_line, start_column), _end_pos(end_line, end_column) {}
 		Token(TokenType type, std::any value, std::pair<uint64_t, uint64_t> start, std::pair<uint64_t, uint64_t> end)
-			: Token(type, value, start.first, start.second, end.first, end.second) {}
+			: Token(type, std::move(value), start.first, start.second, end.first, end.second) {}
 		Token(const Token& t) { _type = t._type;  _value = t._value; _start_pos = t._start_pos; _end_pos = t._end_pos; }
-		Token(Token&& t) : Token(TokenType::NULL_TOKEN, nullptr, 0, 0, 0, 0) { swap(*this, t); }
+		Token(Token&& t) noexcept : Token(TokenType::NULL_TOKEN, nullptr, 0, 0, 0, 0) { swap(*this, t); }
 		Token& operator=(Token t) { swap(*this, t); return *this; }
 		bool operator==(const Token& rhs) const { 
 			return _type == rhs._type 
@@ -79,7 +83,7 @@ namespace cc0 {
 		}
 
 		TokenType GetType() const { return _type; };
-		std::any GetValue() const { return _value; };
+		const std::any& GetValue() const { return _value; };
 		std::pair<uint64_t, uint64_t> GetStartPos() const { return _start_pos; }
 		std::pair<uint64_t, uint64_t> GetEndPos() const { return _end_pos; }
 		std::string GetValueString() const {
@@ -99,6 +103,13 @@ namespace cc0 {
 			}
 			return "Invalid";
 		}
+		// 标识符、字符、字符串的值本身就是 std::string，直接返回引用，不拷贝
+		const std::string& GetStringValue() const {
+			auto str = std::any_cast<std::string>(&_value);
+			if (str == nullptr)
+				DieAndPrint("Token value is not a string.");
+			return *str;
+		}
 	private:
 		TokenType _type;
 		std::any _value;
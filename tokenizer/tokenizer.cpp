@@ -21,7 +21,7 @@ namespace cc0 {
             {"for", TokenType::FOR},
             {"do", TokenType::DO},
             {"return", TokenType::RETURN},
-            {"break", TokenType::RETURN},
+            {"break", TokenType::BREAK},
             {"continue", TokenType::CONTINUE},
             {"print", TokenType::PRINT},
             {"scan", TokenType::SCAN}
@@ -49,7 +49,7 @@ namespace cc0 {
 			auto p = NextToken();
 			if (p.second.has_value()) {
 				if (p.second.value().GetCode() == ErrorCode::ErrEOF)
-					return std::make_pair(result, std::optional<CompilationError>());
+					return std::make_pair(std::move(result), std::optional<CompilationError>());
 				else
 					return std::make_pair(std::vector<Token>(), p.second);
 			}
@@ -131,6 +131,9 @@ namespace cc0 {
                     case ',':
                         current_state = DFAState::COMMA_SIGN_STATE;
                         break;
+                    case ':':
+                        current_state = DFAState::COLON_STATE;
+                        break;
                     case '{':
                         current_state = DFAState::LEFT_BRACE_STATE;
                         break;
@@ -146,6 +149,12 @@ namespace cc0 {
                     case '!':
                         current_state = DFAState::EXCLAMATION_SIGN_STATE;
                         break;
+                    case '&':
+                        current_state = DFAState::AND_SIGN_STATE;
+                        break;
+                    case '|':
+                        current_state = DFAState::OR_SIGN_STATE;
+                        break;
                     case '\'':
                         current_state = DFAState::CHAR_STATE;
                         break;
@@ -505,7 +514,13 @@ namespace cc0 {
                 return std::make_pair(std::make_optional<Token>(TokenType::COMMA_SIGN, ',', pos, currentPos()), std::optional<CompilationError>());
 			}
 
-			// !=
+			// :
+			case COLON_STATE: {
+                unreadLast();
+                return std::make_pair(std::make_optional<Token>(TokenType::COLON, ':', pos, currentPos()), std::optional<CompilationError>());
+			}
+
+			// ! !=
 			case EXCLAMATION_SIGN_STATE: {
                 if(current_char.has_value()) {
                     auto ch = current_char.value();
@@ -514,6 +529,25 @@ namespace cc0 {
                         return std::make_pair(std::make_optional<Token>(TokenType::NONEQUAL_SIGN, value, pos, currentPos()), std::optional<CompilationError>());
                     }
                 }
+                unreadLast();
+                return std::make_pair(std::make_optional<Token>(TokenType::NOT_SIGN, '!', pos, currentPos()), std::optional<CompilationError>());
+            }
+
+			// &&，单独的 & 不合法
+			case AND_SIGN_STATE: {
+                if(current_char.has_value() && current_char.value() == '&') {
+                    std::any value{std::in_place_type<std::string>, "&&"};
+                    return std::make_pair(std::make_optional<Token>(TokenType::AND_SIGN, value, pos, currentPos()), std::optional<CompilationError>());
+                }
+                return std::make_pair(std::optional<Token>(), std::make_optional<CompilationError>(pos, ErrorCode::ErrInvalidInput));
+            }
+
+			// ||，单独的 | 不合法
+			case OR_SIGN_STATE: {
+                if(current_char.has_value() && current_char.value() == '|') {
+                    std::any value{std::in_place_type<std::string>, "||"};
+                    return std::make_pair(std::make_optional<Token>(TokenType::OR_SIGN, value, pos, currentPos()), std::optional<CompilationError>());
+                }
                 return std::make_pair(std::optional<Token>(), std::make_optional<CompilationError>(pos, ErrorCode::ErrInvalidInput));
             }
 
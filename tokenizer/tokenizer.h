@@ -41,7 +41,10 @@ namespace cc0 {
 			LESS_SIGN_STATE,  // <
 			GREATER_SIGN_STATE,  //  >
             COMMA_SIGN_STATE,  // ,
-            EXCLAMATION_SIGN_STATE,  // !
+            COLON_STATE,  // :
+            EXCLAMATION_SIGN_STATE,  // ! !=
+            AND_SIGN_STATE,  // &&
+            OR_SIGN_STATE,  // ||
             SINGLE_LINE_COMMENT_STATE, // //
             MULTI_LINE_COMMENT_STATE  // /* */
 		};
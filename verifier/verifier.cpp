@@ -0,0 +1,428 @@
+#include "verifier/verifier.h"
+#include "ir/ir.h"
+#include "optimizer/cfg.h"
+
+#include "fmt/format.h"
+
+#include <algorithm>
+
+namespace cc0 {
+
+    namespace {
+        using Slot = Verifier::Slot;
+
+        Slot slotOf(Slot::Kind kind) {
+            Slot slot;
+            slot.kind = kind;
+            return slot;
+        }
+
+        // 读成 kind 类型是否可以：参数的类型可能还不知道，没有初始化的 slot 读出来是任意的值
+        bool readableAs(const Slot& slot, Slot::Kind kind) {
+            return slot.kind == kind || slot.kind == Slot::ANY || slot.kind == Slot::UNINIT || slot.kind == Slot::ZERO;
+        }
+
+        Slot join(const Slot& a, const Slot& b) {
+            if(a == b)
+                return a;
+            if(a.kind == Slot::ANY || b.kind == Slot::ANY)
+                return slotOf(Slot::ANY);
+            // 没有初始化的 slot 和 0 可以当作任何值
+            auto loose = [](const Slot& slot) { return slot.kind == Slot::UNINIT || slot.kind == Slot::ZERO; };
+            if(loose(a) && b.kind != Slot::CONFLICT && b.kind != Slot::ADDRESS)
+                return b;
+            if(loose(b) && a.kind != Slot::CONFLICT && a.kind != Slot::ADDRESS)
+                return a;
+            return slotOf(Slot::CONFLICT);
+        }
+
+        // 在 size 处把 frame 分成两段是否会拆开一个 double
+        bool splitsDouble(const std::vector<Slot>& frame, std::size_t size) {
+            return size > 0 && size < frame.size() && frame[size - 1].kind == Slot::LOW && frame[size].kind == Slot::HIGH;
+        }
+
+        const char* kindName(Slot::Kind kind) {
+            switch(kind) {
+                case Slot::ANY:      return "an untyped parameter";
+                case Slot::UNINIT:   return "an uninitialized slot";
+                case Slot::ZERO:     return "zero";
+                case Slot::INT:      return "an int";
+                case Slot::LOW:      return "the low half of a double";
+                case Slot::HIGH:     return "the high half of a double";
+                case Slot::ADDRESS:  return "an address";
+                default:             return "a slot with conflicting types";
+            }
+        }
+    }
+
+    std::optional<std::string> Verifier::step(int32_t function, const Instruction& instruction, std::vector<Slot>& frame) {
+        auto op = instruction.getOperation();
+        auto& consts = _program.getConstants();
+        int32_t pop, push;
+        if(!stackEffect(instruction, consts, _calls, pop, push))
+            return fmt::format("{} has an invalid operand {}", opcodeInfo(op).mnemonic, instruction.getX());
+        if(static_cast<int32_t>(frame.size()) < pop)
+            return fmt::format("{} pops {} slots but the stack has {}", opcodeInfo(op).mnemonic, pop, frame.size());
+        auto expected = frame.size() - pop + push;
+
+        auto top = [&](std::size_t k) -> Slot& { return frame[frame.size() - 1 - k]; };
+        auto pushKind = [&](Slot::Kind kind) { frame.push_back(slotOf(kind)); };
+        auto pushDouble = [&]() {
+            pushKind(Slot::LOW);
+            pushKind(Slot::HIGH);
+        };
+        // 弹出一个 int 或者 double，类型不对时返回原因
+        auto popValue = [&](bool isDouble) -> std::optional<std::string> {
+            if(isDouble) {
+                if(!readableAs(top(0), Slot::HIGH) || !readableAs(top(1), Slot::LOW))
+                    return fmt::format("{} expects a double on the stack, found {} and {}", opcodeInfo(op).mnemonic,
+                                       kindName(top(1).kind), kindName(top(0).kind));
+                frame.resize(frame.size() - 2);
+            }
+            else {
+                if(!readableAs(top(0), Slot::INT))
+                    return fmt::format("{} expects an int on the stack, found {}", opcodeInfo(op).mnemonic, kindName(top(0).kind));
+                frame.pop_back();
+            }
+            return std::nullopt;
+        };
+        // 地址指向的栈帧：level 0 是当前的栈帧，函数里 level 1 是全局变量
+        auto targetOf = [&](const Slot& address, int32_t size) -> std::vector<Slot>* {
+            auto& target = address.level == 0 ? frame : _globals;
+            if(address.offset < 0 || address.offset + size > static_cast<int32_t>(target.size()))
+                return nullptr;
+            return &target;
+        };
+
+        std::optional<std::string> error;
+        ir::Type operand, result;
+        int32_t arity;
+        if(ir::signatureOf(op, operand, arity, result)) {
+            for(int32_t k=0; k<arity && !error; k++)
+                error = popValue(operand == ir::Type::DOUBLE);
+            if(error)
+                return error;
+            if(result == ir::Type::DOUBLE)
+                pushDouble();
+            else
+                pushKind(Slot::INT);
+        }
+        else switch(op) {
+            case Operation::NOP:
+            case Operation::JMP:
+            case Operation::PRINTL:
+                break;
+            case Operation::BIPUSH:
+            case Operation::IPUSH:
+                pushKind(instruction.getX() == 0 ? Slot::ZERO : Slot::INT);
+                break;
+            case Operation::ISCAN:
+            case Operation::CSCAN:
+                pushKind(Slot::INT);
+                break;
+            case Operation::DSCAN:
+                pushDouble();
+                break;
+            case Operation::LOADC:
+                if(consts.getType(instruction.getX()) == DOUBLE_CONSTANT)
+                    pushDouble();
+                else
+                    pushKind(Slot::INT);
+                break;
+            case Operation::POP:
+            case Operation::POP2:
+            case Operation::POPN:
+                if(splitsDouble(frame, frame.size() - pop))
+                    return fmt::format("{} pops half of a double", opcodeInfo(op).mnemonic);
+                frame.resize(frame.size() - pop);
+                break;
+            case Operation::DUP:
+            case Operation::DUP2:
+                if(splitsDouble(frame, frame.size() - pop))
+                    return fmt::format("{} copies half of a double", opcodeInfo(op).mnemonic);
+                for(int32_t k=0; k<pop; k++)
+                    frame.push_back(frame[frame.size() - pop]);
+                break;
+            case Operation::SNEW:
+                for(int32_t k=0; k<push; k++)
+                    pushKind(Slot::UNINIT);
+                break;
+            case Operation::LOADA: {
+                auto level = instruction.getX();
+                // 启动代码的栈帧就是全局变量，函数里 level 1 是全局变量
+                if(level != 0 && !(level == 1 && function != -1))
+                    return fmt::format("loada has an invalid level {}", level);
+                Slot address = slotOf(Slot::ADDRESS);
+                address.level = level;
+                address.offset = instruction.getY();
+                frame.push_back(address);
+                break;
+            }
+            case Operation::ILOAD:
+            case Operation::DLOAD: {
+                auto address = top(0);
+                if(address.kind != Slot::ADDRESS)
+                    return fmt::format("{} expects an address from loada, found {}", opcodeInfo(op).mnemonic, kindName(address.kind));
+                frame.pop_back();
+                auto size = op == Operation::DLOAD ? 2 : 1;
+                auto target = targetOf(address, size);
+                if(target == nullptr)
+                    return fmt::format("{} reads slot {} outside the frame", opcodeInfo(op).mnemonic, address.offset);
+                auto& slots = *target;
+                if(size == 2) {
+                    if(!readableAs(slots[address.offset], Slot::LOW) || !readableAs(slots[address.offset + 1], Slot::HIGH))
+                        return fmt::format("dload reads slots {}, {} holding {} and {}", address.offset, address.offset + 1,
+                                           kindName(slots[address.offset].kind), kindName(slots[address.offset + 1].kind));
+                    pushDouble();
+                }
+                else {
+                    if(!readableAs(slots[address.offset], Slot::INT))
+                        return fmt::format("iload reads slot {} holding {}", address.offset, kindName(slots[address.offset].kind));
+                    pushKind(Slot::INT);
+                }
+                break;
+            }
+            case Operation::ISTORE:
+            case Operation::DSTORE: {
+                auto size = op == Operation::DSTORE ? 2 : 1;
+                if((error = popValue(size == 2)))
+                    return error;
+                auto address = top(0);
+                if(address.kind != Slot::ADDRESS)
+                    return fmt::format("{} expects an address from loada, found {}", opcodeInfo(op).mnemonic, kindName(address.kind));
+                frame.pop_back();
+                auto target = targetOf(address, size);
+                if(target == nullptr)
+                    return fmt::format("{} writes slot {} outside the frame", opcodeInfo(op).mnemonic, address.offset);
+                auto& slots = *target;
+                auto offset = static_cast<std::size_t>(address.offset);
+                if(target == &_globals) {
+                    // 全局变量的类型由启动代码确定，函数里只能写同样类型的值
+                    bool same = size == 2 ? readableAs(slots[offset], Slot::LOW) && readableAs(slots[offset + 1], Slot::HIGH)
+                                          : readableAs(slots[offset], Slot::INT);
+                    if(!same)
+                        return fmt::format("{} writes global slot {} holding {}", opcodeInfo(op).mnemonic, offset, kindName(slots[offset].kind));
+                    break;
+                }
+                // 局部的 slot 可以换成别的类型（不同变量共用 slot），被拆开的 double 剩下的一半不能再读
+                if(splitsDouble(slots, offset))
+                    slots[offset - 1] = slotOf(Slot::CONFLICT);
+                if(splitsDouble(slots, offset + size))
+                    slots[offset + size] = slotOf(Slot::CONFLICT);
+                if(size == 2) {
+                    slots[offset] = slotOf(Slot::LOW);
+                    slots[offset + 1] = slotOf(Slot::HIGH);
+                }
+                else
+                    slots[offset] = slotOf(Slot::INT);
+                break;
+            }
+            case Operation::JE: case Operation::JNE: case Operation::JL:
+            case Operation::JGE: case Operation::JG: case Operation::JLE:
+            case Operation::IPRINT:
+            case Operation::CPRINT:
+            case Operation::SPRINT:
+                if((error = popValue(false)))
+                    return error;
+                break;
+            case Operation::DPRINT:
+                if((error = popValue(true)))
+                    return error;
+                break;
+            case Operation::CALL: {
+                auto callee = instruction.getX();
+                auto base = frame.size() - pop;
+                if(splitsDouble(frame, base))
+                    return "call takes half of a double as an argument";
+                std::vector<Slot> args(frame.begin() + base, frame.end());
+                for(auto& arg : args) {
+                    if(arg.kind == Slot::ADDRESS || arg.kind == Slot::CONFLICT)
+                        return fmt::format("call passes {} as an argument", kindName(arg.kind));
+                    if(arg.kind == Slot::UNINIT)
+                        arg = slotOf(Slot::ANY);
+                }
+                // 参数的类型取各个调用处的实参，已知的类型必须一致
+                auto& params = _params[callee];
+                if(params.empty() && !args.empty()) {
+                    params = args;
+                    _params_changed = true;
+                }
+                for(std::size_t k=0; k<args.size(); k++) {
+                    if(args[k].kind == Slot::ANY || args[k] == params[k])
+                        continue;
+                    auto joined = params[k].kind == Slot::ANY ? args[k] : join(params[k], args[k]);
+                    if(joined.kind == Slot::CONFLICT)
+                        return fmt::format("argument slot {} is {} but an earlier call passed {}", k,
+                                           kindName(args[k].kind), kindName(params[k].kind));
+                    if(joined != params[k]) {
+                        params[k] = joined;
+                        _params_changed = true;
+                    }
+                }
+                frame.resize(base);
+                if(push == 2)
+                    pushDouble();
+                else if(push == 1)
+                    pushKind(Slot::INT);
+                break;
+            }
+            case Operation::RET:
+            case Operation::IRET:
+            case Operation::DRET:
+                if(function == -1)
+                    return "the start code cannot return";
+                if(_calls[function].push != pop)
+                    return fmt::format("{} does not match the other returns of the function", opcodeInfo(op).mnemonic);
+                if(pop > 0 && (error = popValue(pop == 2)))
+                    return error;
+                break;
+            default:
+                return fmt::format("{} is not generated by the compiler", opcodeInfo(op).mnemonic);
+        }
+        // 类型规则和栈效果表必须一致
+        if(frame.size() != expected)
+            return fmt::format("{} changed the stack by a different amount than its stack effect", opcodeInfo(op).mnemonic);
+        return std::nullopt;
+    }
+
+    std::optional<VerifyError> Verifier::verify(int32_t function, const std::vector<Instruction>& code, std::vector<Slot> frame,
+                                                int32_t& maxDepth) {
+        auto n = static_cast<int32_t>(code.size());
+        auto& consts = _program.getConstants();
+        maxDepth = static_cast<int32_t>(frame.size());
+        auto fail = [function](int32_t index, std::string message) {
+            return VerifyError{ function, index, std::move(message) };
+        };
+        if(n == 0) {
+            if(function != -1)
+                return fail(0, "the function has no instructions");
+            _globals = frame;
+            return std::nullopt;
+        }
+
+        // 操作数的范围先逐条检查，之后才能建控制流图
+        for(int32_t i=0; i<n; i++) {
+            auto op = code[i].getOperation();
+            auto& info = opcodeInfo(op);
+            if(info.mnemonic == nullptr)
+                return fail(i, fmt::format("invalid opcode 0x{:02x}", static_cast<int>(op)));
+            // 可以跳到代码末尾：启动代码到末尾就结束了，函数里的这种跳转只能在执行不到的地方，到达时再报错
+            if(info.is_branch && (code[i].getX() < 0 || code[i].getX() > n))
+                return fail(i, fmt::format("{} jumps to {} outside the code", info.mnemonic, code[i].getX()));
+            if(op == Operation::CALL && (code[i].getX() < 0 || code[i].getX() >= static_cast<int32_t>(_calls.size())))
+                return fail(i, fmt::format("call of an invalid function {}", code[i].getX()));
+            if(op == Operation::LOADC && (code[i].getX() < 0 || code[i].getX() >= consts.size()))
+                return fail(i, fmt::format("loadc of an invalid constant {}", code[i].getX()));
+            if((op == Operation::SNEW || op == Operation::POPN) && code[i].getX() < 0)
+                return fail(i, fmt::format("{} has a negative count", info.mnemonic));
+        }
+
+        ControlFlowGraph cfg(code);
+        auto& blocks = cfg.blocks();
+        std::vector<std::vector<Slot>> entry(blocks.size());
+        std::vector<bool> reached(blocks.size(), false);
+        std::optional<std::vector<Slot>> exit;   // 启动代码执行到末尾时的栈帧
+        std::vector<int32_t> work{ 0 };
+        entry[0] = std::move(frame);
+        reached[0] = true;
+
+        // 从指令 from 到达 index：第一次到达时记下栈帧，之后逐个 slot 合并
+        auto reach = [&](int32_t from, int32_t index, const std::vector<Slot>& state) -> std::optional<VerifyError> {
+            if(index == n) {
+                if(function != -1)
+                    return fail(from, "execution falls off the end of the function");
+                if(exit && exit->size() != state.size())
+                    return fail(from, fmt::format("the start code ends with {} slots here but {} elsewhere", state.size(), exit->size()));
+                if(!exit)
+                    exit = state;
+                else
+                    for(std::size_t k=0; k<state.size(); k++)
+                        (*exit)[k] = join((*exit)[k], state[k]);
+                return std::nullopt;
+            }
+            auto b = cfg.blockOf(index);
+            if(!reached[b]) {
+                reached[b] = true;
+                entry[b] = state;
+                work.push_back(b);
+                return std::nullopt;
+            }
+            auto& slots = entry[b];
+            if(slots.size() != state.size())
+                return fail(from, fmt::format("the stack has {} slots here but {} at instruction {}", state.size(), slots.size(), index));
+            bool changed = false;
+            for(std::size_t k=0; k<slots.size(); k++) {
+                auto joined = join(slots[k], state[k]);
+                if(joined != slots[k]) {
+                    slots[k] = joined;
+                    changed = true;
+                }
+            }
+            if(changed)
+                work.push_back(b);
+            return std::nullopt;
+        };
+
+        while(!work.empty()) {
+            auto b = work.back();
+            work.pop_back();
+            auto state = entry[b];
+            auto& block = blocks[b];
+            bool returns = true;
+            for(auto i=block.begin; i<block.end && returns; i++) {
+                if(auto message = step(function, code[i], state))
+                    return fail(i, *message);
+                maxDepth = std::max(maxDepth, static_cast<int32_t>(state.size()));
+                // 调用的函数不会返回时，后面的指令执行不到
+                returns = code[i].getOperation() != Operation::CALL || _calls[code[i].getX()].returns;
+            }
+            if(!returns)
+                continue;
+            auto& last = code[block.end - 1];
+            auto& info = opcodeInfo(last.getOperation());
+            if(info.is_return)
+                continue;
+            std::optional<VerifyError> error;
+            if(info.is_branch && (error = reach(block.end - 1, last.getX(), state)))
+                return error;
+            if(last.getOperation() != Operation::JMP && (error = reach(block.end - 1, block.end, state)))
+                return error;
+        }
+        if(function == -1)
+            _globals = exit ? *exit : std::vector<Slot>();
+        return std::nullopt;
+    }
+
+    std::optional<VerifyError> Verifier::run() {
+        auto& functions = _program.getFunctions();
+        _calls = callEffects(_program);
+        _params.assign(functions.size(), {});
+        _max_depths.assign(functions.size(), 0);
+        if(auto error = verify(-1, _program.getStartCode().decode(), {}, _start_max_depth))
+            return error;
+        // 参数的类型从调用处得到，新知道了某个参数的类型就再校验一遍，直到不再变化
+        do {
+            _params_changed = false;
+            for(std::size_t f=0; f<functions.size(); f++) {
+                auto& func = functions[f];
+                std::vector<Slot> frame = _params[f];
+                if(frame.empty())
+                    frame.assign(func.getParamsSize(), slotOf(Slot::ANY));
+                if(auto error = verify(static_cast<int32_t>(f), func.getInstructions().decode(), std::move(frame), _max_depths[f]))
+                    return error;
+            }
+        } while(_params_changed);
+        return std::nullopt;
+    }
+
+    std::string Verifier::report() const {
+        auto& consts = _program.getConstants();
+        fmt::memory_buffer buf;
+        fmt::format_to(buf, "max stack depth (slots):\n");
+        fmt::format_to(buf, "    {:<20} {}\n", ".start", _start_max_depth);
+        auto& functions = _program.getFunctions();
+        for(std::size_t f=0; f<functions.size(); f++)
+            fmt::format_to(buf, "    {:<20} {}\n", consts.getString(functions[f].getNameIndex()), _max_depths[f]);
+        return fmt::to_string(buf);
+    }
+}
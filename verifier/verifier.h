@@ -0,0 +1,86 @@
+#pragma once
+
+#include "analyser/program.h"
+#include "optimizer/stackDepth.h"
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace cc0 {
+
+    // 校验失败的位置和原因，function 为 -1 表示启动代码
+    struct VerifyError {
+        std::int32_t function = -1;
+        std::int32_t index = 0;
+        std::string message;
+    };
+
+    // 字节码校验：在控制流图上做抽象解释，每条指令执行前检查栈帧里每个 slot 的类型
+    // （int、double 的低/高两半、loada 压入的地址、没有初始化的 slot）：
+    //   - 栈高度不能小于指令要弹出的 slot 数（按操作码的栈效果表），汇合处各条路径的高度必须相同；
+    //   - 运算、转换、比较、打印、条件跳转的操作数类型要对，double 必须两半一起用；
+    //   - iload/istore 等的地址必须是 loada 压入的，目标 slot 在栈帧里并且类型相符，全局变量的类型由启动代码确定；
+    //     用 iload/istore 逐个 slot 拷贝 double 也算类型不符，优化生成的代码要用 dload/dstore；
+    //   - 实参的类型在各个调用处一致，函数里所有返回指令返回同样的类型，函数不能执行到代码末尾；
+    //     没有返回指令的函数（尾递归改成的死循环）不会返回，调用它之后的指令执行不到；
+    //   - 跳转目标、call 的函数下标、loadc 的常量下标都在范围内。
+    // 同时算出每个函数（和启动代码）运行时栈帧的最大 slot 数，包括参数、局部变量和操作数栈
+    class Verifier final {
+    private:
+        using int32_t = std::int32_t;
+
+    public:
+        explicit Verifier(const Program& program) : _program(program) {}
+
+        // 没有错误时返回空
+        std::optional<VerifyError> run();
+
+        int32_t getStartMaxDepth() const { return _start_max_depth; }
+        // 下标是函数在 .functions 里的位置
+        const std::vector<int32_t>& getMaxDepths() const { return _max_depths; }
+        // 每个函数一行最大栈深度
+        std::string report() const;
+
+    public:
+        // slot 的类型，也是抽象解释的格
+        struct Slot {
+            enum Kind : std::uint8_t {
+                ANY,       // 参数，调用处还没有确定类型
+                UNINIT,    // snew 分配后没有写过
+                ZERO,      // 常数 0，全 0 的 slot 既是 int 0 也是 0.0 的一半，没有初始值的全局变量就是这样初始化的
+                INT,
+                LOW,       // double 的低位 slot（地址小的一半）
+                HIGH,
+                ADDRESS,
+                CONFLICT   // 不同路径上类型不同，不能再读
+            };
+            Kind kind = ANY;
+            int32_t level = 0;
+            int32_t offset = 0;
+
+            bool operator==(const Slot& rhs) const {
+                return kind == rhs.kind && (kind != ADDRESS || (level == rhs.level && offset == rhs.offset));
+            }
+            bool operator!=(const Slot& rhs) const { return !(*this == rhs); }
+        };
+
+    private:
+        // 校验一段代码，function 为 -1 表示启动代码，frame 是入口处的栈帧
+        std::optional<VerifyError> verify(int32_t function, const std::vector<Instruction>& code, std::vector<Slot> frame,
+                                          int32_t& maxDepth);
+        // 模拟一条指令，出错时返回原因
+        std::optional<std::string> step(int32_t function, const Instruction& instruction, std::vector<Slot>& frame);
+
+    private:
+        const Program& _program;
+        std::vector<CallEffect> _calls;
+        std::vector<Slot> _globals;
+        // 每个函数的参数类型，从调用处得到，还没有调用处时为空
+        std::vector<std::vector<Slot>> _params;
+        bool _params_changed = false;
+        int32_t _start_max_depth = 0;
+        std::vector<int32_t> _max_depths;
+    };
+}